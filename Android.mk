@@ -23,6 +23,28 @@ TA_KEYMASTER_UUID    := dba51a17-0563-11e7-93b16fa7b0071a51
 ################################################################################
 # Build keymaster HAL                                                          #
 ################################################################################
+KEYMASTER_HAL_SRC_FILES := \
+    optee_keymaster.cpp \
+    optee_keymaster_call.cpp \
+    optee_keymaster_pubkey.cpp \
+    optee_keymaster_stats.cpp \
+    optee_keymaster_timeline.cpp \
+    optee_keymaster_trace.cpp \
+    optee_keymaster_ipc.c \
+    optee_keymaster_teec.c
+
+KEYMASTER_HAL_SHARED_LIBRARIES := \
+    libteec \
+    liblog \
+    libbase \
+    libhidlbase \
+    libhidltransport \
+    libhardware \
+    libutils \
+    libcutils \
+    libcrypto \
+    android.hardware.keymaster@3.0
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE                := android.hardware.keymaster@3.0-service.renesas
@@ -36,26 +58,173 @@ LOCAL_CFLAGS                += -DANDROID_BUILD
 
 LOCAL_SRC_FILES := \
     service.cpp \
-    optee_keymaster.cpp \
-    optee_keymaster_ipc.c
+    $(KEYMASTER_HAL_SRC_FILES)
 
 LOCAL_C_INCLUDES := \
     vendor/renesas/utils/optee-client/public \
     $(TA_KEYMASTER_SRC)/include
 
-LOCAL_SHARED_LIBRARIES := \
-    libteec \
-    liblog \
-    libbase \
-    libhidlbase \
-    libhidltransport \
-    libhardware \
-    libutils \
-    libcutils \
-    android.hardware.keymaster@3.0
+LOCAL_SHARED_LIBRARIES := $(KEYMASTER_HAL_SHARED_LIBRARIES)
 
 include $(BUILD_EXECUTABLE)
 
+################################################################################
+# Build keymaster TA against host TEE API shim and in-process transports       #
+################################################################################
+
+# Same TA sources as listed for OP-TEE build
+srcs-y :=
+include $(TA_KEYMASTER_SRC)/sub.mk
+TA_KEYMASTER_SHIM_SRC_FILES := \
+    $(addprefix ta/,$(srcs-y)) \
+    ta/host/tee_api.c \
+    ta/host/tee_api_objects.c \
+    ta/host/tee_api_operations.c \
+    ta/host/tee_api_storage.c \
+    ta/host/static_ta.c
+TA_KEYMASTER_SHIM_INCLUDES := \
+    $(TA_KEYMASTER_SRC)/host/include \
+    $(TA_KEYMASTER_SRC)/include
+TA_KEYMASTER_SHIM_CFLAGS := \
+    -DCFG_TEE_TA_LOG_LEVEL=0 \
+    -DOPENSSL_API_COMPAT=10100 \
+    -Wno-unused-parameter
+
+TA_KEYMASTER_TRANSPORT_SRC_FILES := \
+    optee_keymaster_inproc.c \
+    optee_keymaster_loopback.c
+
+include $(CLEAR_VARS)
+LOCAL_MODULE                := libkeymaster_ta_host
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_SRC_FILES             := $(TA_KEYMASTER_SHIM_SRC_FILES)
+LOCAL_C_INCLUDES            := $(TA_KEYMASTER_SHIM_INCLUDES)
+LOCAL_CFLAGS                := $(TA_KEYMASTER_SHIM_CFLAGS)
+LOCAL_SHARED_LIBRARIES      := libcrypto
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE                := libkeymaster_ta_host
+LOCAL_SRC_FILES             := $(TA_KEYMASTER_SHIM_SRC_FILES)
+LOCAL_C_INCLUDES            := $(TA_KEYMASTER_SHIM_INCLUDES)
+LOCAL_CFLAGS                := $(TA_KEYMASTER_SHIM_CFLAGS)
+LOCAL_SHARED_LIBRARIES      := libcrypto
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE                := libkeymaster_transport_inproc
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_SRC_FILES             := $(TA_KEYMASTER_TRANSPORT_SRC_FILES)
+LOCAL_C_INCLUDES            := $(TA_KEYMASTER_SHIM_INCLUDES)
+LOCAL_STATIC_LIBRARIES      := libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES      := liblog libcrypto
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE                := libkeymaster_transport_inproc
+LOCAL_SRC_FILES             := $(TA_KEYMASTER_TRANSPORT_SRC_FILES)
+LOCAL_C_INCLUDES            := $(TA_KEYMASTER_SHIM_INCLUDES)
+LOCAL_STATIC_LIBRARIES      := libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES      := liblog libcrypto
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+################################################################################
+# Build keymaster benchmark                                                    #
+################################################################################
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                := keymaster_bench
+LOCAL_MODULE_TAGS           := optional
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_CFLAGS                += -DANDROID_BUILD
+
+LOCAL_SRC_FILES := \
+    bench/keymaster_bench.cpp \
+    bench/bench_util.cpp \
+    $(KEYMASTER_HAL_SRC_FILES)
+
+LOCAL_C_INCLUDES := \
+    vendor/renesas/utils/optee-client/public \
+    $(TA_KEYMASTER_SRC)/include
+
+LOCAL_STATIC_LIBRARIES := libkeymaster_transport_inproc libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES := $(KEYMASTER_HAL_SHARED_LIBRARIES)
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+# Build keymaster concurrency benchmark                                        #
+################################################################################
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                := keymaster_load
+LOCAL_MODULE_TAGS           := optional
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_CFLAGS                += -DANDROID_BUILD
+
+LOCAL_SRC_FILES := \
+    bench/keymaster_load.cpp \
+    bench/bench_util.cpp \
+    $(KEYMASTER_HAL_SRC_FILES)
+
+LOCAL_C_INCLUDES := \
+    vendor/renesas/utils/optee-client/public \
+    $(TA_KEYMASTER_SRC)/include
+
+LOCAL_STATIC_LIBRARIES := libkeymaster_transport_inproc libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES := $(KEYMASTER_HAL_SHARED_LIBRARIES)
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+# Build keymaster trace replay                                                 #
+################################################################################
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                := keymaster_replay
+LOCAL_MODULE_TAGS           := optional
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_CFLAGS                += -DANDROID_BUILD
+
+LOCAL_SRC_FILES := \
+    bench/keymaster_replay.cpp \
+    bench/bench_util.cpp \
+    $(KEYMASTER_HAL_SRC_FILES)
+
+LOCAL_C_INCLUDES := \
+    vendor/renesas/utils/optee-client/public \
+    $(TA_KEYMASTER_SRC)/include
+
+LOCAL_STATIC_LIBRARIES := libkeymaster_transport_inproc libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES := $(KEYMASTER_HAL_SHARED_LIBRARIES)
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+# Build HAL and TA marshalling microbenchmarks                                 #
+################################################################################
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                := keymaster_marshalling_bench
+LOCAL_PROPRIETARY_MODULE    := true
+LOCAL_CFLAGS                += -DANDROID_BUILD
+
+LOCAL_SRC_FILES := \
+    bench/hal_marshalling_bench.cpp \
+    bench/ta_marshalling_bench.cpp \
+    bench/alloc_counter.cpp \
+    bench/bench_util.cpp \
+    $(KEYMASTER_HAL_SRC_FILES)
+
+LOCAL_C_INCLUDES := \
+    vendor/renesas/utils/optee-client/public \
+    $(TA_KEYMASTER_SHIM_INCLUDES)
+
+LOCAL_STATIC_LIBRARIES := libkeymaster_transport_inproc libkeymaster_ta_host
+LOCAL_SHARED_LIBRARIES := $(KEYMASTER_HAL_SHARED_LIBRARIES)
+
+include $(BUILD_NATIVE_BENCHMARK)
+
 ################################################################################
 # Build keymaster HAL TA                                                       #
 ################################################################################
@@ -0,0 +1,475 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include "bench_util.h"
+
+namespace keymaster_bench {
+
+const struct optee_keystore_transport *transportByName(const std::string &name) {
+#ifndef KM_HOST_BUILD
+    if (name == optee_transport_teec.name)
+        return &optee_transport_teec;
+#endif
+    if (name == optee_transport_inproc.name)
+        return &optee_transport_inproc;
+    if (name == optee_transport_loopback.name)
+        return &optee_transport_loopback;
+    return nullptr;
+}
+
+std::vector<uint32_t> parseList(const std::string &list) {
+    std::vector<uint32_t> values;
+    const char *p = list.c_str();
+
+    while (*p) {
+        char *end = nullptr;
+        values.push_back(strtoul(p, &end, 0));
+        if (end == p)
+            break;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+bool getOption(int argc, char **argv, const char *name, std::string &value) {
+    size_t len = strlen(name);
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0 ||
+                strncmp(argv[i] + 2, name, len) != 0)
+            continue;
+        if (argv[i][2 + len] == '=') {
+            value = argv[i] + 3 + len;
+            return true;
+        }
+        if (argv[i][2 + len] == '\0') {
+            value.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Samples::add(const Samples &other) {
+    values_.insert(values_.end(), other.values_.begin(), other.values_.end());
+    sorted_ = false;
+}
+
+double Samples::sum() const {
+    return std::accumulate(values_.begin(), values_.end(), 0.0);
+}
+
+double Samples::percentile(double p) const {
+    size_t rank = 0;
+
+    if (values_.empty())
+        return 0;
+    if (!sorted_) {
+        std::sort(values_.begin(), values_.end());
+        sorted_ = true;
+    }
+    rank = (size_t)std::ceil(p / 100 * values_.size());
+    return values_[rank ? rank - 1 : 0];
+}
+
+void JsonWriter::separator(const char *key) {
+    if (!first_.back())
+        fputc(',', out_);
+    first_.back() = false;
+    if (first_.size() > 1) {
+        fputc('\n', out_);
+        for (size_t i = 1; i < first_.size(); i++)
+            fputs("  ", out_);
+    }
+    if (key) {
+        string(key);
+        fputs(": ", out_);
+    }
+}
+
+void JsonWriter::string(const char *value) {
+    fputc('"', out_);
+    for (const char *c = value; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(out_, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20)
+            fprintf(out_, "\\u%04x", *c);
+        else
+            fputc(*c, out_);
+    }
+    fputc('"', out_);
+}
+
+void JsonWriter::beginObject(const char *key) {
+    separator(key);
+    fputc('{', out_);
+    first_.push_back(true);
+}
+
+void JsonWriter::endObject() {
+    bool empty = first_.back();
+
+    first_.pop_back();
+    if (!empty) {
+        fputc('\n', out_);
+        for (size_t i = 1; i < first_.size(); i++)
+            fputs("  ", out_);
+    }
+    fputc('}', out_);
+}
+
+void JsonWriter::beginArray(const char *key) {
+    separator(key);
+    fputc('[', out_);
+    first_.push_back(true);
+}
+
+void JsonWriter::endArray() {
+    bool empty = first_.back();
+
+    first_.pop_back();
+    if (!empty) {
+        fputc('\n', out_);
+        for (size_t i = 1; i < first_.size(); i++)
+            fputs("  ", out_);
+    }
+    fputc(']', out_);
+}
+
+void JsonWriter::field(const char *key, const std::string &value) {
+    field(key, value.c_str());
+}
+
+void JsonWriter::field(const char *key, const char *value) {
+    separator(key);
+    string(value);
+}
+
+void JsonWriter::field(const char *key, double value) {
+    separator(key);
+    if (std::isfinite(value))
+        fprintf(out_, "%.3f", value);
+    else
+        fputs("null", out_);
+}
+
+void JsonWriter::field(const char *key, uint64_t value) {
+    separator(key);
+    fprintf(out_, "%llu", (unsigned long long)value);
+}
+
+void JsonWriter::field(const char *key, int64_t value) {
+    separator(key);
+    fprintf(out_, "%lld", (long long)value);
+}
+
+void JsonWriter::field(const char *key, bool value) {
+    separator(key);
+    fputs(value ? "true" : "false", out_);
+}
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+
+    for (size_t i = 0; i < size; i++)
+        data[i] = (uint8_t)(i * 31 + 7);
+    return data;
+}
+
+std::vector<uint8_t> makePkcs8(Algorithm algorithm, uint32_t keySize) {
+    std::vector<uint8_t> der;
+    EVP_PKEY *pkey = EVP_PKEY_new();
+    PKCS8_PRIV_KEY_INFO *p8 = nullptr;
+    uint8_t *buf = nullptr;
+    int len = 0;
+
+    if (!pkey)
+        return der;
+    if (algorithm == Algorithm::RSA) {
+        RSA *rsa = RSA_new();
+        BIGNUM *e = BN_new();
+
+        if (rsa && e && BN_set_word(e, RSA_F4) &&
+                RSA_generate_key_ex(rsa, keySize, e, nullptr))
+            EVP_PKEY_assign_RSA(pkey, rsa);
+        else
+            RSA_free(rsa);
+        BN_free(e);
+    } else {
+        int nid = keySize == 224 ? NID_secp224r1 :
+                keySize == 256 ? NID_X9_62_prime256v1 :
+                keySize == 384 ? NID_secp384r1 : NID_secp521r1;
+        EC_KEY *ec = EC_KEY_new_by_curve_name(nid);
+
+        if (ec && EC_KEY_generate_key(ec))
+            EVP_PKEY_assign_EC_KEY(pkey, ec);
+        else
+            EC_KEY_free(ec);
+    }
+    p8 = EVP_PKEY2PKCS8(pkey);
+    if (p8)
+        len = i2d_PKCS8_PRIV_KEY_INFO(p8, &buf);
+    if (len > 0)
+        der.assign(buf, buf + len);
+    OPENSSL_free(buf);
+    PKCS8_PRIV_KEY_INFO_free(p8);
+    EVP_PKEY_free(pkey);
+    return der;
+}
+
+KeyParameter paramInt(Tag tag, uint32_t value) {
+    KeyParameter param;
+
+    param.tag = tag;
+    param.f.integer = value;
+    return param;
+}
+
+KeyParameter paramLong(Tag tag, uint64_t value) {
+    KeyParameter param;
+
+    param.tag = tag;
+    param.f.longInteger = value;
+    return param;
+}
+
+KeyParameter paramBool(Tag tag) {
+    KeyParameter param;
+
+    param.tag = tag;
+    param.f.boolValue = true;
+    return param;
+}
+
+KeyParameter paramBlob(Tag tag, const std::vector<uint8_t> &value) {
+    KeyParameter param;
+
+    param.tag = tag;
+    param.blob = toHidl(value);
+    return param;
+}
+
+KeyParameter paramAlgorithm(Algorithm algorithm) {
+    KeyParameter param;
+
+    param.tag = Tag::ALGORITHM;
+    param.f.algorithm = algorithm;
+    return param;
+}
+
+KeyParameter paramPurpose(KeyPurpose purpose) {
+    KeyParameter param;
+
+    param.tag = Tag::PURPOSE;
+    param.f.purpose = purpose;
+    return param;
+}
+
+KeyParameter paramBlockMode(BlockMode mode) {
+    KeyParameter param;
+
+    param.tag = Tag::BLOCK_MODE;
+    param.f.blockMode = mode;
+    return param;
+}
+
+KeyParameter paramPadding(PaddingMode padding) {
+    KeyParameter param;
+
+    param.tag = Tag::PADDING;
+    param.f.paddingMode = padding;
+    return param;
+}
+
+KeyParameter paramDigest(Digest digest) {
+    KeyParameter param;
+
+    param.tag = Tag::DIGEST;
+    param.f.digest = digest;
+    return param;
+}
+
+std::vector<KeyParameter> realisticParams(uint32_t tags, uint32_t aadSize) {
+    /* sizeof(hw_auth_token_t) */
+    const size_t authTokenSize = 69;
+    std::vector<KeyParameter> params{
+        paramAlgorithm(Algorithm::AES),
+        paramPurpose(KeyPurpose::ENCRYPT),
+        paramBlockMode(BlockMode::GCM),
+        paramPadding(PaddingMode::NONE),
+        paramInt(Tag::MAC_LENGTH, 128),
+        paramBlob(Tag::NONCE, pattern(12)),
+        paramBlob(Tag::ASSOCIATED_DATA, pattern(aadSize)),
+        paramBlob(Tag::AUTH_TOKEN, pattern(authTokenSize)),
+        paramBlob(Tag::APPLICATION_ID, pattern(16)),
+        paramBlob(Tag::APPLICATION_DATA, pattern(16)),
+    };
+    const std::vector<KeyParameter> filler{
+        paramInt(Tag::KEY_SIZE, 256),
+        paramLong(Tag::USER_SECURE_ID, 0x0123456789abcdefULL),
+        paramInt(Tag::AUTH_TIMEOUT, 300),
+        paramLong(Tag::CREATION_DATETIME, 1500000000000ULL),
+        paramInt(Tag::OS_VERSION, 80100),
+        paramInt(Tag::OS_PATCHLEVEL, 201805),
+        paramInt(Tag::ORIGIN, 0),
+        paramPurpose(KeyPurpose::DECRYPT),
+        paramBlockMode(BlockMode::CTR),
+        paramDigest(Digest::SHA_2_256),
+        paramInt(Tag::MIN_MAC_LENGTH, 96),
+        paramBool(Tag::CALLER_NONCE),
+    };
+
+    for (size_t i = 0; params.size() < tags; i++)
+        params.push_back(filler[i % filler.size()]);
+    params.resize(tags);
+    return params;
+}
+
+hidl_vec<KeyParameter> toHidl(const std::vector<KeyParameter> &params) {
+    hidl_vec<KeyParameter> result;
+
+    result.resize(params.size());
+    for (size_t i = 0; i < params.size(); i++)
+        result[i] = params[i];
+    return result;
+}
+
+hidl_vec<uint8_t> toHidl(const std::vector<uint8_t> &data) {
+    hidl_vec<uint8_t> result;
+
+    result.resize(data.size());
+    if (!data.empty())
+        memcpy(result.data(), data.data(), data.size());
+    return result;
+}
+
+const char *algorithmName(Algorithm algorithm) {
+    switch (algorithm) {
+    case Algorithm::RSA:
+        return "RSA";
+    case Algorithm::EC:
+        return "EC";
+    case Algorithm::AES:
+        return "AES";
+    case Algorithm::HMAC:
+        return "HMAC";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+const char *purposeName(KeyPurpose purpose) {
+    switch (purpose) {
+    case KeyPurpose::ENCRYPT:
+        return "ENCRYPT";
+    case KeyPurpose::DECRYPT:
+        return "DECRYPT";
+    case KeyPurpose::SIGN:
+        return "SIGN";
+    case KeyPurpose::VERIFY:
+        return "VERIFY";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+const char *blockModeName(BlockMode mode) {
+    switch (mode) {
+    case BlockMode::ECB:
+        return "ECB";
+    case BlockMode::CBC:
+        return "CBC";
+    case BlockMode::CTR:
+        return "CTR";
+    case BlockMode::GCM:
+        return "GCM";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+const char *paddingName(PaddingMode padding) {
+    switch (padding) {
+    case PaddingMode::NONE:
+        return "NONE";
+    case PaddingMode::RSA_OAEP:
+        return "RSA_OAEP";
+    case PaddingMode::RSA_PSS:
+        return "RSA_PSS";
+    case PaddingMode::RSA_PKCS1_1_5_ENCRYPT:
+        return "RSA_PKCS1_1_5_ENCRYPT";
+    case PaddingMode::RSA_PKCS1_1_5_SIGN:
+        return "RSA_PKCS1_1_5_SIGN";
+    case PaddingMode::PKCS7:
+        return "PKCS7";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+const char *digestName(Digest digest) {
+    switch (digest) {
+    case Digest::NONE:
+        return "NONE";
+    case Digest::MD5:
+        return "MD5";
+    case Digest::SHA1:
+        return "SHA1";
+    case Digest::SHA_2_224:
+        return "SHA_2_224";
+    case Digest::SHA_2_256:
+        return "SHA_2_256";
+    case Digest::SHA_2_384:
+        return "SHA_2_384";
+    case Digest::SHA_2_512:
+        return "SHA_2_512";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+uint32_t digestSize(Digest digest) {
+    switch (digest) {
+    case Digest::MD5:
+        return 16;
+    case Digest::SHA1:
+        return 20;
+    case Digest::SHA_2_224:
+        return 28;
+    case Digest::SHA_2_256:
+        return 32;
+    case Digest::SHA_2_384:
+        return 48;
+    case Digest::SHA_2_512:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+} // namespace keymaster_bench
@@ -0,0 +1,145 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_BENCH_UTIL_H
+#define OPTEE_KEYMASTER_BENCH_UTIL_H
+
+#include <android/hardware/keymaster/3.0/IKeymasterDevice.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "optee_keymaster_transport.h"
+
+namespace keymaster_bench {
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V3_0::Algorithm;
+using ::android::hardware::keymaster::V3_0::BlockMode;
+using ::android::hardware::keymaster::V3_0::Digest;
+using ::android::hardware::keymaster::V3_0::EcCurve;
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+using ::android::hardware::keymaster::V3_0::KeyParameter;
+using ::android::hardware::keymaster::V3_0::KeyPurpose;
+using ::android::hardware::keymaster::V3_0::PaddingMode;
+using ::android::hardware::keymaster::V3_0::Tag;
+
+typedef std::chrono::steady_clock Clock;
+
+static inline double elapsedUs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+/* Transport backend by name: teec, inproc or loopback */
+const struct optee_keystore_transport *transportByName(const std::string &name);
+
+/* Comma separated list of unsigned numbers */
+std::vector<uint32_t> parseList(const std::string &list);
+
+/* Value of --name=value command line option, false if absent */
+bool getOption(int argc, char **argv, const char *name, std::string &value);
+
+/* Latency samples of one benchmark case, in microseconds */
+class Samples {
+public:
+    void add(double us) { values_.push_back(us); sorted_ = false; }
+    /* Appends all samples of other */
+    void add(const Samples &other);
+    size_t count() const { return values_.size(); }
+    double sum() const;
+    /* Nearest-rank percentile, p in [0, 100] */
+    double percentile(double p) const;
+    double min() const { return percentile(0); }
+    double max() const { return percentile(100); }
+    double mean() const { return values_.empty() ? 0 : sum() / values_.size(); }
+
+private:
+    mutable std::vector<double> values_;
+    mutable bool sorted_ = false;
+};
+
+/* Minimal streaming JSON writer, enough for flat result records */
+class JsonWriter {
+public:
+    explicit JsonWriter(FILE *out) : out_(out) {}
+
+    void beginObject(const char *key = nullptr);
+    void endObject();
+    void beginArray(const char *key);
+    void endArray();
+    void field(const char *key, const std::string &value);
+    void field(const char *key, const char *value);
+    void field(const char *key, double value);
+    void field(const char *key, uint64_t value);
+    void field(const char *key, int64_t value);
+    void field(const char *key, uint32_t value) { field(key, (uint64_t)value); }
+    void field(const char *key, int32_t value) { field(key, (int64_t)value); }
+    void field(const char *key, bool value);
+    void finish() { fputc('\n', out_); }
+
+private:
+    void separator(const char *key);
+    void string(const char *value);
+
+    FILE *out_;
+    std::vector<bool> first_{true};
+};
+
+/* Calls of global operator new so far, needs alloc_counter.cpp linked in */
+uint64_t allocationCount();
+
+/* Deterministic non-zero filler data */
+std::vector<uint8_t> pattern(size_t size);
+
+/* PKCS#8 encoding of a fresh RSA or EC key pair for importKey */
+std::vector<uint8_t> makePkcs8(Algorithm algorithm, uint32_t keySize);
+
+/* KeyParameter constructors */
+KeyParameter paramInt(Tag tag, uint32_t value);
+KeyParameter paramLong(Tag tag, uint64_t value);
+KeyParameter paramBool(Tag tag);
+KeyParameter paramBlob(Tag tag, const std::vector<uint8_t> &value);
+KeyParameter paramAlgorithm(Algorithm algorithm);
+KeyParameter paramPurpose(KeyPurpose purpose);
+KeyParameter paramBlockMode(BlockMode mode);
+KeyParameter paramPadding(PaddingMode padding);
+KeyParameter paramDigest(Digest digest);
+
+/*
+ * Parameters as seen on a begin of an authenticated AES-GCM operation:
+ * nonce, associated data of aadSize bytes, auth token and application
+ * id/data, followed by key characteristics style tags up to tags count.
+ */
+std::vector<KeyParameter> realisticParams(uint32_t tags, uint32_t aadSize);
+
+hidl_vec<KeyParameter> toHidl(const std::vector<KeyParameter> &params);
+hidl_vec<uint8_t> toHidl(const std::vector<uint8_t> &data);
+
+const char *algorithmName(Algorithm algorithm);
+const char *purposeName(KeyPurpose purpose);
+const char *blockModeName(BlockMode mode);
+const char *paddingName(PaddingMode padding);
+const char *digestName(Digest digest);
+/* Digest size in bytes, 0 for Digest::NONE */
+uint32_t digestSize(Digest digest);
+
+} // namespace keymaster_bench
+
+#endif /* OPTEE_KEYMASTER_BENCH_UTIL_H */
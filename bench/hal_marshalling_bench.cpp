@@ -0,0 +1,218 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of HAL side marshalling. The device talks to a stub
+ * transport that only answers the version exchange, so no TA work is
+ * measured. Allocations are counted by alloc_counter.cpp.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+
+#include "optee_keymaster.h"
+#include "optee_keymaster_ipc.h"
+#include "bench_util.h"
+
+using ::android::hardware::keymaster::V3_0::renesas::KmParamSet;
+using ::android::hardware::keymaster::V3_0::renesas::OpteeKeymasterDevice;
+using ::android::sp;
+
+namespace keymaster_bench {
+
+/* Wire format the stub agrees on in the version exchange */
+static uint32_t stubWireVersion = KM_WIRE_VERSION_2;
+
+static bool stubOpen(void) {
+    return true;
+}
+
+static void stubClose(void) {
+}
+
+static uint32_t stubInvoke(uint32_t cmd, void *in, uint32_t in_size,
+                           void *out, uint32_t out_size,
+                           uint32_t trace_id, uint32_t trace_seq) {
+    uint32_t *reply = static_cast<uint32_t *>(out);
+
+    (void)in;
+    (void)in_size;
+    (void)trace_id;
+    (void)trace_seq;
+    if (cmd != KM_GET_VERSION || out_size < 2 * sizeof(uint32_t))
+        return KM_ERROR_UNIMPLEMENTED;
+    reply[0] = stubWireVersion;
+    reply[1] = stubWireVersion >= KM_WIRE_VERSION_2 ? KM_CAP_WIRE_V2 : 0;
+    return KM_ERROR_OK;
+}
+
+static const struct optee_keystore_transport stubTransport = {
+    "stub", stubOpen, stubClose, stubInvoke,
+};
+
+class HalMarshalling {
+public:
+    /* Device connected over the stub with the given wire format */
+    static OpteeKeymasterDevice &device(uint32_t wireVersion) {
+        static sp<OpteeKeymasterDevice> dev;
+
+        if (dev == nullptr || stubWireVersion != wireVersion) {
+            dev = nullptr;
+            stubWireVersion = wireVersion;
+            optee_keystore_set_transport(&stubTransport);
+            dev = new OpteeKeymasterDevice();
+        }
+        return *dev;
+    }
+
+    static int paramSetSize(OpteeKeymasterDevice &dev,
+                            const KmParamSet &params) {
+        return dev.getParamSetSize(params);
+    }
+
+    static int serializeParamSet(OpteeKeymasterDevice &dev, uint8_t *dest,
+                                 const KmParamSet &params) {
+        return dev.serializeParamSet(dest, params);
+    }
+
+    static int deserializeKeyCharacteristics(OpteeKeymasterDevice &dev,
+            keymaster_key_characteristics_t &characteristics,
+            const uint8_t *source, const uint8_t *end, ErrorCode &rc) {
+        return dev.deserializeKeyCharacteristics(characteristics, source, end,
+                                                 rc);
+    }
+};
+
+} // namespace keymaster_bench
+
+using namespace keymaster_bench;
+
+namespace {
+
+/* Args: tags, associated data size, wire version */
+void marshallingArgs(benchmark::internal::Benchmark *b) {
+    for (int wire : {KM_WIRE_VERSION_1, KM_WIRE_VERSION_2})
+        for (int tags : {10, 20, 40})
+            for (int aad : {16, 1024, 16384})
+                b->Args({tags, aad, wire});
+    b->ArgNames({"tags", "aad", "wire"});
+}
+
+void reportAllocations(benchmark::State &state, uint64_t before) {
+    state.counters["allocs/op"] = benchmark::Counter(
+            (double)(allocationCount() - before),
+            benchmark::Counter::kAvgIterations);
+}
+
+/* Memory of deserialized params comes from new[] */
+void freeParamSet(keymaster_key_param_set_t &params) {
+    for (size_t i = 0; i < params.length; i++) {
+        if (keymaster_tag_get_type(params.params[i].tag) == KM_BIGNUM ||
+                keymaster_tag_get_type(params.params[i].tag) == KM_BYTES)
+            delete[] params.params[i].blob.data;
+    }
+    delete[] params.params;
+    params.params = nullptr;
+    params.length = 0;
+}
+
+/* Conversion of HIDL parameters done by every HAL call taking them */
+void BM_HalKmParamSet(benchmark::State &state) {
+    hidl_vec<KeyParameter> params = toHidl(realisticParams(
+            (uint32_t)state.range(0), (uint32_t)state.range(1)));
+    uint64_t allocs = allocationCount();
+
+    for (auto _ : state) {
+        KmParamSet kmParams(params);
+
+        benchmark::DoNotOptimize(kmParams.params);
+    }
+    reportAllocations(state, allocs);
+}
+BENCHMARK(BM_HalKmParamSet)->Apply([](benchmark::internal::Benchmark *b) {
+    for (int tags : {10, 20, 40})
+        for (int aad : {16, 1024, 16384})
+            b->Args({tags, aad});
+    b->ArgNames({"tags", "aad"});
+});
+
+void BM_HalSerializeParamSet(benchmark::State &state) {
+    OpteeKeymasterDevice &dev =
+            HalMarshalling::device((uint32_t)state.range(2));
+    hidl_vec<KeyParameter> hidlParams = toHidl(realisticParams(
+            (uint32_t)state.range(0), (uint32_t)state.range(1)));
+    KmParamSet params(hidlParams);
+    std::vector<uint8_t> out(HalMarshalling::paramSetSize(dev, params));
+    uint64_t allocs = allocationCount();
+    int size = 0;
+
+    for (auto _ : state) {
+        size = HalMarshalling::serializeParamSet(dev, out.data(), params);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    reportAllocations(state, allocs);
+    state.counters["wire_bytes"] = size;
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_HalSerializeParamSet)->Apply(marshallingArgs);
+
+/* Half of the tags are hardware enforced, the rest software enforced */
+void BM_HalDeserializeKeyCharacteristics(benchmark::State &state) {
+    OpteeKeymasterDevice &dev =
+            HalMarshalling::device((uint32_t)state.range(2));
+    std::vector<KeyParameter> all = realisticParams(
+            (uint32_t)state.range(0), (uint32_t)state.range(1));
+    size_t half = all.size() / 2;
+    hidl_vec<KeyParameter> hwParams = toHidl(
+            std::vector<KeyParameter>(all.begin(), all.begin() + half));
+    hidl_vec<KeyParameter> swParams = toHidl(
+            std::vector<KeyParameter>(all.begin() + half, all.end()));
+    KmParamSet hwEnforced(hwParams);
+    KmParamSet swEnforced(swParams);
+    std::vector<uint8_t> in(HalMarshalling::paramSetSize(dev, hwEnforced) +
+                            HalMarshalling::paramSetSize(dev, swEnforced));
+    uint64_t allocs = 0;
+    int size = 0;
+
+    size = HalMarshalling::serializeParamSet(dev, in.data(), hwEnforced);
+    size += HalMarshalling::serializeParamSet(dev, in.data() + size,
+                                              swEnforced);
+    allocs = allocationCount();
+    for (auto _ : state) {
+        keymaster_key_characteristics_t characteristics;
+        ErrorCode rc = ErrorCode::OK;
+
+        memset(&characteristics, 0, sizeof(characteristics));
+        HalMarshalling::deserializeKeyCharacteristics(dev, characteristics,
+                                                      in.data(),
+                                                      in.data() + in.size(), rc);
+        if (rc != ErrorCode::OK) {
+            state.SkipWithError("deserializeKeyCharacteristics failed");
+            break;
+        }
+        freeParamSet(characteristics.hw_enforced);
+        freeParamSet(characteristics.sw_enforced);
+    }
+    reportAllocations(state, allocs);
+    state.counters["wire_bytes"] = size;
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_HalDeserializeKeyCharacteristics)->Apply(marshallingArgs);
+
+} // namespace
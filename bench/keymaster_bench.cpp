@@ -0,0 +1,862 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End-to-end latency and throughput benchmark of OpteeKeymasterDevice.
+ * Calls the HAL object directly, without binder, over any transport:
+ *
+ *   keymaster_bench [--transport=teec|inproc|loopback] [--iterations=N]
+ *           [--warmup=N] [--filter=substring] [--rsa-sizes=1024,2048]
+ *           [--ec-sizes=224,256,384,521] [--aes-sizes=128,256]
+ *           [--chunk-sizes=16,256,4096,65536] [--chunks=N]
+ *           [--message-size=N] [--output=file.json]
+ *
+ * Results go to stdout or --output as JSON, progress to stderr.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <openssl/rsa.h>
+
+#include "optee_keymaster.h"
+#include "optee_keymaster_ipc.h"
+#include "bench_util.h"
+
+using namespace keymaster_bench;
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V3_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V3_0::KeyFormat;
+using ::android::hardware::keymaster::V3_0::renesas::OpteeKeymasterDevice;
+
+namespace {
+
+struct Options {
+    std::string transport = "teec";
+    uint32_t iterations = 20;
+    uint32_t warmup = 2;
+    std::string filter;
+    std::vector<uint32_t> rsaSizes{1024, 2048};
+    std::vector<uint32_t> ecSizes{224, 256, 384, 521};
+    std::vector<uint32_t> aesSizes{128, 256};
+    std::vector<uint32_t> chunkSizes{16, 256, 4096, 65536};
+    uint32_t chunks = 4;
+    uint32_t messageSize = 1024;
+    std::string output;
+};
+
+/* Description of one benchmark case, becomes one JSON record */
+struct Case {
+    std::string name;
+    const char *operation = "";
+    Algorithm algorithm = Algorithm::AES;
+    uint32_t keySize = 0;
+    const char *purpose = nullptr;
+    const char *blockMode = nullptr;
+    const char *padding = nullptr;
+    const char *digest = nullptr;
+    uint32_t chunkSize = 0;
+    uint64_t bytesPerOp = 0;
+};
+
+/* Per-call latencies of begin/update/finish sequences */
+struct OperationTimes {
+    Samples begin;
+    Samples update;
+    Samples finish;
+};
+
+struct KeyBlob {
+    ErrorCode rc = ErrorCode::UNKNOWN_ERROR;
+    hidl_vec<uint8_t> blob;
+};
+
+class Benchmark {
+public:
+    Benchmark(const sp<OpteeKeymasterDevice> &device, const Options &options,
+              JsonWriter &json)
+        : device_(device), options_(options), json_(json) {}
+
+    void run();
+
+private:
+    bool selected(const Case &c) const {
+        return options_.filter.empty() ||
+                c.name.find(options_.filter) != std::string::npos;
+    }
+
+    /* Runs body warmup + iterations times, body returns its latency */
+    void measure(const Case &c,
+                 const std::function<ErrorCode(Samples &)> &body,
+                 OperationTimes *times = nullptr);
+    void report(const Case &c, const Samples &samples, uint32_t errors,
+                ErrorCode lastError, const OperationTimes *times);
+
+    KeyBlob generateKey(const std::vector<KeyParameter> &params);
+    ErrorCode runOperation(KeyPurpose purpose, const hidl_vec<uint8_t> &key,
+                           std::vector<KeyParameter> params,
+                           const std::vector<uint8_t> &input,
+                           uint32_t chunkSize,
+                           const std::vector<uint8_t> &signature,
+                           std::vector<uint8_t> *output,
+                           hidl_vec<KeyParameter> *outParams,
+                           OperationTimes *times);
+    void benchOperation(Case c, KeyPurpose purpose,
+                        const hidl_vec<uint8_t> &key,
+                        const std::vector<KeyParameter> &params,
+                        const std::vector<uint8_t> &input,
+                        uint32_t chunkSize);
+
+    void benchKeyManagement();
+    void benchAes();
+    void benchHmac();
+    void benchRsa();
+    void benchEc();
+
+    sp<OpteeKeymasterDevice> device_;
+    const Options &options_;
+    JsonWriter &json_;
+};
+
+std::vector<uint8_t> toVector(const hidl_vec<uint8_t> &data) {
+    return std::vector<uint8_t>(data.data(), data.data() + data.size());
+}
+
+/* The TA imports RSA keys up to 1024 bits and EC keys above 224 bits */
+bool importable(Algorithm algorithm, uint32_t keySize) {
+    if (algorithm == Algorithm::RSA)
+        return keySize <= 1024;
+    if (algorithm == Algorithm::EC)
+        return keySize > 224;
+    return true;
+}
+
+std::vector<KeyParameter> rsaKeyParams(uint32_t keySize) {
+    std::vector<KeyParameter> params{
+        paramAlgorithm(Algorithm::RSA),
+        paramInt(Tag::KEY_SIZE, keySize),
+        paramLong(Tag::RSA_PUBLIC_EXPONENT, RSA_F4),
+        paramBool(Tag::NO_AUTH_REQUIRED),
+    };
+
+    for (KeyPurpose p : {KeyPurpose::ENCRYPT, KeyPurpose::DECRYPT,
+                         KeyPurpose::SIGN, KeyPurpose::VERIFY})
+        params.push_back(paramPurpose(p));
+    for (PaddingMode p : {PaddingMode::NONE, PaddingMode::RSA_OAEP,
+                          PaddingMode::RSA_PSS,
+                          PaddingMode::RSA_PKCS1_1_5_ENCRYPT,
+                          PaddingMode::RSA_PKCS1_1_5_SIGN})
+        params.push_back(paramPadding(p));
+    for (Digest d : {Digest::NONE, Digest::MD5, Digest::SHA1,
+                     Digest::SHA_2_224, Digest::SHA_2_256,
+                     Digest::SHA_2_384, Digest::SHA_2_512})
+        params.push_back(paramDigest(d));
+    return params;
+}
+
+std::vector<KeyParameter> ecKeyParams(uint32_t keySize) {
+    std::vector<KeyParameter> params{
+        paramAlgorithm(Algorithm::EC),
+        paramInt(Tag::KEY_SIZE, keySize),
+        paramBool(Tag::NO_AUTH_REQUIRED),
+        paramPurpose(KeyPurpose::SIGN),
+        paramPurpose(KeyPurpose::VERIFY),
+    };
+
+    for (Digest d : {Digest::NONE, Digest::SHA1, Digest::SHA_2_224,
+                     Digest::SHA_2_256, Digest::SHA_2_384,
+                     Digest::SHA_2_512})
+        params.push_back(paramDigest(d));
+    return params;
+}
+
+std::vector<KeyParameter> aesKeyParams(uint32_t keySize) {
+    std::vector<KeyParameter> params{
+        paramAlgorithm(Algorithm::AES),
+        paramInt(Tag::KEY_SIZE, keySize),
+        paramBool(Tag::NO_AUTH_REQUIRED),
+        paramPurpose(KeyPurpose::ENCRYPT),
+        paramPurpose(KeyPurpose::DECRYPT),
+        paramPadding(PaddingMode::NONE),
+        paramPadding(PaddingMode::PKCS7),
+        paramInt(Tag::MIN_MAC_LENGTH, 128),
+    };
+
+    for (BlockMode m : {BlockMode::ECB, BlockMode::CBC, BlockMode::CTR,
+                        BlockMode::GCM})
+        params.push_back(paramBlockMode(m));
+    return params;
+}
+
+/* HMAC keys are bound to exactly one digest */
+std::vector<KeyParameter> hmacKeyParams(uint32_t keySize, Digest digest) {
+    return {
+        paramAlgorithm(Algorithm::HMAC),
+        paramInt(Tag::KEY_SIZE, keySize),
+        paramBool(Tag::NO_AUTH_REQUIRED),
+        paramPurpose(KeyPurpose::SIGN),
+        paramPurpose(KeyPurpose::VERIFY),
+        paramInt(Tag::MIN_MAC_LENGTH, 128),
+        paramDigest(digest),
+    };
+}
+
+void Benchmark::measure(const Case &c,
+                        const std::function<ErrorCode(Samples &)> &body,
+                        OperationTimes *times) {
+    Samples samples;
+    Samples discard;
+    ErrorCode lastError = ErrorCode::OK;
+    uint32_t errors = 0;
+
+    fprintf(stderr, "%s\n", c.name.c_str());
+    for (uint32_t i = 0; i < options_.warmup; i++)
+        body(discard);
+    /* Calls made during warmup are not reported */
+    if (times)
+        *times = OperationTimes();
+    for (uint32_t i = 0; i < options_.iterations; i++) {
+        ErrorCode rc = body(samples);
+        if (rc != ErrorCode::OK) {
+            errors++;
+            lastError = rc;
+        }
+    }
+    report(c, samples, errors, lastError, times);
+}
+
+void Benchmark::report(const Case &c, const Samples &samples, uint32_t errors,
+                       ErrorCode lastError, const OperationTimes *times) {
+    double seconds = samples.sum() / 1e6;
+
+    json_.beginObject();
+    json_.field("name", c.name);
+    json_.field("operation", c.operation);
+    json_.field("algorithm", algorithmName(c.algorithm));
+    json_.field("key_size", c.keySize);
+    if (c.purpose)
+        json_.field("purpose", c.purpose);
+    if (c.blockMode)
+        json_.field("block_mode", c.blockMode);
+    if (c.padding)
+        json_.field("padding", c.padding);
+    if (c.digest)
+        json_.field("digest", c.digest);
+    if (c.chunkSize)
+        json_.field("chunk_size", c.chunkSize);
+    json_.field("bytes_per_op", c.bytesPerOp);
+    json_.field("iterations", (uint64_t)samples.count());
+    json_.field("errors", errors);
+    if (errors)
+        json_.field("last_error", (int32_t)lastError);
+    if (samples.count()) {
+        json_.field("p50_us", samples.percentile(50));
+        json_.field("p99_us", samples.percentile(99));
+        json_.field("mean_us", samples.mean());
+        json_.field("min_us", samples.min());
+        json_.field("max_us", samples.max());
+        json_.field("ops_per_s", samples.count() / seconds);
+        if (c.bytesPerOp)
+            json_.field("mb_per_s",
+                        c.bytesPerOp * samples.count() / seconds / 1e6);
+    }
+    if (times && times->begin.count()) {
+        json_.field("begin_p50_us", times->begin.percentile(50));
+        json_.field("update_p50_us", times->update.percentile(50));
+        json_.field("finish_p50_us", times->finish.percentile(50));
+    }
+    json_.endObject();
+}
+
+KeyBlob Benchmark::generateKey(const std::vector<KeyParameter> &params) {
+    KeyBlob key;
+
+    device_->generateKey(toHidl(params),
+            [&](ErrorCode rc, const hidl_vec<uint8_t> &blob,
+                const KeyCharacteristics &) {
+                key.rc = rc;
+                key.blob = blob;
+            });
+    if (key.rc != ErrorCode::OK)
+        fprintf(stderr, "generateKey failed with %d\n", (int)key.rc);
+    return key;
+}
+
+/*
+ * One begin/update.../finish sequence. Input is fed in chunkSize pieces,
+ * the part not consumed by the TA is passed again with the next update.
+ */
+ErrorCode Benchmark::runOperation(KeyPurpose purpose,
+                                  const hidl_vec<uint8_t> &key,
+                                  std::vector<KeyParameter> params,
+                                  const std::vector<uint8_t> &input,
+                                  uint32_t chunkSize,
+                                  const std::vector<uint8_t> &signature,
+                                  std::vector<uint8_t> *output,
+                                  hidl_vec<KeyParameter> *outParams,
+                                  OperationTimes *times) {
+    ErrorCode rc = ErrorCode::OK;
+    uint64_t handle = 0;
+    size_t offset = 0;
+    Clock::time_point start;
+    hidl_vec<uint8_t> hidlSignature = toHidl(signature);
+    hidl_vec<uint8_t> empty;
+
+    if (output)
+        output->clear();
+    start = Clock::now();
+    device_->begin(purpose, key, toHidl(params),
+            [&](ErrorCode error, const hidl_vec<KeyParameter> &out,
+                uint64_t operationHandle) {
+                rc = error;
+                handle = operationHandle;
+                if (outParams)
+                    *outParams = out;
+            });
+    if (times)
+        times->begin.add(elapsedUs(start, Clock::now()));
+    if (rc != ErrorCode::OK)
+        return rc;
+
+    while (offset < input.size()) {
+        size_t size = std::min((size_t)chunkSize, input.size() - offset);
+        hidl_vec<uint8_t> chunk;
+        uint32_t consumed = 0;
+
+        chunk.setToExternal(const_cast<uint8_t *>(input.data()) + offset,
+                            size);
+        start = Clock::now();
+        device_->update(handle, hidl_vec<KeyParameter>(), chunk,
+                [&](ErrorCode error, uint32_t inputConsumed,
+                    const hidl_vec<KeyParameter> &,
+                    const hidl_vec<uint8_t> &out) {
+                    rc = error;
+                    consumed = inputConsumed;
+                    if (output)
+                        output->insert(output->end(), out.data(),
+                                       out.data() + out.size());
+                });
+        if (times)
+            times->update.add(elapsedUs(start, Clock::now()));
+        if (rc != ErrorCode::OK)
+            goto abort;
+        if (consumed == 0) {
+            rc = ErrorCode::UNKNOWN_ERROR;
+            goto abort;
+        }
+        offset += consumed;
+    }
+
+    start = Clock::now();
+    device_->finish(handle, hidl_vec<KeyParameter>(), empty, hidlSignature,
+            [&](ErrorCode error, const hidl_vec<KeyParameter> &,
+                const hidl_vec<uint8_t> &out) {
+                rc = error;
+                if (output)
+                    output->insert(output->end(), out.data(),
+                                   out.data() + out.size());
+            });
+    if (times)
+        times->finish.add(elapsedUs(start, Clock::now()));
+    return rc;
+
+abort:
+    device_->abort(handle);
+    return rc;
+}
+
+void Benchmark::benchOperation(Case c, KeyPurpose purpose,
+                               const hidl_vec<uint8_t> &key,
+                               const std::vector<KeyParameter> &params,
+                               const std::vector<uint8_t> &input,
+                               uint32_t chunkSize) {
+    OperationTimes times;
+    std::vector<uint8_t> signature;
+
+    c.operation = "begin_update_finish";
+    c.purpose = purposeName(purpose);
+    c.bytesPerOp = input.size();
+    if (!selected(c))
+        return;
+    /* Verification needs a signature made by the same key */
+    if (purpose == KeyPurpose::VERIFY) {
+        ErrorCode rc = runOperation(KeyPurpose::SIGN, key, params, input,
+                                    chunkSize, {}, &signature, nullptr,
+                                    nullptr);
+        if (rc != ErrorCode::OK) {
+            report(c, Samples(), 1, rc, nullptr);
+            return;
+        }
+    }
+    measure(c, [&](Samples &samples) {
+        Clock::time_point start = Clock::now();
+        ErrorCode rc = runOperation(purpose, key, params, input, chunkSize,
+                                    signature, nullptr, nullptr, &times);
+        if (rc == ErrorCode::OK)
+            samples.add(elapsedUs(start, Clock::now()));
+        return rc;
+    }, &times);
+}
+
+void Benchmark::benchKeyManagement() {
+    struct KeySpec {
+        Algorithm algorithm;
+        uint32_t keySize;
+        std::vector<KeyParameter> params;
+    };
+    std::vector<KeySpec> specs;
+
+    for (uint32_t size : options_.rsaSizes)
+        specs.push_back({Algorithm::RSA, size, rsaKeyParams(size)});
+    for (uint32_t size : options_.ecSizes)
+        specs.push_back({Algorithm::EC, size, ecKeyParams(size)});
+    for (uint32_t size : options_.aesSizes)
+        specs.push_back({Algorithm::AES, size, aesKeyParams(size)});
+    specs.push_back({Algorithm::HMAC, 256,
+                     hmacKeyParams(256, Digest::SHA_2_256)});
+
+    for (const KeySpec &spec : specs) {
+        bool asymmetric = spec.algorithm == Algorithm::RSA ||
+                spec.algorithm == Algorithm::EC;
+        std::string suffix = std::string(algorithmName(spec.algorithm)) +
+                "-" + std::to_string(spec.keySize);
+        hidl_vec<KeyParameter> params = toHidl(spec.params);
+        KeyBlob key;
+        Case c;
+
+        c.algorithm = spec.algorithm;
+        c.keySize = spec.keySize;
+
+        c.name = "generateKey/" + suffix;
+        c.operation = "generateKey";
+        if (selected(c)) {
+            measure(c, [&](Samples &samples) {
+                ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+                Clock::time_point start = Clock::now();
+                device_->generateKey(params,
+                        [&](ErrorCode rc, const hidl_vec<uint8_t> &,
+                            const KeyCharacteristics &) { result = rc; });
+                if (result == ErrorCode::OK)
+                    samples.add(elapsedUs(start, Clock::now()));
+                return result;
+            });
+        }
+
+        c.name = "importKey/" + suffix;
+        c.operation = "importKey";
+        if (selected(c) && importable(spec.algorithm, spec.keySize)) {
+            KeyFormat format = asymmetric ? KeyFormat::PKCS8 : KeyFormat::RAW;
+            hidl_vec<uint8_t> keyData = toHidl(asymmetric ?
+                    makePkcs8(spec.algorithm, spec.keySize) :
+                    pattern(spec.keySize / 8));
+            measure(c, [&](Samples &samples) {
+                ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+                Clock::time_point start = Clock::now();
+                device_->importKey(params, format, keyData,
+                        [&](ErrorCode rc, const hidl_vec<uint8_t> &,
+                            const KeyCharacteristics &) { result = rc; });
+                if (result == ErrorCode::OK)
+                    samples.add(elapsedUs(start, Clock::now()));
+                return result;
+            });
+        }
+
+        key = generateKey(spec.params);
+        if (key.rc != ErrorCode::OK)
+            continue;
+
+        c.name = "getKeyCharacteristics/" + suffix;
+        c.operation = "getKeyCharacteristics";
+        if (selected(c)) {
+            measure(c, [&](Samples &samples) {
+                ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+                Clock::time_point start = Clock::now();
+                device_->getKeyCharacteristics(key.blob, hidl_vec<uint8_t>(),
+                        hidl_vec<uint8_t>(),
+                        [&](ErrorCode rc, const KeyCharacteristics &) {
+                            result = rc;
+                        });
+                if (result == ErrorCode::OK)
+                    samples.add(elapsedUs(start, Clock::now()));
+                return result;
+            });
+        }
+        if (!asymmetric)
+            continue;
+
+        c.name = "exportKey/" + suffix;
+        c.operation = "exportKey";
+        if (selected(c)) {
+            measure(c, [&](Samples &samples) {
+                ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+                Clock::time_point start = Clock::now();
+                device_->exportKey(KeyFormat::X509, key.blob,
+                        hidl_vec<uint8_t>(), hidl_vec<uint8_t>(),
+                        [&](ErrorCode rc, const hidl_vec<uint8_t> &) {
+                            result = rc;
+                        });
+                if (result == ErrorCode::OK)
+                    samples.add(elapsedUs(start, Clock::now()));
+                return result;
+            });
+        }
+
+        c.name = "attestKey/" + suffix;
+        c.operation = "attestKey";
+        if (selected(c)) {
+            hidl_vec<KeyParameter> attestParams = toHidl({
+                paramBlob(Tag::ATTESTATION_CHALLENGE, pattern(32)),
+                paramBlob(Tag::ATTESTATION_APPLICATION_ID, pattern(64)),
+            });
+            measure(c, [&](Samples &samples) {
+                ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+                Clock::time_point start = Clock::now();
+                device_->attestKey(key.blob, attestParams,
+                        [&](ErrorCode rc,
+                            const hidl_vec<hidl_vec<uint8_t>> &) {
+                            result = rc;
+                        });
+                if (result == ErrorCode::OK)
+                    samples.add(elapsedUs(start, Clock::now()));
+                return result;
+            });
+        }
+    }
+}
+
+void Benchmark::benchAes() {
+    const std::vector<std::pair<BlockMode, PaddingMode>> modes{
+        {BlockMode::ECB, PaddingMode::NONE},
+        {BlockMode::ECB, PaddingMode::PKCS7},
+        {BlockMode::CBC, PaddingMode::NONE},
+        {BlockMode::CBC, PaddingMode::PKCS7},
+        {BlockMode::CTR, PaddingMode::NONE},
+        {BlockMode::GCM, PaddingMode::NONE},
+    };
+
+    for (uint32_t keySize : options_.aesSizes) {
+        KeyBlob key = generateKey(aesKeyParams(keySize));
+
+        if (key.rc != ErrorCode::OK)
+            continue;
+        for (const auto &mode : modes) {
+            for (uint32_t chunkSize : options_.chunkSizes) {
+                std::vector<uint8_t> plain =
+                        pattern((size_t)chunkSize * options_.chunks);
+                std::vector<KeyParameter> params{
+                    paramBlockMode(mode.first),
+                    paramPadding(mode.second),
+                };
+                std::vector<uint8_t> cipher;
+                hidl_vec<KeyParameter> outParams;
+                Case c;
+
+                if (mode.first == BlockMode::GCM)
+                    params.push_back(paramInt(Tag::MAC_LENGTH, 128));
+                /* Unpadded ECB and CBC take whole blocks only */
+                if (mode.second == PaddingMode::NONE &&
+                        (mode.first == BlockMode::ECB ||
+                         mode.first == BlockMode::CBC) &&
+                        plain.size() % 16 != 0)
+                    continue;
+                c.algorithm = Algorithm::AES;
+                c.keySize = keySize;
+                c.blockMode = blockModeName(mode.first);
+                c.padding = paddingName(mode.second);
+                c.chunkSize = chunkSize;
+                c.name = std::string("op/AES-") + std::to_string(keySize) +
+                        "/" + c.blockMode + "/" + c.padding + "/ENCRYPT" +
+                        "/chunk=" + std::to_string(chunkSize);
+                benchOperation(c, KeyPurpose::ENCRYPT, key.blob, params,
+                               plain, chunkSize);
+
+                c.name = std::string("op/AES-") + std::to_string(keySize) +
+                        "/" + c.blockMode + "/" + c.padding + "/DECRYPT" +
+                        "/chunk=" + std::to_string(chunkSize);
+                if (!selected(c))
+                    continue;
+                /* Ciphertext and nonce of the same key for decryption */
+                ErrorCode rc = runOperation(KeyPurpose::ENCRYPT, key.blob,
+                                            params, plain, chunkSize, {},
+                                            &cipher, &outParams, nullptr);
+                if (rc != ErrorCode::OK) {
+                    report(c, Samples(), 1, rc, nullptr);
+                    continue;
+                }
+                for (size_t i = 0; i < outParams.size(); i++) {
+                    if (outParams[i].tag == Tag::NONCE)
+                        params.push_back(paramBlob(Tag::NONCE,
+                                toVector(outParams[i].blob)));
+                }
+                benchOperation(c, KeyPurpose::DECRYPT, key.blob, params,
+                               cipher, chunkSize);
+            }
+        }
+    }
+}
+
+void Benchmark::benchHmac() {
+    /* The TA has no MD5 HMAC */
+    for (Digest digest : {Digest::SHA1, Digest::SHA_2_224,
+                          Digest::SHA_2_256, Digest::SHA_2_384,
+                          Digest::SHA_2_512}) {
+        KeyBlob key = generateKey(hmacKeyParams(256, digest));
+
+        if (key.rc != ErrorCode::OK)
+            continue;
+        for (uint32_t chunkSize : options_.chunkSizes) {
+            std::vector<uint8_t> message =
+                    pattern((size_t)chunkSize * options_.chunks);
+            std::vector<KeyParameter> params{
+                paramDigest(digest),
+                paramInt(Tag::MAC_LENGTH, digestSize(digest) * 8),
+            };
+            Case c;
+
+            c.algorithm = Algorithm::HMAC;
+            c.keySize = 256;
+            c.digest = digestName(digest);
+            c.chunkSize = chunkSize;
+            for (KeyPurpose purpose : {KeyPurpose::SIGN, KeyPurpose::VERIFY}) {
+                c.name = std::string("op/HMAC-256/") + c.digest + "/" +
+                        purposeName(purpose) + "/chunk=" +
+                        std::to_string(chunkSize);
+                benchOperation(c, purpose, key.blob, params, message,
+                               chunkSize);
+            }
+        }
+    }
+}
+
+void Benchmark::benchRsa() {
+    const std::vector<Digest> digests{Digest::MD5, Digest::SHA1,
+            Digest::SHA_2_224, Digest::SHA_2_256, Digest::SHA_2_384,
+            Digest::SHA_2_512};
+    struct Scheme {
+        KeyPurpose purpose;
+        PaddingMode padding;
+        Digest digest;
+    };
+
+    for (uint32_t keySize : options_.rsaSizes) {
+        KeyBlob key = generateKey(rsaKeyParams(keySize));
+        std::vector<Scheme> schemes;
+        uint32_t k = keySize / 8;
+
+        if (key.rc != ErrorCode::OK)
+            continue;
+        schemes.push_back({KeyPurpose::SIGN, PaddingMode::NONE, Digest::NONE});
+        schemes.push_back({KeyPurpose::SIGN, PaddingMode::RSA_PKCS1_1_5_SIGN,
+                           Digest::NONE});
+        schemes.push_back({KeyPurpose::ENCRYPT, PaddingMode::NONE,
+                           Digest::NONE});
+        schemes.push_back({KeyPurpose::ENCRYPT,
+                           PaddingMode::RSA_PKCS1_1_5_ENCRYPT, Digest::NONE});
+        for (Digest d : digests) {
+            schemes.push_back({KeyPurpose::SIGN,
+                               PaddingMode::RSA_PKCS1_1_5_SIGN, d});
+            /* PSS and OAEP need room for two digests in the modulus */
+            if (k >= 2 * digestSize(d) + 2) {
+                schemes.push_back({KeyPurpose::SIGN, PaddingMode::RSA_PSS, d});
+                schemes.push_back({KeyPurpose::ENCRYPT,
+                                   PaddingMode::RSA_OAEP, d});
+            }
+        }
+
+        for (const Scheme &s : schemes) {
+            std::vector<KeyParameter> params{
+                paramPadding(s.padding),
+                paramDigest(s.digest),
+            };
+            std::vector<uint8_t> input;
+            Case c;
+
+            if (s.padding == PaddingMode::NONE) {
+                /*
+                 * Raw RSA input must be below the modulus. Keep the top
+                 * byte nonzero: the TA compares the recovered message
+                 * without its leading zeroes on raw verification.
+                 */
+                input = pattern(k);
+                input[0] = 1;
+            } else if (s.padding == PaddingMode::RSA_OAEP) {
+                input = pattern(std::min<size_t>(32,
+                        k - 2 * digestSize(s.digest) - 2));
+            } else if (s.digest == Digest::NONE ||
+                       s.purpose == KeyPurpose::ENCRYPT) {
+                input = pattern(32);
+            } else {
+                input = pattern(options_.messageSize);
+            }
+            c.algorithm = Algorithm::RSA;
+            c.keySize = keySize;
+            c.padding = paddingName(s.padding);
+            c.digest = digestName(s.digest);
+
+            if (s.purpose == KeyPurpose::SIGN) {
+                for (KeyPurpose purpose : {KeyPurpose::SIGN,
+                                           KeyPurpose::VERIFY}) {
+                    c.name = "op/RSA-" + std::to_string(keySize) + "/" +
+                            c.padding + "/" + c.digest + "/" +
+                            purposeName(purpose);
+                    benchOperation(c, purpose, key.blob, params, input,
+                                   input.size());
+                }
+                continue;
+            }
+
+            c.name = "op/RSA-" + std::to_string(keySize) + "/" + c.padding +
+                    "/" + c.digest + "/ENCRYPT";
+            benchOperation(c, KeyPurpose::ENCRYPT, key.blob, params, input,
+                           input.size());
+
+            c.name = "op/RSA-" + std::to_string(keySize) + "/" + c.padding +
+                    "/" + c.digest + "/DECRYPT";
+            if (!selected(c))
+                continue;
+            std::vector<uint8_t> cipher;
+            ErrorCode rc = runOperation(KeyPurpose::ENCRYPT, key.blob, params,
+                                        input, input.size(), {}, &cipher,
+                                        nullptr, nullptr);
+            if (rc != ErrorCode::OK) {
+                report(c, Samples(), 1, rc, nullptr);
+                continue;
+            }
+            benchOperation(c, KeyPurpose::DECRYPT, key.blob, params, cipher,
+                           cipher.size());
+        }
+    }
+}
+
+void Benchmark::benchEc() {
+    for (uint32_t keySize : options_.ecSizes) {
+        KeyBlob key = generateKey(ecKeyParams(keySize));
+
+        if (key.rc != ErrorCode::OK)
+            continue;
+        for (Digest digest : {Digest::NONE, Digest::SHA1, Digest::SHA_2_224,
+                              Digest::SHA_2_256, Digest::SHA_2_384,
+                              Digest::SHA_2_512}) {
+            std::vector<KeyParameter> params{paramDigest(digest)};
+            std::vector<uint8_t> message = pattern(digest == Digest::NONE ?
+                    (keySize + 7) / 8 : options_.messageSize);
+            Case c;
+
+            c.algorithm = Algorithm::EC;
+            c.keySize = keySize;
+            c.digest = digestName(digest);
+            for (KeyPurpose purpose : {KeyPurpose::SIGN, KeyPurpose::VERIFY}) {
+                c.name = "op/EC-" + std::to_string(keySize) + "/" + c.digest +
+                        "/" + purposeName(purpose);
+                benchOperation(c, purpose, key.blob, params, message,
+                               message.size());
+            }
+        }
+    }
+}
+
+void Benchmark::run() {
+    json_.beginArray("results");
+    benchKeyManagement();
+    benchAes();
+    benchHmac();
+    benchRsa();
+    benchEc();
+    json_.endArray();
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    std::string value;
+
+    if (getOption(argc, argv, "help", value)) {
+        fprintf(stderr, "usage: %s [--transport=teec|inproc|loopback] "
+                "[--iterations=N] [--warmup=N] [--filter=substring] "
+                "[--rsa-sizes=list] [--ec-sizes=list] [--aes-sizes=list] "
+                "[--chunk-sizes=list] [--chunks=N] [--message-size=N] "
+                "[--output=file]\n", argv[0]);
+        return false;
+    }
+    if (getOption(argc, argv, "transport", value))
+        options.transport = value;
+    if (getOption(argc, argv, "iterations", value))
+        options.iterations = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "warmup", value))
+        options.warmup = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "filter", value))
+        options.filter = value;
+    if (getOption(argc, argv, "rsa-sizes", value))
+        options.rsaSizes = parseList(value);
+    if (getOption(argc, argv, "ec-sizes", value))
+        options.ecSizes = parseList(value);
+    if (getOption(argc, argv, "aes-sizes", value))
+        options.aesSizes = parseList(value);
+    if (getOption(argc, argv, "chunk-sizes", value))
+        options.chunkSizes = parseList(value);
+    if (getOption(argc, argv, "chunks", value))
+        options.chunks = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "message-size", value))
+        options.messageSize = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "output", value))
+        options.output = value;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    const struct optee_keystore_transport *transport = nullptr;
+    FILE *out = stdout;
+
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    transport = transportByName(options.transport);
+    if (!transport) {
+        fprintf(stderr, "Unknown transport %s\n", options.transport.c_str());
+        return 1;
+    }
+    /* Device connects to the TA in its constructor */
+    optee_keystore_set_transport(transport);
+    sp<OpteeKeymasterDevice> device = new OpteeKeymasterDevice;
+
+    if (!options.output.empty()) {
+        out = fopen(options.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Can not open %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("benchmark", "keymaster_bench");
+    json.field("transport", transport->name);
+    json.field("wire_version", optee_keystore_wire_version());
+    json.field("capabilities", optee_keystore_capabilities());
+    json.field("iterations", options.iterations);
+    json.field("warmup", options.warmup);
+    Benchmark(device, options, json).run();
+    json.endObject();
+    json.finish();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
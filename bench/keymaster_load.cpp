@@ -0,0 +1,639 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Concurrency scaling benchmark of OpteeKeymasterDevice. N client threads
+ * replay a weighted mix of keystore workloads for a fixed time, for each
+ * N of --threads:
+ *
+ *   keymaster_load [--transport=teec|inproc|loopback] [--threads=1,2,4,8]
+ *           [--binder-threads=K] [--duration-ms=N] [--warmup-ms=N]
+ *           [--mix=ecdsa_sign:40,hmac_token:30,aes_gcm_file:20,
+ *                  rsa_keygen:5,attest:5]
+ *           [--file-size=N] [--chunk-size=N] [--rsa-size=N] [--seed=N]
+ *           [--output=file.json]
+ *
+ * Each HAL method call goes through a pool of K dispatch threads, the way
+ * binder hands calls to the service. The service runs a single binder
+ * thread, so K defaults to 1; K = 0 calls the HAL from the clients
+ * directly. Queue time of a request is the wait for a dispatch thread
+ * plus the wait for other threads' TA calls, exec time is the time spent
+ * in the transport. Results go to stdout or --output as JSON.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/rsa.h>
+
+#include "optee_keymaster.h"
+#include "optee_keymaster_ipc.h"
+#include "bench_util.h"
+
+using namespace keymaster_bench;
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V3_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V3_0::renesas::OpteeKeymasterDevice;
+
+namespace {
+
+enum Workload {
+    /* TLS handshake signature with a P-256 client key */
+    WORKLOAD_ECDSA_SIGN,
+    /* HMAC-SHA256 of a short token */
+    WORKLOAD_HMAC_TOKEN,
+    /* AES-256-GCM encryption of a file in chunks */
+    WORKLOAD_AES_GCM_FILE,
+    WORKLOAD_RSA_KEYGEN,
+    /* Attestation of the P-256 key */
+    WORKLOAD_ATTEST,
+    WORKLOAD_COUNT,
+};
+
+const char *const workloadNames[WORKLOAD_COUNT] = {
+    "ecdsa_sign", "hmac_token", "aes_gcm_file", "rsa_keygen", "attest",
+};
+
+struct Options {
+    std::string transport = "teec";
+    std::vector<uint32_t> threads{1, 2, 4, 8};
+    uint32_t binderThreads = 1;
+    uint32_t durationMs = 10000;
+    uint32_t warmupMs = 1000;
+    std::vector<uint32_t> mix{40, 30, 20, 5, 5};
+    uint32_t fileSize = 16384;
+    uint32_t chunkSize = 4096;
+    uint32_t rsaSize = 2048;
+    uint32_t seed = 1;
+    std::string output;
+};
+
+/* Latencies of one workload, or of all of them */
+struct Stats {
+    Samples latency;
+    Samples queue;
+    Samples exec;
+    std::map<int32_t, uint32_t> errors;
+
+    void add(const Stats &other) {
+        latency.add(other.latency);
+        queue.add(other.queue);
+        exec.add(other.exec);
+        for (const auto &e : other.errors)
+            errors[e.first] += e.second;
+    }
+
+    uint32_t errorCount() const {
+        uint32_t count = 0;
+
+        for (const auto &e : errors)
+            count += e.second;
+        return count;
+    }
+};
+
+/*
+ * Emulation of the binder thread pool. A call is queued and the client
+ * blocks until one of the pool threads has run it.
+ */
+class Dispatcher {
+public:
+    explicit Dispatcher(uint32_t threads) {
+        for (uint32_t i = 0; i < threads; i++)
+            threads_.emplace_back([this] { loop(); });
+    }
+
+    ~Dispatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread &t : threads_)
+            t.join();
+    }
+
+    /* Runs job on a pool thread, returns time it waited in the queue */
+    double run(const std::function<void()> &job) {
+        Job j;
+
+        if (threads_.empty()) {
+            job();
+            return 0;
+        }
+        j.job = &job;
+        std::unique_lock<std::mutex> lock(mutex_);
+        j.queued = Clock::now();
+        queue_.push_back(&j);
+        cv_.notify_one();
+        j.cv.wait(lock, [&] { return j.done; });
+        return elapsedUs(j.queued, j.started);
+    }
+
+private:
+    struct Job {
+        const std::function<void()> *job = nullptr;
+        Clock::time_point queued;
+        Clock::time_point started;
+        bool done = false;
+        std::condition_variable cv;
+    };
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        for (;;) {
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            Job *j = queue_.front();
+            queue_.pop_front();
+            j->started = Clock::now();
+            lock.unlock();
+            (*j->job)();
+            lock.lock();
+            j->done = true;
+            j->cv.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job *> queue_;
+    bool stop_ = false;
+};
+
+/* Keys shared by all clients */
+struct Keys {
+    hidl_vec<uint8_t> ec;
+    hidl_vec<uint8_t> hmac;
+    hidl_vec<uint8_t> aes;
+};
+
+/* One client thread, keeps its own samples */
+class Client {
+public:
+    Client(const sp<OpteeKeymasterDevice> &device, Dispatcher &dispatcher,
+           const Keys &keys, const Options &options, uint32_t seed)
+        : device_(device), dispatcher_(dispatcher), keys_(keys),
+          options_(options), rng_(seed),
+          mix_(options.mix.begin(), options.mix.end()),
+          file_(pattern(options.fileSize)),
+          rsaParams_(toHidl({
+              paramAlgorithm(Algorithm::RSA),
+              paramInt(Tag::KEY_SIZE, options.rsaSize),
+              paramLong(Tag::RSA_PUBLIC_EXPONENT, RSA_F4),
+              paramBool(Tag::NO_AUTH_REQUIRED),
+              paramPurpose(KeyPurpose::SIGN),
+              paramPadding(PaddingMode::RSA_PKCS1_1_5_SIGN),
+              paramDigest(Digest::SHA_2_256),
+          })) {}
+
+    /* Replays the mix until deadline, requests started after from count */
+    void run(Clock::time_point from, Clock::time_point deadline);
+
+    const Stats &stats(Workload w) const { return stats_[w]; }
+    Clock::time_point lastEnd() const { return lastEnd_; }
+
+private:
+    /* One HAL method call as it would arrive over binder */
+    void call(const std::function<void()> &method);
+
+    ErrorCode runOperation(KeyPurpose purpose, const hidl_vec<uint8_t> &key,
+                           const hidl_vec<KeyParameter> &params,
+                           const std::vector<uint8_t> &input);
+    ErrorCode request(Workload w);
+
+    sp<OpteeKeymasterDevice> device_;
+    Dispatcher &dispatcher_;
+    const Keys &keys_;
+    const Options &options_;
+    std::mt19937 rng_;
+    std::discrete_distribution<int> mix_;
+    const std::vector<uint8_t> file_;
+    const hidl_vec<KeyParameter> rsaParams_;
+    double queueUs_ = 0;
+    double execUs_ = 0;
+    Stats stats_[WORKLOAD_COUNT];
+    Clock::time_point lastEnd_;
+};
+
+void Client::call(const std::function<void()> &method) {
+    struct optee_keystore_call_times before;
+    struct optee_keystore_call_times after;
+
+    memset(&before, 0, sizeof(before));
+    memset(&after, 0, sizeof(after));
+    queueUs_ += dispatcher_.run([&] {
+        optee_keystore_get_call_times(&before);
+        method();
+        optee_keystore_get_call_times(&after);
+    });
+    queueUs_ += (after.queue_ns - before.queue_ns) / 1e3;
+    execUs_ += (after.exec_ns - before.exec_ns) / 1e3;
+}
+
+ErrorCode Client::runOperation(KeyPurpose purpose,
+                               const hidl_vec<uint8_t> &key,
+                               const hidl_vec<KeyParameter> &params,
+                               const std::vector<uint8_t> &input) {
+    ErrorCode rc = ErrorCode::OK;
+    uint64_t handle = 0;
+    size_t offset = 0;
+    hidl_vec<uint8_t> empty;
+
+    call([&] {
+        device_->begin(purpose, key, params,
+                [&](ErrorCode error, const hidl_vec<KeyParameter> &,
+                    uint64_t operationHandle) {
+                    rc = error;
+                    handle = operationHandle;
+                });
+    });
+    if (rc != ErrorCode::OK)
+        return rc;
+
+    while (offset < input.size()) {
+        size_t size = std::min((size_t)options_.chunkSize,
+                               input.size() - offset);
+        hidl_vec<uint8_t> chunk;
+        uint32_t consumed = 0;
+
+        chunk.setToExternal(const_cast<uint8_t *>(input.data()) + offset,
+                            size);
+        call([&] {
+            device_->update(handle, hidl_vec<KeyParameter>(), chunk,
+                    [&](ErrorCode error, uint32_t inputConsumed,
+                        const hidl_vec<KeyParameter> &,
+                        const hidl_vec<uint8_t> &) {
+                        rc = error;
+                        consumed = inputConsumed;
+                    });
+        });
+        if (rc == ErrorCode::OK && consumed == 0)
+            rc = ErrorCode::UNKNOWN_ERROR;
+        if (rc != ErrorCode::OK) {
+            call([&] { device_->abort(handle); });
+            return rc;
+        }
+        offset += consumed;
+    }
+
+    call([&] {
+        device_->finish(handle, hidl_vec<KeyParameter>(), empty, empty,
+                [&](ErrorCode error, const hidl_vec<KeyParameter> &,
+                    const hidl_vec<uint8_t> &) { rc = error; });
+    });
+    return rc;
+}
+
+ErrorCode Client::request(Workload w) {
+    static const hidl_vec<KeyParameter> ecdsaParams = toHidl({
+        paramDigest(Digest::SHA_2_256),
+    });
+    static const hidl_vec<KeyParameter> hmacParams = toHidl({
+        paramDigest(Digest::SHA_2_256),
+        paramInt(Tag::MAC_LENGTH, 256),
+    });
+    static const hidl_vec<KeyParameter> gcmParams = toHidl({
+        paramBlockMode(BlockMode::GCM),
+        paramPadding(PaddingMode::NONE),
+        paramInt(Tag::MAC_LENGTH, 128),
+    });
+    static const hidl_vec<KeyParameter> attestParams = toHidl({
+        paramBlob(Tag::ATTESTATION_CHALLENGE, pattern(32)),
+        paramBlob(Tag::ATTESTATION_APPLICATION_ID, pattern(64)),
+    });
+    /* Signed part of a TLS 1.2 ServerKeyExchange */
+    static const std::vector<uint8_t> handshake = pattern(133);
+    static const std::vector<uint8_t> token = pattern(64);
+    ErrorCode rc = ErrorCode::UNKNOWN_ERROR;
+
+    switch (w) {
+    case WORKLOAD_ECDSA_SIGN:
+        return runOperation(KeyPurpose::SIGN, keys_.ec, ecdsaParams,
+                            handshake);
+    case WORKLOAD_HMAC_TOKEN:
+        return runOperation(KeyPurpose::SIGN, keys_.hmac, hmacParams, token);
+    case WORKLOAD_AES_GCM_FILE:
+        return runOperation(KeyPurpose::ENCRYPT, keys_.aes, gcmParams, file_);
+    case WORKLOAD_RSA_KEYGEN:
+        call([&] {
+            device_->generateKey(rsaParams_,
+                    [&](ErrorCode error, const hidl_vec<uint8_t> &,
+                        const KeyCharacteristics &) { rc = error; });
+        });
+        return rc;
+    case WORKLOAD_ATTEST:
+        call([&] {
+            device_->attestKey(keys_.ec, attestParams,
+                    [&](ErrorCode error,
+                        const hidl_vec<hidl_vec<uint8_t>> &) { rc = error; });
+        });
+        return rc;
+    default:
+        return rc;
+    }
+}
+
+void Client::run(Clock::time_point from, Clock::time_point deadline) {
+    Clock::time_point start;
+
+    while ((start = Clock::now()) < deadline) {
+        Workload w = (Workload)mix_(rng_);
+        ErrorCode rc = ErrorCode::OK;
+
+        queueUs_ = 0;
+        execUs_ = 0;
+        rc = request(w);
+        lastEnd_ = Clock::now();
+        if (start < from)
+            continue;
+        if (rc != ErrorCode::OK) {
+            stats_[w].errors[(int32_t)rc]++;
+            continue;
+        }
+        stats_[w].latency.add(elapsedUs(start, lastEnd_));
+        stats_[w].queue.add(queueUs_);
+        stats_[w].exec.add(execUs_);
+    }
+}
+
+void reportStats(JsonWriter &json, const Stats &stats, double seconds) {
+    uint32_t errors = stats.errorCount();
+
+    json.field("requests", (uint64_t)stats.latency.count());
+    json.field("errors", errors);
+    if (errors) {
+        json.beginObject("error_codes");
+        for (const auto &e : stats.errors)
+            json.field(std::to_string(e.first).c_str(), e.second);
+        json.endObject();
+    }
+    if (!stats.latency.count())
+        return;
+    json.field("requests_per_s", stats.latency.count() / seconds);
+    json.field("p50_us", stats.latency.percentile(50));
+    json.field("p90_us", stats.latency.percentile(90));
+    json.field("p99_us", stats.latency.percentile(99));
+    json.field("p999_us", stats.latency.percentile(99.9));
+    json.field("max_us", stats.latency.max());
+    json.field("queue_p50_us", stats.queue.percentile(50));
+    json.field("queue_p99_us", stats.queue.percentile(99));
+    json.field("queue_mean_us", stats.queue.mean());
+    json.field("exec_p50_us", stats.exec.percentile(50));
+    json.field("exec_p99_us", stats.exec.percentile(99));
+    json.field("exec_mean_us", stats.exec.mean());
+}
+
+/* One step of the scaling run with the given number of clients */
+void runStep(const sp<OpteeKeymasterDevice> &device, Dispatcher &dispatcher,
+             const Keys &keys, const Options &options, uint32_t clients,
+             JsonWriter &json) {
+    std::vector<std::unique_ptr<Client>> c;
+    std::vector<std::thread> threads;
+    Clock::time_point from;
+    Clock::time_point deadline;
+    Clock::time_point end;
+    Stats total;
+    double seconds = 0;
+
+    fprintf(stderr, "threads=%u\n", clients);
+    for (uint32_t i = 0; i < clients; i++)
+        c.emplace_back(new Client(device, dispatcher, keys, options,
+                                  options.seed + i));
+    from = Clock::now() + std::chrono::milliseconds(options.warmupMs);
+    deadline = from + std::chrono::milliseconds(options.durationMs);
+    for (uint32_t i = 0; i < clients; i++)
+        threads.emplace_back([&, i] { c[i]->run(from, deadline); });
+    for (std::thread &t : threads)
+        t.join();
+    /* Requests in flight at the deadline complete and are counted */
+    end = deadline;
+    for (const auto &client : c)
+        end = std::max(end, client->lastEnd());
+    seconds = elapsedUs(from, end) / 1e6;
+
+    json.beginObject();
+    json.field("threads", clients);
+    json.field("seconds", seconds);
+    for (const auto &client : c) {
+        for (int w = 0; w < WORKLOAD_COUNT; w++)
+            total.add(client->stats((Workload)w));
+    }
+    reportStats(json, total, seconds);
+    json.beginArray("workloads");
+    for (int w = 0; w < WORKLOAD_COUNT; w++) {
+        Stats stats;
+
+        if (!options.mix[w])
+            continue;
+        for (const auto &client : c)
+            stats.add(client->stats((Workload)w));
+        json.beginObject();
+        json.field("name", workloadNames[w]);
+        reportStats(json, stats, seconds);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
+
+bool generateKey(const sp<OpteeKeymasterDevice> &device,
+                 const std::vector<KeyParameter> &params,
+                 hidl_vec<uint8_t> &blob) {
+    ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+
+    device->generateKey(toHidl(params),
+            [&](ErrorCode rc, const hidl_vec<uint8_t> &keyBlob,
+                const KeyCharacteristics &) {
+                result = rc;
+                blob = keyBlob;
+            });
+    if (result != ErrorCode::OK)
+        fprintf(stderr, "generateKey failed with %d\n", (int)result);
+    return result == ErrorCode::OK;
+}
+
+bool generateKeys(const sp<OpteeKeymasterDevice> &device, Keys &keys) {
+    return generateKey(device, {
+                paramAlgorithm(Algorithm::EC),
+                paramInt(Tag::KEY_SIZE, 256),
+                paramBool(Tag::NO_AUTH_REQUIRED),
+                paramPurpose(KeyPurpose::SIGN),
+                paramDigest(Digest::SHA_2_256),
+            }, keys.ec) &&
+            generateKey(device, {
+                paramAlgorithm(Algorithm::HMAC),
+                paramInt(Tag::KEY_SIZE, 256),
+                paramBool(Tag::NO_AUTH_REQUIRED),
+                paramPurpose(KeyPurpose::SIGN),
+                paramInt(Tag::MIN_MAC_LENGTH, 128),
+                paramDigest(Digest::SHA_2_256),
+            }, keys.hmac) &&
+            generateKey(device, {
+                paramAlgorithm(Algorithm::AES),
+                paramInt(Tag::KEY_SIZE, 256),
+                paramBool(Tag::NO_AUTH_REQUIRED),
+                paramPurpose(KeyPurpose::ENCRYPT),
+                paramBlockMode(BlockMode::GCM),
+                paramPadding(PaddingMode::NONE),
+                paramInt(Tag::MIN_MAC_LENGTH, 128),
+            }, keys.aes);
+}
+
+/* Comma separated name:weight pairs, workloads not listed get weight 0 */
+bool parseMix(const std::string &value, std::vector<uint32_t> &mix) {
+    size_t pos = 0;
+
+    mix.assign(WORKLOAD_COUNT, 0);
+    while (pos < value.size()) {
+        size_t end = value.find(',', pos);
+        std::string item = value.substr(pos, end == std::string::npos ?
+                                        std::string::npos : end - pos);
+        size_t colon = item.find(':');
+        int w = 0;
+
+        for (w = 0; w < WORKLOAD_COUNT; w++) {
+            if (item.compare(0, colon, workloadNames[w]) == 0)
+                break;
+        }
+        if (w == WORKLOAD_COUNT || colon == std::string::npos) {
+            fprintf(stderr, "Bad mix entry %s\n", item.c_str());
+            return false;
+        }
+        mix[w] = strtoul(item.c_str() + colon + 1, nullptr, 0);
+        if (end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+    for (uint32_t weight : mix) {
+        if (weight)
+            return true;
+    }
+    fprintf(stderr, "Mix has no workloads\n");
+    return false;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    std::string value;
+
+    if (getOption(argc, argv, "help", value)) {
+        fprintf(stderr, "usage: %s [--transport=teec|inproc|loopback] "
+                "[--threads=list] [--binder-threads=K] [--duration-ms=N] "
+                "[--warmup-ms=N] [--mix=name:weight,...] [--file-size=N] "
+                "[--chunk-size=N] [--rsa-size=N] [--seed=N] "
+                "[--output=file]\n", argv[0]);
+        return false;
+    }
+    if (getOption(argc, argv, "transport", value))
+        options.transport = value;
+    if (getOption(argc, argv, "threads", value))
+        options.threads = parseList(value);
+    if (getOption(argc, argv, "binder-threads", value))
+        options.binderThreads = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "duration-ms", value))
+        options.durationMs = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "warmup-ms", value))
+        options.warmupMs = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "mix", value) && !parseMix(value, options.mix))
+        return false;
+    if (getOption(argc, argv, "file-size", value))
+        options.fileSize = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "chunk-size", value))
+        options.chunkSize = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "rsa-size", value))
+        options.rsaSize = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "seed", value))
+        options.seed = strtoul(value.c_str(), nullptr, 0);
+    if (getOption(argc, argv, "output", value))
+        options.output = value;
+    if (!options.chunkSize) {
+        fprintf(stderr, "Chunk size must not be zero\n");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    const struct optee_keystore_transport *transport = nullptr;
+    FILE *out = stdout;
+    Keys keys;
+
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    transport = transportByName(options.transport);
+    if (!transport) {
+        fprintf(stderr, "Unknown transport %s\n", options.transport.c_str());
+        return 1;
+    }
+    /* Device connects to the TA in its constructor */
+    optee_keystore_set_transport(transport);
+    sp<OpteeKeymasterDevice> device = new OpteeKeymasterDevice;
+
+    if (!generateKeys(device, keys))
+        return 1;
+    if (!options.output.empty()) {
+        out = fopen(options.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Can not open %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("benchmark", "keymaster_load");
+    json.field("transport", transport->name);
+    json.field("wire_version", optee_keystore_wire_version());
+    json.field("capabilities", optee_keystore_capabilities());
+    json.field("binder_threads", options.binderThreads);
+    json.field("duration_ms", options.durationMs);
+    json.field("warmup_ms", options.warmupMs);
+    json.beginObject("mix");
+    for (int w = 0; w < WORKLOAD_COUNT; w++)
+        json.field(workloadNames[w], options.mix[w]);
+    json.endObject();
+    json.beginArray("results");
+    {
+        Dispatcher dispatcher(options.binderThreads);
+
+        for (uint32_t clients : options.threads)
+            runStep(device, dispatcher, keys, options, clients, json);
+    }
+    json.endArray();
+    json.endObject();
+    json.finish();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
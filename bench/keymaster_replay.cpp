@@ -0,0 +1,554 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replay of a keymaster call trace recorded by the HAL, see
+ * optee_keymaster_trace.h, over any transport:
+ *
+ *   keymaster_replay --trace=file [--transport=teec|inproc|loopback]
+ *           [--speed=X] [--output=file.json]
+ *
+ * Calls are issued at their recorded times divided by --speed, 0 issues
+ * them back to back. Keys created before the trace started are generated
+ * from their recorded characteristics before the replay, without user
+ * authentication. Blobs and data are synthesised with the recorded sizes,
+ * so verification and decryption of synthesised input fail where the
+ * original calls succeeded; such differences are counted as mismatches.
+ * deleteAllKeys is never replayed. Results go to stdout or --output as
+ * JSON.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "optee_keymaster.h"
+#include "optee_keymaster_ipc.h"
+#include "bench_util.h"
+
+using namespace keymaster_bench;
+using ::android::sp;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V3_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V3_0::KeyFormat;
+using ::android::hardware::keymaster::V3_0::renesas::OpteeKeymasterDevice;
+
+namespace {
+
+struct Options {
+    std::string transport = "teec";
+    std::string trace;
+    double speed = 1;
+    std::string output;
+};
+
+/* One line of the trace */
+struct Call {
+    uint64_t startUs = 0;
+    std::string method;
+    uint64_t durationUs = 0;
+    int32_t error = 0;
+    std::map<std::string, uint64_t> values;
+    hidl_vec<KeyParameter> params;
+    /* Synthesised key material of importKey */
+    std::vector<uint8_t> keyMaterial;
+
+    bool has(const char *name) const { return values.count(name) != 0; }
+    uint64_t get(const char *name) const {
+        auto it = values.find(name);
+        return it == values.end() ? 0 : it->second;
+    }
+};
+
+struct MethodStats {
+    Samples replayed;
+    Samples recorded;
+    uint32_t skipped = 0;
+    uint32_t mismatches = 0;
+};
+
+KeyParameter makeParam(Tag tag, uint64_t value) {
+    KeyParameter param;
+
+    param.tag = tag;
+    switch (keymaster_tag_get_type(static_cast<keymaster_tag_t>(tag))) {
+    case KM_ULONG:
+    case KM_ULONG_REP:
+        param.f.longInteger = value;
+        break;
+    case KM_DATE:
+        param.f.dateTime = value;
+        break;
+    case KM_BOOL:
+        param.f.boolValue = value != 0;
+        break;
+    default:
+        param.f.integer = (uint32_t)value;
+        break;
+    }
+    return param;
+}
+
+/* tag:value,tag#size,... with blobs filled by pattern() */
+bool parseParams(const std::string &text, hidl_vec<KeyParameter> &result) {
+    std::vector<KeyParameter> params;
+    const char *p = text.c_str();
+
+    while (*p) {
+        char *end = nullptr;
+        Tag tag = Tag(strtoul(p, &end, 0));
+        uint64_t value = 0;
+        char kind = *end;
+
+        if (end == p || (kind != ':' && kind != '#'))
+            return false;
+        p = end + 1;
+        value = strtoull(p, &end, 0);
+        if (end == p)
+            return false;
+        if (kind == '#')
+            params.push_back(paramBlob(tag, pattern(value)));
+        else
+            params.push_back(makeParam(tag, value));
+        p = *end == ',' ? end + 1 : end;
+    }
+    result = toHidl(params);
+    return true;
+}
+
+bool loadTrace(const std::string &path, std::vector<Call> &calls) {
+    std::ifstream in(path);
+    std::string line;
+    size_t number = 0;
+
+    if (!in) {
+        fprintf(stderr, "Can not open %s\n", path.c_str());
+        return false;
+    }
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        Call c;
+
+        number++;
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (!(fields >> c.startUs >> c.method >> c.durationUs >> c.error)) {
+            fprintf(stderr, "%s:%zu: malformed call\n", path.c_str(), number);
+            return false;
+        }
+        while (fields >> field) {
+            size_t eq = field.find('=');
+            std::string name = field.substr(0, eq);
+
+            if (eq == std::string::npos) {
+                fprintf(stderr, "%s:%zu: malformed field %s\n", path.c_str(),
+                        number, field.c_str());
+                return false;
+            }
+            if (name == "params") {
+                if (!parseParams(field.substr(eq + 1), c.params)) {
+                    fprintf(stderr, "%s:%zu: malformed params\n",
+                            path.c_str(), number);
+                    return false;
+                }
+            } else {
+                c.values[name] = strtoull(field.c_str() + eq + 1, nullptr, 0);
+            }
+        }
+        calls.push_back(std::move(c));
+    }
+    return true;
+}
+
+uint32_t paramValue(const hidl_vec<KeyParameter> &params, Tag tag,
+                    uint32_t def) {
+    for (size_t i = 0; i < params.size(); i++) {
+        if (params[i].tag == tag)
+            return params[i].f.integer;
+    }
+    return def;
+}
+
+/* Characteristics which are accepted by generateKey */
+bool generationTag(Tag tag) {
+    switch (tag) {
+    case Tag::ALGORITHM:
+    case Tag::KEY_SIZE:
+    case Tag::RSA_PUBLIC_EXPONENT:
+    case Tag::EC_CURVE:
+    case Tag::PURPOSE:
+    case Tag::BLOCK_MODE:
+    case Tag::PADDING:
+    case Tag::DIGEST:
+    case Tag::MIN_MAC_LENGTH:
+    case Tag::CALLER_NONCE:
+    case Tag::MAX_USES_PER_BOOT:
+    case Tag::MIN_SECONDS_BETWEEN_OPS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Replayer {
+public:
+    Replayer(const sp<OpteeKeymasterDevice> &device, const Options &options)
+        : device_(device), options_(options) {}
+
+    /* Creates keys described in the trace and material for imports */
+    void prepare(std::vector<Call> &calls);
+    void run(const std::vector<Call> &calls, JsonWriter &json);
+
+private:
+    /* Returns false if the call refers to a key or operation not replayed */
+    bool issue(const Call &c, ErrorCode &rc);
+    bool findKey(const Call &c, hidl_vec<uint8_t> &key);
+    bool findOperation(const Call &c, uint64_t &handle);
+    void storeKey(const Call &c, ErrorCode rc, const hidl_vec<uint8_t> &key);
+
+    sp<OpteeKeymasterDevice> device_;
+    const Options &options_;
+    std::map<uint64_t, hidl_vec<uint8_t>> keys_;
+    std::map<uint64_t, uint64_t> operations_;
+};
+
+void Replayer::prepare(std::vector<Call> &calls) {
+    for (Call &c : calls) {
+        if (c.method == "importKey") {
+            Algorithm algorithm = Algorithm(paramValue(c.params,
+                    Tag::ALGORITHM, (uint32_t)Algorithm::AES));
+            uint32_t keySize = paramValue(c.params, Tag::KEY_SIZE,
+                    algorithm == Algorithm::RSA ? 2048 : 256);
+
+            if (KeyFormat(c.get("format")) == KeyFormat::PKCS8)
+                c.keyMaterial = makePkcs8(algorithm, keySize);
+            else
+                c.keyMaterial = pattern(c.get("data"));
+            continue;
+        }
+        if (c.method != "key")
+            continue;
+
+        std::vector<KeyParameter> params{paramBool(Tag::NO_AUTH_REQUIRED)};
+        ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+
+        for (size_t i = 0; i < c.params.size(); i++) {
+            if (generationTag(c.params[i].tag))
+                params.push_back(c.params[i]);
+        }
+        if (c.get("client_id"))
+            params.push_back(paramBlob(Tag::APPLICATION_ID,
+                                       pattern(c.get("client_id"))));
+        if (c.get("app_data"))
+            params.push_back(paramBlob(Tag::APPLICATION_DATA,
+                                       pattern(c.get("app_data"))));
+        device_->generateKey(toHidl(params),
+                [&](ErrorCode rc, const hidl_vec<uint8_t> &blob,
+                    const KeyCharacteristics &) {
+                    result = rc;
+                    if (rc == ErrorCode::OK)
+                        keys_[c.get("key")] = blob;
+                });
+        if (result != ErrorCode::OK)
+            fprintf(stderr, "Can not create key %llu, error %d\n",
+                    (unsigned long long)c.get("key"), (int)result);
+    }
+}
+
+bool Replayer::findKey(const Call &c, hidl_vec<uint8_t> &key) {
+    auto it = keys_.find(c.get("key"));
+
+    if (it == keys_.end())
+        return false;
+    key = it->second;
+    return true;
+}
+
+bool Replayer::findOperation(const Call &c, uint64_t &handle) {
+    auto it = operations_.find(c.get("op"));
+
+    if (it == operations_.end())
+        return false;
+    handle = it->second;
+    return true;
+}
+
+void Replayer::storeKey(const Call &c, ErrorCode rc,
+                        const hidl_vec<uint8_t> &key) {
+    if (rc == ErrorCode::OK && c.has("out_key") && key.size())
+        keys_[c.get("out_key")] = key;
+}
+
+bool Replayer::issue(const Call &c, ErrorCode &rc) {
+    hidl_vec<uint8_t> key;
+    uint64_t handle = 0;
+
+    if (c.method == "getHardwareFeatures") {
+        device_->getHardwareFeatures([&](bool, bool, bool, bool, bool,
+                                         const hidl_string &,
+                                         const hidl_string &) {});
+        rc = ErrorCode::OK;
+    } else if (c.method == "addRngEntropy") {
+        rc = device_->addRngEntropy(toHidl(pattern(c.get("data"))));
+    } else if (c.method == "generateKey") {
+        device_->generateKey(c.params,
+                [&](ErrorCode error, const hidl_vec<uint8_t> &blob,
+                    const KeyCharacteristics &) {
+                    rc = error;
+                    storeKey(c, rc, blob);
+                });
+    } else if (c.method == "importKey") {
+        device_->importKey(c.params, KeyFormat(c.get("format")),
+                toHidl(c.keyMaterial),
+                [&](ErrorCode error, const hidl_vec<uint8_t> &blob,
+                    const KeyCharacteristics &) {
+                    rc = error;
+                    storeKey(c, rc, blob);
+                });
+    } else if (c.method == "getKeyCharacteristics") {
+        if (!findKey(c, key))
+            return false;
+        device_->getKeyCharacteristics(key,
+                toHidl(pattern(c.get("client_id"))),
+                toHidl(pattern(c.get("app_data"))),
+                [&](ErrorCode error, const KeyCharacteristics &) {
+                    rc = error;
+                });
+    } else if (c.method == "exportKey") {
+        if (!findKey(c, key))
+            return false;
+        device_->exportKey(KeyFormat(c.get("format")), key,
+                toHidl(pattern(c.get("client_id"))),
+                toHidl(pattern(c.get("app_data"))),
+                [&](ErrorCode error, const hidl_vec<uint8_t> &) {
+                    rc = error;
+                });
+    } else if (c.method == "attestKey") {
+        if (!findKey(c, key))
+            return false;
+        device_->attestKey(key, c.params,
+                [&](ErrorCode error, const hidl_vec<hidl_vec<uint8_t>> &) {
+                    rc = error;
+                });
+    } else if (c.method == "upgradeKey") {
+        if (!findKey(c, key))
+            return false;
+        device_->upgradeKey(key, c.params,
+                [&](ErrorCode error, const hidl_vec<uint8_t> &blob) {
+                    rc = error;
+                    storeKey(c, rc, blob);
+                });
+    } else if (c.method == "deleteKey") {
+        if (!findKey(c, key))
+            return false;
+        rc = device_->deleteKey(key);
+        keys_.erase(c.get("key"));
+    } else if (c.method == "destroyAttestationIds") {
+        rc = device_->destroyAttestationIds();
+    } else if (c.method == "begin") {
+        if (!findKey(c, key))
+            return false;
+        device_->begin(KeyPurpose(c.get("purpose")), key, c.params,
+                [&](ErrorCode error, const hidl_vec<KeyParameter> &,
+                    uint64_t operationHandle) {
+                    rc = error;
+                    if (rc == ErrorCode::OK && c.get("op"))
+                        operations_[c.get("op")] = operationHandle;
+                });
+    } else if (c.method == "update") {
+        if (!findOperation(c, handle))
+            return false;
+        device_->update(handle, c.params, toHidl(pattern(c.get("in"))),
+                [&](ErrorCode error, uint32_t,
+                    const hidl_vec<KeyParameter> &,
+                    const hidl_vec<uint8_t> &) { rc = error; });
+        if (rc != ErrorCode::OK)
+            operations_.erase(c.get("op"));
+    } else if (c.method == "finish") {
+        if (!findOperation(c, handle))
+            return false;
+        device_->finish(handle, c.params, toHidl(pattern(c.get("in"))),
+                toHidl(pattern(c.get("sig"))),
+                [&](ErrorCode error, const hidl_vec<KeyParameter> &,
+                    const hidl_vec<uint8_t> &) { rc = error; });
+        operations_.erase(c.get("op"));
+    } else if (c.method == "abort") {
+        if (!findOperation(c, handle))
+            return false;
+        rc = device_->abort(handle);
+        operations_.erase(c.get("op"));
+    } else {
+        /* deleteAllKeys and methods unknown to this tool */
+        return false;
+    }
+    return true;
+}
+
+void Replayer::run(const std::vector<Call> &calls, JsonWriter &json) {
+    std::map<std::string, MethodStats> stats;
+    Samples lag;
+    uint64_t firstUs = 0;
+    uint64_t lastUs = 0;
+    uint32_t replayed = 0;
+    uint32_t skipped = 0;
+    uint32_t mismatches = 0;
+    Clock::time_point start;
+    Clock::time_point end;
+
+    for (const Call &c : calls) {
+        if (c.method == "key")
+            continue;
+        if (!firstUs || c.startUs < firstUs)
+            firstUs = c.startUs;
+        lastUs = std::max(lastUs, c.startUs + c.durationUs);
+    }
+    start = Clock::now();
+    for (const Call &c : calls) {
+        MethodStats &s = stats[c.method];
+        ErrorCode rc = ErrorCode::OK;
+        Clock::time_point issued;
+
+        if (c.method == "key")
+            continue;
+        if (options_.speed > 0) {
+            Clock::time_point due = start +
+                    std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double, std::micro>(
+                    (c.startUs - firstUs) / options_.speed));
+            std::this_thread::sleep_until(due);
+            lag.add(std::max(0.0, elapsedUs(due, Clock::now())));
+        }
+        issued = Clock::now();
+        if (!issue(c, rc)) {
+            s.skipped++;
+            skipped++;
+            continue;
+        }
+        s.replayed.add(elapsedUs(issued, Clock::now()));
+        s.recorded.add(c.durationUs);
+        replayed++;
+        if ((int32_t)rc != c.error) {
+            s.mismatches++;
+            mismatches++;
+        }
+    }
+    end = Clock::now();
+
+    json.field("calls", replayed);
+    json.field("skipped", skipped);
+    json.field("mismatches", mismatches);
+    json.field("recorded_seconds", (lastUs - firstUs) / 1e6);
+    json.field("replay_seconds", elapsedUs(start, end) / 1e6);
+    if (lag.count()) {
+        json.field("lag_p50_us", lag.percentile(50));
+        json.field("lag_p99_us", lag.percentile(99));
+        json.field("lag_max_us", lag.max());
+    }
+    json.beginArray("methods");
+    for (auto &entry : stats) {
+        MethodStats &s = entry.second;
+
+        if (entry.first == "key")
+            continue;
+        json.beginObject();
+        json.field("method", entry.first);
+        json.field("calls", (uint64_t)s.replayed.count());
+        json.field("skipped", s.skipped);
+        json.field("mismatches", s.mismatches);
+        if (s.replayed.count()) {
+            json.field("p50_us", s.replayed.percentile(50));
+            json.field("p99_us", s.replayed.percentile(99));
+            json.field("max_us", s.replayed.max());
+            json.field("recorded_p50_us", s.recorded.percentile(50));
+            json.field("recorded_p99_us", s.recorded.percentile(99));
+        }
+        json.endObject();
+    }
+    json.endArray();
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    std::string value;
+
+    if (getOption(argc, argv, "help", value) ||
+            !getOption(argc, argv, "trace", options.trace)) {
+        fprintf(stderr, "usage: %s --trace=file "
+                "[--transport=teec|inproc|loopback] [--speed=X] "
+                "[--output=file]\n", argv[0]);
+        return false;
+    }
+    if (getOption(argc, argv, "transport", value))
+        options.transport = value;
+    if (getOption(argc, argv, "speed", value))
+        options.speed = strtod(value.c_str(), nullptr);
+    if (getOption(argc, argv, "output", value))
+        options.output = value;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    const struct optee_keystore_transport *transport = nullptr;
+    std::vector<Call> calls;
+    FILE *out = stdout;
+
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    if (!loadTrace(options.trace, calls))
+        return 1;
+    transport = transportByName(options.transport);
+    if (!transport) {
+        fprintf(stderr, "Unknown transport %s\n", options.transport.c_str());
+        return 1;
+    }
+    /* Device connects to the TA in its constructor */
+    optee_keystore_set_transport(transport);
+    sp<OpteeKeymasterDevice> device = new OpteeKeymasterDevice;
+    Replayer replayer(device, options);
+
+    replayer.prepare(calls);
+    if (!options.output.empty()) {
+        out = fopen(options.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Can not open %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("benchmark", "keymaster_replay");
+    json.field("transport", transport->name);
+    json.field("wire_version", optee_keystore_wire_version());
+    json.field("capabilities", optee_keystore_capabilities());
+    json.field("trace", options.trace);
+    json.field("speed", options.speed);
+    replayer.run(calls, json);
+    json.endObject();
+    json.finish();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
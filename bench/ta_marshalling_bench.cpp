@@ -0,0 +1,217 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of TA side marshalling in parsel.c, run against the
+ * host TEE API shim. Allocations are TEE_Malloc/TEE_Realloc calls.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <host_tee.h>
+#include "parameters.h"
+#include "parsel.h"
+}
+
+namespace {
+
+/* Same tag mix as realisticParams() in bench_util.cpp */
+class TaParamSet {
+public:
+    TaParamSet(uint32_t tags, uint32_t aadSize) {
+        static const keymaster_tag_t filler[] = {
+            KM_TAG_KEY_SIZE, KM_TAG_USER_SECURE_ID, KM_TAG_AUTH_TIMEOUT,
+            KM_TAG_CREATION_DATETIME, KM_TAG_OS_VERSION, KM_TAG_OS_PATCHLEVEL,
+            KM_TAG_ORIGIN, KM_TAG_PURPOSE, KM_TAG_BLOCK_MODE, KM_TAG_DIGEST,
+            KM_TAG_MIN_MAC_LENGTH, KM_TAG_CALLER_NONCE,
+        };
+        static const uint64_t fillerValue[] = {
+            256, 0x0123456789abcdefULL, 300, 1500000000000ULL, 80100,
+            201805, KM_ORIGIN_GENERATED, KM_PURPOSE_DECRYPT, KM_MODE_CTR,
+            KM_DIGEST_SHA_2_256, 96, 1,
+        };
+        const size_t fillerCount = sizeof(filler) / sizeof(filler[0]);
+
+        add(KM_TAG_ALGORITHM, KM_ALGORITHM_AES);
+        add(KM_TAG_PURPOSE, KM_PURPOSE_ENCRYPT);
+        add(KM_TAG_BLOCK_MODE, KM_MODE_GCM);
+        add(KM_TAG_PADDING, KM_PAD_NONE);
+        add(KM_TAG_MAC_LENGTH, 128);
+        addBlob(KM_TAG_NONCE, 12);
+        addBlob(KM_TAG_ASSOCIATED_DATA, aadSize);
+        /* sizeof(hw_auth_token_t) */
+        addBlob(KM_TAG_AUTH_TOKEN, 69);
+        addBlob(KM_TAG_APPLICATION_ID, 16);
+        addBlob(KM_TAG_APPLICATION_DATA, 16);
+        for (size_t i = 0; params_.size() < tags; i++)
+            add(filler[i % fillerCount], fillerValue[i % fillerCount]);
+        params_.resize(tags);
+    }
+
+    /* Set of params in [first, first + count) */
+    keymaster_key_param_set_t slice(size_t first, size_t count) {
+        return {params_.data() + first, count};
+    }
+
+    keymaster_key_param_set_t all() { return slice(0, params_.size()); }
+
+    size_t size() const { return params_.size(); }
+
+    /* Upper bound of serialized size, as for wire format v1 */
+    size_t wireSize() const {
+        size_t size = SIZE_LENGTH + params_.size() * sizeof(params_[0]);
+
+        for (const std::vector<uint8_t> &blob : blobs_)
+            size += SIZE_LENGTH + blob.size();
+        return size;
+    }
+
+private:
+    void add(keymaster_tag_t tag, uint64_t value) {
+        keymaster_key_param_t param;
+
+        memset(&param, 0, sizeof(param));
+        param.tag = tag;
+        switch (keymaster_tag_get_type(tag)) {
+        case KM_BOOL:
+            param.key_param.boolean = value != 0;
+            break;
+        case KM_ULONG:
+        case KM_ULONG_REP:
+        case KM_DATE:
+            param.key_param.long_integer = value;
+            break;
+        default:
+            param.key_param.integer = (uint32_t)value;
+            break;
+        }
+        params_.push_back(param);
+    }
+
+    void addBlob(keymaster_tag_t tag, size_t size) {
+        keymaster_key_param_t param;
+
+        blobs_.emplace_back(size);
+        for (size_t i = 0; i < size; i++)
+            blobs_.back()[i] = (uint8_t)(i * 31 + 7);
+        memset(&param, 0, sizeof(param));
+        param.tag = tag;
+        param.key_param.blob.data = blobs_.back().data();
+        param.key_param.blob.data_length = size;
+        params_.push_back(param);
+    }
+
+    std::vector<keymaster_key_param_t> params_;
+    std::vector<std::vector<uint8_t>> blobs_;
+};
+
+/* Args: tags, associated data size, wire version */
+void marshallingArgs(benchmark::internal::Benchmark *b) {
+    for (int wire : {KM_WIRE_VERSION_1, KM_WIRE_VERSION_2})
+        for (int tags : {10, 20, 40})
+            for (int aad : {16, 1024, 16384})
+                b->Args({tags, aad, wire});
+    b->ArgNames({"tags", "aad", "wire"});
+}
+
+void reportAllocations(benchmark::State &state, uint64_t before) {
+    state.counters["allocs/op"] = benchmark::Counter(
+            (double)(host_tee_alloc_count() - before),
+            benchmark::Counter::kAvgIterations);
+}
+
+void BM_TaSerializeParamSet(benchmark::State &state) {
+    TaParamSet set((uint32_t)state.range(0), (uint32_t)state.range(1));
+    keymaster_key_param_set_t params = set.all();
+    std::vector<uint8_t> out(set.wireSize());
+    uint64_t allocs = 0;
+    int size = 0;
+
+    TA_set_wire_version((uint32_t)state.range(2));
+    allocs = host_tee_alloc_count();
+    for (auto _ : state) {
+        size = TA_serialize_param_set(out.data(), &params);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    reportAllocations(state, allocs);
+    state.counters["wire_bytes"] = size;
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_TaSerializeParamSet)->Apply(marshallingArgs);
+
+void BM_TaDeserializeParamSet(benchmark::State &state) {
+    TaParamSet set((uint32_t)state.range(0), (uint32_t)state.range(1));
+    keymaster_key_param_set_t params = set.all();
+    std::vector<uint8_t> in(set.wireSize());
+    uint64_t allocs = 0;
+    int size = 0;
+
+    TA_set_wire_version((uint32_t)state.range(2));
+    size = TA_serialize_param_set(in.data(), &params);
+    allocs = host_tee_alloc_count();
+    for (auto _ : state) {
+        keymaster_key_param_set_t result;
+        keymaster_error_t res = KM_ERROR_OK;
+
+        TA_deserialize_param_set(in.data(), in.data() + size, &result,
+                                 false, &res);
+        if (res != KM_ERROR_OK) {
+            state.SkipWithError("TA_deserialize_param_set failed");
+            TA_free_params(&result);
+            break;
+        }
+        TA_free_params(&result);
+    }
+    reportAllocations(state, allocs);
+    state.counters["wire_bytes"] = size;
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_TaDeserializeParamSet)->Apply(marshallingArgs);
+
+/* Half of the tags are hardware enforced, the rest software enforced */
+void BM_TaSerializeCharacteristics(benchmark::State &state) {
+    TaParamSet set((uint32_t)state.range(0), (uint32_t)state.range(1));
+    keymaster_key_characteristics_t characteristics = {
+        set.slice(0, set.size() / 2),
+        set.slice(set.size() / 2, set.size() - set.size() / 2),
+    };
+    std::vector<uint8_t> out(set.wireSize() + SIZE_LENGTH);
+    uint64_t allocs = 0;
+    int size = 0;
+
+    TA_set_wire_version((uint32_t)state.range(2));
+    allocs = host_tee_alloc_count();
+    for (auto _ : state) {
+        size = TA_serialize_characteristics(out.data(), &characteristics);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    reportAllocations(state, allocs);
+    state.counters["wire_bytes"] = size;
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_TaSerializeCharacteristics)->Apply(marshallingArgs);
+
+} // namespace
+
+/* Shared by the host TA only and the target HAL + TA binaries */
+BENCHMARK_MAIN();
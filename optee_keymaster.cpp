@@ -16,11 +16,18 @@
 
 #include <utils/Log.h>
 #include <cutils/properties.h>
+#include <cstdio>
 #include <cstring>
+#include <unistd.h>
+#include <algorithm>
 #include <memory>
 #include <new>
+#include <vector>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
 
 #include "optee_keymaster.h"
+#include "optee_keymaster_call.h"
 #include "optee_keymaster_ipc.h"
 
 #undef LOG_TAG
@@ -62,6 +69,15 @@ inline static ErrorCode legacy_enum_conversion(const keymaster_error_t value) {
     return ErrorCode(value);
 }
 
+/* Value of the first blob param with tag, empty if there is none */
+static hidl_vec<uint8_t> findBlob(const hidl_vec<KeyParameter> &params, Tag tag) {
+    for (size_t i = 0; i < params.size(); i++) {
+        if (params[i].tag == tag)
+            return params[i].blob;
+    }
+    return hidl_vec<uint8_t>();
+}
+
 /*
  * KmParamSet implementation
  */
@@ -121,6 +137,20 @@ inline static KmParamSet hidlParams2KmParamSet(const hidl_vec<KeyParameter> &par
     return KmParamSet(params);
 }
 
+/* Associated data is accepted only before any input is provided */
+static hidl_vec<KeyParameter> removeAssociatedData(const hidl_vec<KeyParameter> &params) {
+    hidl_vec<KeyParameter> result;
+    size_t count = 0;
+
+    result.resize(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params[i].tag != Tag::ASSOCIATED_DATA)
+            result[count++] = params[i];
+    }
+    result.resize(count);
+    return result;
+}
+
 inline static keymaster_blob_t hidlVec2KmBlob(const hidl_vec<uint8_t> &blob) {
     if (blob.size())
         return {&blob[0], blob.size()};
@@ -161,6 +191,29 @@ inline static hidl_vec<hidl_vec<uint8_t>> kmCertChain2Hidl(
     return result;
 }
 
+/* Checks that size more bytes of the response are left after source */
+static bool responseLeft(const uint8_t *source, const uint8_t *end,
+                    size_t size, ErrorCode &rc) {
+    if (source > end || static_cast<size_t>(end - source) < size) {
+        ALOGE("Response from TA is truncated");
+        rc = ErrorCode::UNKNOWN_ERROR;
+        return false;
+    }
+    return true;
+}
+
+/* Reads a v2 varint, 0 on truncated or over-long input */
+static size_t responseVarint(uint64_t &value, const uint8_t *source,
+                    const uint8_t *end, ErrorCode &rc) {
+    size_t len = source < end ? km_get_varint(source, end, &value) : 0;
+
+    if (!len) {
+        ALOGE("Malformed varint in response from TA");
+        rc = ErrorCode::UNKNOWN_ERROR;
+    }
+    return len;
+}
+
 static inline hidl_vec<KeyParameter> kmParamSet2Hidl(const keymaster_key_param_set_t& set) {
     hidl_vec<KeyParameter> result;
     if (set.length == 0 || set.params == nullptr) return result;
@@ -207,14 +260,39 @@ static inline hidl_vec<KeyParameter> kmParamSet2Hidl(const keymaster_key_param_s
 /*OpteeKeymasterDevice implementation*/
 
 OpteeKeymasterDevice::OpteeKeymasterDevice() {
+    char tracePath[PROPERTY_VALUE_MAX] = {0,};
+    char statsPath[PROPERTY_VALUE_MAX] = {0,};
+    char timelinePath[PROPERTY_VALUE_MAX] = {0,};
+
+    if (property_get("vendor.keymaster.trace", tracePath, "") > 0)
+        trace_ = KeymasterTrace::open(tracePath);
+    if (property_get("vendor.keymaster.stats", statsPath, "") > 0)
+        stats_path_ = statsPath;
     connect();
+    /* Needs the connection to read spans back from the TA */
+    if (property_get("vendor.keymaster.timeline", timelinePath, "") > 0)
+        timeline_ = KeymasterTimeline::open(timelinePath);
+    last_activity_ = std::chrono::steady_clock::now();
+    maintenance_thread_ = std::thread(&OpteeKeymasterDevice::maintenanceLoop, this);
 }
 
 OpteeKeymasterDevice::~OpteeKeymasterDevice() {
+    {
+        std::lock_guard<std::mutex> lock(maintenance_mutex_);
+        maintenance_stop_ = true;
+    }
+    maintenance_cv_.notify_one();
+    maintenance_thread_.join();
+    saveStats();
+    timeline_.reset();
     disconnect();
 }
 
 Return<void>  OpteeKeymasterDevice::getHardwareFeatures(getHardwareFeatures_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::GET_HARDWARE_FEATURES);
+
+    record.done(ErrorCode::OK);
     //send results off to the client
     _hidl_cb(is_secure_, supports_ec_, supports_symmetric_cryptography_,
              supports_attestation_, supports_all_digests_,
@@ -223,11 +301,14 @@ Return<void>  OpteeKeymasterDevice::getHardwareFeatures(getHardwareFeatures_cb _
 }
 
 Return<ErrorCode> OpteeKeymasterDevice::addRngEntropy(const hidl_vec<uint8_t> &data) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::ADD_RNG_ENTROPY);
     ErrorCode rc = ErrorCode::OK;
-    int in_size = data.size() + sizeof(size_t);
+    int in_size = data.size() + SIZE_LENGTH;
     std::unique_ptr<uint8_t[]> in(new uint8_t[in_size]);
     /*Restrictions for max input data length 2KB*/
     const uint32_t maxInputData = 1024 * 2;
+    record.trace().size("data", data.size());
     if (!checkConnection(rc))
         goto error;
     if (!data.size())
@@ -237,7 +318,7 @@ Return<ErrorCode> OpteeKeymasterDevice::addRngEntropy(const hidl_vec<uint8_t> &d
         goto error;
     }
     memset(in.get(), 0, in_size);
-    serializeData(in.get(), data.size(), &data[0], sizeof(uint8_t));
+    in_size = serializeData(in.get(), data.size(), &data[0], sizeof(uint8_t));
 
     rc = legacy_enum_conversion(
         optee_keystore_call(KM_ADD_RNG_ENTROPY, in.get(), in_size, nullptr, 0));
@@ -246,6 +327,7 @@ Return<ErrorCode> OpteeKeymasterDevice::addRngEntropy(const hidl_vec<uint8_t> &d
         ALOGE("Add RNG entropy failed with code %d [%x]", rc, rc);
 out:
 error:
+    record.done(rc);
     return rc;
 }
 
@@ -298,6 +380,8 @@ exit:
 
 Return<void> OpteeKeymasterDevice::generateKey(const hidl_vec<KeyParameter> &keyParams,
                                           generateKey_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::GENERATE_KEY);
     ErrorCode rc = ErrorCode::OK;
     KeyCharacteristics resultCharacteristics;
     hidl_vec<uint8_t> resultKeyBlob;
@@ -309,6 +393,7 @@ Return<void> OpteeKeymasterDevice::generateKey(const hidl_vec<KeyParameter> &key
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().params(keyParams);
     if (!checkConnection(rc))
         goto error;
     memset(out.get(), 0, outSize);
@@ -322,19 +407,19 @@ Return<void> OpteeKeymasterDevice::generateKey(const hidl_vec<KeyParameter> &key
 
     rc = legacy_enum_conversion(
         optee_keystore_call(KM_GENERATE_KEY, in.get(),
-            inSize, out.get(), outSize));
+            ptr - in.get(), out.get(), outSize));
     if (rc != ErrorCode::OK) {
         ALOGE("Generate key failed with error code %d [%x]", rc, rc);
         goto error;
     }
 
     ptr = out.get();
-    ptr += deserializeKeyBlob(kmKeyBlob, ptr, rc);
+    ptr += deserializeKeyBlob(kmKeyBlob, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize key blob");
         goto error;
     }
-    ptr += deserializeKeyCharacteristics(kmKeyCharacteristics, ptr, rc);
+    ptr += deserializeKeyCharacteristics(kmKeyCharacteristics, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize characteristics");
         goto error;
@@ -345,6 +430,8 @@ Return<void> OpteeKeymasterDevice::generateKey(const hidl_vec<KeyParameter> &key
     resultCharacteristics.teeEnforced = kmParamSet2Hidl(kmKeyCharacteristics.hw_enforced);
 
 error:
+    record.trace().newKey(resultKeyBlob);
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultKeyBlob, resultCharacteristics);
     if (kmKeyBlob.key_material)
@@ -357,6 +444,8 @@ Return<void>  OpteeKeymasterDevice::getKeyCharacteristics(const hidl_vec<uint8_t
                                    const hidl_vec<uint8_t> &clientId,
                                    const hidl_vec<uint8_t> &appData,
                                    getKeyCharacteristics_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::GET_KEY_CHARACTERISTICS);
     ErrorCode rc = ErrorCode::OK;
     KeyCharacteristics resultCharacteristics;
     keymaster_key_characteristics_t kmKeyCharacteristics{{nullptr, 0}, {nullptr, 0}};
@@ -374,6 +463,9 @@ Return<void>  OpteeKeymasterDevice::getKeyCharacteristics(const hidl_vec<uint8_t
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().key(keyBlob);
+    record.trace().size("client_id", clientId.size());
+    record.trace().size("app_data", appData.size());
     if (!checkConnection(rc))
         goto error;
     if (!keyBlob.size() || kmKeyBlob.key_material == nullptr) {
@@ -390,14 +482,14 @@ Return<void>  OpteeKeymasterDevice::getKeyCharacteristics(const hidl_vec<uint8_t
 
     rc = legacy_enum_conversion(
         optee_keystore_call(KM_GET_KEY_CHARACTERISTICS, in.get(),
-            inSize, out.get(), outSize));
+            ptr - in.get(), out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Get key characteristics failed with code %d, [%x]", rc, rc);
         goto error;
     }
 
-    deserializeKeyCharacteristics(kmKeyCharacteristics, out.get(), rc);
+    deserializeKeyCharacteristics(kmKeyCharacteristics, out.get(), out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize key characteristics");
         goto error;
@@ -407,14 +499,18 @@ Return<void>  OpteeKeymasterDevice::getKeyCharacteristics(const hidl_vec<uint8_t
     resultCharacteristics.teeEnforced = kmParamSet2Hidl(kmKeyCharacteristics.hw_enforced);
 
 error:
+    record.done(rc);
     // send results off to the client
     _hidl_cb(rc, resultCharacteristics);
     keymaster_free_characteristics(&kmKeyCharacteristics);
+    traceKey(record.trace(), keyBlob, clientId, appData);
     return Void();
 }
 
 Return<void>  OpteeKeymasterDevice::importKey(const hidl_vec<KeyParameter> &params, KeyFormat keyFormat,
                        const hidl_vec<uint8_t> &keyData, importKey_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::IMPORT_KEY);
     ErrorCode rc = ErrorCode::OK;
     KeyCharacteristics resultCharacteristics;
     hidl_vec<uint8_t> resultKeyBlob;
@@ -429,6 +525,9 @@ Return<void>  OpteeKeymasterDevice::importKey(const hidl_vec<KeyParameter> &para
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().params(params);
+    record.trace().value("format", static_cast<uint32_t>(keyFormat));
+    record.trace().size("data", keyData.size());
     if (!checkConnection(rc))
         goto error;
     memset(in.get(), 0, inSize);
@@ -440,7 +539,8 @@ Return<void>  OpteeKeymasterDevice::importKey(const hidl_vec<KeyParameter> &para
                                                SIZE_OF_ITEM(kmKeyData.data));
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_IMPORT_KEY, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_IMPORT_KEY, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Import key failed with code %d [%x]", rc, rc);
@@ -448,12 +548,12 @@ Return<void>  OpteeKeymasterDevice::importKey(const hidl_vec<KeyParameter> &para
     }
 
     ptr = out.get();
-    ptr += deserializeKeyBlob(kmKeyBlob, ptr, rc);
+    ptr += deserializeKeyBlob(kmKeyBlob, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to allocate memory for blob deserialization");
         goto error;
     }
-    ptr += deserializeKeyCharacteristics(kmKeyCharacteristics, ptr, rc);
+    ptr += deserializeKeyCharacteristics(kmKeyCharacteristics, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to allocate memory for characteristics deserialization");
         goto error;
@@ -464,6 +564,8 @@ Return<void>  OpteeKeymasterDevice::importKey(const hidl_vec<KeyParameter> &para
     resultCharacteristics.teeEnforced = kmParamSet2Hidl(kmKeyCharacteristics.hw_enforced);
 
 error:
+    record.trace().newKey(resultKeyBlob);
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultKeyBlob, resultCharacteristics);
 
@@ -477,6 +579,8 @@ error:
 Return<void>  OpteeKeymasterDevice::exportKey(KeyFormat exportFormat, const hidl_vec<uint8_t> &keyBlob,
                        const hidl_vec<uint8_t> &clientId, const hidl_vec<uint8_t> &appData,
                        exportKey_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::EXPORT_KEY);
     ErrorCode rc = ErrorCode::OK;
     hidl_vec<uint8_t> resultKeyBlob;
     keymaster_blob_t kmBlob{nullptr, 0};
@@ -485,15 +589,20 @@ Return<void>  OpteeKeymasterDevice::exportKey(KeyFormat exportFormat, const hidl
     keymaster_blob_t kmAppData = hidlVec2KmBlob(appData);
     keymaster_key_format_t kmKeyFormat = legacy_enum_conversion(exportFormat);
     int outSize = recv_buf_size_;
-    int inSize = getKeyBlobSize(kmKeyBlob);
-    if (!clientId.size())
+    int inSize = sizeof(kmKeyFormat) + getKeyBlobSize(kmKeyBlob);
+    inSize += sizeof(presence);
+    if (clientId.size())
         inSize += getBlobSize(kmClientId);
     inSize += sizeof(presence);
-    if (!appData.size())
+    if (appData.size())
         inSize += getBlobSize(kmAppData);
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().value("format", static_cast<uint32_t>(exportFormat));
+    record.trace().key(keyBlob);
+    record.trace().size("client_id", clientId.size());
+    record.trace().size("app_data", appData.size());
     if (!checkConnection(rc))
         goto error;
     if (!keyBlob.size() || kmKeyBlob.key_material == nullptr) {
@@ -510,14 +619,15 @@ Return<void>  OpteeKeymasterDevice::exportKey(KeyFormat exportFormat, const hidl
     ptr += serializeBlobWithPresenceInfo(ptr, kmAppData, appData.size());
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_EXPORT_KEY, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_EXPORT_KEY, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Export key failed with code %d [%x]", rc, rc);
         goto error;
     }
 
-    deserializeBlob(kmBlob, out.get(), rc);
+    deserializeBlob(kmBlob, out.get(), out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize blob from TA");
         goto error;
@@ -526,6 +636,7 @@ Return<void>  OpteeKeymasterDevice::exportKey(KeyFormat exportFormat, const hidl
     resultKeyBlob = kmBlob2hidlVec(kmBlob);
 
 error:
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultKeyBlob);
 
@@ -533,6 +644,7 @@ error:
     if (kmBlob.data)
         free(const_cast<uint8_t *>(kmBlob.data));
 
+    traceKey(record.trace(), keyBlob, clientId, appData);
     return Void();
 }
 
@@ -560,9 +672,12 @@ int OpteeKeymasterDevice::verifiedBootState(uint8_t *in) {
 Return<void>  OpteeKeymasterDevice::attestKey(const hidl_vec<uint8_t> &keyToAttest,
                        const hidl_vec<KeyParameter> &attestParams,
                        attestKey_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::ATTEST_KEY);
     ErrorCode rc = ErrorCode::OK;
     hidl_vec<hidl_vec<uint8_t>> resultCertChain;
     keymaster_cert_chain_t kmCertChain{nullptr, 0};
+    size_t entryCount = 0;
     keymaster_key_blob_t kmKeyToAttest = hidlVec2KmKeyBlob(keyToAttest);
     KmParamSet kmAttestParams = hidlParams2KmParamSet(attestParams);
     int outSize = recv_buf_size_;
@@ -572,8 +687,11 @@ Return<void>  OpteeKeymasterDevice::attestKey(const hidl_vec<uint8_t> &keyToAtte
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *perm = nullptr;
     uint8_t *ptr = nullptr;
+    record.trace().key(keyToAttest);
+    record.trace().params(attestParams);
     if (!checkConnection(rc))
         goto error;
+    waitProvisioned();
     memset(in.get(), 0, inSize);
     memset(out.get(), 0, outSize);
     for (size_t i = 0; i < attestParams.size(); ++i) {
@@ -607,7 +725,8 @@ Return<void>  OpteeKeymasterDevice::attestKey(const hidl_vec<uint8_t> &keyToAtte
     ptr += verifiedBootState(ptr);
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_ATTEST_KEY, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_ATTEST_KEY, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Attest key failed with code %d [%x]", rc, rc);
@@ -615,15 +734,28 @@ Return<void>  OpteeKeymasterDevice::attestKey(const hidl_vec<uint8_t> &keyToAtte
     }
 
     ptr = out.get();
-    ptr += deserializeSize(kmCertChain.entry_count, ptr);
-    kmCertChain.entries = new (std::nothrow) keymaster_blob_t[kmCertChain.entry_count];
+    ptr += deserializeSize(entryCount, ptr, out.get() + outSize, rc);
+    if (rc != ErrorCode::OK) {
+        ALOGE("Failed to deserialize cert chain from TA");
+        goto error;
+    }
+    /* Zeroed, so a chain read in part is freed safely */
+    kmCertChain.entries = new (std::nothrow) keymaster_blob_t[entryCount]();
     if (!kmCertChain.entries) {
         ALOGE("Failed to allocate memory for cert chain");
         rc = ErrorCode::MEMORY_ALLOCATION_FAILED;
         goto error;
     }
+    kmCertChain.entry_count = entryCount;
     for(size_t i = 0; i < kmCertChain.entry_count; i++) {
-        ptr += deserializeSize(kmCertChain.entries[i].data_length, ptr);;
+        ptr += deserializeSize(kmCertChain.entries[i].data_length, ptr,
+                        out.get() + outSize, rc);
+        if (rc != ErrorCode::OK ||
+                !responseLeft(ptr, out.get() + outSize,
+                        kmCertChain.entries[i].data_length, rc)) {
+            ALOGE("Failed to deserialize cert chain from TA");
+            goto error;
+        }
         perm = new (std::nothrow) uint8_t[kmCertChain.entries[i].data_length];
         if (!perm) {
             ALOGE("Failed to allocate memory on certificate chain deserialization");
@@ -638,18 +770,24 @@ Return<void>  OpteeKeymasterDevice::attestKey(const hidl_vec<uint8_t> &keyToAtte
     resultCertChain = kmCertChain2Hidl(&kmCertChain);
 
 error:
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultCertChain);
 
-    if (rc == ErrorCode::OK)
-        keymaster_free_cert_chain(&kmCertChain);
+    keymaster_free_cert_chain(&kmCertChain);
 
+    if (record.trace().needsKeyDescription())
+        traceKey(record.trace(), keyToAttest,
+                        findBlob(attestParams, Tag::APPLICATION_ID),
+                        findBlob(attestParams, Tag::APPLICATION_DATA));
     return Void();
 }
 
 Return<void>  OpteeKeymasterDevice::upgradeKey(const hidl_vec<uint8_t> &keyBlobToUpgrade,
                         const hidl_vec<KeyParameter> &upgradeParams,
                         upgradeKey_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::UPGRADE_KEY);
     ErrorCode rc = ErrorCode::OK;
     hidl_vec<uint8_t> resultKeyBlob;
     keymaster_key_blob_t kmKeyBlob{nullptr, 0};
@@ -661,6 +799,8 @@ Return<void>  OpteeKeymasterDevice::upgradeKey(const hidl_vec<uint8_t> &keyBlobT
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().key(keyBlobToUpgrade);
+    record.trace().params(upgradeParams);
     if (!checkConnection(rc))
         goto error;
     memset(out.get(), 0, outSize);
@@ -672,13 +812,14 @@ Return<void>  OpteeKeymasterDevice::upgradeKey(const hidl_vec<uint8_t> &keyBlobT
     ptr += serializeParamSet(ptr, kmUpgradeParams);
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_UPGRADE_KEY, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_UPGRADE_KEY, in.get(), ptr - in.get(),
+            out.get(), outSize));
     if (rc != ErrorCode::OK) {
         ALOGE("Upgrade key failed with code %d [%x]", rc, rc);
         goto error;
     }
 
-    deserializeKeyBlob(kmKeyBlob, out.get(), rc);
+    deserializeKeyBlob(kmKeyBlob, out.get(), out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize key blob");
         goto error;
@@ -687,24 +828,36 @@ Return<void>  OpteeKeymasterDevice::upgradeKey(const hidl_vec<uint8_t> &keyBlobT
     resultKeyBlob = kmBlob2hidlVec(kmKeyBlob);
 
 error:
+    record.trace().newKey(resultKeyBlob);
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultKeyBlob);
 
     if (kmKeyBlob.key_material)
         free(const_cast<uint8_t *>(kmKeyBlob.key_material));
 
+    if (record.trace().needsKeyDescription())
+        traceKey(record.trace(), keyBlobToUpgrade,
+                        findBlob(upgradeParams, Tag::APPLICATION_ID),
+                        findBlob(upgradeParams, Tag::APPLICATION_DATA));
     return Void();
 }
 
 Return<ErrorCode>  OpteeKeymasterDevice::deleteKey(const hidl_vec<uint8_t> &keyBlob) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::DELETE_KEY);
     ErrorCode rc = ErrorCode::OK;
     keymaster_key_blob_t kmKeyBlob = hidlVec2KmKeyBlob(keyBlob);
     int inSize = getKeyBlobSize(kmKeyBlob);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
+    record.trace().key(keyBlob);
+    record.trace().deletedKey(keyBlob);
+    pubkey_cache_.erase(PublicKeyCache::hashBlob(keyBlob));
     if (!checkConnection(rc))
         goto error;
     memset(in.get(), 0, inSize);
-    serializeData(in.get(), kmKeyBlob.key_material_size, kmKeyBlob.key_material,
+    inSize = serializeData(in.get(), kmKeyBlob.key_material_size,
+                        kmKeyBlob.key_material,
                         SIZE_OF_ITEM(kmKeyBlob.key_material));
 
     rc = legacy_enum_conversion(
@@ -721,11 +874,15 @@ Return<ErrorCode>  OpteeKeymasterDevice::deleteKey(const hidl_vec<uint8_t> &keyB
     if (rc != ErrorCode::OK)
         ALOGE("Attest key failed with code %d [%x]", rc, rc);
 error:
+    record.done(rc);
     return rc;
 }
 
 Return<ErrorCode> OpteeKeymasterDevice::deleteAllKeys() {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::DELETE_ALL_KEYS);
     ErrorCode rc = ErrorCode::OK;
+    pubkey_cache_.clear();
     if (!checkConnection(rc))
         goto error;
     rc = legacy_enum_conversion(
@@ -733,18 +890,24 @@ Return<ErrorCode> OpteeKeymasterDevice::deleteAllKeys() {
     if (rc != ErrorCode::OK)
         ALOGE("Delete all keys failed with code %d [%x]", rc, rc);
 error:
+    record.done(rc);
     return rc;
 }
 
 Return<ErrorCode> OpteeKeymasterDevice::destroyAttestationIds() {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::DESTROY_ATTESTATION_IDS);
     ErrorCode rc = ErrorCode::OK;
-    if (!checkConnection(rc))
-        return rc;
-    return ErrorCode::UNIMPLEMENTED;
+    if (checkConnection(rc))
+        rc = ErrorCode::UNIMPLEMENTED;
+    record.done(rc);
+    return rc;
 }
 
 Return<void> OpteeKeymasterDevice::begin(KeyPurpose purpose, const hidl_vec<uint8_t> &key,
                    const hidl_vec<KeyParameter> &inParams, begin_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::BEGIN);
     ErrorCode rc = ErrorCode::OK;
     hidl_vec<KeyParameter> resultParams;
     uint64_t resultOpHandle = 0;
@@ -758,23 +921,28 @@ Return<void> OpteeKeymasterDevice::begin(KeyPurpose purpose, const hidl_vec<uint
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().value("purpose", static_cast<uint32_t>(purpose));
+    record.trace().key(key);
+    record.trace().params(inParams);
     if (!checkConnection(rc))
         goto error;
     if (kmKey.key_material == nullptr) {
         rc = ErrorCode::UNEXPECTED_NULL_POINTER;
         goto error;
     }
+    if (beginPublicKeyOperation(purpose, key, inParams, resultOpHandle))
+        goto out;
     memset(out.get(), 0, outSize);
     memset(in.get(), 0, inSize);
     ptr = in.get();
-    memcpy(ptr, &kmPurpose, sizeof(kmPurpose));
-    ptr += sizeof(kmPurpose);
+    ptr += serializeEnum(ptr, kmPurpose);
     ptr += serializeData(ptr, kmKey.key_material_size, kmKey.key_material,
         SIZE_OF_ITEM(kmKey.key_material));
     ptr += serializeParamSetWithPresence(ptr, kmInParams);
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_BEGIN, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_BEGIN, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Begin failed with code %d [%x]", rc, rc);
@@ -782,52 +950,57 @@ Return<void> OpteeKeymasterDevice::begin(KeyPurpose purpose, const hidl_vec<uint
     }
 
     ptr = out.get();
-    ptr += deserializeParamSet(kmOutParams, ptr, rc);
+    ptr += deserializeParamSet(kmOutParams, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize param set from TA");
         goto error;
     }
+    if (!responseLeft(ptr, out.get() + outSize, sizeof(resultOpHandle), rc))
+        goto error;
     memcpy(&resultOpHandle, ptr, sizeof(resultOpHandle));
 
     resultParams = kmParamSet2Hidl(kmOutParams);
 
+out:
 error:
+    if (rc == ErrorCode::OK)
+        record.trace().newOperation(resultOpHandle);
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultParams, resultOpHandle);
 
     keymaster_free_param_set(&kmOutParams);
 
+    if (record.trace().needsKeyDescription())
+        traceKey(record.trace(), key, findBlob(inParams, Tag::APPLICATION_ID),
+                        findBlob(inParams, Tag::APPLICATION_DATA));
     return Void();
 }
 
-Return<void> OpteeKeymasterDevice::update(uint64_t operationHandle, const hidl_vec<KeyParameter> &inParams,
-                    const hidl_vec<uint8_t> &input, update_cb _hidl_cb) {
+ErrorCode OpteeKeymasterDevice::updateChunk(uint64_t operationHandle,
+                    const KmParamSet &kmInParams, const keymaster_blob_t &kmInputBlob,
+                    size_t &consumed, std::vector<uint8_t> &output,
+                    hidl_vec<KeyParameter> &resultParams) {
     ErrorCode rc = ErrorCode::OK;
-    uint32_t resultConsumed = 0;
-    hidl_vec<KeyParameter> resultParams;
-    hidl_vec<uint8_t> resultBlob;
-    size_t consumed = 0;
     KmParamSet kmOutParams;
-    KmParamSet kmInParams = hidlParams2KmParamSet(inParams);
     keymaster_blob_t kmOutBlob{nullptr, 0};
-    keymaster_blob_t kmInputBlob = hidlVec2KmBlob(input);
     int outSize = recv_buf_size_;
     int inSize = sizeof(operationHandle) + getBlobSize(kmInputBlob) +
             sizeof(presence) + getParamSetSize(kmInParams);
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
-    if (!checkConnection(rc))
-        goto error;
+
     memset(out.get(), 0, outSize);
     memset(in.get(), 0, inSize);
     ptr = in.get();
-    ptr += serializeSize(ptr, operationHandle);
+    ptr += serializeOpHandle(ptr, operationHandle);
     ptr += serializeParamSetWithPresence(ptr, kmInParams);
     ptr += serializeData(ptr, kmInputBlob.data_length, kmInputBlob.data,
                         SIZE_OF_ITEM(kmInputBlob.data));
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_UPDATE, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_UPDATE, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Update failed with code %d [%x]", rc, rc);
@@ -835,37 +1008,112 @@ Return<void> OpteeKeymasterDevice::update(uint64_t operationHandle, const hidl_v
     }
 
     ptr = out.get();
-    memcpy(&consumed, ptr, sizeof(consumed));
-    ptr += sizeof(consumed);
-    ptr += deserializeBlob(kmOutBlob, ptr, rc);
+    ptr += deserializeSize(consumed, ptr, out.get() + outSize, rc);
+    if (rc != ErrorCode::OK) {
+        ALOGE("Failed to deserialize consumed size from TA");
+        goto error;
+    }
+    ptr += deserializeBlob(kmOutBlob, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize blob from TA");
         goto error;
     }
-    ptr += deserializeParamSet(kmOutParams, ptr, rc);
+    ptr += deserializeParamSet(kmOutParams, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize param set from TA");
         goto error;
     }
 
-    resultConsumed = consumed;
+    output.insert(output.end(), kmOutBlob.data,
+            kmOutBlob.data + kmOutBlob.data_length);
     resultParams = kmParamSet2Hidl(kmOutParams);
-    resultBlob = kmBlob2hidlVec(kmOutBlob);
 
 error:
-    //send results off to the client
-    _hidl_cb(rc, resultConsumed, resultParams, resultBlob);
-
     keymaster_free_param_set(&kmOutParams);
     if (kmOutBlob.data)
         free(const_cast<uint8_t *>(kmOutBlob.data));
 
+    return rc;
+}
+
+Return<void> OpteeKeymasterDevice::update(uint64_t operationHandle, const hidl_vec<KeyParameter> &inParams,
+                    const hidl_vec<uint8_t> &input, update_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::UPDATE);
+    ErrorCode rc = ErrorCode::OK;
+    uint32_t resultConsumed = 0;
+    hidl_vec<KeyParameter> resultParams;
+    hidl_vec<uint8_t> resultBlob;
+    std::vector<uint8_t> output;
+    size_t consumed = 0;
+    size_t chunk = 0;
+    size_t offset = 0;
+    KmParamSet kmInParams = hidlParams2KmParamSet(inParams);
+    KmParamSet kmNextParams = hidlParams2KmParamSet(
+            removeAssociatedData(inParams));
+    keymaster_blob_t kmInputBlob = hidlVec2KmBlob(input);
+    std::shared_ptr<PublicKeyOperation> pubkeyOp =
+            findPublicKeyOperation(operationHandle);
+    record.trace().operation(operationHandle);
+    record.trace().params(inParams);
+    record.trace().size("in", input.size());
+    if (pubkeyOp) {
+        rc = pubkeyOp->update(input, resultConsumed);
+        if (rc != ErrorCode::OK)
+            erasePublicKeyOperation(operationHandle);
+        goto error;
+    }
+    if (!checkConnection(rc))
+        goto error;
+
+    /*
+     * Large input is passed to the TA by chunks which fit in shared
+     * memory and TA heap, output of all chunks is returned at once.
+     * The TA may consume less than a chunk, the rest is sent again.
+     */
+    do {
+        chunk = std::min(kmInputBlob.data_length - offset,
+                static_cast<size_t>(KM_MAX_UPDATE_CHUNK));
+        consumed = 0;
+        rc = updateChunk(operationHandle,
+                offset == 0 ? kmInParams : kmNextParams,
+                {kmInputBlob.data + offset, chunk}, consumed, output,
+                resultParams);
+        if (rc != ErrorCode::OK)
+            goto error;
+        if (consumed > chunk) {
+            ALOGE("TA consumed %zu bytes of a %zu byte chunk", consumed, chunk);
+            rc = ErrorCode::UNKNOWN_ERROR;
+            /* The TA update succeeded, so the operation is still there */
+            abort(operationHandle);
+            goto error;
+        }
+        offset += consumed;
+    } while (consumed != 0 && offset < kmInputBlob.data_length);
+
+    resultConsumed = offset;
+    resultBlob.setToExternal(output.data(), output.size());
+
+error:
+    if (rc != ErrorCode::OK) {
+        resultParams = hidl_vec<KeyParameter>();
+        /* Failed update aborts the operation */
+        record.trace().endOperation(operationHandle);
+    }
+    record.trace().size("consumed", resultConsumed);
+    record.trace().size("out", resultBlob.size());
+    record.done(rc);
+    //send results off to the client
+    _hidl_cb(rc, resultConsumed, resultParams, resultBlob);
+
     return Void();
 }
 
 Return<void>  OpteeKeymasterDevice::finish(uint64_t operationHandle, const hidl_vec<KeyParameter> &inParams,
                     const hidl_vec<uint8_t> &input, const hidl_vec<uint8_t> &signature,
                     finish_cb _hidl_cb) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::FINISH);
     ErrorCode rc = ErrorCode::OK;
     hidl_vec<KeyParameter> resultParams;
     hidl_vec<uint8_t> resultBlob;
@@ -874,6 +1122,9 @@ Return<void>  OpteeKeymasterDevice::finish(uint64_t operationHandle, const hidl_
     keymaster_blob_t kmOutBlob{nullptr, 0};
     keymaster_blob_t kmInput = hidlVec2KmBlob(input);
     keymaster_blob_t kmSignature = hidlVec2KmBlob(signature);
+    std::vector<uint8_t> output;
+    std::shared_ptr<PublicKeyOperation> pubkeyOp =
+            findPublicKeyOperation(operationHandle);
     int outSize = recv_buf_size_;
     int inSize = sizeof(operationHandle) +
             sizeof(presence) + getBlobSize(kmSignature) +
@@ -882,17 +1133,29 @@ Return<void>  OpteeKeymasterDevice::finish(uint64_t operationHandle, const hidl_
     std::unique_ptr<uint8_t[]> out(new uint8_t[outSize]);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
     uint8_t *ptr = nullptr;
+    record.trace().operation(operationHandle);
+    record.trace().endOperation(operationHandle);
+    record.trace().params(inParams);
+    record.trace().size("in", input.size());
+    record.trace().size("sig", signature.size());
+    if (pubkeyOp) {
+        erasePublicKeyOperation(operationHandle);
+        rc = pubkeyOp->finish(input, signature, output);
+        if (rc == ErrorCode::OK)
+            resultBlob.setToExternal(output.data(), output.size());
+        goto error;
+    }
     if (!checkConnection(rc))
         goto error;
     ptr = in.get();
-    memcpy(ptr, &operationHandle, sizeof(operationHandle));
-    ptr += sizeof(operationHandle);
+    ptr += serializeOpHandle(ptr, operationHandle);
     ptr += serializeParamSetWithPresence(ptr, kmInParams);
     ptr += serializeBlobWithPresenceInfo(ptr, kmInput, true);
     ptr += serializeBlobWithPresenceInfo(ptr, kmSignature, true);
 
     rc = legacy_enum_conversion(
-        optee_keystore_call(KM_FINISH, in.get(), inSize, out.get(), outSize));
+        optee_keystore_call(KM_FINISH, in.get(), ptr - in.get(),
+            out.get(), outSize));
 
     if (rc != ErrorCode::OK) {
         ALOGE("Finish failed with code %d [%x]", rc, rc);
@@ -900,12 +1163,12 @@ Return<void>  OpteeKeymasterDevice::finish(uint64_t operationHandle, const hidl_
     }
 
     ptr = out.get();
-    ptr += deserializeParamSet(kmOutParams, ptr, rc);
+    ptr += deserializeParamSet(kmOutParams, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed deserialize param set from TA");
         goto error;
     }
-    ptr += deserializeBlob(kmOutBlob, ptr, rc);
+    ptr += deserializeBlob(kmOutBlob, ptr, out.get() + outSize, rc);
     if (rc != ErrorCode::OK) {
         ALOGE("Failed to deserialize blob from TA");
         goto error;
@@ -915,6 +1178,8 @@ Return<void>  OpteeKeymasterDevice::finish(uint64_t operationHandle, const hidl_
     resultBlob = kmBlob2hidlVec(kmOutBlob);
 
 error:
+    record.trace().size("out", resultBlob.size());
+    record.done(rc);
     //send results off to the client
     _hidl_cb(rc, resultParams, resultBlob);
 
@@ -926,13 +1191,19 @@ error:
 }
 
 Return<ErrorCode>  OpteeKeymasterDevice::abort(uint64_t operationHandle) {
+    CallRecord record(stats_, trace_.get(), timeline_.get(),
+                    KeymasterStats::ABORT);
     ErrorCode rc = ErrorCode::OK;
     int inSize = sizeof(operationHandle);
     std::unique_ptr<uint8_t[]> in(new uint8_t[inSize]);
+    record.trace().operation(operationHandle);
+    record.trace().endOperation(operationHandle);
+    if (erasePublicKeyOperation(operationHandle))
+        goto error;
     if (!checkConnection(rc))
         goto error;
     memset(in.get(), 0, inSize);
-    memcpy(in.get(), &operationHandle, sizeof(operationHandle));
+    serializeOpHandle(in.get(), operationHandle);
     rc = legacy_enum_conversion(
         optee_keystore_call(KM_ABORT, in.get(), inSize, nullptr, 0));
 
@@ -940,9 +1211,389 @@ Return<ErrorCode>  OpteeKeymasterDevice::abort(uint64_t operationHandle) {
         ALOGE("Abort failed with code %d [%x]", rc, rc);
 
 error:
+    record.done(rc);
     return rc;
 }
 
+Return<void> OpteeKeymasterDevice::debug(const hidl_handle &fd,
+                    const hidl_vec<hidl_string> &options) {
+    const native_handle_t *handle = fd.getNativeHandle();
+    bool histograms = false;
+    bool reset = false;
+    bool help = false;
+    FILE *out = nullptr;
+    int outFd = -1;
+    km_stats_t ta;
+    km_heap_t heap;
+    std::vector<km_heap_event_t> events;
+    uint32_t heapFlags = 0;
+    uint32_t traceCmd = 0;
+
+    if (!handle || handle->numFds < 1)
+        return Void();
+    for (size_t i = 0; i < options.size(); i++) {
+        if (!strcmp(options[i].c_str(), "--histograms"))
+            histograms = true;
+        else if (!strcmp(options[i].c_str(), "--reset"))
+            reset = true;
+        else if (!strncmp(options[i].c_str(), "--heap-trace=", 13)) {
+            heapFlags |= KM_HEAP_TRACE;
+            traceCmd = KeymasterStats::taCommand(options[i].c_str() + 13);
+        } else
+            help = true;
+    }
+    if (reset)
+        heapFlags |= KM_HEAP_RESET;
+    outFd = dup(handle->data[0]);
+    if (outFd < 0 || !(out = fdopen(outFd, "w"))) {
+        ALOGE("Failed to open debug output");
+        if (outFd >= 0)
+            close(outFd);
+        return Void();
+    }
+    if (help) {
+        fprintf(out, "usage: lshal debug <instance> [--histograms] [--reset]"
+                " [--heap-trace=<command>]\n"
+                "  --histograms  print latency histograms of every phase\n"
+                "  --reset       start counting over after the dump, "
+                "in the TA too\n"
+                "  --heap-trace  record TA heap use of each call of a command,"
+                " given as KM_ name\n"
+                "                or id, until --heap-trace=0. Recorded "
+                "calls are printed by each dump\n");
+    } else {
+        stats_.dump(out, histograms);
+        if (reset)
+            stats_.reset();
+        if (getTaStats(ta, reset))
+            KeymasterStats::dumpTa(out, ta);
+        if (getTaHeap(heap, &events, heapFlags, traceCmd))
+            KeymasterStats::dumpTaHeap(out, heap, events.data());
+    }
+    fclose(out);
+    return Void();
+}
+
+void OpteeKeymasterDevice::saveStats() {
+    uint64_t calls = stats_.calls();
+    km_stats_t ta;
+    km_heap_t heap;
+
+    if (stats_path_.empty() || calls == stats_saved_calls_)
+        return;
+    if (stats_.save(stats_path_.c_str(),
+                    getTaStats(ta, false) ? &ta : nullptr,
+                    getTaHeap(heap, nullptr, 0, 0) ? &heap : nullptr))
+        stats_saved_calls_ = calls;
+}
+
+bool OpteeKeymasterDevice::getTaStats(km_stats_t &ta, bool reset) {
+    ErrorCode rc = ErrorCode::OK;
+    uint32_t flags = reset ? KM_STATS_RESET : 0;
+
+    if (!is_connected_ ||
+            !(optee_keystore_capabilities() & KM_CAP_STATS))
+        return false;
+    rc = legacy_enum_conversion(
+        optee_keystore_call(KM_GET_STATS, &flags, sizeof(flags),
+            &ta, sizeof(ta)));
+    if (rc != ErrorCode::OK) {
+        ALOGE("Reading TA statistics failed with code %d [%x]", rc, rc);
+        return false;
+    }
+    if (ta.version != KM_STATS_VERSION) {
+        ALOGE("Unsupported TA statistics version %u", ta.version);
+        return false;
+    }
+    return true;
+}
+
+bool OpteeKeymasterDevice::getTaHeap(km_heap_t &heap,
+                    std::vector<km_heap_event_t> *events,
+                    uint32_t flags, uint32_t cmd) {
+    ErrorCode rc = ErrorCode::OK;
+    uint32_t in[2] = {flags, cmd};
+    std::vector<uint8_t> out(sizeof(heap) +
+                    (events ? KM_HEAP_EVENTS * sizeof(km_heap_event_t) : 0));
+
+    if (!is_connected_ ||
+            !(optee_keystore_capabilities() & KM_CAP_HEAP))
+        return false;
+    rc = legacy_enum_conversion(
+        optee_keystore_call(KM_GET_HEAP_STATS, in, sizeof(in),
+            out.data(), out.size()));
+    if (rc != ErrorCode::OK) {
+        ALOGE("Reading TA heap statistics failed with code %d [%x]", rc, rc);
+        return false;
+    }
+    memcpy(&heap, out.data(), sizeof(heap));
+    if (heap.version != KM_HEAP_VERSION ||
+            heap.events > (out.size() - sizeof(heap)) / sizeof(km_heap_event_t)) {
+        ALOGE("Unsupported TA heap statistics version %u", heap.version);
+        return false;
+    }
+    if (events) {
+        events->resize(heap.events);
+        memcpy(events->data(), out.data() + sizeof(heap),
+                    heap.events * sizeof(km_heap_event_t));
+    }
+    return true;
+}
+
+void OpteeKeymasterDevice::noteActivity() {
+    {
+        std::lock_guard<std::mutex> lock(maintenance_mutex_);
+        last_activity_ = std::chrono::steady_clock::now();
+        maintenance_pending_ = true;
+    }
+    maintenance_cv_.notify_one();
+}
+
+/*
+ * Every request postpones maintenance by maintenance_idle_delay_. The TA
+ * serves one command at a time, so each maintenance call does a bounded
+ * piece of work and the loop checks for requests again after it.
+ */
+void OpteeKeymasterDevice::maintenanceLoop() {
+    std::unique_lock<std::mutex> lock(maintenance_mutex_);
+    std::chrono::steady_clock::time_point started;
+    bool provisioned = false;
+    bool more = false;
+
+    if (!maintenance_stop_) {
+        lock.unlock();
+        provisioned = provisionAttestation();
+        lock.lock();
+        provisioned_ = provisioned;
+    }
+    provision_done_ = true;
+    provision_cv_.notify_all();
+
+    while (!maintenance_stop_) {
+        if (!maintenance_pending_) {
+            maintenance_cv_.wait(lock);
+            continue;
+        }
+        if (std::chrono::steady_clock::now() <
+                last_activity_ + maintenance_idle_delay_) {
+            maintenance_cv_.wait_until(lock,
+                    last_activity_ + maintenance_idle_delay_);
+            continue;
+        }
+        started = last_activity_;
+        lock.unlock();
+        saveStats();
+        more = refillKeyPool();
+        lock.lock();
+        if (!more && last_activity_ == started)
+            maintenance_pending_ = false;
+    }
+}
+
+bool OpteeKeymasterDevice::refillKeyPool() {
+    ErrorCode rc = ErrorCode::OK;
+    uint32_t missing = 0;
+
+    if (!is_connected_ ||
+            !(optee_keystore_capabilities() & KM_CAP_KEY_POOL))
+        return false;
+    rc = legacy_enum_conversion(
+        optee_keystore_call(KM_REFILL_KEY_POOL, nullptr, 0,
+            &missing, sizeof(missing)));
+    if (rc != ErrorCode::OK) {
+        ALOGE("Key pool refill failed with code %d [%x]", rc, rc);
+        return false;
+    }
+    return missing != 0;
+}
+
+/* Returns false only if the TA failed to provision */
+bool OpteeKeymasterDevice::provisionAttestation() {
+    ErrorCode rc = ErrorCode::OK;
+    uint32_t state = KM_PROVISION_NOT_READY;
+
+    if (!is_connected_ ||
+            !(optee_keystore_capabilities() & KM_CAP_PROVISION))
+        return true;
+    rc = legacy_enum_conversion(
+        optee_keystore_call(KM_PROVISION, nullptr, 0,
+            &state, sizeof(state)));
+    if (rc != ErrorCode::OK || state != KM_PROVISION_READY) {
+        ALOGE("Attestation provisioning failed with code %d [%x]", rc, rc);
+        return false;
+    }
+    ALOGV("Attestation material is provisioned");
+    return true;
+}
+
+/*
+ * attestKey must not reach the TA before provisioning has finished.
+ * Failed provisioning is retried here, so attestKey can still succeed.
+ */
+void OpteeKeymasterDevice::waitProvisioned() {
+    std::unique_lock<std::mutex> lock(maintenance_mutex_);
+    bool provisioned = false;
+
+    provision_cv_.wait(lock, [this] { return provision_done_; });
+    if (provisioned_)
+        return;
+    lock.unlock();
+    provisioned = provisionAttestation();
+    lock.lock();
+    provisioned_ = provisioned;
+}
+
+void OpteeKeymasterDevice::traceKey(TraceRecord &record,
+                    const hidl_vec<uint8_t> &key,
+                    const hidl_vec<uint8_t> &clientId,
+                    const hidl_vec<uint8_t> &appData) {
+    if (!record.needsKeyDescription())
+        return;
+    /* Nested call, it is not traced itself */
+    getKeyCharacteristics(key, clientId, appData,
+            [&](ErrorCode error, const KeyCharacteristics &characteristics) {
+        size_t teeSize = characteristics.teeEnforced.size();
+        size_t swSize = characteristics.softwareEnforced.size();
+        hidl_vec<KeyParameter> all;
+
+        if (error != ErrorCode::OK)
+            return;
+        all.resize(teeSize + swSize);
+        for (size_t i = 0; i < teeSize; i++)
+            all[i] = characteristics.teeEnforced[i];
+        for (size_t i = 0; i < swSize; i++)
+            all[teeSize + i] = characteristics.softwareEnforced[i];
+        record.describeKey(all, clientId.size(), appData.size());
+    });
+}
+
+bool OpteeKeymasterDevice::fetchPublicKey(const hidl_vec<uint8_t> &key,
+                    const hidl_vec<uint8_t> &clientId,
+                    const hidl_vec<uint8_t> &appData, PublicKeyEntry &entry) {
+    ErrorCode rc = ErrorCode::UNKNOWN_ERROR;
+    uint32_t version = 0;
+    uint32_t patchlevel = 0;
+
+    getKeyCharacteristics(key, clientId, appData,
+            [&](ErrorCode error, const KeyCharacteristics &characteristics) {
+        size_t teeSize = characteristics.teeEnforced.size();
+        size_t swSize = characteristics.softwareEnforced.size();
+
+        rc = error;
+        if (rc != ErrorCode::OK)
+            return;
+        entry.authorizations.resize(teeSize + swSize);
+        for (size_t i = 0; i < teeSize; i++)
+            entry.authorizations[i] = characteristics.teeEnforced[i];
+        for (size_t i = 0; i < swSize; i++)
+            entry.authorizations[teeSize + i] = characteristics.softwareEnforced[i];
+    });
+    if (rc != ErrorCode::OK)
+        return false;
+
+    osVersion(&version);
+    osPatchlevel(&patchlevel);
+    if (!PublicKeyCache::isUsable(entry.authorizations, version, patchlevel))
+        return true;
+
+    exportKey(KeyFormat::X509, key, clientId, appData,
+            [&](ErrorCode error, const hidl_vec<uint8_t> &keyData) {
+        const uint8_t *ptr = keyData.data();
+
+        if (error == ErrorCode::OK)
+            entry.key.reset(d2i_PUBKEY(nullptr, &ptr, keyData.size()));
+    });
+    return true;
+}
+
+bool OpteeKeymasterDevice::beginPublicKeyOperation(KeyPurpose purpose,
+                    const hidl_vec<uint8_t> &key,
+                    const hidl_vec<KeyParameter> &inParams,
+                    uint64_t &operationHandle) {
+    PublicKeyEntry entry;
+    hidl_vec<uint8_t> clientId;
+    hidl_vec<uint8_t> appData;
+    hidl_vec<KeyParameter> authorizations;
+    bssl::UniquePtr<EVP_PKEY> pkey;
+    std::shared_ptr<PublicKeyOperation> op;
+    uint64_t handle = 0;
+
+    if (purpose != KeyPurpose::VERIFY && purpose != KeyPurpose::ENCRYPT)
+        return false;
+    for (size_t i = 0; i < inParams.size(); i++) {
+        if (inParams[i].tag == Tag::APPLICATION_ID)
+            clientId = inParams[i].blob;
+        else if (inParams[i].tag == Tag::APPLICATION_DATA)
+            appData = inParams[i].blob;
+    }
+
+    /*
+     * Characteristics and public key are requested from the TA once per
+     * key blob, the TA also checks the blob and its binding this way
+     */
+    entry.blobHash = PublicKeyCache::hashBlob(key);
+    entry.bindingHash = PublicKeyCache::hashBinding(clientId, appData);
+    if (!pubkey_cache_.find(entry.blobHash, entry.bindingHash,
+                    pkey, authorizations)) {
+        if (!fetchPublicKey(key, clientId, appData, entry))
+            return false;
+        if (entry.key) {
+            EVP_PKEY_up_ref(entry.key.get());
+            pkey.reset(entry.key.get());
+        }
+        authorizations = entry.authorizations;
+        pubkey_cache_.insert(std::move(entry));
+    }
+    if (!pkey)
+        return false;
+
+    op = PublicKeyOperation::create(purpose, pkey.get(), authorizations,
+                    inParams);
+    if (!op)
+        return false;
+
+    std::lock_guard<std::mutex> lock(pubkey_ops_mutex_);
+    do {
+        if (RAND_bytes(reinterpret_cast<uint8_t *>(&handle),
+                        sizeof(handle)) != 1)
+            return false;
+    } while (handle == 0 || pubkey_ops_.count(handle));
+    /* Operations abandoned by clients would hold the table forever */
+    if (pubkey_ops_.size() >= max_pubkey_ops_)
+        evictPublicKeyOperation();
+    pubkey_ops_[handle] = {op, ++pubkey_ops_clock_};
+    operationHandle = handle;
+    return true;
+}
+
+std::shared_ptr<PublicKeyOperation> OpteeKeymasterDevice::findPublicKeyOperation(
+                    uint64_t operationHandle) {
+    std::lock_guard<std::mutex> lock(pubkey_ops_mutex_);
+    auto it = pubkey_ops_.find(operationHandle);
+
+    if (it == pubkey_ops_.end())
+        return nullptr;
+    it->second.lastUse = ++pubkey_ops_clock_;
+    return it->second.op;
+}
+
+bool OpteeKeymasterDevice::erasePublicKeyOperation(uint64_t operationHandle) {
+    std::lock_guard<std::mutex> lock(pubkey_ops_mutex_);
+
+    return pubkey_ops_.erase(operationHandle) != 0;
+}
+
+void OpteeKeymasterDevice::evictPublicKeyOperation() {
+    auto oldest = pubkey_ops_.begin();
+
+    for (auto it = pubkey_ops_.begin(); it != pubkey_ops_.end(); ++it) {
+        if (it->second.lastUse < oldest->second.lastUse)
+            oldest = it;
+    }
+    pubkey_ops_.erase(oldest);
+    stats_.addPublicKeyEviction();
+}
+
 bool OpteeKeymasterDevice::connect() {
     if (is_connected_) {
         ALOGE("Keymaster device is already connected");
@@ -969,6 +1620,7 @@ void OpteeKeymasterDevice::disconnect() {
 }
 
 bool OpteeKeymasterDevice::checkConnection(ErrorCode &rc) {
+    noteActivity();
     if (!is_connected_) {
         ALOGE("Keymaster is not connected");
         rc = ErrorCode::SECURE_HW_COMMUNICATION_FAILED;
@@ -976,13 +1628,17 @@ bool OpteeKeymasterDevice::checkConnection(ErrorCode &rc) {
     return is_connected_;
 }
 
+/*
+ * Buffer sizes below are computed for wire format v1. They are upper bounds
+ * for v2, where every field is encoded in the same or smaller number of bytes.
+ */
 int OpteeKeymasterDevice::getParamSetBlobSize(const KmParamSet &paramSet) {
     int size = 0;
     for (size_t i = 0; i < paramSet.length; i++) {
         if (keymaster_tag_get_type(
                 paramSet.params[i].tag) == KM_BIGNUM ||
                 keymaster_tag_get_type(paramSet.params[i].tag) == KM_BYTES) {
-            size += paramSet.params[i].blob.data_length + sizeof(size_t);
+            size += paramSet.params[i].blob.data_length + SIZE_LENGTH;
         }
     }
     return size;
@@ -990,59 +1646,113 @@ int OpteeKeymasterDevice::getParamSetBlobSize(const KmParamSet &paramSet) {
 
 int OpteeKeymasterDevice::getParamSetSize(const KmParamSet &paramSet) {
     int size = 0;
-    size += getParamSetBlobSize(paramSet) + sizeof(paramSet.length) +
+    size += getParamSetBlobSize(paramSet) + SIZE_LENGTH +
         paramSet.length * SIZE_OF_ITEM(paramSet.params);
     return size;
 }
 
 int OpteeKeymasterDevice::getBlobSize(const keymaster_blob_t &blob) {
     int size = 0;
-    size += blob.data_length * SIZE_OF_ITEM(blob.data) + sizeof(size_t);
+    size += blob.data_length * SIZE_OF_ITEM(blob.data) + SIZE_LENGTH;
     return size;
 }
 
 int OpteeKeymasterDevice::getKeyBlobSize(const keymaster_key_blob_t &keyBlob) {
     int size = 0;
     size += keyBlob.key_material_size *
-        SIZE_OF_ITEM(keyBlob.key_material) + sizeof(size_t);
+        SIZE_OF_ITEM(keyBlob.key_material) + SIZE_LENGTH;
     return size;
 }
 
+bool OpteeKeymasterDevice::isWireV2() {
+    return optee_keystore_wire_version() >= KM_WIRE_VERSION_2;
+}
+
 /****************************************************************************
  *             Functions for serialization base KM types                    *
  ****************************************************************************/
 
 int OpteeKeymasterDevice::serializeData(uint8_t *dest, const size_t count,
                                     const uint8_t *source, const size_t objSize) {
-    memcpy(dest, &count, sizeof(count));
-    dest += sizeof(count);
+    uint8_t *start = dest;
+    dest += serializeSize(dest, count);
     memcpy(dest, source, count * objSize);
-    return sizeof(count) + count * objSize;
+    dest += count * objSize;
+    return dest - start;
 }
 
 int OpteeKeymasterDevice::serializeSize(uint8_t *dest, const size_t size) {
-    memcpy(dest, &size, sizeof(size));
-    return sizeof(size);
+    uint64_t value = size;
+    if (isWireV2())
+        return km_put_varint(dest, value);
+    memcpy(dest, &value, SIZE_LENGTH);
+    return SIZE_LENGTH;
+}
+
+int OpteeKeymasterDevice::serializeEnum(uint8_t *dest, const uint32_t value) {
+    if (isWireV2())
+        return km_put_varint(dest, value);
+    memcpy(dest, &value, sizeof(value));
+    return sizeof(value);
+}
+
+int OpteeKeymasterDevice::serializeOpHandle(uint8_t *dest,
+                const uint64_t operationHandle) {
+    memcpy(dest, &operationHandle, sizeof(operationHandle));
+    return sizeof(operationHandle);
+}
+
+int OpteeKeymasterDevice::serializeParam(uint8_t *dest,
+                const keymaster_key_param_t &param) {
+    uint8_t *start = dest;
+    if (!isWireV2()) {
+        memcpy(dest, &param, sizeof(param));
+        dest += sizeof(param);
+        if (keymaster_tag_get_type(param.tag) == KM_BIGNUM ||
+                keymaster_tag_get_type(param.tag) == KM_BYTES) {
+            dest += serializeData(dest, param.blob.data_length,
+                    param.blob.data, SIZE_OF_ITEM(param.blob.data));
+        }
+        return dest - start;
+    }
+    dest += km_put_varint(dest, param.tag);
+    switch (keymaster_tag_get_type(param.tag)) {
+    case KM_INVALID:
+        break;
+    case KM_BOOL:
+        *dest++ = param.boolean ? 1 : 0;
+        break;
+    case KM_BIGNUM:
+    case KM_BYTES:
+        dest += serializeData(dest, param.blob.data_length,
+                param.blob.data, SIZE_OF_ITEM(param.blob.data));
+        break;
+    case KM_ULONG:
+    case KM_ULONG_REP:
+    case KM_DATE:
+        dest += km_put_varint(dest, param.long_integer);
+        break;
+    default: /* KM_ENUM, KM_ENUM_REP, KM_UINT, KM_UINT_REP */
+        dest += km_put_varint(dest, param.integer);
+        break;
+    }
+    return dest - start;
 }
 
 int OpteeKeymasterDevice::serializeParamSet(uint8_t *dest,
                                 const KmParamSet &paramSet) {
     uint8_t *start = dest;
     dest += serializeSize(dest, paramSet.length);
-    for (size_t i = 0; i < paramSet.length; i++) {
-        memcpy(dest, &paramSet.params[i], SIZE_OF_ITEM(paramSet.params));
-        dest += SIZE_OF_ITEM(paramSet.params);
-        if (keymaster_tag_get_type(paramSet.params[i].tag) == KM_BIGNUM ||
-                keymaster_tag_get_type(paramSet.params[i].tag) == KM_BYTES) {
-                    dest += serializeData(dest, paramSet.params[i].blob.data_length,
-                    paramSet.params[i].blob.data,
-                    SIZE_OF_ITEM(paramSet.params[i].blob.data));
-        }
-    }
+    for (size_t i = 0; i < paramSet.length; i++)
+        dest += serializeParam(dest, paramSet.params[i]);
     return dest - start;
 }
 
 int OpteeKeymasterDevice::serializePresence(uint8_t *dest, const presence p) {
+    if (isWireV2()) {
+        *dest = (p == KM_POPULATED) ? 1 : 0;
+        return sizeof(uint8_t);
+    }
     memcpy(dest, &p, sizeof(presence));
     return sizeof(presence);
 }
@@ -1055,7 +1765,7 @@ int OpteeKeymasterDevice::serializeParamSetWithPresence(uint8_t *dest,
     return dest - start;
 }
 
-int OpteeKeymasterDevice::serializeBlobWithPresenceInfo(uint8_t *dest, 
+int OpteeKeymasterDevice::serializeBlobWithPresenceInfo(uint8_t *dest,
                     const keymaster_blob_t &blob, bool presence) {
     uint8_t *start = dest;
     if (presence) {
@@ -1065,31 +1775,45 @@ int OpteeKeymasterDevice::serializeBlobWithPresenceInfo(uint8_t *dest,
     } else {
         dest += serializePresence(dest, KM_NULL);
     }
-    return dest - start;                  
+    return dest - start;
 }
 
 int OpteeKeymasterDevice::serializeKeyFormat(uint8_t *dest,
                 const keymaster_key_format_t &keyFormat) {
-    memcpy(dest, &keyFormat, sizeof(keyFormat));
-    return sizeof(keyFormat);
+    return serializeEnum(dest, keyFormat);
 }
 
 /****************************************************************************
  *             Functions for deserialization base KM types                  *
  ****************************************************************************/
 
-int OpteeKeymasterDevice::deserializeSize(size_t &size, const uint8_t *source) {
-    memcpy(&size, source, sizeof(size));
-    return sizeof(size);
+int OpteeKeymasterDevice::deserializeSize(size_t &size, const uint8_t *source,
+                    const uint8_t *end, ErrorCode &rc) {
+    uint64_t value = 0;
+    int len = SIZE_LENGTH;
+
+    size = 0;
+    if (isWireV2()) {
+        len = responseVarint(value, source, end, rc);
+    } else {
+        if (!responseLeft(source, end, SIZE_LENGTH, rc))
+            return 0;
+        memcpy(&value, source, SIZE_LENGTH);
+    }
+    size = value;
+    return len;
 }
 
 int OpteeKeymasterDevice::deserializeKeyBlob(keymaster_key_blob_t &keyBlob,
-                                const uint8_t *source, ErrorCode &rc) {
+                                const uint8_t *source, const uint8_t *end,
+                                ErrorCode &rc) {
     size_t size = 0;
     uint8_t *material = nullptr;
     const uint8_t *start = source;
 
-    source += deserializeSize(size, source);
+    source += deserializeSize(size, source, end, rc);
+    if (rc != ErrorCode::OK || !responseLeft(source, end, size, rc))
+        goto error;
     keyBlob.key_material_size = size;
     material = new (std::nothrow) uint8_t[keyBlob.key_material_size];
     if (!material) {
@@ -1104,66 +1828,27 @@ error:
 }
 
 int OpteeKeymasterDevice::deserializeKeyCharacteristics(keymaster_key_characteristics_t &characteristics,
-                        const uint8_t *source, ErrorCode &rc) {
-    size_t size = 0;
+                        const uint8_t *source, const uint8_t *end,
+                        ErrorCode &rc) {
     const uint8_t *start = source;
 
-    source += deserializeSize(size, source);
-    characteristics.hw_enforced.length = size;
-    characteristics.hw_enforced.params =
-               new (std::nothrow) keymaster_key_param_t[characteristics.hw_enforced.length];
-    if (!characteristics.hw_enforced.params) {
-        rc = ErrorCode::MEMORY_ALLOCATION_FAILED;
-        goto error;
-    }
-    for (size_t i = 0; i < characteristics.hw_enforced.length; i++) {
-        memcpy(&characteristics.hw_enforced.params[i],
-            source, SIZE_OF_ITEM(characteristics.hw_enforced.params));
-            source += SIZE_OF_ITEM(characteristics.hw_enforced.params);
-        if (keymaster_tag_get_type(
-             characteristics.hw_enforced.params[i].tag) == KM_BIGNUM ||
-             keymaster_tag_get_type(characteristics.hw_enforced.params[i].tag)
-             == KM_BYTES) {
-            source += deserializeBlob(characteristics.hw_enforced.params[i].blob,
-                        source, rc);
-            if (rc != ErrorCode::OK)
-                    goto error;
-        }
-    }
-    memcpy(&characteristics.sw_enforced.length, source,
-                       sizeof(characteristics.sw_enforced.length));
-    source += sizeof(characteristics.sw_enforced.length);
-    characteristics.sw_enforced.params =
-               new (std::nothrow) keymaster_key_param_t[characteristics.sw_enforced.length];
-    if (!characteristics.sw_enforced.params) {
-        rc = ErrorCode::MEMORY_ALLOCATION_FAILED;
+    source += deserializeParamSet(characteristics.hw_enforced, source, end, rc);
+    if (rc != ErrorCode::OK)
         goto error;
-    }
-    for (size_t i = 0; i < characteristics.sw_enforced.length; i++) {
-        memcpy(&characteristics.sw_enforced.params[i], source,
-               SIZE_OF_ITEM(characteristics.sw_enforced.params));
-               source += SIZE_OF_ITEM(characteristics.sw_enforced.params);
-        if (keymaster_tag_get_type(
-             characteristics.sw_enforced.params[i].tag) == KM_BIGNUM ||
-             keymaster_tag_get_type(characteristics.sw_enforced.params[i].tag)
-             == KM_BYTES) {
-            source += deserializeBlob(characteristics.sw_enforced.params[i].blob,
-                            source, rc);
-            if (rc != ErrorCode::OK)
-                    goto error;
-        }
-    }
+    source += deserializeParamSet(characteristics.sw_enforced, source, end, rc);
 error:
     return source - start;
 }
 
 int OpteeKeymasterDevice::deserializeBlob(keymaster_blob_t &blob,
-                    const uint8_t *source, ErrorCode &rc) {
+                    const uint8_t *source, const uint8_t *end, ErrorCode &rc) {
     size_t size = 0;
     uint8_t *data = nullptr;
     const uint8_t *start = source;
 
-    source += deserializeSize(size, source);
+    source += deserializeSize(size, source, end, rc);
+    if (rc != ErrorCode::OK || !responseLeft(source, end, size, rc))
+        goto error;
     blob.data_length = size;
     data = new (std::nothrow) uint8_t[blob.data_length];
     if (!data) {
@@ -1178,30 +1863,83 @@ error:
     return source - start;
 }
 
-int OpteeKeymasterDevice::deserializeParamSet(KmParamSet &params,
-                    const uint8_t *source, ErrorCode &rc) {
+int OpteeKeymasterDevice::deserializeParam(keymaster_key_param_t &param,
+                    const uint8_t *source, const uint8_t *end, ErrorCode &rc) {
+    uint64_t value = 0;
+    size_t len = 0;
+    const uint8_t *start = source;
+
+    if (!isWireV2()) {
+        if (!responseLeft(source, end, sizeof(param), rc))
+            return 0;
+        memcpy(&param, source, sizeof(param));
+        source += sizeof(param);
+        if (keymaster_tag_get_type(param.tag) == KM_BIGNUM ||
+                keymaster_tag_get_type(param.tag) == KM_BYTES) {
+            /* Pointer from the TA side, not ours to free */
+            param.blob.data = nullptr;
+            param.blob.data_length = 0;
+            source += deserializeBlob(param.blob, source, end, rc);
+        }
+        return source - start;
+    }
+    memset(&param, 0, sizeof(param));
+    len = responseVarint(value, source, end, rc);
+    if (!len)
+        goto error;
+    source += len;
+    param.tag = static_cast<keymaster_tag_t>(value);
+    switch (keymaster_tag_get_type(param.tag)) {
+    case KM_INVALID:
+        break;
+    case KM_BOOL:
+        if (!responseLeft(source, end, 1, rc))
+            goto error;
+        param.boolean = *source++ != 0;
+        break;
+    case KM_BIGNUM:
+    case KM_BYTES:
+        source += deserializeBlob(param.blob, source, end, rc);
+        break;
+    case KM_ULONG:
+    case KM_ULONG_REP:
+    case KM_DATE:
+        len = responseVarint(value, source, end, rc);
+        source += len;
+        param.long_integer = value;
+        break;
+    default: /* KM_ENUM, KM_ENUM_REP, KM_UINT, KM_UINT_REP */
+        len = responseVarint(value, source, end, rc);
+        source += len;
+        param.integer = static_cast<uint32_t>(value);
+        break;
+    }
+error:
+    return source - start;
+}
+
+int OpteeKeymasterDevice::deserializeParamSet(keymaster_key_param_set_t &params,
+                    const uint8_t *source, const uint8_t *end, ErrorCode &rc) {
     size_t size = 0;
     const uint8_t *start = source;
 
-    source += deserializeSize(size, source);
+    /* Every param takes at least a byte */
+    source += deserializeSize(size, source, end, rc);
+    if (rc != ErrorCode::OK || !responseLeft(source, end, size, rc))
+        goto error;
     params.length = size;
-    params.params = new (std::nothrow) keymaster_key_param_t[params.length];
+    /* Zeroed, so a param set read in part is freed safely */
+    params.params = new (std::nothrow) keymaster_key_param_t[params.length]();
     if (!params.params) {
         ALOGE("Failed to allocate memory for param set");
         rc = ErrorCode::MEMORY_ALLOCATION_FAILED;
         goto error;
     }
     for(size_t i = 0; i < params.length; i++) {
-        memcpy(&params.params[i], source, SIZE_OF_ITEM(params.params));
-        source += SIZE_OF_ITEM(params.params);
-        if (keymaster_tag_get_type(
-                params.params[i].tag) == KM_BIGNUM ||
-                keymaster_tag_get_type(params.params[i].tag) == KM_BYTES) {
-                    source += deserializeBlob(params.params[i].blob, source, rc);
-            if (rc != ErrorCode::OK) {
-                ALOGE("Failed to deserialize blob in param");
-                goto error;
-            }
+        source += deserializeParam(params.params[i], source, end, rc);
+        if (rc != ErrorCode::OK) {
+            ALOGE("Failed to deserialize blob in param");
+            goto error;
         }
     }
 error:
@@ -21,9 +21,27 @@
 #include <hidl/Status.h>
 
 #include <hidl/MQDescriptor.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <hardware/keymaster_defs.h>
 #include <common.h>
 
+#include "optee_keymaster_pubkey.h"
+#include "optee_keymaster_stats.h"
+#include "optee_keymaster_timeline.h"
+#include "optee_keymaster_trace.h"
+
+namespace keymaster_bench {
+class HalMarshalling;
+} // namespace keymaster_bench
+
 namespace android {
 namespace hardware {
 namespace keymaster {
@@ -40,6 +58,7 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_handle;
 using ::android::sp;
 
 class KmParamSet: public keymaster_key_param_set_t {
@@ -87,7 +106,14 @@ public:
                     finish_cb _hidl_cb) override;
     Return<ErrorCode> abort(uint64_t operationHandle) override;
 
+    /* lshal debug: dumps call statistics, see usage with --help */
+    Return<void> debug(const hidl_handle &fd,
+                    const hidl_vec<hidl_string> &options) override;
+
 private:
+    /* Marshalling microbenchmarks call (de)serializers directly */
+    friend class ::keymaster_bench::HalMarshalling;
+
     bool connect();
     void disconnect();
     bool checkConnection(ErrorCode &rc);
@@ -97,6 +123,9 @@ private:
     int getBlobSize(const keymaster_blob_t &blob);
     int getKeyBlobSize(const keymaster_key_blob_t &keyBlob);
 
+    /* Wire format negotiated with the TA on connection */
+    bool isWireV2();
+
     int osVersion(uint32_t *in);
     int osPatchlevel(uint32_t *in);
     int verifiedBootState(uint8_t *in);
@@ -105,6 +134,10 @@ private:
     int serializeData(uint8_t *dest, const size_t count,
 			const uint8_t *source, const size_t objSize);
     int serializeSize(uint8_t *dest, const size_t size);
+    int serializeEnum(uint8_t *dest, const uint32_t value);
+    int serializeOpHandle(uint8_t *dest, const uint64_t operationHandle);
+    int serializeParam(uint8_t *dest,
+			const keymaster_key_param_t &param);
     int serializeParamSet(uint8_t *dest,
 			const KmParamSet &paramSet);
     int serializePresence(uint8_t *dest, const presence p);
@@ -115,24 +148,110 @@ private:
     int serializeKeyFormat(uint8_t *dest,
 			const keymaster_key_format_t &keyFormat);
 
-    /*Deserializers*/
-    int deserializeSize(size_t &size, const uint8_t *source);
+    /*
+     * Deserializers, end is the end of the response buffer. Input running
+     * past it sets rc to UNKNOWN_ERROR.
+     */
+    int deserializeSize(size_t &size, const uint8_t *source,
+			const uint8_t *end, ErrorCode &rc);
     int deserializeKeyBlob(keymaster_key_blob_t &keyBlob,
-			const uint8_t *source, ErrorCode &rc);
+			const uint8_t *source, const uint8_t *end, ErrorCode &rc);
     int deserializeBlob(keymaster_blob_t &blob,
-			const uint8_t *source, ErrorCode &rc);
+			const uint8_t *source, const uint8_t *end, ErrorCode &rc);
     int deserializeKeyCharacteristics(keymaster_key_characteristics_t &characteristics,
-			const uint8_t *source, ErrorCode &rc);
-    int deserializeParamSet(KmParamSet &params,
-			const uint8_t *source, ErrorCode &rc);
+			const uint8_t *source, const uint8_t *end, ErrorCode &rc);
+    int deserializeParam(keymaster_key_param_t &param,
+			const uint8_t *source, const uint8_t *end, ErrorCode &rc);
+    int deserializeParamSet(keymaster_key_param_set_t &params,
+			const uint8_t *source, const uint8_t *end, ErrorCode &rc);
+
+    /* One KM_UPDATE call, output is appended to output */
+    ErrorCode updateChunk(uint64_t operationHandle,
+			const KmParamSet &kmInParams,
+			const keymaster_blob_t &kmInputBlob, size_t &consumed,
+			std::vector<uint8_t> &output,
+			hidl_vec<KeyParameter> &resultParams);
+
+    /* VERIFY and ENCRYPT with public keys cached in normal world */
+    bool beginPublicKeyOperation(KeyPurpose purpose,
+			const hidl_vec<uint8_t> &key,
+			const hidl_vec<KeyParameter> &inParams,
+			uint64_t &operationHandle);
+    bool fetchPublicKey(const hidl_vec<uint8_t> &key,
+			const hidl_vec<uint8_t> &clientId,
+			const hidl_vec<uint8_t> &appData, PublicKeyEntry &entry);
+    std::shared_ptr<PublicKeyOperation> findPublicKeyOperation(
+			uint64_t operationHandle);
+    bool erasePublicKeyOperation(uint64_t operationHandle);
+    /* Drops the least recently used one, pubkey_ops_mutex_ is held */
+    void evictPublicKeyOperation();
+
+    /* TA housekeeping done in background while HAL is idle */
+    void noteActivity();
+    void maintenanceLoop();
+    bool refillKeyPool();
+    /* Attestation material is created once at start, before idle work */
+    bool provisionAttestation();
+    void waitProvisioned();
 
-    bool is_connected_;
+    /* Describes a key first seen by the trace using its characteristics */
+    void traceKey(TraceRecord &record, const hidl_vec<uint8_t> &key,
+			const hidl_vec<uint8_t> &clientId,
+			const hidl_vec<uint8_t> &appData);
+
+    /* Writes the stats file if there were calls since it was last written */
+    void saveStats();
+    /* Reads KM_GET_STATS of the TA, false if it has none */
+    bool getTaStats(km_stats_t &ta, bool reset);
+    /*
+     * Reads KM_GET_HEAP_STATS of the TA with KM_HEAP_* flags, false if it
+     * has none. Events recorded in soak mode are moved to events.
+     */
+    bool getTaHeap(km_heap_t &heap, std::vector<km_heap_event_t> *events,
+			uint32_t flags, uint32_t cmd);
+
+    /* Read by the maintenance thread without holding a lock */
+    std::atomic<bool> is_connected_{false};
     /* This constant is used for precomuted outbuf size for keymaster functions.
      * There are no any strict rules for out memory size and we can't predict it
      * easily, but we suppose, that 100 kB will be suitable for keymaster needs.
      */
     const uint32_t recv_buf_size_ = 100 * 1024;
 
+    PublicKeyCache pubkey_cache_;
+    std::mutex pubkey_ops_mutex_;
+    /* Public key operation and the pubkey_ops_clock_ of its last use */
+    struct PublicKeyOperationSlot {
+        std::shared_ptr<PublicKeyOperation> op;
+        uint64_t lastUse;
+    };
+    std::map<uint64_t, PublicKeyOperationSlot> pubkey_ops_;
+    uint64_t pubkey_ops_clock_ = 0;
+    /* Same limit as for operations in the TA */
+    const size_t max_pubkey_ops_ = 20;
+
+    /* Set when vendor.keymaster.trace names a file */
+    std::unique_ptr<KeymasterTrace> trace_;
+
+    KeymasterStats stats_;
+    /* From vendor.keymaster.stats, the file is refreshed when idle */
+    std::string stats_path_;
+    uint64_t stats_saved_calls_ = 0;
+
+    /* Set when vendor.keymaster.timeline names a file */
+    std::unique_ptr<KeymasterTimeline> timeline_;
+
+    std::thread maintenance_thread_;
+    std::mutex maintenance_mutex_;
+    std::condition_variable maintenance_cv_;
+    std::chrono::steady_clock::time_point last_activity_;
+    bool maintenance_pending_ = true;
+    bool maintenance_stop_ = false;
+    const std::chrono::milliseconds maintenance_idle_delay_{3000};
+    std::condition_variable provision_cv_;
+    bool provision_done_ = false;
+    bool provisioned_ = false;
+
     const bool supports_symmetric_cryptography_ = true;
     const bool supports_attestation_ = true;
     const bool supports_ec_ = true;
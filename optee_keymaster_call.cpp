@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include "optee_keymaster_call.h"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+/* Depth of HAL calls on this thread, only the outermost one is recorded */
+static thread_local int callDepth = 0;
+
+CallRecord::CallRecord(KeymasterStats &stats, KeymasterTrace *trace,
+                    KeymasterTimeline *timeline, KeymasterStats::Method method)
+    : stats_(stats), method_(method), outer_(callDepth++ == 0),
+      trace_(outer_ ? trace : nullptr) {
+    if (!outer_)
+        return;
+    optee_keystore_get_call_times(&times_);
+    if (timeline) {
+        timeline_ = timeline;
+        timelineId_ = timeline->beginCall(&calls_);
+    }
+    startNs_ = optee_keystore_now_ns();
+}
+
+CallRecord::~CallRecord() {
+    uint64_t phaseNs[KeymasterStats::PHASE_COUNT];
+    const char *method = KeymasterStats::methodName(method_);
+    uint64_t work = 0;
+    uint64_t now = 0;
+
+    callDepth--;
+    if (!outer_)
+        return;
+    if (!done_)
+        done(rc_);
+    now = optee_keystore_now_ns();
+    work = doneNs_ - startNs_;
+    phaseNs[KeymasterStats::TOTAL] = now - startNs_;
+    phaseNs[KeymasterStats::QUEUE] = times_.queue_ns;
+    phaseNs[KeymasterStats::TEE] = times_.exec_ns;
+    phaseNs[KeymasterStats::MARSHAL] =
+        work > times_.queue_ns + times_.exec_ns ?
+        work - times_.queue_ns - times_.exec_ns : 0;
+    phaseNs[KeymasterStats::CALLBACK] = now - doneNs_;
+    stats_.add(method_, rc_, phaseNs);
+    trace_.write(method, startNs_, work, rc_);
+    if (timeline_) {
+        timeline_->endCall();
+        timeline_->writeCall(method, timelineId_, rc_, gettid(), startNs_,
+                    doneNs_, now, calls_);
+    }
+}
+
+void CallRecord::done(ErrorCode rc) {
+    struct optee_keystore_call_times times;
+
+    if (!outer_ || done_)
+        return;
+    doneNs_ = optee_keystore_now_ns();
+    optee_keystore_get_call_times(&times);
+    times_.queue_ns = times.queue_ns - times_.queue_ns;
+    times_.exec_ns = times.exec_ns - times_.exec_ns;
+    rc_ = rc;
+    done_ = true;
+}
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_CALL_H
+#define OPTEE_KEYMASTER_CALL_H
+
+#include <vector>
+
+#include "optee_keymaster_stats.h"
+#include "optee_keymaster_timeline.h"
+#include "optee_keymaster_trace.h"
+#include "optee_keymaster_ipc.h"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+
+/*
+ * One IKeymasterDevice call, timed once and reported on destruction to the
+ * stats, and to the trace and the timeline when they are on. Calls the HAL
+ * makes to itself while serving a call are part of the outer call, their
+ * TA time included.
+ */
+class CallRecord {
+public:
+    CallRecord(KeymasterStats &stats, KeymasterTrace *trace,
+                    KeymasterTimeline *timeline, KeymasterStats::Method method);
+    ~CallRecord();
+
+    /* Fields of the trace line, ignored unless the call is traced */
+    TraceRecord &trace() { return trace_; }
+    /* Ends the work of the call, the callback follows */
+    void done(ErrorCode rc);
+
+private:
+    KeymasterStats &stats_;
+    KeymasterTimeline *timeline_ = nullptr;
+    const KeymasterStats::Method method_;
+    const bool outer_;
+    ErrorCode rc_ = ErrorCode::OK;
+    bool done_ = false;
+    uint64_t startNs_ = 0;
+    uint64_t doneNs_ = 0;
+    /* Call times of the thread at the start, spent by the call once done */
+    struct optee_keystore_call_times times_ = {};
+    uint32_t timelineId_ = 0;
+    std::vector<optee_keystore_call_span> calls_;
+    TraceRecord trace_;
+};
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
+
+#endif /* OPTEE_KEYMASTER_CALL_H */
@@ -0,0 +1,90 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Backend calling entry points of the TA built against the host TEE API
+ * shim (ta/host). Memory references are passed as is, without copies.
+ */
+
+#include <log/log.h>
+#include <tee_internal_api.h>
+
+#include "optee_keymaster_transport.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+static void* sess_ctx = NULL;
+
+static bool inproc_open(void) {
+    TEE_Param params[TEE_NUM_PARAMS];
+    TEE_Result res;
+
+    memset(params, 0, sizeof(params));
+    res = TA_CreateEntryPoint();
+    if (res != TEE_SUCCESS) {
+        ALOGE("TA_CreateEntryPoint failed with code 0x%x", res);
+        return false;
+    }
+    res = TA_OpenSessionEntryPoint(TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+                                                   TEE_PARAM_TYPE_NONE,
+                                                   TEE_PARAM_TYPE_NONE,
+                                                   TEE_PARAM_TYPE_NONE),
+                                   params, &sess_ctx);
+    if (res != TEE_SUCCESS) {
+        ALOGE("TA_OpenSessionEntryPoint failed with code 0x%x", res);
+        TA_DestroyEntryPoint();
+        return false;
+    }
+    return true;
+}
+
+static void inproc_close(void) {
+    TA_CloseSessionEntryPoint(sess_ctx);
+    TA_DestroyEntryPoint();
+    sess_ctx = NULL;
+}
+
+static uint32_t inproc_invoke(uint32_t cmd, void* in, uint32_t in_size,
+                              void* out, uint32_t out_size,
+                              uint32_t trace_id, uint32_t trace_seq) {
+    TEE_Param params[TEE_NUM_PARAMS];
+
+    memset(params, 0, sizeof(params));
+    params[0].memref.buffer = in;
+    params[0].memref.size = in_size;
+    params[1].memref.buffer = out;
+    params[1].memref.size = out_size;
+    params[2].value.a = trace_id;
+    params[2].value.b = trace_seq;
+    return TA_InvokeCommandEntryPoint(sess_ctx, cmd,
+                                      TEE_PARAM_TYPES(
+                                          TEE_PARAM_TYPE_MEMREF_INPUT,
+                                          TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                          trace_id ?
+                                              TEE_PARAM_TYPE_VALUE_INPUT :
+                                              TEE_PARAM_TYPE_NONE,
+                                          TEE_PARAM_TYPE_NONE),
+                                      params);
+}
+
+const struct optee_keystore_transport optee_transport_inproc = {
+    .name = "inproc",
+    .open = inproc_open,
+    .close = inproc_close,
+    .invoke = inproc_invoke,
+};
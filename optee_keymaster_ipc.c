@@ -16,58 +16,113 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include <log/log.h>
-#include <tee_client_api.h>
 #include <hardware/keymaster2.h>
 
 #include "optee_keymaster_ipc.h"
+#include "optee_keymaster_transport.h"
 #include "common.h"
 
 #undef LOG_TAG
 #define LOG_TAG "OpteeKeymaster"
 
-static TEEC_Context ctx;
-static TEEC_Session sess;
+#ifndef KM_DEFAULT_TRANSPORT
+#define KM_DEFAULT_TRANSPORT optee_transport_teec
+#endif
+
+static const struct optee_keystore_transport* transport =
+        &KM_DEFAULT_TRANSPORT;
 static bool connected = false;
+static uint32_t wire_version = KM_WIRE_VERSION_1;
+static uint32_t capabilities = 0;
+/* HAL calls and idle maintenance may come from different threads */
+static pthread_mutex_t call_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct optee_keystore_call_times call_times;
+/* TA calls of a thread are tagged while it has a trace id */
+static __thread uint32_t trace_id;
+static __thread uint32_t trace_seq;
+static optee_keystore_trace_hook trace_hook = NULL;
 
-bool optee_keystore_connect(void) {
-    TEEC_Result res;
-    TEEC_UUID uuid = TA_KEYMASTER_UUID;
-    uint32_t err_origin;
+uint64_t optee_keystore_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Agrees on wire format with the TA. TA without KM_GET_VERSION support
+ * rejects the command, and version 1 format is used in that case.
+ */
+static void optee_keystore_handshake(void) {
+    uint32_t res;
+    uint32_t in[2] = {KM_WIRE_VERSION, KM_CAPABILITIES};
+    uint32_t out[2] = {KM_WIRE_VERSION_1, 0};
+
+    wire_version = KM_WIRE_VERSION_1;
+    capabilities = 0;
 
+    res = transport->invoke(KM_GET_VERSION, in, sizeof(in), out, sizeof(out),
+                            0, 0);
+    if (res != KM_ERROR_OK) {
+        ALOGI("Keystore TA does not support version exchange (0x%x), "
+              "falling back to wire format v%d", res, KM_WIRE_VERSION_1);
+        return;
+    }
+    if (out[0] >= KM_WIRE_VERSION_2 && (out[1] & KM_CAP_WIRE_V2))
+        wire_version = KM_WIRE_VERSION_2;
+    capabilities = out[1] & KM_CAPABILITIES;
+    ALOGI("Keystore TA wire format v%u, capabilities 0x%x",
+          wire_version, capabilities);
+}
+
+bool optee_keystore_set_transport(const struct optee_keystore_transport* t) {
     if (connected) {
-        ALOGE("Connection with trustled application already established");
+        ALOGE("Transport can not be changed while connected");
         return false;
     }
-    res = TEEC_InitializeContext(NULL, &ctx);
-    if (res != TEEC_SUCCESS) {
-        ALOGE("TEEC_InitializeContext failed with code 0x%x", res);
+    transport = t;
+    return true;
+}
+
+const struct optee_keystore_transport* optee_keystore_transport(void) {
+    return transport;
+}
+
+bool optee_keystore_connect(void) {
+    if (connected) {
+        ALOGE("Connection with trustled application already established");
         return false;
     }
-
-    /* Open a session to the TA */
-    res = TEEC_OpenSession(&ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC,
-            NULL, NULL, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        TEEC_FinalizeContext(&ctx);
-        ALOGE("TEEC_Opensession failed with code 0x%x origin 0x%x",
-                res, err_origin);
+    if (!transport->open()) {
+        ALOGE("Failed to open %s transport to keystore TA", transport->name);
         return false;
     }
     connected = true;
-    ALOGI("Connection with keystore was established");
+    optee_keystore_handshake();
+    ALOGI("Connection with keystore was established over %s",
+          transport->name);
     return true;
 }
 
 void optee_keystore_disconnect(void) {
-    TEEC_CloseSession(&sess);
-    TEEC_FinalizeContext(&ctx);
+    transport->close();
     connected  = false;
 }
 
+uint32_t optee_keystore_wire_version(void) {
+    return wire_version;
+}
+
+uint32_t optee_keystore_capabilities(void) {
+    return capabilities;
+}
+
 const char* keymaster_error_message(uint32_t error) {
     switch(error) {
         case (KM_ERROR_OK):
@@ -189,33 +244,61 @@ const char* keymaster_error_message(uint32_t error) {
 
 keymaster_error_t optee_keystore_call(uint32_t cmd, void* in, uint32_t in_size, void* out,
                         uint32_t out_size) {
-    TEEC_Operation op;
     uint32_t res;
-    uint32_t err_origin;
+    uint64_t start = optee_keystore_now_ns();
+    uint64_t locked;
+    struct optee_keystore_call_span span = {0};
 
+    pthread_mutex_lock(&call_lock);
+    locked = optee_keystore_now_ns();
+    call_times.calls++;
+    call_times.queue_ns += locked - start;
     if (!connected) {
+        pthread_mutex_unlock(&call_lock);
         ALOGE("Keystore trusted application is not connected");
         return KM_ERROR_SECURE_HW_COMMUNICATION_FAILED;
     }
 
-    (void)memset(&op, 0, sizeof(op));
-    op.paramTypes = (uint32_t)TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-                                               TEEC_MEMREF_TEMP_OUTPUT,
-                                               TEEC_NONE,
-                                               TEEC_NONE);
-        op.params[0].tmpref.buffer = (void*)in;
-        op.params[0].tmpref.size   = in_size;
-        op.params[1].tmpref.buffer = (void*)out;
-        op.params[1].tmpref.size   = out_size;
-
-    res = TEEC_InvokeCommand(&sess, cmd, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        ALOGI("TEEC_InvokeCommand failed with code 0x%08x (%s) origin 0x%08x",
-              res, keymaster_error_message(res), err_origin);
-	    if (res == TEEC_ERROR_TARGET_DEAD) {
-                optee_keystore_disconnect();
-                optee_keystore_connect();
-	    }
+    if (trace_id) {
+        span.id = trace_id;
+        span.seq = ++trace_seq;
     }
+    /* TA without tracing would reject the extra parameter */
+    if (capabilities & KM_CAP_TRACE)
+        res = transport->invoke(cmd, in, in_size, out, out_size,
+                                span.id, span.seq);
+    else
+        res = transport->invoke(cmd, in, in_size, out, out_size, 0, 0);
+    span.end_ns = optee_keystore_now_ns();
+    call_times.exec_ns += span.end_ns - locked;
+    if (span.id && trace_hook) {
+        span.cmd = cmd;
+        span.res = res;
+        span.start_ns = start;
+        span.locked_ns = locked;
+        trace_hook(&span);
+    }
+    if (res != KM_ERROR_OK) {
+        ALOGI("Keystore TA command %u failed with code 0x%08x (%s)",
+              cmd, res, keymaster_error_message(res));
+        if (res == KM_TRANSPORT_TARGET_DEAD) {
+            optee_keystore_disconnect();
+            optee_keystore_connect();
+        }
+    }
+    pthread_mutex_unlock(&call_lock);
     return (keymaster_error_t)res;
 }
+
+void optee_keystore_get_call_times(struct optee_keystore_call_times* times) {
+    *times = call_times;
+}
+
+void optee_keystore_set_trace_id(uint32_t id) {
+    trace_id = id;
+    trace_seq = 0;
+}
+
+void optee_keystore_set_trace_hook(optee_keystore_trace_hook hook) {
+    trace_hook = hook;
+}
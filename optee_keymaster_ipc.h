@@ -26,7 +26,55 @@ keymaster_error_t optee_keystore_call(uint32_t cmd, void* in, uint32_t in_size,
 
 void optee_keystore_disconnect(void);
 
+/* Negotiated with the TA each time the session is (re)opened */
+uint32_t optee_keystore_wire_version(void);
+
+uint32_t optee_keystore_capabilities(void);
+
 const char* print_error_message(uint32_t error);
 
+/* Time spent by one thread in optee_keystore_call */
+struct optee_keystore_call_times {
+    uint64_t calls;
+    /* Waiting for calls of other threads to complete */
+    uint64_t queue_ns;
+    /* Inside the transport, TA execution included */
+    uint64_t exec_ns;
+};
+
+/*
+ * Returns times of the calling thread accumulated since it started. Callers
+ * split latency of a HAL method by the difference of two readings.
+ */
+void optee_keystore_get_call_times(struct optee_keystore_call_times* times);
+
+/* CLOCK_MONOTONIC, the clock call times and spans are measured with */
+uint64_t optee_keystore_now_ns(void);
+
+/* One TA call made while the calling thread had a trace id */
+struct optee_keystore_call_span {
+    uint32_t id;
+    /* Number of the TA call since the trace id was set, from 1 */
+    uint32_t seq;
+    uint32_t cmd;
+    uint32_t res;
+    /* Call entered, call lock taken, transport returned */
+    uint64_t start_ns;
+    uint64_t locked_ns;
+    uint64_t end_ns;
+};
+
+typedef void (*optee_keystore_trace_hook)(
+        const struct optee_keystore_call_span* span);
+
+/*
+ * Tags TA calls of the calling thread with id until it is set to 0. The
+ * tags are passed to the TA if it has KM_CAP_TRACE. The hook is called on
+ * the calling thread after each tagged call, with the call lock held.
+ */
+void optee_keystore_set_trace_id(uint32_t id);
+
+void optee_keystore_set_trace_hook(optee_keystore_trace_hook hook);
+
 __END_DECLS
 #endif /* OPTEE_KEYMASTER_IPC_H */
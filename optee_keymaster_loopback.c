@@ -0,0 +1,177 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Backend running the in-process TA on a server thread behind a Unix
+ * socket pair. Buffers are copied both ways and the caller sleeps until
+ * the reply arrives, the way a TEEC call copies temporary memory
+ * references and waits for the secure world.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <log/log.h>
+
+#include "optee_keymaster_transport.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+struct loopback_request {
+    uint32_t cmd;
+    uint32_t in_size;
+    uint32_t out_size;
+    uint32_t trace_id;
+    uint32_t trace_seq;
+};
+
+struct loopback_reply {
+    uint32_t res;
+    uint32_t out_size;
+};
+
+static int client_fd = -1;
+static int server_fd = -1;
+static pthread_t server_thread;
+static useconds_t delay_us = 0;
+
+static bool read_full(int fd, void* buf, size_t size) {
+    uint8_t* p = (uint8_t*)buf;
+
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void* buf, size_t size) {
+    const uint8_t* p = (const uint8_t*)buf;
+
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void* loopback_serve(void* arg) {
+    struct loopback_request req;
+    struct loopback_reply reply;
+    uint8_t* in = NULL;
+    uint8_t* out = NULL;
+
+    (void)arg;
+    while (read_full(server_fd, &req, sizeof(req))) {
+        in = (uint8_t*)malloc(req.in_size ? req.in_size : 1);
+        out = (uint8_t*)calloc(1, req.out_size ? req.out_size : 1);
+        if (!in || !out || !read_full(server_fd, in, req.in_size))
+            break;
+        reply.res = optee_transport_inproc.invoke(req.cmd,
+                req.in_size ? in : NULL, req.in_size,
+                req.out_size ? out : NULL, req.out_size,
+                req.trace_id, req.trace_seq);
+        reply.out_size = req.out_size;
+        if (delay_us)
+            usleep(delay_us);
+        if (!write_full(server_fd, &reply, sizeof(reply)) ||
+                !write_full(server_fd, out, reply.out_size))
+            break;
+        free(in);
+        free(out);
+        in = out = NULL;
+    }
+    free(in);
+    free(out);
+    return NULL;
+}
+
+static bool loopback_open(void) {
+    int fds[2];
+    const char* delay = getenv("KEYMASTER_LOOPBACK_DELAY_US");
+
+    delay_us = delay ? (useconds_t)strtoul(delay, NULL, 10) : 0;
+    if (!optee_transport_inproc.open())
+        return false;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        ALOGE("socketpair failed: %s", strerror(errno));
+        goto error;
+    }
+    client_fd = fds[0];
+    server_fd = fds[1];
+    if (pthread_create(&server_thread, NULL, loopback_serve, NULL) != 0) {
+        ALOGE("Failed to start loopback server thread");
+        close(client_fd);
+        close(server_fd);
+        client_fd = server_fd = -1;
+        goto error;
+    }
+    return true;
+error:
+    optee_transport_inproc.close();
+    return false;
+}
+
+static void loopback_close(void) {
+    if (client_fd < 0)
+        return;
+    shutdown(client_fd, SHUT_RDWR);
+    pthread_join(server_thread, NULL);
+    close(client_fd);
+    close(server_fd);
+    client_fd = server_fd = -1;
+    optee_transport_inproc.close();
+}
+
+static uint32_t loopback_invoke(uint32_t cmd, void* in, uint32_t in_size,
+                                void* out, uint32_t out_size,
+                                uint32_t trace_id, uint32_t trace_seq) {
+    struct loopback_request req = {cmd, in_size, out_size,
+                                   trace_id, trace_seq};
+    struct loopback_reply reply;
+
+    if (!write_full(client_fd, &req, sizeof(req)) ||
+            !write_full(client_fd, in, in_size) ||
+            !read_full(client_fd, &reply, sizeof(reply)) ||
+            reply.out_size != out_size ||
+            !read_full(client_fd, out, out_size)) {
+        ALOGE("Loopback server is gone");
+        return KM_TRANSPORT_TARGET_DEAD;
+    }
+    return reply.res;
+}
+
+const struct optee_keystore_transport optee_transport_loopback = {
+    .name = "loopback",
+    .open = loopback_open,
+    .close = loopback_close,
+    .invoke = loopback_invoke,
+};
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Log.h>
+#include <openssl/err.h>
+#include <openssl/rsa.h>
+
+#include "optee_keymaster_pubkey.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+static void hashUpdateVec(SHA256_CTX *ctx, const hidl_vec<uint8_t> &vec) {
+    uint64_t size = vec.size();
+
+    SHA256_Update(ctx, &size, sizeof(size));
+    SHA256_Update(ctx, vec.data(), vec.size());
+}
+
+KeyBlobHash PublicKeyCache::hashBlob(const hidl_vec<uint8_t> &blob) {
+    KeyBlobHash hash;
+
+    SHA256(blob.data(), blob.size(), hash.data());
+    return hash;
+}
+
+KeyBlobHash PublicKeyCache::hashBinding(const hidl_vec<uint8_t> &clientId,
+                    const hidl_vec<uint8_t> &appData) {
+    KeyBlobHash hash;
+    SHA256_CTX ctx;
+
+    SHA256_Init(&ctx);
+    hashUpdateVec(&ctx, clientId);
+    hashUpdateVec(&ctx, appData);
+    SHA256_Final(hash.data(), &ctx);
+    return hash;
+}
+
+bool PublicKeyCache::isUsable(const hidl_vec<KeyParameter> &authorizations,
+                    uint32_t osVersion, uint32_t osPatchlevel) {
+    bool asymmetric = false;
+
+    for (size_t i = 0; i < authorizations.size(); i++) {
+        switch (authorizations[i].tag) {
+        case Tag::ALGORITHM:
+            asymmetric = authorizations[i].f.algorithm == Algorithm::RSA ||
+                    authorizations[i].f.algorithm == Algorithm::EC;
+            break;
+        /*
+         * Authentication, validity period and usage counters are
+         * enforced by the TA, such keys are never used here
+         */
+        case Tag::USER_SECURE_ID:
+        case Tag::USER_AUTH_TYPE:
+        case Tag::AUTH_TIMEOUT:
+        case Tag::ACTIVE_DATETIME:
+        case Tag::ORIGINATION_EXPIRE_DATETIME:
+        case Tag::USAGE_EXPIRE_DATETIME:
+        case Tag::MIN_SECONDS_BETWEEN_OPS:
+        case Tag::MAX_USES_PER_BOOT:
+        case Tag::BOOTLOADER_ONLY:
+            return false;
+        /* Blob of previous system version has to be upgraded first */
+        case Tag::OS_VERSION:
+            if (authorizations[i].f.integer != osVersion)
+                return false;
+            break;
+        case Tag::OS_PATCHLEVEL:
+            if (authorizations[i].f.integer != osPatchlevel)
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return asymmetric;
+}
+
+bool PublicKeyCache::find(const KeyBlobHash &blobHash,
+                    const KeyBlobHash &bindingHash,
+                    bssl::UniquePtr<EVP_PKEY> &key,
+                    hidl_vec<KeyParameter> &authorizations) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); it++) {
+        if (it->blobHash != blobHash)
+            continue;
+        if (it->bindingHash != bindingHash)
+            return false;
+        entries_.splice(entries_.begin(), entries_, it);
+        if (it->key) {
+            EVP_PKEY_up_ref(it->key.get());
+            key.reset(it->key.get());
+        }
+        authorizations = it->authorizations;
+        return true;
+    }
+    return false;
+}
+
+void PublicKeyCache::insert(PublicKeyEntry &&entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); it++) {
+        if (it->blobHash == entry.blobHash) {
+            entries_.erase(it);
+            break;
+        }
+    }
+    entries_.push_front(std::move(entry));
+    if (entries_.size() > kMaxEntries)
+        entries_.pop_back();
+}
+
+void PublicKeyCache::erase(const KeyBlobHash &blobHash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    entries_.remove_if([&blobHash](const PublicKeyEntry &entry) {
+        return entry.blobHash == blobHash;
+    });
+}
+
+void PublicKeyCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    entries_.clear();
+}
+
+static const EVP_MD *digestToEvp(const Digest digest) {
+    switch (digest) {
+    case Digest::MD5:
+        return EVP_md5();
+    case Digest::SHA1:
+        return EVP_sha1();
+    case Digest::SHA_2_224:
+        return EVP_sha224();
+    case Digest::SHA_2_256:
+        return EVP_sha256();
+    case Digest::SHA_2_384:
+        return EVP_sha384();
+    case Digest::SHA_2_512:
+        return EVP_sha512();
+    default:
+        return nullptr;
+    }
+}
+
+static bool isAuthorized(const hidl_vec<KeyParameter> &authorizations,
+                    const Tag tag, const uint32_t value) {
+    for (size_t i = 0; i < authorizations.size(); i++) {
+        if (authorizations[i].tag == tag &&
+                authorizations[i].f.integer == value)
+            return true;
+    }
+    return false;
+}
+
+std::unique_ptr<PublicKeyOperation> PublicKeyOperation::create(KeyPurpose purpose,
+                    EVP_PKEY *key, const hidl_vec<KeyParameter> &authorizations,
+                    const hidl_vec<KeyParameter> &inParams) {
+    std::unique_ptr<PublicKeyOperation> op;
+    uint32_t digestCount = 0;
+    uint32_t paddingCount = 0;
+    Digest digest = Digest::NONE;
+    PaddingMode padding = PaddingMode::NONE;
+    const EVP_MD *md = nullptr;
+    const int type = EVP_PKEY_id(key);
+
+    for (size_t i = 0; i < inParams.size(); i++) {
+        if (inParams[i].tag == Tag::DIGEST) {
+            digest = inParams[i].f.digest;
+            digestCount++;
+        } else if (inParams[i].tag == Tag::PADDING) {
+            padding = inParams[i].f.paddingMode;
+            paddingCount++;
+        }
+    }
+    /* Ambiguous and unauthorized requests get the TA error codes */
+    if (digestCount > 1 || paddingCount > 1)
+        return op;
+    if (!isAuthorized(authorizations, Tag::PURPOSE,
+                    static_cast<uint32_t>(purpose)))
+        return op;
+    if (digestCount && !isAuthorized(authorizations, Tag::DIGEST,
+                    static_cast<uint32_t>(digest)))
+        return op;
+    if (paddingCount && !isAuthorized(authorizations, Tag::PADDING,
+                    static_cast<uint32_t>(padding)))
+        return op;
+
+    /*
+     * Digest::NONE and PaddingMode::NONE need the same input
+     * normalization as in the TA, they are not handled here
+     */
+    md = digestToEvp(digest);
+    if (type == EVP_PKEY_EC && purpose == KeyPurpose::VERIFY) {
+        if (md == nullptr)
+            return op;
+        op.reset(new PublicKeyOperation(purpose, key, md, KM_PAD_NONE));
+    } else if (type == EVP_PKEY_RSA && purpose == KeyPurpose::VERIFY) {
+        if (md == nullptr || (padding != PaddingMode::RSA_PKCS1_1_5_SIGN &&
+                    padding != PaddingMode::RSA_PSS))
+            return op;
+        if (padding == PaddingMode::RSA_PSS &&
+                    2 * (size_t)EVP_MD_size(md) + 2 > (size_t)EVP_PKEY_size(key))
+            return op;
+        op.reset(new PublicKeyOperation(purpose, key, md,
+                    static_cast<keymaster_padding_t>(padding)));
+    } else if (type == EVP_PKEY_RSA && purpose == KeyPurpose::ENCRYPT) {
+        if (padding == PaddingMode::RSA_OAEP && md == nullptr)
+            return op;
+        if (padding != PaddingMode::RSA_PKCS1_1_5_ENCRYPT &&
+                    padding != PaddingMode::RSA_OAEP)
+            return op;
+        op.reset(new PublicKeyOperation(purpose, key, md,
+                    static_cast<keymaster_padding_t>(padding)));
+    } else {
+        return op;
+    }
+    if (!op->init())
+        op.reset();
+    return op;
+}
+
+PublicKeyOperation::PublicKeyOperation(KeyPurpose purpose, EVP_PKEY *key,
+                    const EVP_MD *digest, keymaster_padding_t padding)
+        : purpose_(purpose), key_(key), digest_(digest), padding_(padding) {
+    EVP_PKEY_up_ref(key);
+}
+
+static bool setRsaPadding(EVP_PKEY_CTX *pctx, const keymaster_padding_t padding,
+                    const EVP_MD *digest) {
+    switch (padding) {
+    case KM_PAD_RSA_PKCS1_1_5_SIGN:
+    case KM_PAD_RSA_PKCS1_1_5_ENCRYPT:
+        return EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) > 0;
+    case KM_PAD_RSA_PSS:
+        /* TA signs with salt of digest length */
+        return EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) > 0 &&
+                EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1) > 0;
+    case KM_PAD_RSA_OAEP:
+        /* MGF1 uses the OAEP digest as TEE_ALG_RSAES_PKCS1_OAEP_MGF1_* */
+        return EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_OAEP_PADDING) > 0 &&
+                EVP_PKEY_CTX_set_rsa_oaep_md(pctx, digest) > 0 &&
+                EVP_PKEY_CTX_set_rsa_mgf1_md(pctx, digest) > 0;
+    default:
+        return true;
+    }
+}
+
+bool PublicKeyOperation::init() {
+    EVP_PKEY_CTX *pctx = nullptr;
+
+    if (purpose_ != KeyPurpose::VERIFY)
+        return true;
+    md_ctx_.reset(EVP_MD_CTX_new());
+    if (!md_ctx_)
+        return false;
+    if (EVP_DigestVerifyInit(md_ctx_.get(), &pctx, digest_, nullptr,
+                    key_.get()) != 1 ||
+            !setRsaPadding(pctx, padding_, digest_)) {
+        ALOGE("Failed to initialize public key verification");
+        ERR_clear_error();
+        return false;
+    }
+    return true;
+}
+
+ErrorCode PublicKeyOperation::update(const hidl_vec<uint8_t> &input,
+                    uint32_t &consumed) {
+    consumed = 0;
+    if (purpose_ == KeyPurpose::VERIFY) {
+        if (EVP_DigestVerifyUpdate(md_ctx_.get(), input.data(),
+                        input.size()) != 1)
+            return ErrorCode::UNKNOWN_ERROR;
+    } else {
+        if (buffer_.size() + input.size() > (size_t)EVP_PKEY_size(key_.get())) {
+            ALOGE("RSA encryption of too-long message");
+            return ErrorCode::INVALID_INPUT_LENGTH;
+        }
+        buffer_.insert(buffer_.end(), input.begin(), input.end());
+    }
+    consumed = input.size();
+    return ErrorCode::OK;
+}
+
+ErrorCode PublicKeyOperation::finish(const hidl_vec<uint8_t> &input,
+                    const hidl_vec<uint8_t> &signature,
+                    std::vector<uint8_t> &output) {
+    ErrorCode rc = ErrorCode::OK;
+    const size_t keyBytes = EVP_PKEY_size(key_.get());
+    bssl::UniquePtr<EVP_PKEY_CTX> pctx;
+    uint32_t consumed = 0;
+    size_t outSize = 0;
+
+    rc = update(input, consumed);
+    if (rc != ErrorCode::OK)
+        return rc;
+
+    if (purpose_ == KeyPurpose::VERIFY) {
+        if (signature.size() == 0 ||
+                EVP_DigestVerifyFinal(md_ctx_.get(), signature.data(),
+                        signature.size()) != 1) {
+            ERR_clear_error();
+            return ErrorCode::VERIFICATION_FAILED;
+        }
+        return ErrorCode::OK;
+    }
+
+    /* Same message size limits as in the TA */
+    if ((padding_ == KM_PAD_RSA_PKCS1_1_5_ENCRYPT &&
+                buffer_.size() + 11 > keyBytes) ||
+            (padding_ == KM_PAD_RSA_OAEP &&
+                buffer_.size() + 2 + 2 * EVP_MD_size(digest_) > keyBytes)) {
+        ALOGE("RSA encryption of too-long message");
+        return ErrorCode::INVALID_INPUT_LENGTH;
+    }
+    pctx.reset(EVP_PKEY_CTX_new(key_.get(), nullptr));
+    output.resize(keyBytes);
+    outSize = output.size();
+    if (!pctx || EVP_PKEY_encrypt_init(pctx.get()) != 1 ||
+            !setRsaPadding(pctx.get(), padding_, digest_) ||
+            EVP_PKEY_encrypt(pctx.get(), output.data(), &outSize,
+                    buffer_.data(), buffer_.size()) != 1) {
+        ALOGE("Public key encryption failed");
+        ERR_clear_error();
+        output.clear();
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    output.resize(outSize);
+    return ErrorCode::OK;
+}
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
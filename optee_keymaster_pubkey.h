@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_PUBKEY_H
+#define OPTEE_KEYMASTER_PUBKEY_H
+
+#include <android/hardware/keymaster/3.0/IKeymasterDevice.h>
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <hardware/keymaster_defs.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+using ::android::hardware::keymaster::V3_0::KeyParameter;
+using ::android::hardware::keymaster::V3_0::KeyPurpose;
+using ::android::hardware::hidl_vec;
+
+typedef std::array<uint8_t, SHA256_DIGEST_LENGTH> KeyBlobHash;
+
+/*
+ * Public part of an asymmetric key blob together with its authorizations.
+ * key is empty when the key can not be used in normal world (symmetric
+ * key, auth bound, time or usage limited), such entries are kept too,
+ * so the TA is not asked about the same blob again.
+ */
+struct PublicKeyEntry {
+    KeyBlobHash blobHash;
+    KeyBlobHash bindingHash;
+    bssl::UniquePtr<EVP_PKEY> key;
+    hidl_vec<KeyParameter> authorizations;
+};
+
+/* LRU cache of public keys, keyed by key blob hash */
+class PublicKeyCache {
+public:
+    static KeyBlobHash hashBlob(const hidl_vec<uint8_t> &blob);
+    static KeyBlobHash hashBinding(const hidl_vec<uint8_t> &clientId,
+                    const hidl_vec<uint8_t> &appData);
+
+    /* Checks if key with such authorizations may be used in normal world */
+    static bool isUsable(const hidl_vec<KeyParameter> &authorizations,
+                    uint32_t osVersion, uint32_t osPatchlevel);
+
+    /*
+     * Returns true if blob is cached, key gets a new reference to the cached
+     * key or stays empty for keys which are used by the TA only.
+     * Entry created with other APPLICATION_ID/APPLICATION_DATA is a miss.
+     */
+    bool find(const KeyBlobHash &blobHash, const KeyBlobHash &bindingHash,
+                    bssl::UniquePtr<EVP_PKEY> &key,
+                    hidl_vec<KeyParameter> &authorizations);
+    void insert(PublicKeyEntry &&entry);
+    void erase(const KeyBlobHash &blobHash);
+    void clear();
+
+private:
+    static const size_t kMaxEntries = 32;
+
+    std::mutex mutex_;
+    std::list<PublicKeyEntry> entries_; /* most recently used first */
+};
+
+/*
+ * VERIFY or ENCRYPT operation executed with the cached public key.
+ * Only digested RSA PKCS#1/PSS and ECDSA verification and RSA PKCS#1/OAEP
+ * encryption are handled, everything else is left to the TA.
+ */
+class PublicKeyOperation {
+public:
+    /* Returns nullptr if operation should be passed to the TA */
+    static std::unique_ptr<PublicKeyOperation> create(KeyPurpose purpose,
+                    EVP_PKEY *key, const hidl_vec<KeyParameter> &authorizations,
+                    const hidl_vec<KeyParameter> &inParams);
+
+    ErrorCode update(const hidl_vec<uint8_t> &input, uint32_t &consumed);
+    ErrorCode finish(const hidl_vec<uint8_t> &input,
+                    const hidl_vec<uint8_t> &signature,
+                    std::vector<uint8_t> &output);
+
+private:
+    PublicKeyOperation(KeyPurpose purpose, EVP_PKEY *key,
+                    const EVP_MD *digest, keymaster_padding_t padding);
+    bool init();
+
+    KeyPurpose purpose_;
+    bssl::UniquePtr<EVP_PKEY> key_;
+    const EVP_MD *digest_;
+    keymaster_padding_t padding_;
+    bssl::UniquePtr<EVP_MD_CTX> md_ctx_; /* VERIFY */
+    std::vector<uint8_t> buffer_;        /* ENCRYPT */
+};
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
+
+#endif /* OPTEE_KEYMASTER_PUBKEY_H */
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Log.h>
+#include <hardware/keymaster_defs.h>
+#include <inttypes.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "optee_keymaster_stats.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+static const char *methodNames[KeymasterStats::METHOD_COUNT] = {
+    "getHardwareFeatures",
+    "addRngEntropy",
+    "generateKey",
+    "getKeyCharacteristics",
+    "importKey",
+    "exportKey",
+    "attestKey",
+    "upgradeKey",
+    "deleteKey",
+    "deleteAllKeys",
+    "destroyAttestationIds",
+    "begin",
+    "update",
+    "finish",
+    "abort",
+};
+
+static const char *phaseNames[KeymasterStats::PHASE_COUNT] = {
+    "total",
+    "marshal",
+    "queue",
+    "tee",
+    "callback",
+};
+
+/* Indexed by TA command id, slot 0 counts unknown ids */
+static const char *taCommandNames[KM_STATS_COMMANDS] = {
+    "other",
+    "unused",
+    "KM_ADD_RNG_ENTROPY",
+    "KM_GENERATE_KEY",
+    "KM_GET_KEY_CHARACTERISTICS",
+    "KM_IMPORT_KEY",
+    "KM_EXPORT_KEY",
+    "KM_ATTEST_KEY",
+    "KM_UPGRADE_KEY",
+    "KM_DELETE_KEY",
+    "KM_DELETE_ALL_KEYS",
+    "KM_BEGIN",
+    "KM_UPDATE",
+    "KM_FINISH",
+    "KM_ABORT",
+    "KM_DESTROY_ATT_IDS",
+    "KM_GET_VERSION",
+    "KM_REFILL_KEY_POOL",
+    "KM_PROVISION",
+    "KM_GET_STATS",
+    "KM_GET_HEAP_STATS",
+    "KM_GET_TRACE",
+};
+
+static const char *taPhaseNames[KM_PHASE_COUNT] = {
+    "deser",
+    "blob",
+    "check",
+    "crypto",
+    "ser",
+    "other",
+};
+
+static const char *taHeapNames[KM_HEAP_COUNT] = {
+    "params",
+    "blob",
+    "operation",
+    "crypto",
+    "attestation",
+    "other",
+};
+
+static const char *taHeapEventNames[] = {
+    "alloc",
+    "free",
+    "failed",
+};
+
+static uint64_t elapsedNs(std::chrono::steady_clock::time_point from,
+                    std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+KeymasterStats::KeymasterStats() {
+    reset();
+}
+
+size_t KeymasterStats::bucket(uint64_t ns) {
+    size_t i = 0;
+
+    while (ns > 1 && i < kBuckets - 1) {
+        ns >>= 1;
+        i++;
+    }
+    return i;
+}
+
+size_t KeymasterStats::errorSlot(ErrorCode rc) {
+    int32_t code = -static_cast<int32_t>(rc);
+
+    if (rc == ErrorCode::UNKNOWN_ERROR)
+        return kErrorSlots - 1;
+    if (code > 0 && code < static_cast<int32_t>(kErrorSlots) - 1)
+        return code;
+    return 0;
+}
+
+int32_t KeymasterStats::slotError(size_t slot) {
+    if (slot == kErrorSlots - 1)
+        return static_cast<int32_t>(ErrorCode::UNKNOWN_ERROR);
+    return -static_cast<int32_t>(slot);
+}
+
+void KeymasterStats::add(Method method, ErrorCode rc,
+                    const uint64_t (&phaseNs)[PHASE_COUNT]) {
+    MethodStats &stats = methods_[method];
+
+    stats.calls.fetch_add(1, std::memory_order_relaxed);
+    if (rc != ErrorCode::OK) {
+        stats.errors.fetch_add(1, std::memory_order_relaxed);
+        stats.errorCodes[errorSlot(rc)].fetch_add(1, std::memory_order_relaxed);
+    }
+    for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+        stats.sumNs[phase].fetch_add(phaseNs[phase], std::memory_order_relaxed);
+        stats.buckets[phase][bucket(phaseNs[phase])].fetch_add(1,
+                    std::memory_order_relaxed);
+    }
+}
+
+void KeymasterStats::addPublicKeyEviction() {
+    pubkeyEvictions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t KeymasterStats::calls() const {
+    uint64_t calls = 0;
+
+    for (size_t method = 0; method < METHOD_COUNT; method++)
+        calls += methods_[method].calls.load(std::memory_order_relaxed);
+    return calls;
+}
+
+void KeymasterStats::reset() {
+    start_ = std::chrono::steady_clock::now();
+    pubkeyEvictions_.store(0, std::memory_order_relaxed);
+    for (size_t method = 0; method < METHOD_COUNT; method++) {
+        MethodStats &stats = methods_[method];
+
+        stats.calls.store(0, std::memory_order_relaxed);
+        stats.errors.store(0, std::memory_order_relaxed);
+        for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+            stats.sumNs[phase].store(0, std::memory_order_relaxed);
+            for (size_t i = 0; i < kBuckets; i++)
+                stats.buckets[phase][i].store(0, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kErrorSlots; i++)
+            stats.errorCodes[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+double KeymasterStats::percentileUs(const uint64_t (&buckets)[kBuckets],
+                    uint64_t count, double quantile) {
+    uint64_t rank = static_cast<uint64_t>(quantile * count);
+    uint64_t seen = 0;
+    size_t i = 0;
+
+    for (i = 0; i < kBuckets - 1; i++) {
+        seen += buckets[i];
+        if (seen > rank)
+            break;
+    }
+    return (2ull << i) / 1e3;
+}
+
+void KeymasterStats::dump(FILE *out, bool histograms) const {
+    double uptime = elapsedNs(start_, std::chrono::steady_clock::now()) / 1e9;
+
+    fprintf(out, "Keymaster HAL statistics over %.1f s\n", uptime);
+    fprintf(out, "Percentiles are upper bounds of power of two buckets\n");
+    fprintf(out, "Public key operations evicted: %" PRIu64 "\n",
+                    pubkeyEvictions_.load(std::memory_order_relaxed));
+    for (size_t method = 0; method < METHOD_COUNT; method++) {
+        const MethodStats &stats = methods_[method];
+        uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+        uint64_t buckets[PHASE_COUNT][kBuckets];
+        uint64_t count = 0;
+
+        if (!calls)
+            continue;
+        fprintf(out, "\n%s: calls %" PRIu64 ", errors %" PRIu64 "\n",
+                    methodNames[method], calls,
+                    stats.errors.load(std::memory_order_relaxed));
+        fprintf(out, "  %-10s %10s %10s %10s %10s %10s\n", "phase",
+                    "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us");
+        for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+            count = 0;
+            for (size_t i = 0; i < kBuckets; i++) {
+                buckets[phase][i] =
+                    stats.buckets[phase][i].load(std::memory_order_relaxed);
+                count += buckets[phase][i];
+            }
+            if (!count)
+                continue;
+            fprintf(out, "  %-10s %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    phaseNames[phase],
+                    stats.sumNs[phase].load(std::memory_order_relaxed) / 1e3 / count,
+                    percentileUs(buckets[phase], count, 0.5),
+                    percentileUs(buckets[phase], count, 0.9),
+                    percentileUs(buckets[phase], count, 0.99),
+                    percentileUs(buckets[phase], count, 0.999));
+        }
+        for (size_t i = 0; i < kErrorSlots; i++) {
+            uint64_t errors = stats.errorCodes[i].load(std::memory_order_relaxed);
+
+            if (!errors)
+                continue;
+            if (i)
+                fprintf(out, "  error %d: %" PRIu64 "\n", slotError(i), errors);
+            else
+                fprintf(out, "  error other: %" PRIu64 "\n", errors);
+        }
+        if (!histograms)
+            continue;
+        for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+            std::string line;
+
+            for (size_t i = 0; i < kBuckets; i++) {
+                if (!buckets[phase][i])
+                    continue;
+                line += " " + std::to_string(i ? 1ull << i : 0) + ":" +
+                        std::to_string(buckets[phase][i]);
+            }
+            fprintf(out, "  histogram %s ns:%s\n", phaseNames[phase], line.c_str());
+        }
+    }
+}
+
+static void dumpTaTable(FILE *out, const char *name, const km_stats_table_t &table) {
+    fprintf(out, "  %-14s %8u %8u %8u %10" PRIu64 " %8" PRIu64 " %10" PRIu64 "\n",
+                    name, table.capacity, table.used, table.peak,
+                    table.inserts, table.full, table.evictions);
+}
+
+void KeymasterStats::dumpTa(FILE *out, const km_stats_t &ta) {
+    fprintf(out, "\nKeymaster TA statistics, clock resolution %u ns\n", ta.clock_ns);
+    fprintf(out, "Times are mean us per call, phases as marked by the TA\n");
+    fprintf(out, "  %-26s %8s %8s %10s %10s", "command", "calls", "errors",
+                    "mean", "max");
+    for (size_t phase = 0; phase < KM_PHASE_COUNT; phase++)
+        fprintf(out, " %8s", taPhaseNames[phase]);
+    fprintf(out, "\n");
+    for (size_t cmd = 0; cmd < KM_STATS_COMMANDS; cmd++) {
+        const km_stats_command_t &command = ta.command[cmd];
+
+        if (!command.calls)
+            continue;
+        fprintf(out, "  %-26s %8" PRIu64 " %8" PRIu64 " %10.1f %10.1f",
+                    taCommandNames[cmd], command.calls, command.errors,
+                    command.total_ns / 1e3 / command.calls,
+                    command.max_ns / 1e3);
+        for (size_t phase = 0; phase < KM_PHASE_COUNT; phase++)
+            fprintf(out, " %8.1f", command.phase_ns[phase] / 1e3 / command.calls);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "  %-14s %8s %8s %8s %10s %8s %10s\n", "table", "capacity",
+                    "used", "peak", "inserts", "full", "evictions");
+    dumpTaTable(out, "operations", ta.operations);
+    dumpTaTable(out, "use counters", ta.use_counters);
+    dumpTaTable(out, "use timers", ta.use_timers);
+}
+
+void KeymasterStats::dumpTaHeap(FILE *out, const km_heap_t &heap,
+                    const km_heap_event_t *events) {
+    fprintf(out, "\nKeymaster TA heap: %" PRIu64 " bytes live, peak %" PRIu64
+                    " of %u, %u bytes overhead per allocation\n",
+                    heap.live_bytes, heap.peak_bytes, heap.data_size,
+                    heap.overhead);
+    fprintf(out, "  %-12s %10s %8s %10s %10s %8s\n", "category", "live",
+                    "count", "peak", "allocs", "failures");
+    for (size_t i = 0; i < KM_HEAP_COUNT; i++) {
+        const km_heap_category_t &category = heap.category[i];
+
+        fprintf(out, "  %-12s %10" PRIu64 " %8u %10" PRIu64 " %10" PRIu64
+                    " %8" PRIu64 "\n", taHeapNames[i], category.live_bytes,
+                    category.live_count, category.peak_bytes, category.allocs,
+                    category.failures);
+    }
+    fprintf(out, "  %-26s %10s %10s  %s\n", "command", "peak", "retained",
+                    "failures");
+    for (size_t cmd = 0; cmd < KM_STATS_COMMANDS; cmd++) {
+        const km_heap_command_t &command = heap.command[cmd];
+        std::string failures;
+
+        if (!command.peak_bytes && !command.retained_bytes)
+            continue;
+        for (size_t i = 0; i < KM_HEAP_COUNT; i++) {
+            if (command.failures[i])
+                failures += std::string(" ") + taHeapNames[i] + ":" +
+                            std::to_string(command.failures[i]);
+        }
+        fprintf(out, "  %-26s %10" PRIu64 " %10" PRId64 " %s\n",
+                    taCommandNames[cmd], command.peak_bytes,
+                    command.retained_bytes, failures.c_str());
+    }
+    if (heap.last_failure.size || heap.last_failure.command)
+        fprintf(out, "  last failure: %s, %u bytes of %s with %" PRIu64
+                    " bytes live\n", taCommandName(heap.last_failure.command),
+                    heap.last_failure.size,
+                    heap.last_failure.category < KM_HEAP_COUNT ?
+                        taHeapNames[heap.last_failure.category] : "unknown",
+                    heap.last_failure.live_bytes);
+    if (!heap.trace_command && !heap.events)
+        return;
+    fprintf(out, "  soak mode: %s, %u events, %u dropped\n",
+                    heap.trace_command ? taCommandName(heap.trace_command) : "off",
+                    heap.events, heap.dropped);
+    for (size_t i = 0; i < heap.events; i++) {
+        const km_heap_event_t &event = events[i];
+
+        fprintf(out, "  call %u %-6s %-12s %8u bytes, %8u live\n", event.call,
+                    event.type <= KM_HEAP_FAILED ? taHeapEventNames[event.type] : "?",
+                    event.category < KM_HEAP_COUNT ? taHeapNames[event.category] : "?",
+                    event.size, event.live_bytes);
+    }
+}
+
+const char *KeymasterStats::taCommandName(uint32_t cmd) {
+    return cmd < KM_STATS_COMMANDS ? taCommandNames[cmd] : "other";
+}
+
+const char *KeymasterStats::methodName(Method method) {
+    return methodNames[method];
+}
+
+uint32_t KeymasterStats::taCommand(const char *name) {
+    char *end = nullptr;
+    unsigned long id = strtoul(name, &end, 0);
+
+    if (end != name && !*end)
+        return id < UINT32_MAX ? id : 0;
+    for (uint32_t cmd = 1; cmd < KM_STATS_COMMANDS; cmd++) {
+        if (!strcmp(name, taCommandNames[cmd]))
+            return cmd;
+    }
+    return 0;
+}
+
+bool KeymasterStats::save(const char *path, const km_stats_t *ta,
+                    const km_heap_t *heap) const {
+    std::string temp = std::string(path) + ".tmp";
+    FILE *out = fopen(temp.c_str(), "w");
+
+    if (!out) {
+        ALOGE("Failed to open stats file %s", temp.c_str());
+        return false;
+    }
+    dump(out, true);
+    if (ta)
+        dumpTa(out, *ta);
+    if (heap)
+        dumpTaHeap(out, *heap, nullptr);
+    if (fclose(out) || rename(temp.c_str(), path)) {
+        ALOGE("Failed to write stats file %s", path);
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_STATS_H
+#define OPTEE_KEYMASTER_STATS_H
+
+#include <android/hardware/keymaster/3.0/IKeymasterDevice.h>
+#include <common.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+
+/*
+ * Counters and latency histograms of IKeymasterDevice calls, always on.
+ * Updated with relaxed atomics only, so calls never wait for each other
+ * or for a dump in progress. A dump taken while calls run may be off by
+ * the calls in flight.
+ *
+ * Latency of a call is split into phases:
+ *   marshal  - everything in the HAL but the phases below, public key
+ *              operations done in normal world included
+ *   queue    - waiting for TA calls of other threads to complete
+ *   tee      - inside the transport, TA execution included
+ *   callback - the HIDL callback, i.e. the reply to the client
+ * Histogram bucket i counts latencies in [2^i, 2^(i+1)) ns, the last one
+ * is open ended.
+ */
+class KeymasterStats {
+public:
+    enum Method {
+        GET_HARDWARE_FEATURES,
+        ADD_RNG_ENTROPY,
+        GENERATE_KEY,
+        GET_KEY_CHARACTERISTICS,
+        IMPORT_KEY,
+        EXPORT_KEY,
+        ATTEST_KEY,
+        UPGRADE_KEY,
+        DELETE_KEY,
+        DELETE_ALL_KEYS,
+        DESTROY_ATTESTATION_IDS,
+        BEGIN,
+        UPDATE,
+        FINISH,
+        ABORT,
+        METHOD_COUNT
+    };
+
+    enum Phase {
+        TOTAL,
+        MARSHAL,
+        QUEUE,
+        TEE,
+        CALLBACK,
+        PHASE_COUNT
+    };
+
+    KeymasterStats();
+
+    void add(Method method, ErrorCode rc, const uint64_t (&phaseNs)[PHASE_COUNT]);
+    /* Public key operation dropped by the HAL to make room for a new one */
+    void addPublicKeyEviction();
+    /* Calls of all methods counted so far */
+    uint64_t calls() const;
+    void reset();
+    void dump(FILE *out, bool histograms) const;
+    /* Dumps to path through a temporary file, so readers never see a partial one */
+    bool save(const char *path, const km_stats_t *ta, const km_heap_t *heap) const;
+    /* Command timing and table occupancy reported by KM_GET_STATS */
+    static void dumpTa(FILE *out, const km_stats_t &ta);
+    /* Heap use reported by KM_GET_HEAP_STATS, events follow the header */
+    static void dumpTaHeap(FILE *out, const km_heap_t &heap,
+                    const km_heap_event_t *events);
+    /* TA command id from a KM_ name or a number, 0 if unknown */
+    static uint32_t taCommand(const char *name);
+    static const char *taCommandName(uint32_t cmd);
+    static const char *methodName(Method method);
+
+private:
+    static const size_t kBuckets = 36;
+    /*
+     * Error codes -1..-126 are counted each on its own, UNKNOWN_ERROR in
+     * the last slot, anything else in slot 0.
+     */
+    static const size_t kErrorSlots = 128;
+
+    struct MethodStats {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> sumNs[PHASE_COUNT];
+        std::atomic<uint64_t> buckets[PHASE_COUNT][kBuckets];
+        std::atomic<uint64_t> errorCodes[kErrorSlots];
+    };
+
+    static size_t bucket(uint64_t ns);
+    static size_t errorSlot(ErrorCode rc);
+    static int32_t slotError(size_t slot);
+    /* Upper bound of the bucket holding the given quantile, in us */
+    static double percentileUs(const uint64_t (&buckets)[kBuckets],
+                    uint64_t count, double quantile);
+
+    std::chrono::steady_clock::time_point start_;
+    MethodStats methods_[METHOD_COUNT];
+    std::atomic<uint64_t> pubkeyEvictions_;
+};
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
+
+#endif /* OPTEE_KEYMASTER_STATS_H */
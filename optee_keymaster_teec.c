@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <log/log.h>
+#include <tee_client_api.h>
+
+#include "optee_keymaster_transport.h"
+#include "common.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+static TEEC_Context ctx;
+static TEEC_Session sess;
+
+static bool teec_open(void) {
+    TEEC_Result res;
+    TEEC_UUID uuid = TA_KEYMASTER_UUID;
+    uint32_t err_origin;
+
+    res = TEEC_InitializeContext(NULL, &ctx);
+    if (res != TEEC_SUCCESS) {
+        ALOGE("TEEC_InitializeContext failed with code 0x%x", res);
+        return false;
+    }
+
+    /* Open a session to the TA */
+    res = TEEC_OpenSession(&ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC,
+            NULL, NULL, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        TEEC_FinalizeContext(&ctx);
+        ALOGE("TEEC_Opensession failed with code 0x%x origin 0x%x",
+                res, err_origin);
+        return false;
+    }
+    return true;
+}
+
+static void teec_close(void) {
+    TEEC_CloseSession(&sess);
+    TEEC_FinalizeContext(&ctx);
+}
+
+static uint32_t teec_invoke(uint32_t cmd, void* in, uint32_t in_size,
+                            void* out, uint32_t out_size,
+                            uint32_t trace_id, uint32_t trace_seq) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+
+    (void)memset(&op, 0, sizeof(op));
+    op.paramTypes = (uint32_t)TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                               TEEC_MEMREF_TEMP_OUTPUT,
+                                               trace_id ? TEEC_VALUE_INPUT :
+                                                          TEEC_NONE,
+                                               TEEC_NONE);
+    op.params[0].tmpref.buffer = in;
+    op.params[0].tmpref.size   = in_size;
+    op.params[1].tmpref.buffer = out;
+    op.params[1].tmpref.size   = out_size;
+    op.params[2].value.a       = trace_id;
+    op.params[2].value.b       = trace_seq;
+
+    res = TEEC_InvokeCommand(&sess, cmd, &op, &err_origin);
+    if (res != TEEC_SUCCESS && err_origin != TEEC_ORIGIN_TRUSTED_APP)
+        ALOGI("TEEC_InvokeCommand failed with code 0x%08x origin 0x%08x",
+              res, err_origin);
+    return res;
+}
+
+const struct optee_keystore_transport optee_transport_teec = {
+    .name = "teec",
+    .open = teec_open,
+    .close = teec_close,
+    .invoke = teec_invoke,
+};
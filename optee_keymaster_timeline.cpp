@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Log.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <cstring>
+
+#include "optee_keymaster_timeline.h"
+#include "optee_keymaster_stats.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+static const char *taPhaseNames[KM_PHASE_COUNT] = {
+    "deserialize",
+    "key_blob",
+    "check",
+    "crypto",
+    "serialize",
+    "other",
+};
+
+/* TA calls of the HAL call in progress on this thread */
+static thread_local std::vector<optee_keystore_call_span> *currentCalls = nullptr;
+
+/* Called by optee_keystore_call for each TA call of a tagged thread */
+static void collectCall(const struct optee_keystore_call_span *span) {
+    if (currentCalls)
+        currentCalls->push_back(*span);
+}
+
+std::unique_ptr<KeymasterTimeline> KeymasterTimeline::open(const char *path) {
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        ALOGE("Failed to open timeline file %s", path);
+        return nullptr;
+    }
+    ALOGI("Writing keymaster timeline to %s", path);
+    return std::unique_ptr<KeymasterTimeline>(new KeymasterTimeline(out));
+}
+
+KeymasterTimeline::KeymasterTimeline(FILE *out)
+    : out_(out), startNs_(optee_keystore_now_ns()), pid_(getpid()) {
+    /* The closing bracket is optional, a file cut short still loads */
+    fprintf(out_, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                    "\"args\":{\"name\":\"keymaster HAL\"}},\n"
+                    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                    "\"args\":{\"name\":\"keystore TA\"}}", pid_, kTaPid);
+    optee_keystore_set_trace_hook(collectCall);
+}
+
+KeymasterTimeline::~KeymasterTimeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        drain(true);
+    }
+    optee_keystore_set_trace_hook(nullptr);
+    fprintf(out_, "\n]\n");
+    fclose(out_);
+}
+
+void KeymasterTimeline::event(const char *name, const char *category, int pid,
+                    int tid, uint64_t startNs, uint64_t durationNs,
+                    const std::string &args) {
+    uint64_t ts = startNs > startNs_ ? startNs - startNs_ : 0;
+
+    fprintf(out_, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+                    "\"tid\":%d,\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%"
+                    PRIu64 ".%03" PRIu64 ",\"args\":{%s}}",
+                    name, category, pid, tid,
+                    ts / 1000, ts % 1000, durationNs / 1000, durationNs % 1000,
+                    args.c_str());
+}
+
+uint32_t KeymasterTimeline::beginCall(
+                    std::vector<optee_keystore_call_span> *calls) {
+    uint32_t id = nextId_++;
+
+    currentCalls = calls;
+    optee_keystore_set_trace_id(id);
+    return id;
+}
+
+void KeymasterTimeline::endCall() {
+    optee_keystore_set_trace_id(0);
+    currentCalls = nullptr;
+}
+
+void KeymasterTimeline::writeCall(const char *method, uint32_t id,
+                    ErrorCode rc, int tid, uint64_t startNs, uint64_t doneNs,
+                    uint64_t endNs,
+                    const std::vector<optee_keystore_call_span> &calls) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string args = "\"id\":" + std::to_string(id);
+    uint64_t cursor = startNs;
+
+    event(method, "hal", pid_, tid, startNs, endNs - startNs,
+                    args + ",\"error\":" +
+                    std::to_string(static_cast<int32_t>(rc)));
+    for (size_t i = 0; i < calls.size(); i++) {
+        const optee_keystore_call_span &call = calls[i];
+
+        event(i ? "hal" : "marshal", "hal", pid_, tid, cursor,
+                    call.start_ns - cursor, args);
+        event("queue", "hal", pid_, tid, call.start_ns,
+                    call.locked_ns - call.start_ns, args);
+        event("invoke", "hal", pid_, tid, call.locked_ns,
+                    call.end_ns - call.locked_ns,
+                    args + ",\"seq\":" + std::to_string(call.seq) +
+                    ",\"cmd\":\"" + KeymasterStats::taCommandName(call.cmd) +
+                    "\",\"res\":" +
+                    std::to_string(static_cast<int32_t>(call.res)));
+        auto command = commands_.find(CallKey(call.id, call.seq));
+        if (command != commands_.end()) {
+            writeTaCommand(Invoke{call.locked_ns, call.end_ns, tid},
+                    command->second);
+            commands_.erase(command);
+        } else {
+            if (invokes_.size() >= kMaxPending)
+                invokes_.erase(invokes_.begin());
+            invokes_[CallKey(call.id, call.seq)] =
+                    Invoke{call.locked_ns, call.end_ns, tid};
+        }
+        cursor = call.end_ns;
+    }
+    event(calls.empty() ? "hal" : "unmarshal", "hal", pid_, tid, cursor,
+                    doneNs - cursor, args);
+    event("callback", "hal", pid_, tid, doneNs, endNs - doneNs, args);
+    undrained_ += calls.size();
+    if (undrained_ >= kDrainCalls)
+        drain(false);
+}
+
+void KeymasterTimeline::writeTaCommand(const Invoke &invoke,
+                    const std::vector<km_trace_span_t> &spans) {
+    const km_trace_span_t &command = spans.back();
+    uint64_t window = invoke.endNs - invoke.lockedNs;
+    uint64_t start = invoke.lockedNs;
+    std::string args = "\"id\":" + std::to_string(command.id) +
+                    ",\"seq\":" + std::to_string(command.seq);
+
+    if (command.duration_ns < window)
+        start += (window - command.duration_ns) / 2;
+    event(KeymasterStats::taCommandName(command.cmd), "ta", kTaPid,
+                    invoke.tid, start, command.duration_ns,
+                    args + ",\"res\":" +
+                    std::to_string(static_cast<int32_t>(command.res)));
+    for (size_t i = 0; i + 1 < spans.size(); i++) {
+        if (spans[i].phase >= KM_PHASE_COUNT)
+            continue;
+        event(taPhaseNames[spans[i].phase], "ta", kTaPid, invoke.tid,
+                    start + spans[i].start_ns, spans[i].duration_ns, args);
+    }
+}
+
+void KeymasterTimeline::drain(bool stop) {
+    uint32_t flags = stop ? KM_TRACE_STOP : 0;
+    std::vector<uint8_t> out(sizeof(km_trace_t) +
+                    KM_TRACE_SPANS * sizeof(km_trace_span_t));
+    std::map<CallKey, std::vector<km_trace_span_t>> pending;
+    km_trace_t trace;
+    keymaster_error_t res = KM_ERROR_OK;
+
+    undrained_ = 0;
+    if (!(optee_keystore_capabilities() & KM_CAP_TRACE))
+        return;
+    res = optee_keystore_call(KM_GET_TRACE, &flags, sizeof(flags),
+                    out.data(), out.size());
+    if (res != KM_ERROR_OK) {
+        ALOGE("Reading TA trace failed with code %d [%x]", res, res);
+        return;
+    }
+    memcpy(&trace, out.data(), sizeof(trace));
+    if (trace.version != KM_TRACE_VERSION || trace.spans > KM_TRACE_SPANS) {
+        ALOGE("Unsupported TA trace version %u", trace.version);
+        return;
+    }
+    if (trace.dropped)
+        ALOGI("TA dropped %u trace spans", trace.dropped);
+    for (uint32_t i = 0; i < trace.spans; i++) {
+        km_trace_span_t span;
+        CallKey key;
+
+        memcpy(&span, out.data() + sizeof(trace) + i * sizeof(span),
+                    sizeof(span));
+        key = CallKey(span.id, span.seq);
+        pending[key].push_back(span);
+        if (span.phase != KM_TRACE_COMMAND)
+            continue;
+        auto invoke = invokes_.find(key);
+        if (invoke != invokes_.end()) {
+            writeTaCommand(invoke->second, pending[key]);
+            invokes_.erase(invoke);
+        } else {
+            if (commands_.size() >= kMaxPending)
+                commands_.erase(commands_.begin());
+            commands_[key] = pending[key];
+        }
+        pending.erase(key);
+    }
+}
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
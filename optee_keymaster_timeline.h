@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_TIMELINE_H
+#define OPTEE_KEYMASTER_TIMELINE_H
+
+#include <android/hardware/keymaster/3.0/IKeymasterDevice.h>
+#include <common.h>
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "optee_keymaster_ipc.h"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+
+/*
+ * Timeline of IKeymasterDevice calls across the HAL and the TA, written in
+ * Chrome trace event format for chrome://tracing or ui.perfetto.dev.
+ * Enabled by setting vendor.keymaster.timeline to a file path writable by
+ * the service before it starts.
+ *
+ * Each call gets an id the HAL passes to the TA with its commands. Spans of
+ * a call on the HAL thread serving it:
+ *   marshal   - from the start of the call to its first TA call
+ *   queue     - waiting for TA calls of other threads to complete
+ *   invoke    - a TA call through the transport, world switch included
+ *   hal       - HAL work between two TA calls
+ *   unmarshal - from the last TA call to the reply
+ *   callback  - the HIDL callback
+ * The TA records the phases of tagged commands, which are read back every
+ * few calls and when the timeline is closed. TA clock is not the HAL clock,
+ * so each TA command is centered in the invoke span of its TA call. Phases
+ * are as precise as the TA clock, see CFG_KM_STATS_CNTVCT in ta/sub.mk.
+ */
+class KeymasterTimeline {
+public:
+    static std::unique_ptr<KeymasterTimeline> open(const char *path);
+    /* Reads the spans left in the TA and stops recording there */
+    ~KeymasterTimeline();
+
+private:
+    friend class CallRecord;
+
+    typedef std::pair<uint32_t, uint32_t> CallKey;
+
+    /* TA call, by id and number within the HAL call */
+    struct Invoke {
+        uint64_t lockedNs;
+        uint64_t endNs;
+        int tid;
+    };
+
+    KeymasterTimeline(FILE *out);
+
+    /* Tags TA calls of this thread with a new id and collects them */
+    uint32_t beginCall(std::vector<optee_keystore_call_span> *calls);
+    void endCall();
+    void writeCall(const char *method, uint32_t id, ErrorCode rc, int tid,
+                    uint64_t startNs, uint64_t doneNs, uint64_t endNs,
+                    const std::vector<optee_keystore_call_span> &calls);
+    /* Reads spans recorded by the TA, mutex_ is held */
+    void drain(bool stop);
+    /* Spans of a command end with the span of the whole command */
+    void writeTaCommand(const Invoke &invoke,
+                    const std::vector<km_trace_span_t> &spans);
+    void event(const char *name, const char *category, int pid, int tid,
+                    uint64_t startNs, uint64_t durationNs,
+                    const std::string &args);
+
+    /* TA calls made between two reads of TA spans */
+    static const uint32_t kDrainCalls = 16;
+    /* TA calls and commands never matched are dropped past this */
+    static const size_t kMaxPending = 1024;
+    /* Chrome trace process of the TA spans */
+    static const int kTaPid = 0;
+
+    std::mutex mutex_;
+    FILE *out_;
+    const uint64_t startNs_;
+    const int pid_;
+    std::atomic<uint32_t> nextId_{1};
+    /* TA calls waiting for the spans of their command */
+    std::map<CallKey, Invoke> invokes_;
+    /* Spans of TA commands read while their HAL call was in progress */
+    std::map<CallKey, std::vector<km_trace_span_t>> commands_;
+    uint32_t undrained_ = 0;
+};
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
+
+#endif /* OPTEE_KEYMASTER_TIMELINE_H */
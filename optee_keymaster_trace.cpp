@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Log.h>
+#include <inttypes.h>
+
+#include "optee_keymaster_trace.h"
+#include "optee_keymaster_ipc.h"
+
+#undef LOG_TAG
+#define LOG_TAG "OpteeKeymaster"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+std::unique_ptr<KeymasterTrace> KeymasterTrace::open(const char *path) {
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        ALOGE("Failed to open trace file %s", path);
+        return nullptr;
+    }
+    /* A line per call, so the trace survives the service being killed */
+    setvbuf(out, nullptr, _IOLBF, 0);
+    fprintf(out, "# keymaster trace 1\n");
+    ALOGI("Tracing keymaster calls to %s", path);
+    return std::unique_ptr<KeymasterTrace>(new KeymasterTrace(out));
+}
+
+KeymasterTrace::KeymasterTrace(FILE *out)
+    : out_(out), startNs_(optee_keystore_now_ns()) {}
+
+KeymasterTrace::~KeymasterTrace() {
+    fclose(out_);
+}
+
+uint32_t KeymasterTrace::keyId(const hidl_vec<uint8_t> &blob, bool &describe) {
+    KeyBlobHash hash = PublicKeyCache::hashBlob(blob);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.find(hash);
+
+    describe = it == keys_.end();
+    if (!describe) {
+        describe = undescribed_.erase(it->second) != 0;
+        return it->second;
+    }
+    keys_[hash] = nextKey_;
+    return nextKey_++;
+}
+
+uint32_t KeymasterTrace::newKeyId(const hidl_vec<uint8_t> &blob) {
+    KeyBlobHash hash = PublicKeyCache::hashBlob(blob);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.find(hash);
+
+    if (it != keys_.end())
+        return it->second;
+    keys_[hash] = nextKey_;
+    return nextKey_++;
+}
+
+void KeymasterTrace::keyUndescribed(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    /* Not if the call deleted the key */
+    for (auto it = keys_.begin(); it != keys_.end(); ++it) {
+        if (it->second == id) {
+            undescribed_.insert(id);
+            break;
+        }
+    }
+}
+
+void KeymasterTrace::eraseKey(const hidl_vec<uint8_t> &blob) {
+    KeyBlobHash hash = PublicKeyCache::hashBlob(blob);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.find(hash);
+
+    if (it == keys_.end())
+        return;
+    undescribed_.erase(it->second);
+    keys_.erase(it);
+}
+
+uint32_t KeymasterTrace::operationId(uint64_t handle, bool create) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = operations_.find(handle);
+
+    if (it != operations_.end())
+        return it->second;
+    if (!create)
+        return 0;
+    if (operations_.size() >= kMaxOperations) {
+        auto oldest = operations_.begin();
+        for (auto i = operations_.begin(); i != operations_.end(); ++i) {
+            if (i->second < oldest->second)
+                oldest = i;
+        }
+        operations_.erase(oldest);
+    }
+    operations_[handle] = nextOperation_;
+    return nextOperation_++;
+}
+
+void KeymasterTrace::eraseOperation(uint64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    operations_.erase(handle);
+}
+
+void KeymasterTrace::write(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    fputs(line.c_str(), out_);
+}
+
+void TraceRecord::size(const char *name, size_t size) {
+    value(name, size);
+}
+
+void TraceRecord::value(const char *name, uint64_t value) {
+    if (!trace_)
+        return;
+    fields_ += " ";
+    fields_ += name;
+    fields_ += "=";
+    fields_ += std::to_string(value);
+}
+
+std::string TraceRecord::formatParams(const hidl_vec<KeyParameter> &params) {
+    std::string result;
+
+    for (size_t i = 0; i < params.size(); i++) {
+        keymaster_tag_t tag = static_cast<keymaster_tag_t>(params[i].tag);
+        uint64_t value = 0;
+
+        if (i)
+            result += ",";
+        result += std::to_string(static_cast<uint32_t>(tag));
+        switch (keymaster_tag_get_type(tag)) {
+        case KM_BIGNUM:
+        case KM_BYTES:
+            result += "#" + std::to_string(params[i].blob.size());
+            continue;
+        case KM_ULONG:
+        case KM_ULONG_REP:
+            if (params[i].tag != Tag::USER_SECURE_ID)
+                value = params[i].f.longInteger;
+            break;
+        case KM_DATE:
+            value = params[i].f.dateTime;
+            break;
+        case KM_BOOL:
+            value = params[i].f.boolValue;
+            break;
+        default:
+            value = params[i].f.integer;
+            break;
+        }
+        result += ":" + std::to_string(value);
+    }
+    return result;
+}
+
+void TraceRecord::params(const hidl_vec<KeyParameter> &params) {
+    if (!trace_)
+        return;
+    fields_ += " params=" + formatParams(params);
+}
+
+void TraceRecord::key(const hidl_vec<uint8_t> &blob) {
+    if (!trace_ || !blob.size())
+        return;
+    keyId_ = trace_->keyId(blob, describe_);
+    value("key", keyId_);
+}
+
+void TraceRecord::newKey(const hidl_vec<uint8_t> &blob) {
+    if (!trace_ || !blob.size())
+        return;
+    value("out_key", trace_->newKeyId(blob));
+}
+
+void TraceRecord::deletedKey(const hidl_vec<uint8_t> &blob) {
+    if (!trace_ || !blob.size())
+        return;
+    trace_->eraseKey(blob);
+}
+
+void TraceRecord::describeKey(const hidl_vec<KeyParameter> &characteristics,
+                    size_t clientIdSize, size_t appDataSize) {
+    if (!trace_ || !describe_)
+        return;
+    keyLine_ = " key=" + std::to_string(keyId_) +
+                    " client_id=" + std::to_string(clientIdSize) +
+                    " app_data=" + std::to_string(appDataSize) +
+                    " params=" + formatParams(characteristics);
+    describe_ = false;
+}
+
+void TraceRecord::operation(uint64_t handle) {
+    if (!trace_)
+        return;
+    value("op", trace_->operationId(handle, false));
+}
+
+void TraceRecord::newOperation(uint64_t handle) {
+    if (!trace_ || !handle)
+        return;
+    value("op", trace_->operationId(handle, true));
+}
+
+void TraceRecord::endOperation(uint64_t handle) {
+    if (!trace_)
+        return;
+    trace_->eraseOperation(handle);
+}
+
+void TraceRecord::write(const char *method, uint64_t startNs,
+                    uint64_t durationNs, ErrorCode rc) {
+    char head[96];
+    uint64_t startUs = 0;
+
+    if (!trace_)
+        return;
+    if (describe_)
+        trace_->keyUndescribed(keyId_);
+    if (startNs > trace_->startNs_)
+        startUs = (startNs - trace_->startNs_) / 1000;
+    if (!keyLine_.empty()) {
+        snprintf(head, sizeof(head), "%" PRIu64 " key 0 0", startUs);
+        trace_->write(head + keyLine_ + "\n");
+    }
+    snprintf(head, sizeof(head), "%" PRIu64 " %s %" PRIu64 " %d", startUs,
+                    method, durationNs / 1000, static_cast<int32_t>(rc));
+    trace_->write(head + fields_ + "\n");
+}
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
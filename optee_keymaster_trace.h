@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPTEE_KEYMASTER_TRACE_H
+#define OPTEE_KEYMASTER_TRACE_H
+
+#include <android/hardware/keymaster/3.0/IKeymasterDevice.h>
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "optee_keymaster_pubkey.h"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V3_0 {
+namespace renesas {
+
+using ::android::hardware::keymaster::V3_0::ErrorCode;
+using ::android::hardware::keymaster::V3_0::KeyParameter;
+using ::android::hardware::keymaster::V3_0::Tag;
+using ::android::hardware::hidl_vec;
+
+/*
+ * Trace of IKeymasterDevice calls, replayed by bench/keymaster_replay.
+ * Enabled by setting vendor.keymaster.trace to a file path writable by
+ * the service before it starts.
+ *
+ * Only the shape of the traffic is kept. Key blobs and operation handles
+ * are replaced by ids local to the trace, blobs and data are written as
+ * sizes, USER_SECURE_ID values are zeroed. The file has one line per
+ * call, times are in microseconds since the trace was opened:
+ *
+ *   <start> <method> <duration> <error> [name=value ...]
+ *
+ * Parameters are written as params=tag:value,tag#size,... Before the first
+ * call using a key created before the trace started, a line with method
+ * "key" describes that key by its characteristics. If its characteristics
+ * can not be read, the next call using the key tries again.
+ */
+class KeymasterTrace {
+public:
+    static std::unique_ptr<KeymasterTrace> open(const char *path);
+    ~KeymasterTrace();
+
+private:
+    friend class TraceRecord;
+
+    KeymasterTrace(FILE *out);
+
+    /* describe is set for the one call that should describe the key */
+    uint32_t keyId(const hidl_vec<uint8_t> &blob, bool &describe);
+    /* Key created by a traced call, the replay creates it the same way */
+    uint32_t newKeyId(const hidl_vec<uint8_t> &blob);
+    /* Hands the description of the key to the next call using it */
+    void keyUndescribed(uint32_t id);
+    void eraseKey(const hidl_vec<uint8_t> &blob);
+    /* Returns 0 for an unknown handle if create is false */
+    uint32_t operationId(uint64_t handle, bool create);
+    void eraseOperation(uint64_t handle);
+    void write(const std::string &line);
+
+    /* Operations never finished or aborted are dropped past this */
+    static const size_t kMaxOperations = 256;
+
+    std::mutex mutex_;
+    FILE *out_;
+    const uint64_t startNs_;
+    std::map<KeyBlobHash, uint32_t> keys_;
+    /* Keys created before the trace, not described yet */
+    std::set<uint32_t> undescribed_;
+    std::map<uint64_t, uint32_t> operations_;
+    uint32_t nextKey_ = 1;
+    uint32_t nextOperation_ = 1;
+};
+
+/*
+ * Fields of one traced call, see CallRecord. All methods do nothing when
+ * tracing is off.
+ */
+class TraceRecord {
+public:
+    explicit TraceRecord(KeymasterTrace *trace) : trace_(trace) {}
+
+    bool enabled() const { return trace_ != nullptr; }
+
+    void size(const char *name, size_t size);
+    void value(const char *name, uint64_t value);
+    void params(const hidl_vec<KeyParameter> &params);
+    /* Key passed to the call */
+    void key(const hidl_vec<uint8_t> &blob);
+    /* Key created by the call */
+    void newKey(const hidl_vec<uint8_t> &blob);
+    void deletedKey(const hidl_vec<uint8_t> &blob);
+    /* True if the key of the call is not known to the trace yet */
+    bool needsKeyDescription() const { return describe_; }
+    void describeKey(const hidl_vec<KeyParameter> &characteristics,
+                    size_t clientIdSize, size_t appDataSize);
+    void operation(uint64_t handle);
+    void newOperation(uint64_t handle);
+    void endOperation(uint64_t handle);
+    /* Writes the call out, times are optee_keystore_now_ns() */
+    void write(const char *method, uint64_t startNs, uint64_t durationNs,
+                    ErrorCode rc);
+
+private:
+    static std::string formatParams(const hidl_vec<KeyParameter> &params);
+
+    KeymasterTrace *trace_ = nullptr;
+    uint32_t keyId_ = 0;
+    bool describe_ = false;
+    std::string fields_;
+    std::string keyLine_;
+};
+
+} // namespace renesas
+} // namespace V3_0
+} // namespace keymaster
+} // namespace hardware
+} // namespace android
+
+#endif /* OPTEE_KEYMASTER_TRACE_H */
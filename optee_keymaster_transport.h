@@ -0,0 +1,71 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPTEE_KEYMASTER_TRANSPORT_H
+#define OPTEE_KEYMASTER_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Same value as TEEC_ERROR_TARGET_DEAD. Returned by backends when the TA
+ * session is lost, optee_keystore_call() reopens the session then.
+ */
+#define KM_TRANSPORT_TARGET_DEAD    0xFFFF3024
+
+/*
+ * Way the HAL reaches keystore TA. Calls are serialized by
+ * optee_keymaster_ipc.c, backends need no locking of their own.
+ */
+struct optee_keystore_transport {
+    const char* name;
+    /* Opens session to the TA */
+    bool (*open)(void);
+    void (*close)(void);
+    /*
+     * Invokes TA command with input and output memory references. Non-zero
+     * trace_id is passed with trace_seq as a value parameter, see
+     * KM_CAP_TRACE.
+     */
+    uint32_t (*invoke)(uint32_t cmd, void* in, uint32_t in_size,
+                       void* out, uint32_t out_size,
+                       uint32_t trace_id, uint32_t trace_seq);
+};
+
+/* TA in OP-TEE reached through libteec */
+extern const struct optee_keystore_transport optee_transport_teec;
+/* Host-built TA linked into the process, no world switch */
+extern const struct optee_keystore_transport optee_transport_inproc;
+/*
+ * Host-built TA served by a thread behind a Unix socket pair. Each call
+ * pays a round trip through the kernel like a world switch, extra delay
+ * per call may be set with KEYMASTER_LOOPBACK_DELAY_US environment variable.
+ */
+extern const struct optee_keystore_transport optee_transport_loopback;
+
+/*
+ * Selects backend used by next optee_keystore_connect(). Default is
+ * optee_transport_teec unless KM_DEFAULT_TRANSPORT is defined at build time.
+ */
+bool optee_keystore_set_transport(const struct optee_keystore_transport* t);
+
+const struct optee_keystore_transport* optee_keystore_transport(void);
+
+__END_DECLS
+#endif /* OPTEE_KEYMASTER_TRANSPORT_H */
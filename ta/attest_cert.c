@@ -0,0 +1,641 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attest_cert.h"
+#include "attestation.h"
+#include "der.h"
+#include "heap.h"
+
+/* Certificate ::= SEQUENCE {
+ *    tbsCertificate TBSCertificate,
+ *    signatureAlgorithm AlgorithmIdentifier,
+ *    signatureValue BIT STRING }
+ *
+ * TBSCertificate ::= SEQUENCE {
+ *    version [0] EXPLICIT Version, -- v3
+ *    serialNumber INTEGER, -- patched
+ *    signature AlgorithmIdentifier,
+ *    issuer Name, -- subject of root certificate
+ *    validity Validity,
+ *    subject Name,
+ *    subjectPublicKeyInfo SubjectPublicKeyInfo, -- patched
+ *    extensions [3] EXPLICIT Extensions } -- key description
+ */
+
+/* version [0] EXPLICIT INTEGER v3 */
+static const uint8_t cert_version[] = {
+	DER_TAG_CONTEXT_0, 0x03, DER_TAG_INTEGER, 0x01, 0x02
+};
+
+/* sha256WithRSAEncryption */
+static const uint8_t cert_sign_alg_rsa[] = {
+	DER_TAG_SEQUENCE, 0x0d, DER_TAG_OID, 0x09, 0x2a, 0x86, 0x48, 0x86,
+	0xf7, 0x0d, 0x01, 0x01, 0x0b, DER_TAG_NULL, 0x00
+};
+
+/* ecdsa-with-SHA256 */
+static const uint8_t cert_sign_alg_ec[] = {
+	DER_TAG_SEQUENCE, 0x0a, DER_TAG_OID, 0x08, 0x2a, 0x86, 0x48, 0xce,
+	0x3d, 0x04, 0x03, 0x02
+};
+
+/* From 1970-01-01 to 9999-12-31, i.e. no well-defined expiration date */
+static const uint8_t cert_validity[] = {
+	DER_TAG_SEQUENCE, 0x20,
+	DER_TAG_UTC_TIME, 0x0d,
+	'7', '0', '0', '1', '0', '1', '0', '0', '0', '0', '0', '0', 'Z',
+	DER_TAG_GENERALIZED_TIME, 0x0f,
+	'9', '9', '9', '9', '1', '2', '3', '1', '2', '3', '5', '9', '5', '9',
+	'Z'
+};
+
+/* CN=Android Keystore Key */
+static const uint8_t cert_subject[] = {
+	DER_TAG_SEQUENCE, 0x1f, DER_TAG_SET, 0x1d, DER_TAG_SEQUENCE, 0x1b,
+	DER_TAG_OID, 0x03, 0x55, 0x04, 0x03, DER_TAG_UTF8_STRING, 0x14,
+	'A', 'n', 'd', 'r', 'o', 'i', 'd', ' ', 'K', 'e', 'y', 's', 't', 'o',
+	'r', 'e', ' ', 'K', 'e', 'y'
+};
+
+/* Key description extension 1.3.6.1.4.1.11129.2.1.17 */
+static const uint8_t cert_key_description_oid[] = {
+	DER_TAG_OID, 0x0a, 0x2b, 0x06, 0x01, 0x04, 0x01, 0xd6, 0x79, 0x02,
+	0x01, 0x11
+};
+
+/* Tags of AuthorizationList, fields are encoded in ascending tag order */
+static const keymaster_tag_t cert_auth_tags[] = {
+	KM_TAG_PURPOSE,
+	KM_TAG_ALGORITHM,
+	KM_TAG_KEY_SIZE,
+	KM_TAG_DIGEST,
+	KM_TAG_PADDING,
+	KM_TAG_EC_CURVE,
+	KM_TAG_RSA_PUBLIC_EXPONENT,
+	KM_TAG_ACTIVE_DATETIME,
+	KM_TAG_ORIGINATION_EXPIRE_DATETIME,
+	KM_TAG_USAGE_EXPIRE_DATETIME,
+	KM_TAG_NO_AUTH_REQUIRED,
+	KM_TAG_USER_AUTH_TYPE,
+	KM_TAG_AUTH_TIMEOUT,
+	KM_TAG_ALLOW_WHILE_ON_BODY,
+	KM_TAG_ALL_APPLICATIONS,
+	KM_TAG_CREATION_DATETIME,
+	KM_TAG_ORIGIN,
+	KM_TAG_ROLLBACK_RESISTANT,
+	KM_TAG_ROOT_OF_TRUST,
+	KM_TAG_OS_VERSION,
+	KM_TAG_OS_PATCHLEVEL,
+	KM_TAG_ATTESTATION_APPLICATION_ID,
+};
+
+/* Source of one AuthorizationList */
+typedef struct {
+	const keymaster_key_param_set_t *params;
+	const keymaster_blob_t *app_id; /* software enforced only */
+	const uint8_t *verified_boot; /* hardware enforced only */
+} cert_auth_list_t;
+
+/*
+ * Encoders below write to out only if it is not NULL and always return
+ * the encoded size, so lengths are known before anything is written.
+ */
+
+static uint32_t TA_cert_put_header(uint8_t *out, const uint8_t tag,
+				const uint32_t length)
+{
+	if (out)
+		return TA_der_put_header(out, tag, length);
+	return TA_der_header_size(length);
+}
+
+static uint32_t TA_cert_put_bytes(uint8_t *out, const uint8_t tag,
+				const uint8_t *data, const uint32_t data_l)
+{
+	uint32_t size = TA_cert_put_header(out, tag, data_l);
+
+	if (out && data_l)
+		TEE_MemMove(out + size, data, data_l);
+	return size + data_l;
+}
+
+static uint32_t TA_cert_put_uint(uint8_t *out, const uint64_t value)
+{
+	uint8_t be[sizeof(value)];
+
+	for (uint32_t i = 0; i < sizeof(be); i++)
+		be[i] = value >> (8 * (sizeof(be) - 1 - i));
+	if (out)
+		return TA_der_put_uint(out, be, sizeof(be));
+	return TA_der_uint_size(be, sizeof(be));
+}
+
+/* [number] EXPLICIT header, high tag numbers take several bytes */
+static uint32_t TA_cert_put_explicit(uint8_t *out, const uint32_t number,
+				const uint32_t length)
+{
+	uint32_t tag_l = 1;
+
+	if (number >= 0x1f) {
+		for (uint32_t n = number; n; n >>= 7)
+			tag_l++;
+	}
+	if (!out)
+		return tag_l - 1 + TA_der_header_size(length);
+	if (number < 0x1f)
+		return TA_der_put_header(out, DER_TAG_CONTEXT_0 | number,
+					length);
+	out[0] = DER_TAG_CONTEXT_0 | 0x1f;
+	for (uint32_t i = 1; i < tag_l; i++)
+		out[i] = ((number >> (7 * (tag_l - 1 - i))) & 0x7f) |
+			(i + 1 < tag_l ? 0x80 : 0);
+	/* Length follows the last tag byte */
+	return tag_l - 1 + TA_der_put_header(out + tag_l - 1, out[tag_l - 1],
+					length);
+}
+
+static uint64_t TA_cert_param_value(const keymaster_key_param_t *param)
+{
+	switch (keymaster_tag_get_type(param->tag)) {
+	case KM_ENUM:
+	case KM_ENUM_REP:
+		return param->key_param.enumerated;
+	case KM_UINT:
+	case KM_UINT_REP:
+		return param->key_param.integer;
+	default:
+		return param->key_param.long_integer;
+	}
+}
+
+/* SET OF INTEGER, DER wants it sorted and small values encode shorter */
+static uint32_t TA_cert_put_set_items(uint8_t *out,
+				const keymaster_key_param_set_t *params,
+				const keymaster_tag_t tag)
+{
+	uint32_t size = 0;
+	uint64_t prev = 0;
+	uint64_t next = 0;
+	uint64_t value = 0;
+	bool first = true;
+	bool found = false;
+
+	do {
+		found = false;
+		for (size_t i = 0; i < params->length; i++) {
+			if (params->params[i].tag != tag)
+				continue;
+			value = TA_cert_param_value(params->params + i);
+			if ((first || value > prev) && (!found || value < next)) {
+				next = value;
+				found = true;
+			}
+		}
+		if (found) {
+			size += TA_cert_put_uint(out ? out + size : NULL, next);
+			prev = next;
+			first = false;
+		}
+	} while (found);
+	return size;
+}
+
+/*
+ * RootOfTrust ::= SEQUENCE {
+ *    verifiedBootKey OCTET_STRING, -- not known to the TA, left empty
+ *    deviceLocked BOOLEAN,
+ *    verifiedBootState VerifiedBootState }
+ */
+static uint32_t TA_cert_put_root_of_trust(uint8_t *out,
+				const uint8_t verified_boot)
+{
+	/* Verified, SelfSigned, Unverified, Failed */
+	uint8_t state = verified_boot <= 2 ? verified_boot : 3;
+	uint8_t root_of_trust[] = {
+		DER_TAG_SEQUENCE, 0x08, DER_TAG_OCTET_STRING, 0x00,
+		DER_TAG_BOOLEAN, 0x01, state <= 1 ? 0xff : 0x00,
+		DER_TAG_ENUMERATED, 0x01, state
+	};
+
+	if (out)
+		TEE_MemMove(out, root_of_trust, sizeof(root_of_trust));
+	return sizeof(root_of_trust);
+}
+
+/* Value of one AuthorizationList field, 0 if the field is absent */
+static uint32_t TA_cert_put_auth_value(uint8_t *out,
+				const cert_auth_list_t *list,
+				const keymaster_tag_t tag)
+{
+	const keymaster_key_param_t *param = NULL;
+	uint32_t length = 0;
+	uint32_t size = 0;
+
+	if (tag == KM_TAG_ROOT_OF_TRUST) {
+		if (!list->verified_boot)
+			return 0;
+		return TA_cert_put_root_of_trust(out, *list->verified_boot);
+	}
+	if (tag == KM_TAG_ATTESTATION_APPLICATION_ID) {
+		if (!list->app_id)
+			return 0;
+		return TA_cert_put_bytes(out, DER_TAG_OCTET_STRING,
+					list->app_id->data,
+					list->app_id->data_length);
+	}
+	for (size_t i = 0; i < list->params->length && !param; i++) {
+		if (list->params->params[i].tag == tag)
+			param = list->params->params + i;
+	}
+	if (!param)
+		return 0;
+	switch (keymaster_tag_get_type(tag)) {
+	case KM_ENUM_REP:
+	case KM_UINT_REP:
+	case KM_ULONG_REP:
+		length = TA_cert_put_set_items(NULL, list->params, tag);
+		size = TA_cert_put_header(out, DER_TAG_SET, length);
+		if (out)
+			TA_cert_put_set_items(out + size, list->params, tag);
+		return size + length;
+	case KM_BOOL:
+		if (!param->key_param.boolean)
+			return 0;
+		return TA_cert_put_header(out, DER_TAG_NULL, 0);
+	case KM_BYTES:
+	case KM_BIGNUM:
+		return TA_cert_put_bytes(out, DER_TAG_OCTET_STRING,
+					param->key_param.blob.data,
+					param->key_param.blob.data_length);
+	default:
+		return TA_cert_put_uint(out, TA_cert_param_value(param));
+	}
+}
+
+static uint32_t TA_cert_put_auth_items(uint8_t *out,
+				const cert_auth_list_t *list)
+{
+	uint32_t size = 0;
+	uint32_t value_l = 0;
+	keymaster_tag_t tag;
+
+	for (uint32_t i = 0; i < sizeof(cert_auth_tags) /
+				sizeof(cert_auth_tags[0]); i++) {
+		tag = cert_auth_tags[i];
+		value_l = TA_cert_put_auth_value(NULL, list, tag);
+		if (!value_l)
+			continue;
+		size += TA_cert_put_explicit(out ? out + size : NULL,
+					tag & 0x0fffffff, value_l);
+		if (out)
+			TA_cert_put_auth_value(out + size, list, tag);
+		size += value_l;
+	}
+	return size;
+}
+
+/* AuthorizationList ::= SEQUENCE { [tag] EXPLICIT value, ... } */
+static uint32_t TA_cert_put_auth_list(uint8_t *out,
+				const cert_auth_list_t *list)
+{
+	uint32_t length = TA_cert_put_auth_items(NULL, list);
+	uint32_t size = TA_cert_put_header(out, DER_TAG_SEQUENCE, length);
+
+	if (out)
+		TA_cert_put_auth_items(out + size, list);
+	return size + length;
+}
+
+/*
+ * KeyDescription ::= SEQUENCE {
+ *    attestationVersion INTEGER,
+ *    attestationSecurityLevel SecurityLevel,
+ *    keymasterVersion INTEGER,
+ *    keymasterSecurityLevel SecurityLevel,
+ *    attestationChallenge OCTET_STRING,
+ *    uniqueId OCTET_STRING,
+ *    softwareEnforced AuthorizationList,
+ *    teeEnforced AuthorizationList }
+ */
+static uint32_t TA_cert_put_key_description(uint8_t *out,
+				const keymaster_blob_t *challenge,
+				const keymaster_blob_t *unique_id,
+				const cert_auth_list_t *sw_enforced,
+				const cert_auth_list_t *hw_enforced)
+{
+	const uint8_t versions[] = {
+		DER_TAG_INTEGER, 0x01, ATTEST_CERT_ATTESTATION_VERSION,
+		DER_TAG_ENUMERATED, 0x01, ATTEST_CERT_SECURITY_LEVEL,
+		DER_TAG_INTEGER, 0x01, ATTEST_CERT_KEYMASTER_VERSION,
+		DER_TAG_ENUMERATED, 0x01, ATTEST_CERT_SECURITY_LEVEL
+	};
+	uint32_t length = sizeof(versions) +
+		TA_cert_put_bytes(NULL, DER_TAG_OCTET_STRING,
+				challenge->data, challenge->data_length) +
+		TA_cert_put_bytes(NULL, DER_TAG_OCTET_STRING,
+				unique_id->data, unique_id->data_length) +
+		TA_cert_put_auth_list(NULL, sw_enforced) +
+		TA_cert_put_auth_list(NULL, hw_enforced);
+	uint8_t *ptr = out;
+
+	if (!out)
+		return TA_der_header_size(length) + length;
+	ptr += TA_der_put_header(ptr, DER_TAG_SEQUENCE, length);
+	TEE_MemMove(ptr, versions, sizeof(versions));
+	ptr += sizeof(versions);
+	ptr += TA_cert_put_bytes(ptr, DER_TAG_OCTET_STRING,
+				challenge->data, challenge->data_length);
+	ptr += TA_cert_put_bytes(ptr, DER_TAG_OCTET_STRING,
+				unique_id->data, unique_id->data_length);
+	ptr += TA_cert_put_auth_list(ptr, sw_enforced);
+	ptr += TA_cert_put_auth_list(ptr, hw_enforced);
+	return ptr - out;
+}
+
+static void TA_cert_sign_alg(const uint32_t type, const uint8_t **alg,
+				uint32_t *alg_l)
+{
+	if (type == TEE_TYPE_RSA_KEYPAIR) {
+		*alg = cert_sign_alg_rsa;
+		*alg_l = sizeof(cert_sign_alg_rsa);
+	} else {
+		*alg = cert_sign_alg_ec;
+		*alg_l = sizeof(cert_sign_alg_ec);
+	}
+}
+
+static TEE_Result TA_cert_sign(const TEE_ObjectHandle key,
+				const uint32_t type,
+				const uint8_t *tbs, const uint32_t tbs_l,
+				uint8_t *sign, uint32_t *sign_l)
+{
+	TEE_Result res = TEE_SUCCESS;
+	TEE_OperationHandle op = TEE_HANDLE_NULL;
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	uint32_t digest_l = sizeof(digest);
+	uint32_t capacity = *sign_l;
+
+	res = TEE_AllocateOperation(&op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate digest operation, res=%x", res);
+		return res;
+	}
+	res = TEE_DigestDoFinal(op, tbs, tbs_l, digest, &digest_l);
+	TEE_FreeOperation(op);
+	op = TEE_HANDLE_NULL;
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to digest TBS certificate, res=%x", res);
+		return res;
+	}
+	if (type == TEE_TYPE_RSA_KEYPAIR)
+		res = TEE_AllocateOperation(&op,
+				TEE_ALG_RSASSA_PKCS1_V1_5_SHA256,
+				TEE_MODE_SIGN, RSA_KEY_SIZE);
+	else
+		res = TEE_AllocateOperation(&op, TEE_ALG_ECDSA_P256,
+				TEE_MODE_SIGN, EC_KEY_SIZE);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate sign operation, res=%x", res);
+		return res;
+	}
+	res = TEE_SetOperationKey(op, key);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to set attestation key, res=%x", res);
+		goto out;
+	}
+	res = TEE_AsymmetricSignDigest(op, NULL, 0, digest, digest_l,
+							sign, sign_l);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to sign TBS certificate, res=%x", res);
+		goto out;
+	}
+	if (type == TEE_TYPE_ECDSA_KEYPAIR) {
+		if (TA_der_encode_ec_sign(sign, sign_l, capacity) !=
+								KM_ERROR_OK)
+			res = TEE_ERROR_SHORT_BUFFER;
+	}
+out:
+	TEE_FreeOperation(op);
+	return res;
+}
+
+TEE_Result TA_attest_cert_init_template(attest_cert_template_t *tmpl,
+				const uint32_t type,
+				const keymaster_blob_t *root_cert)
+{
+	der_reader_t reader = {
+		.ptr = root_cert->data,
+		.end = root_cert->data + root_cert->data_length
+	};
+	der_reader_t cert;
+	der_reader_t tbs;
+	der_reader_t skip;
+	const uint8_t *issuer = NULL;
+	uint32_t issuer_l = 0;
+	const uint8_t *sign_alg = NULL;
+	uint32_t sign_alg_l = 0;
+	uint8_t *ptr = NULL;
+
+	/* Issuer is the subject of the root certificate */
+	if (!TA_der_read(&reader, DER_TAG_SEQUENCE, &cert) ||
+			!TA_der_read(&cert, DER_TAG_SEQUENCE, &tbs)) {
+		EMSG("Malformed root certificate");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+	/* Version is optional */
+	TA_der_read(&tbs, DER_TAG_CONTEXT_0, &skip);
+	if (!TA_der_read(&tbs, DER_TAG_INTEGER, &skip) ||
+			!TA_der_read(&tbs, DER_TAG_SEQUENCE, &skip) ||
+			!TA_der_read(&tbs, DER_TAG_SEQUENCE, &skip) ||
+			!TA_der_read(&tbs, DER_TAG_SEQUENCE, &skip)) {
+		EMSG("Malformed root TBS certificate");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+	issuer = tbs.ptr;
+	if (!TA_der_read(&tbs, DER_TAG_SEQUENCE, &skip)) {
+		EMSG("Malformed root certificate subject");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+	issuer_l = tbs.ptr - issuer;
+
+	TA_cert_sign_alg(type, &sign_alg, &sign_alg_l);
+	tmpl->type = type;
+	tmpl->head_l = sizeof(cert_version) +
+			TA_der_header_size(ATTEST_CERT_SERIAL_SIZE) +
+			ATTEST_CERT_SERIAL_SIZE + sign_alg_l + issuer_l +
+			sizeof(cert_validity) + sizeof(cert_subject);
+	tmpl->head = TA_malloc(tmpl->head_l, KM_HEAP_ATTESTATION);
+	if (!tmpl->head) {
+		EMSG("Failed to allocate memory for certificate template");
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	ptr = tmpl->head;
+	TEE_MemMove(ptr, cert_version, sizeof(cert_version));
+	ptr += sizeof(cert_version);
+	ptr += TA_der_put_header(ptr, DER_TAG_INTEGER, ATTEST_CERT_SERIAL_SIZE);
+	tmpl->serial_offset = ptr - tmpl->head;
+	ptr += ATTEST_CERT_SERIAL_SIZE;
+	TEE_MemMove(ptr, sign_alg, sign_alg_l);
+	ptr += sign_alg_l;
+	TEE_MemMove(ptr, issuer, issuer_l);
+	ptr += issuer_l;
+	TEE_MemMove(ptr, cert_validity, sizeof(cert_validity));
+	ptr += sizeof(cert_validity);
+	TEE_MemMove(ptr, cert_subject, sizeof(cert_subject));
+	return TEE_SUCCESS;
+}
+
+void TA_attest_cert_free_template(attest_cert_template_t *tmpl)
+{
+	if (tmpl->head)
+		TA_free(tmpl->head);
+	tmpl->head = NULL;
+	tmpl->head_l = 0;
+}
+
+TEE_Result TA_attest_cert_build(const attest_cert_template_t *tmpl,
+				const TEE_ObjectHandle sign_key,
+				const TEE_ObjectHandle attested_key,
+				const uint32_t attested_key_size,
+				const keymaster_key_param_set_t *attest_params,
+				const keymaster_key_characteristics_t *key_chr,
+				const keymaster_blob_t *unique_id,
+				const uint8_t verified_boot,
+				keymaster_blob_t *cert)
+{
+	TEE_Result res = TEE_SUCCESS;
+	keymaster_blob_t spki = {.data = NULL, .data_length = 0};
+	keymaster_blob_t challenge = {.data = NULL, .data_length = 0};
+	const keymaster_blob_t *app_id = NULL;
+	cert_auth_list_t sw_enforced = {
+		.params = &key_chr->sw_enforced,
+		.app_id = NULL,
+		.verified_boot = NULL
+	};
+	cert_auth_list_t hw_enforced = {
+		.params = &key_chr->hw_enforced,
+		.app_id = NULL,
+		.verified_boot = &verified_boot
+	};
+	const uint8_t *sign_alg = NULL;
+	uint32_t sign_alg_l = 0;
+	uint8_t sign[RSA_KEY_BUFFER_SIZE];
+	uint32_t sign_l = sizeof(sign);
+	uint32_t kd_l = 0;
+	uint32_t ext_l = 0;
+	uint32_t exts_l = 0;
+	uint32_t ctx3_l = 0;
+	uint32_t tbs_content_l = 0;
+	uint32_t tbs_l = 0;
+	uint32_t cert_l = 0;
+	uint32_t header_l = 0;
+	uint8_t *tbs = NULL;
+	uint8_t *ptr = NULL;
+
+	for (size_t i = 0; i < attest_params->length; i++) {
+		if (attest_params->params[i].tag ==
+					KM_TAG_ATTESTATION_CHALLENGE)
+			challenge = attest_params->params[i].key_param.blob;
+		else if (attest_params->params[i].tag ==
+					KM_TAG_ATTESTATION_APPLICATION_ID)
+			app_id = &attest_params->params[i].key_param.blob;
+	}
+	sw_enforced.app_id = app_id;
+
+	res = TA_der_encode_spki(attested_key, tmpl->type, attested_key_size,
+								&spki);
+	if (res != KM_ERROR_OK) {
+		EMSG("Failed to encode attested public key, res=%x", res);
+		goto out;
+	}
+
+	//Exact lengths of all nested elements, innermost first
+	kd_l = TA_cert_put_key_description(NULL, &challenge, unique_id,
+					&sw_enforced, &hw_enforced);
+	ext_l = sizeof(cert_key_description_oid) +
+			TA_der_header_size(kd_l) + kd_l;
+	exts_l = TA_der_header_size(ext_l) + ext_l;
+	ctx3_l = TA_der_header_size(exts_l) + exts_l;
+	tbs_content_l = tmpl->head_l + spki.data_length +
+			TA_der_header_size(ctx3_l) + ctx3_l;
+	tbs_l = TA_der_header_size(tbs_content_l) + tbs_content_l;
+
+	//Signature length is known only after signing, reserve the maximum
+	TA_cert_sign_alg(tmpl->type, &sign_alg, &sign_alg_l);
+	cert_l = tbs_l + sign_alg_l + TA_der_header_size(sign_l + 1) +
+			sign_l + 1;
+	header_l = TA_der_header_size(cert_l);
+	cert->data = TA_malloc(header_l + cert_l, KM_HEAP_ATTESTATION);
+	if (!cert->data) {
+		EMSG("Failed to allocate memory for attestation certificate");
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	//Fill template
+	tbs = cert->data + header_l;
+	ptr = tbs;
+	ptr += TA_der_put_header(ptr, DER_TAG_SEQUENCE, tbs_content_l);
+	TEE_MemMove(ptr, tmpl->head, tmpl->head_l);
+	//Positive serial without leading zero keeps its size
+	TEE_GenerateRandom(ptr + tmpl->serial_offset, ATTEST_CERT_SERIAL_SIZE);
+	ptr[tmpl->serial_offset] = (ptr[tmpl->serial_offset] & 0x7f) | 0x40;
+	ptr += tmpl->head_l;
+	TEE_MemMove(ptr, spki.data, spki.data_length);
+	ptr += spki.data_length;
+	ptr += TA_der_put_header(ptr, DER_TAG_CONTEXT_3, ctx3_l);
+	ptr += TA_der_put_header(ptr, DER_TAG_SEQUENCE, exts_l);
+	ptr += TA_der_put_header(ptr, DER_TAG_SEQUENCE, ext_l);
+	TEE_MemMove(ptr, cert_key_description_oid,
+				sizeof(cert_key_description_oid));
+	ptr += sizeof(cert_key_description_oid);
+	ptr += TA_der_put_header(ptr, DER_TAG_OCTET_STRING, kd_l);
+	ptr += TA_cert_put_key_description(ptr, &challenge, unique_id,
+					&sw_enforced, &hw_enforced);
+
+	res = TA_cert_sign(sign_key, tmpl->type, tbs, tbs_l, sign, &sign_l);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	//Length fix-up for the actual signature size
+	cert_l = tbs_l + sign_alg_l + TA_der_header_size(sign_l + 1) +
+			sign_l + 1;
+	if (TA_der_header_size(cert_l) != header_l) {
+		TEE_MemMove(cert->data + TA_der_header_size(cert_l), tbs,
+									tbs_l);
+		header_l = TA_der_header_size(cert_l);
+	}
+	ptr = cert->data;
+	ptr += TA_der_put_header(ptr, DER_TAG_SEQUENCE, cert_l);
+	ptr += tbs_l;
+	TEE_MemMove(ptr, sign_alg, sign_alg_l);
+	ptr += sign_alg_l;
+	ptr += TA_der_put_header(ptr, DER_TAG_BIT_STRING, sign_l + 1);
+	//No unused bits
+	*ptr++ = 0;
+	TEE_MemMove(ptr, sign, sign_l);
+	cert->data_length = header_l + cert_l;
+out:
+	if (res != TEE_SUCCESS && cert->data) {
+		TA_free(cert->data);
+		cert->data = NULL;
+		cert->data_length = 0;
+	}
+	if (spki.data)
+		TA_free(spki.data);
+	return res;
+}
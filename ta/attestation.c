@@ -18,6 +18,8 @@
 #include "attestation.h"
 #include "generator.h"
 #include "asn1.h"
+#include "attest_cert.h"
+#include "heap.h"
 
 //Attestation root keys - RSA and EC
 static uint8_t RsaAttKeyID[] = {0xb7U, 0x6aU, 0xb0U, 0xdcU};
@@ -26,6 +28,28 @@ static uint8_t EcAttKeyID[] = {0xf2U, 0xa0U, 0x37U, 0x80U};
 static uint8_t RSARootAttCertID[] = {0xaeU, 0xc9U, 0x07U, 0x28U};
 static uint8_t ECRootAttCertID[] = {0x74U, 0xf4U, 0xa6U, 0x84U};
 
+/*
+ * Attestation keys and root certificates are read from secure storage
+ * once, attestKey works with these copies and certificate templates only
+ */
+static struct {
+	bool loaded;
+	TEE_ObjectHandle rsa_key;
+	TEE_ObjectHandle ec_key;
+	keymaster_blob_t rsa_root_cert;
+	keymaster_blob_t ec_root_cert;
+	attest_cert_template_t rsa_template;
+	attest_cert_template_t ec_template;
+} attest_cache = {
+	.loaded = false,
+	.rsa_key = TEE_HANDLE_NULL,
+	.ec_key = TEE_HANDLE_NULL,
+	.rsa_root_cert = {.data = NULL, .data_length = 0},
+	.ec_root_cert = {.data = NULL, .data_length = 0},
+	.rsa_template = {.head = NULL, .head_l = 0},
+	.ec_template = {.head = NULL, .head_l = 0},
+};
+
 #ifdef ENUM_PERS_OBJS
 void TA_enum_attest_objs(void)
 {
@@ -63,6 +87,7 @@ void TA_wipe_attest_objs(void)
 			TEE_DATA_FLAG_SHARE_READ |
 			TEE_DATA_FLAG_SHARE_WRITE;
 	DMSG("Wipe persistent objects!");
+	TA_free_attest_cache();
 	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
 			RsaAttKeyID, sizeof(RsaAttKeyID),
 				flags, &object);
@@ -199,7 +224,7 @@ TEE_Result TA_create_rsa_attest_key(void)
 		}
 		//List of RSA attributes
 		attributes = TA_get_attrs_list(KM_ALGORITHM_RSA);
-		buffer = TEE_Malloc(RSA_KEY_BUFFER_SIZE, TEE_MALLOC_FILL_ZERO);
+		buffer = TA_malloc(RSA_KEY_BUFFER_SIZE, KM_HEAP_ATTESTATION);
 		if (NULL == buffer) {
 			EMSG("Failed to allocate memory for RSA attributes");
 			goto error_3;
@@ -225,7 +250,7 @@ TEE_Result TA_create_rsa_attest_key(void)
 		}
 error_3:
 		if (buffer) {
-			TEE_Free(buffer);
+			TA_free(buffer);
 		}
 		(res == TEE_SUCCESS) ?
 				TEE_CloseObject(RSAobject) :
@@ -291,7 +316,7 @@ TEE_Result TA_create_ec_attest_key(void)
 		}
 		//List of EC attributes
 		attributes = TA_get_attrs_list(KM_ALGORITHM_EC);
-		buffer = TEE_Malloc(EC_KEY_BUFFER_SIZE, TEE_MALLOC_FILL_ZERO);
+		buffer = TA_malloc(EC_KEY_BUFFER_SIZE, KM_HEAP_ATTESTATION);
 		if (NULL == buffer) {
 			EMSG("Failed to allocate memory for EC attributes");
 			goto error_3;
@@ -339,7 +364,7 @@ TEE_Result TA_create_ec_attest_key(void)
 		}
 error_3:
 		if (buffer) {
-			TEE_Free(buffer);
+			TA_free(buffer);
 		}
 		(res == TEE_SUCCESS) ?
 				TEE_CloseObject(ECobject) :
@@ -409,7 +434,7 @@ TEE_Result TA_create_root_rsa_attest_cert(TEE_TASessionHandle sessionSTA)
 
 error_2:
 		if (root_cert.data) {
-			TEE_Free(root_cert.data);
+			TA_free(root_cert.data);
 		}
 		TA_close_attest_obj(obj_h);
 
@@ -472,7 +497,7 @@ TEE_Result TA_create_root_ec_attest_cert(TEE_TASessionHandle sessionSTA)
 
 error_2:
 		if (root_cert.data) {
-			TEE_Free(root_cert.data);
+			TA_free(root_cert.data);
 		}
 		TA_close_attest_obj(obj_h);
 
@@ -492,50 +517,57 @@ error_1:
 TEE_Result TA_read_root_attest_cert(uint32_t type,
 				keymaster_cert_chain_t *cert_chain)
 {
-	TEE_Result res = TEE_SUCCESS;
-	TEE_ObjectHandle rootAttCert = TEE_HANDLE_NULL;
+	const keymaster_blob_t *root_cert = NULL;
+	keymaster_blob_t *entry = &cert_chain->entries[ROOT_ATT_CERT_INDEX];
 
-	if (type == TEE_TYPE_RSA_KEYPAIR) {
-		res = TA_open_root_rsa_attest_cert(&rootAttCert);
-	} else if (type == TEE_TYPE_ECDSA_KEYPAIR) {
-		res = TA_open_root_ec_attest_cert(&rootAttCert);
+	if (type == TEE_TYPE_RSA_KEYPAIR)
+		root_cert = &attest_cache.rsa_root_cert;
+	else if (type == TEE_TYPE_ECDSA_KEYPAIR)
+		root_cert = &attest_cache.ec_root_cert;
+	if (!attest_cache.loaded || !root_cert) {
+		EMSG("Root certificate is not loaded");
+		return TEE_ERROR_BAD_STATE;
 	}
 
-	if (res != TEE_SUCCESS) {
-		goto error_1;
-	}
-
-	//Read root certificate, index[1]
-	res = TA_read_attest_cert(rootAttCert,
-			&cert_chain->entries[ROOT_ATT_CERT_INDEX].data,
-			&cert_chain->entries[ROOT_ATT_CERT_INDEX].data_length);
-	if (res != TEE_SUCCESS) {
-		EMSG("Failed to read root certificate, res=%x", res);
-		goto error_1;
+	//Copy root certificate, index[1]
+	entry->data = TA_malloc(root_cert->data_length, KM_HEAP_ATTESTATION);
+	if (!entry->data) {
+		EMSG("Failed to allocate memory for root certificate data");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 	}
-
-error_1:
-	TA_close_attest_obj(rootAttCert);
-	return res;
+	TEE_MemMove(entry->data, root_cert->data, root_cert->data_length);
+	entry->data_length = root_cert->data_length;
+	return TEE_SUCCESS;
 }
 
-TEE_Result TA_gen_key_attest_cert(TEE_TASessionHandle sessionSTA, uint32_t type,
-				  TEE_ObjectHandle attestedKey,
+TEE_Result TA_gen_key_attest_cert(uint32_t type, TEE_ObjectHandle attestedKey,
+				  uint32_t key_size,
 				  keymaster_key_param_set_t *attest_params,
 				  keymaster_key_characteristics_t *key_chr,
 				  keymaster_cert_chain_t *cert_chain,
 				  uint8_t verified_boot)
 {
 	TEE_Result res = TEE_SUCCESS;
+	keymaster_blob_t unique_id = {.data = NULL, .data_length = 0};
+
+	if (!attest_cache.loaded) {
+		EMSG("Attestation objects are not loaded");
+		return TEE_ERROR_BAD_STATE;
+	}
 	if (type == TEE_TYPE_RSA_KEYPAIR) {
-		res = TA_gen_attest_rsa_cert(sessionSTA, attestedKey,
-					     attest_params, key_chr,
-					     cert_chain, verified_boot);
+		res = TA_attest_cert_build(&attest_cache.rsa_template,
+				attest_cache.rsa_key, attestedKey, key_size,
+				attest_params, key_chr, &unique_id,
+				verified_boot,
+				&cert_chain->entries[KEY_ATT_CERT_INDEX]);
 	} else if (type == TEE_TYPE_ECDSA_KEYPAIR) {
-		res = TA_gen_attest_ec_cert(sessionSTA, attestedKey,
-					    attest_params, key_chr,
-					    cert_chain, verified_boot);
+		res = TA_attest_cert_build(&attest_cache.ec_template,
+				attest_cache.ec_key, attestedKey, key_size,
+				attest_params, key_chr, &unique_id,
+				verified_boot,
+				&cert_chain->entries[KEY_ATT_CERT_INDEX]);
 	} else {
+		res = TEE_ERROR_BAD_PARAMETERS;
 	}
 
 	if (res != TEE_SUCCESS) {
@@ -545,10 +577,181 @@ TEE_Result TA_gen_key_attest_cert(TEE_TASessionHandle sessionSTA, uint32_t type,
 	return res;
 }
 
+//Restores attestation key pair from storage as a transient object
+static TEE_Result TA_load_attest_key(const keymaster_algorithm_t algorithm,
+				TEE_ObjectHandle *key)
+{
+	TEE_Result res = TEE_SUCCESS;
+	TEE_ObjectHandle attObj = TEE_HANDLE_NULL;
+	TEE_Attribute attrs[KM_ATTR_COUNT_RSA];
+	uint32_t *attributes = TA_get_attrs_list(algorithm);
+	uint32_t attr_count = KM_ATTR_COUNT_RSA;
+	uint32_t type = TEE_TYPE_RSA_KEYPAIR;
+	uint32_t key_size = RSA_KEY_SIZE;
+	uint32_t buf_size = (RSA_KEY_BUFFER_SIZE + sizeof(uint32_t)) *
+							KM_ATTR_COUNT_RSA;
+	uint32_t size = 0;
+	uint32_t pos = 0;
+	uint32_t attr_size = 0;
+	uint32_t value = 0;
+	uint8_t *buf = NULL;
+
+	if (algorithm == KM_ALGORITHM_EC) {
+		attr_count = KM_ATTR_COUNT_EC;
+		type = TEE_TYPE_ECDSA_KEYPAIR;
+		key_size = EC_KEY_SIZE;
+		buf_size = (EC_KEY_BUFFER_SIZE + sizeof(uint32_t)) *
+							KM_ATTR_COUNT_EC;
+		res = TA_open_ec_attest_key(&attObj);
+	} else {
+		res = TA_open_rsa_attest_key(&attObj);
+	}
+	if (res != TEE_SUCCESS)
+		goto out;
+	buf = TA_malloc(buf_size, KM_HEAP_ATTESTATION);
+	if (!buf) {
+		EMSG("Failed to allocate memory for attestation key");
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	//Stored key in format: size | buffer attribute, ...
+	if (algorithm == KM_ALGORITHM_EC)
+		res = TA_serialize_ec_keypair(buf, &size, attObj);
+	else
+		res = TA_serialize_rsa_keypair(buf, &size, attObj);
+	if (res != TEE_SUCCESS)
+		goto out;
+	for (uint32_t i = 0; i < attr_count; i++) {
+		if (size - pos < sizeof(attr_size)) {
+			res = TEE_ERROR_BAD_STATE;
+			goto out;
+		}
+		TEE_MemMove(&attr_size, buf + pos, sizeof(attr_size));
+		pos += sizeof(attr_size);
+		if (size - pos < attr_size) {
+			res = TEE_ERROR_BAD_STATE;
+			goto out;
+		}
+		if (is_attr_value(attributes[i])) {
+			TEE_MemMove(&value, buf + pos, sizeof(value));
+			TEE_InitValueAttribute(attrs + i, attributes[i],
+								value, 0);
+		} else {
+			TEE_InitRefAttribute(attrs + i, attributes[i],
+							buf + pos, attr_size);
+		}
+		pos += attr_size;
+	}
+	res = TEE_AllocateTransientObject(type, key_size, key);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate attestation key object, res=%x", res);
+		goto out;
+	}
+	res = TEE_PopulateTransientObject(*key, attrs, attr_count);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to populate attestation key object, res=%x", res);
+		TEE_FreeTransientObject(*key);
+		*key = TEE_HANDLE_NULL;
+	}
+out:
+	if (buf) {
+		TEE_MemFill(buf, 0, buf_size);
+		TA_free(buf);
+	}
+	TA_close_attest_obj(attObj);
+	return res;
+}
+
+static TEE_Result TA_load_root_attest_cert(const uint32_t type,
+				keymaster_blob_t *root_cert)
+{
+	TEE_Result res = TEE_SUCCESS;
+	TEE_ObjectHandle rootAttCert = TEE_HANDLE_NULL;
+
+	if (type == TEE_TYPE_RSA_KEYPAIR)
+		res = TA_open_root_rsa_attest_cert(&rootAttCert);
+	else
+		res = TA_open_root_ec_attest_cert(&rootAttCert);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_read_attest_cert(rootAttCert, &root_cert->data,
+						&root_cert->data_length);
+	if (res != TEE_SUCCESS)
+		EMSG("Failed to read root certificate, res=%x", res);
+out:
+	TA_close_attest_obj(rootAttCert);
+	return res;
+}
+
+static TEE_Result TA_load_attest_cache(void)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	res = TA_load_attest_key(KM_ALGORITHM_RSA, &attest_cache.rsa_key);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_load_attest_key(KM_ALGORITHM_EC, &attest_cache.ec_key);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_load_root_attest_cert(TEE_TYPE_RSA_KEYPAIR,
+					&attest_cache.rsa_root_cert);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_load_root_attest_cert(TEE_TYPE_ECDSA_KEYPAIR,
+					&attest_cache.ec_root_cert);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_attest_cert_init_template(&attest_cache.rsa_template,
+			TEE_TYPE_RSA_KEYPAIR, &attest_cache.rsa_root_cert);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TA_attest_cert_init_template(&attest_cache.ec_template,
+			TEE_TYPE_ECDSA_KEYPAIR, &attest_cache.ec_root_cert);
+out:
+	if (res == TEE_SUCCESS) {
+		attest_cache.loaded = true;
+	} else {
+		EMSG("Failed to load attestation objects, res=%x", res);
+		TA_free_attest_cache();
+	}
+	return res;
+}
+
+void TA_free_attest_cache(void)
+{
+	if (attest_cache.rsa_key != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(attest_cache.rsa_key);
+	if (attest_cache.ec_key != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(attest_cache.ec_key);
+	if (attest_cache.rsa_root_cert.data)
+		TA_free(attest_cache.rsa_root_cert.data);
+	if (attest_cache.ec_root_cert.data)
+		TA_free(attest_cache.ec_root_cert.data);
+	TA_attest_cert_free_template(&attest_cache.rsa_template);
+	TA_attest_cert_free_template(&attest_cache.ec_template);
+	attest_cache.rsa_key = TEE_HANDLE_NULL;
+	attest_cache.ec_key = TEE_HANDLE_NULL;
+	attest_cache.rsa_root_cert.data = NULL;
+	attest_cache.rsa_root_cert.data_length = 0;
+	attest_cache.ec_root_cert.data = NULL;
+	attest_cache.ec_root_cert.data_length = 0;
+	attest_cache.loaded = false;
+}
+
+TEE_Result TA_load_attest_objs(void)
+{
+	if (attest_cache.loaded)
+		return TEE_SUCCESS;
+	return TA_load_attest_cache();
+}
+
 TEE_Result TA_create_attest_objs(TEE_TASessionHandle sessionSTA)
 {
 	TEE_Result res = TEE_SUCCESS;
 
+	if (attest_cache.loaded)
+		return TEE_SUCCESS;
+
 	res = TA_create_rsa_attest_key();
 	if (res != TEE_SUCCESS) {
 		EMSG("Something wrong with root RSA key, res=%x", res);
@@ -569,7 +772,7 @@ TEE_Result TA_create_attest_objs(TEE_TASessionHandle sessionSTA)
 		EMSG("Something wrong with root EC certificate, res=%x", res);
 		return res;
 	}
-	return res;
+	return TA_load_attest_cache();
 }
 
 void TA_close_attest_obj(TEE_ObjectHandle attObj)
@@ -635,7 +838,7 @@ TEE_Result TA_read_attest_cert(TEE_ObjectHandle attObj,
 		return res;
 	}
 
-	*buffer = TEE_Malloc(*buffSize, TEE_MALLOC_FILL_ZERO);
+	*buffer = TA_malloc(*buffSize, KM_HEAP_ATTESTATION);
 	if (*buffer == NULL) {
 		EMSG("Failed to allocate memory for root certificate data");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
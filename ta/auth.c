@@ -22,6 +22,21 @@
  */
 static uint8_t auth_token_key_id[] = { 0xB1, 0x60, 0x71, 0x75 };
 
+/*
+ * auth_token key restored once from storage, kept for token validation
+ */
+static TEE_ObjectHandle auth_token_key_cache = TEE_HANDLE_NULL;
+
+/*
+ * Recently validated tokens. Whole token is compared, not only challenge,
+ * timestamp and HMAC, so a token with changed fields never matches.
+ */
+static struct {
+	hw_auth_token_t tokens[AUTH_TOKEN_CACHE_SIZE];
+	uint32_t count;
+	uint32_t next;
+} auth_token_cache;
+
 /*
  * This function creates auth_token key persistent object if it doesn't exist.
  * This function should be called once in TA_CreateEntryPoint function.
@@ -333,8 +348,29 @@ exit:
 	return res;
 }
 
+static bool TA_FindValidatedToken(const hw_auth_token_t *token)
+{
+	for (uint32_t i = 0; i < auth_token_cache.count; i++) {
+		if (memcmp(&auth_token_cache.tokens[i], token,
+					sizeof(*token)) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void TA_AddValidatedToken(const hw_auth_token_t *token)
+{
+	TEE_MemMove(&auth_token_cache.tokens[auth_token_cache.next], token,
+			sizeof(*token));
+	auth_token_cache.next = (auth_token_cache.next + 1) %
+						AUTH_TOKEN_CACHE_SIZE;
+	if (auth_token_cache.count < AUTH_TOKEN_CACHE_SIZE)
+		auth_token_cache.count++;
+}
+
 /*
  * Check that authintication token @token has valid HMAC value.
+ * Tokens validated before are accepted without HMAC computation.
  *
  * @return TEE_SUCCESS on success
  */
@@ -349,40 +385,53 @@ static TEE_Result TA_ValidateTokenSignature(const hw_auth_token_t *token)
 	const uint32_t computed_hmac_length = sizeof(token->hmac);
 	uint8_t computed_hmac[computed_hmac_length];
 
-	TEE_ObjectHandle auth_token_key_obj = TEE_HANDLE_NULL;
-
-	res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA256,
-			HMAC_SHA256_KEY_SIZE_BIT, &auth_token_key_obj);
-	if (res != TEE_SUCCESS) {
-		EMSG("Failed to allocate auth_token_key_obj, res=%x", res);
+	if (TA_FindValidatedToken(token))
 		goto exit;
-	}
 
-	res = TA_GetAuthKeyObj(auth_token_key_obj);
-	if (res != TEE_SUCCESS) {
-		EMSG("Failed to get auth_token key object, res=%x", res);
-		goto close_obj;
+	if (auth_token_key_cache == TEE_HANDLE_NULL) {
+		res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA256,
+				HMAC_SHA256_KEY_SIZE_BIT, &auth_token_key_cache);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to allocate auth_token_key_obj, res=%x", res);
+			auth_token_key_cache = TEE_HANDLE_NULL;
+			goto exit;
+		}
+
+		res = TA_GetAuthKeyObj(auth_token_key_cache);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to get auth_token key object, res=%x", res);
+			TEE_FreeTransientObject(auth_token_key_cache);
+			auth_token_key_cache = TEE_HANDLE_NULL;
+			goto exit;
+		}
 	}
 
-	res = TA_ComputeSignature(computed_hmac, computed_hmac_length, auth_token_key_obj,
-			token_data, token_data_length);
+	res = TA_ComputeSignature(computed_hmac, computed_hmac_length,
+			auth_token_key_cache, token_data, token_data_length);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to compute auth_token signature, res=%x", res);
-		goto close_obj;
+		goto exit;
 	}
 
 	if (memcmp(token->hmac, computed_hmac, computed_hmac_length) != 0) {
 		res = TEE_ERROR_MAC_INVALID;
 		EMSG("auth_token has invallid HMAC");
-		goto close_obj;
+		goto exit;
 	}
+	TA_AddValidatedToken(token);
 
-close_obj:
-	TEE_CloseObject(auth_token_key_obj);
 exit:
 	return res;
 }
 
+void TA_FreeAuthTokenCache(void)
+{
+	if (auth_token_key_cache != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(auth_token_key_cache);
+	auth_token_key_cache = TEE_HANDLE_NULL;
+	TEE_MemFill(&auth_token_cache, 0, sizeof(auth_token_cache));
+}
+
 /*
  * This function validate @auth_token parameter.
  *
@@ -0,0 +1,37 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command.h"
+
+static km_command_t current;
+
+void TA_command_begin(const uint32_t cmd)
+{
+	current.cmd = cmd;
+	current.slot = cmd < KM_STATS_COMMANDS ? cmd : 0;
+	current.active = true;
+}
+
+void TA_command_end(void)
+{
+	current.active = false;
+}
+
+const km_command_t *TA_command_current(void)
+{
+	return &current;
+}
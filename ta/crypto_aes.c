@@ -16,6 +16,7 @@
  */
 
 #include "crypto_aes.h"
+#include "heap.h"
 
 static bool TA_is_stream_cipher(const keymaster_block_mode_t mode)
 {
@@ -36,63 +37,16 @@ static void TA_append_tag(keymaster_blob_t *output, uint32_t *out_size,
 	*out_size += tag_len;
 }
 
-static keymaster_error_t TA_append_input(keymaster_blob_t *input,
-			keymaster_operation_t *operation,
-			const uint32_t to_copy, bool *is_input_ext)
+static bool TA_is_gcm_decrypt(const keymaster_operation_t *operation)
 {
-	uint8_t *data = NULL;
-	uint32_t tag_length = operation->mac_length / 8;
-	uint32_t push_to_input = operation->a_data_length
-					+ to_copy - tag_length;
-
-	data = TEE_Malloc(input->data_length + push_to_input,
-						TEE_MALLOC_FILL_ZERO);
-	if (!data) {
-		EMSG("Failed to allocate memory for input appended by TAG");
-		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-	}
-	TEE_MemMove(data, operation->a_data, push_to_input);
-	TEE_MemMove(data + push_to_input, input->data, input->data_length);
-	if (*is_input_ext)
-		TEE_Free(input->data);
-	input->data = data;
-	input->data_length += push_to_input;
-	operation->a_data_length -= push_to_input;
-	TEE_MemMove(operation->a_data, operation->a_data + push_to_input,
-					operation->a_data_length);
-	*is_input_ext = true;
-	return KM_ERROR_OK;
-}
-
-static keymaster_error_t TA_save_gcm_tag(keymaster_blob_t *input,
-				keymaster_operation_t *operation,
-				bool *is_input_ext)
-{
-	keymaster_error_t res = KM_ERROR_OK;
-	uint32_t tag_size = operation->mac_length / 8;
-	uint32_t to_copy = tag_size;
-
-	if (input->data_length == 0)
-		return res;
-	if (input->data_length < tag_size)
-		to_copy = input->data_length;
-	if (operation->a_data_length + to_copy > tag_size) {
-		res = TA_append_input(input, operation, to_copy, is_input_ext);
-		if (res != KM_ERROR_OK)
-			return res;
-	}
-
-	TEE_MemMove(operation->a_data + operation->a_data_length, input->data +
-				(input->data_length - to_copy), to_copy);
-	input->data_length -= to_copy;
-	operation->a_data_length += to_copy;
-	DMSG("Tag has been stored with size %u", operation->a_data_length);
-	return res;
+	return operation->mode == KM_MODE_GCM &&
+			operation->purpose == KM_PURPOSE_DECRYPT &&
+			operation->mac_length != UNDEFINED;
 }
 
 static keymaster_error_t TA_aes_gcm_prepare(keymaster_operation_t *operation,
 				const keymaster_key_param_set_t *in_params,
-				keymaster_blob_t *input, bool *is_input_ext)
+				const keymaster_blob_t *input)
 {
 	for (uint32_t i = 0; i < in_params->length; i++) {
 		if (in_params->params[i].tag == KM_TAG_ASSOCIATED_DATA) {
@@ -108,313 +62,362 @@ static keymaster_error_t TA_aes_gcm_prepare(keymaster_operation_t *operation,
 	}
 	if (input->data_length != 0)
 		operation->got_input = true;
+	return KM_ERROR_OK;
+}
 
-	/* During AES GCM decryption, the last KM_TAG_MAC_LENGTH bytes
-	 * of the data provided to the last update call is the tag
-	 */
-	if (operation->mac_length != UNDEFINED &&
-			operation->purpose == KM_PURPOSE_DECRYPT &&
-			input->data_length > 0) {
-		if (operation->a_data == NULL) {
-			/* Freed when operation is
-			 * aborted (TA_abort_operation)
-			 */
-			operation->a_data = TEE_Malloc(operation->mac_length/8,
-						TEE_MALLOC_FILL_ZERO);
-			if (!operation->a_data) {
-				EMSG("Failed to allocate memory for authentication tag");
-				return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-			}
-		}
-		/* Since a given invocation of update cannot know if
-		 * it's the last invocation, it must process all but
-		 * the tag length and buffer the possible tag data
-		 * for processing during finish.
-		 */
-		return TA_save_gcm_tag(input, operation, is_input_ext);
+static keymaster_error_t TA_aes_gcm_update_span(
+				keymaster_operation_t *operation,
+				const uint8_t *data, const uint32_t data_l,
+				keymaster_blob_t *output,
+				const uint32_t out_size)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t len = out_size - output->data_length;
+
+	if (data_l == 0)
+		return KM_ERROR_OK;
+	res = TEE_AEUpdate(*operation->operation, data, data_l,
+				output->data + output->data_length, &len);
+	if (res != TEE_SUCCESS) {
+		EMSG("Error TEE_AEUpdate, res=%x", res);
+		return res;
 	}
+	output->data_length += len;
 	return KM_ERROR_OK;
 }
 
-keymaster_error_t TA_aes_finish(keymaster_operation_t *operation,
- 				keymaster_blob_t *input,
- 				keymaster_blob_t *output, uint32_t *out_size,
-				uint32_t tag_len, bool *is_input_ext,
-				const keymaster_key_param_set_t *in_params)
+/*
+ * During AES GCM decryption, the last KM_TAG_MAC_LENGTH bytes of the
+ * data is the tag. Since a given invocation of update cannot know if
+ * it's the last invocation, the last tag size bytes seen so far are
+ * kept in the operation tag ring and everything before them is
+ * decrypted: ring bytes pushed out by the new data, then the new data
+ * except its part that goes to the ring.
+ */
+static keymaster_error_t TA_aes_gcm_feed(keymaster_operation_t *operation,
+				const keymaster_blob_t *input,
+				keymaster_blob_t *output,
+				const uint32_t out_size)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+	uint32_t size = operation->mac_length / 8;
+	uint32_t total = operation->tag_length + input->data_length;
+	uint32_t process = total > size ? total - size : 0;
+	uint32_t from_ring = process < operation->tag_length ?
+					process : operation->tag_length;
+	uint32_t from_input = process - from_ring;
+	uint32_t tail = input->data_length - from_input;
+	uint32_t span = 0;
+	uint32_t pos = 0;
+
+	/* Ring content may wrap around */
+	span = size - operation->tag_start;
+	if (span > from_ring)
+		span = from_ring;
+	res = TA_aes_gcm_update_span(operation,
+			operation->tag_ring + operation->tag_start, span,
+			output, out_size);
+	if (res != KM_ERROR_OK)
+		return res;
+	res = TA_aes_gcm_update_span(operation, operation->tag_ring,
+			from_ring - span, output, out_size);
+	if (res != KM_ERROR_OK)
+		return res;
+	operation->tag_start = (operation->tag_start + from_ring) % size;
+	operation->tag_length -= from_ring;
+
+	res = TA_aes_gcm_update_span(operation, input->data, from_input,
+			output, out_size);
+	if (res != KM_ERROR_OK)
+		return res;
+
+	/* Append the new tail to the ring */
+	pos = (operation->tag_start + operation->tag_length) % size;
+	span = size - pos;
+	if (span > tail)
+		span = tail;
+	TEE_MemMove(operation->tag_ring + pos, input->data + from_input,
+									span);
+	TEE_MemMove(operation->tag_ring, input->data + from_input + span,
+								tail - span);
+	operation->tag_length += tail;
+	return KM_ERROR_OK;
+}
+
+static keymaster_error_t TA_aes_gcm_decrypt_final(
+				keymaster_operation_t *operation,
+				const keymaster_blob_t *input,
+				keymaster_blob_t *output, uint32_t *out_size)
 {
 	TEE_Result tee_res = TEE_SUCCESS;
 	keymaster_error_t res = KM_ERROR_OK;
-	uint8_t *tag = NULL;
+	uint32_t size = operation->mac_length / 8;
+	uint8_t tag[BLOCK_SIZE];
+	uint32_t span = 0;
+	uint32_t len = 0;
 
+	res = TA_aes_gcm_feed(operation, input, output, *out_size);
+	if (res != KM_ERROR_OK)
+		return res;
+	if (operation->tag_length != size) {
+		EMSG("AES GCM input is shorter than the tag");
+		return KM_ERROR_INVALID_INPUT_LENGTH;
+	}
+	span = size - operation->tag_start;
+	TEE_MemMove(tag, operation->tag_ring + operation->tag_start, span);
+	TEE_MemMove(tag + span, operation->tag_ring, size - span);
+
+	len = *out_size - output->data_length;
+	tee_res = TEE_AEDecryptFinal(*operation->operation, NULL, 0,
+				output->data + output->data_length, &len,
+				tag, size);
+	if (tee_res == TEE_ERROR_MAC_INVALID) {
+		/* tag verification fails */
+		EMSG("AES GCM verification failed, res=%x", tee_res);
+		return KM_ERROR_VERIFICATION_FAILED;
+	}
+	if (tee_res != TEE_SUCCESS) {
+		EMSG("TEE_AEDecryptFinal failed, res=%x", tee_res);
+		return tee_res;
+	}
+	output->data_length += len;
+	*out_size = output->data_length;
+	return KM_ERROR_OK;
+}
+
+/* Number of trailing bytes of data that can not be processed yet */
+static uint32_t TA_aes_keep_size(const keymaster_operation_t *operation,
+				const uint32_t total)
+{
+	/* The last block may be the pad, it is decrypted in finish */
 	if (operation->padding == KM_PAD_PKCS7 &&
-			operation->purpose == KM_PURPOSE_ENCRYPT) {
-		res = TA_add_pkcs7_pad(input, !operation->padded, output,
-							out_size, is_input_ext);
-		if (res != KM_ERROR_OK)
+			operation->purpose == KM_PURPOSE_DECRYPT &&
+			total != 0 && total % BLOCK_SIZE == 0)
+		return BLOCK_SIZE;
+	return total % BLOCK_SIZE;
+}
+
+/*
+ * Processes carried bytes followed by data, except the last keep bytes
+ * which are moved to the carry buffer. Result is appended to output.
+ */
+static keymaster_error_t TA_aes_feed_blocks(keymaster_operation_t *operation,
+				const uint8_t *data, uint32_t data_l,
+				const uint32_t keep,
+				keymaster_blob_t *output,
+				const uint32_t out_size)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t process = operation->carry_length + data_l - keep;
+	uint32_t need = 0;
+	uint32_t len = 0;
+
+	if (process != 0 && operation->carry_length != 0) {
+		/* Complete carried block from the new data */
+		need = BLOCK_SIZE - operation->carry_length;
+		TEE_MemMove(operation->carry + operation->carry_length,
+								data, need);
+		len = out_size - output->data_length;
+		res = TEE_CipherUpdate(*operation->operation,
+				operation->carry, BLOCK_SIZE,
+				output->data + output->data_length, &len);
+		if (res != TEE_SUCCESS)
+			goto out;
+		output->data_length += len;
+		operation->carry_length = 0;
+		data += need;
+		data_l -= need;
+		process -= BLOCK_SIZE;
+	}
+	if (process != 0) {
+		/* All full blocks at once */
+		len = out_size - output->data_length;
+		res = TEE_CipherUpdate(*operation->operation, data, process,
+				output->data + output->data_length, &len);
+		if (res != TEE_SUCCESS)
 			goto out;
-		operation->padded = true;
-	} else if (operation->padding == KM_PAD_NONE && (operation->mode ==
-			KM_MODE_CBC || operation->mode == KM_MODE_ECB) &&
-			input->data_length % BLOCK_SIZE != 0) {
+		output->data_length += len;
+		data += process;
+		data_l -= process;
+	}
+	/* No more than one block is left */
+	TEE_MemMove(operation->carry + operation->carry_length, data, data_l);
+	operation->carry_length += data_l;
+out:
+	if (res != TEE_SUCCESS)
+		EMSG("Error TEE_CipherUpdate, res=%x", res);
+	return res;
+}
+
+/* KM_MODE_CBC, KM_MODE_ECB */
+static keymaster_error_t TA_aes_finish_blocks(keymaster_operation_t *operation,
+				const keymaster_blob_t *input,
+				keymaster_blob_t *output, uint32_t *out_size)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+	uint32_t total = operation->carry_length + input->data_length;
+	uint32_t pad = 0;
+	uint32_t len = 0;
+
+	if (operation->padding == KM_PAD_NONE && total % BLOCK_SIZE != 0) {
 		EMSG("Input data size for AES CBC and ECB modes without padding must be a multiple of block size");
-		res = KM_ERROR_INVALID_INPUT_LENGTH;
-		goto out;
-	} else if (operation->padding == KM_PAD_PKCS7 &&
+		return KM_ERROR_INVALID_INPUT_LENGTH;
+	}
+	if (operation->padding == KM_PAD_PKCS7 &&
 			operation->purpose == KM_PURPOSE_DECRYPT &&
-			input->data_length % BLOCK_SIZE != 0) {
+			total % BLOCK_SIZE != 0) {
 		EMSG("Input data size for AES PKCS7 must be a multiple of block size");
-		res = KM_ERROR_INVALID_INPUT_LENGTH;
-		goto out;
+		return KM_ERROR_INVALID_INPUT_LENGTH;
 	}
+	res = TA_aes_feed_blocks(operation, input->data, input->data_length,
+				TA_aes_keep_size(operation, total),
+				output, *out_size);
+	if (res != KM_ERROR_OK)
+		return res;
+	if (operation->padding == KM_PAD_PKCS7 &&
+			operation->purpose == KM_PURPOSE_ENCRYPT) {
+		/* Pad the carried tail up to a full block */
+		pad = BLOCK_SIZE - operation->carry_length;
+		DMSG("PKCS7 ADD pad = %x", pad);
+		TEE_MemFill(operation->carry + operation->carry_length,
+								pad, pad);
+		operation->carry_length = BLOCK_SIZE;
+	}
+	len = *out_size - output->data_length;
+	res = TEE_CipherDoFinal(*operation->operation, operation->carry,
+				operation->carry_length,
+				output->data + output->data_length, &len);
+	operation->carry_length = 0;
+	if (res != KM_ERROR_OK) {
+		EMSG("Error TEE_CipherDoFinal, res=%x", res);
+		return res;
+	}
+	output->data_length += len;
+	*out_size = output->data_length;
+	if (operation->padding == KM_PAD_PKCS7 &&
+			operation->purpose == KM_PURPOSE_DECRYPT) {
+		if (output->data_length == 0) {
+			EMSG("Padding was not removed");
+			return KM_ERROR_INVALID_ARGUMENT;
+		}
+		res = TA_remove_pkcs7_pad(output, out_size);
+	}
+	return res;
+}
+
+keymaster_error_t TA_aes_finish(keymaster_operation_t *operation,
+ 				keymaster_blob_t *input,
+ 				keymaster_blob_t *output, uint32_t *out_size,
+				uint32_t tag_len,
+				const keymaster_key_param_set_t *in_params)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+	uint8_t *tag = NULL;
+
+	if (!TA_is_stream_cipher(operation->mode))
+		return TA_aes_finish_blocks(operation, input, output, out_size);
 	if (operation->mode == KM_MODE_GCM) {
 		/* For KM_MODE_GCM */
-		res = TA_aes_gcm_prepare(operation, in_params, input, is_input_ext);
+		res = TA_aes_gcm_prepare(operation, in_params, input);
 		if (res != KM_ERROR_OK)
 			goto out;
-		if (operation->purpose == KM_PURPOSE_ENCRYPT) {
-			/* During encryption */
-			tag = TEE_Malloc(tag_len, TEE_MALLOC_FILL_ZERO);
-			if (!tag) {
-				EMSG("Failed to allocate memory for GCM tag");
-				res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
-				goto out;
-			}
-			res = TEE_AEEncryptFinal(*operation->operation,
-						input->data, input->data_length,
-						output->data, out_size,
-						tag, &tag_len);
-			if (res != KM_ERROR_OK) {
-				EMSG("TEE_AEEncryptFinal failed, res=%x", res);
-				goto out;
-			}
-			/* after processing all plaintext, compute the
-			 * tag (KM_TAG_MAC_LENGTH bytes) and append it
-			 * to the returned ciphertext
-			 */
-			TA_append_tag(output, out_size, tag, tag_len);
-		} else {/* KM_PURPOSE_DECRYPT	During decryption
-			 * process the last KM_TAG_MAC_LENGTH bytes from
-			 * input data of last Update as the tag
+		if (TA_is_gcm_decrypt(operation)) {
+			/* KM_PURPOSE_DECRYPT	During decryption
+			 * the last KM_TAG_MAC_LENGTH bytes from
+			 * input data is the tag
 			 */
-			tee_res = TEE_AEDecryptFinal(*operation->operation,
-						input->data, input->data_length,
-						output->data, out_size,
-						operation->a_data, /*tag to compare*/
-						operation->mac_length / 8);
-			if (tee_res == TEE_ERROR_MAC_INVALID) {
-				/* tag verification fails */
-				EMSG("AES GCM verification failed, res=%x", res);
-				res = KM_ERROR_VERIFICATION_FAILED;
-				goto out;
-			}
+			res = TA_aes_gcm_decrypt_final(operation, input,
+							output, out_size);
+			goto out;
+		}
+		/* During encryption */
+		tag = TA_malloc(tag_len, KM_HEAP_CRYPTO);
+		if (!tag) {
+			EMSG("Failed to allocate memory for GCM tag");
+			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+			goto out;
 		}
+		res = TEE_AEEncryptFinal(*operation->operation,
+					input->data, input->data_length,
+					output->data, out_size,
+					tag, &tag_len);
+		if (res != KM_ERROR_OK) {
+			EMSG("TEE_AEEncryptFinal failed, res=%x", res);
+			goto out;
+		}
+		/* after processing all plaintext, compute the
+		 * tag (KM_TAG_MAC_LENGTH bytes) and append it
+		 * to the returned ciphertext
+		 */
+		TA_append_tag(output, out_size, tag, tag_len);
 	} else {
 		res = TEE_CipherDoFinal(*operation->operation, input->data,
 					input->data_length, output->data,
 					out_size);
 	}
 	output->data_length = *out_size;
-	if (res == KM_ERROR_OK && operation->padding == KM_PAD_PKCS7
-			&& operation->purpose == KM_PURPOSE_DECRYPT) {
-		if (operation->last_block.data) {
-			TEE_MemMove(output->data, operation->last_block.data, BLOCK_SIZE);
-			operation->last_block.data_length = 0;
-			TEE_Free(operation->last_block.data);
-			operation->last_block.data = NULL;
-			output->data_length += BLOCK_SIZE;
-		}
-		if (output->data_length > 0) {
-			res = TA_remove_pkcs7_pad(output, out_size);
-			if (res == KM_ERROR_OK)
-				operation->padded = true;
-		}
-		if (!operation->padded) {
-			EMSG("Padding was not removed");
-			res = KM_ERROR_INVALID_ARGUMENT;
-		}
-	}
 out:
 	if (tag)
-		TEE_Free(tag);
+		TA_free(tag);
 	return res;
 }
 
-static keymaster_error_t TA_store_last_block(keymaster_blob_t *output,
-					size_t *input_consumed,
-					keymaster_operation_t *op)
-{
-	if (output->data_length < BLOCK_SIZE) {
-		EMSG("Output is too smal to be stored");
-		return KM_ERROR_UNKNOWN_ERROR;
-	}
-	op->last_block.data = TEE_Malloc(BLOCK_SIZE, TEE_MALLOC_FILL_ZERO);
-	if (!op->last_block.data) {
-		EMSG("Failed to allocate memory for last block buffer");
-		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-	}
-	TEE_MemMove(op->last_block.data, output->data +
-		output->data_length - BLOCK_SIZE, BLOCK_SIZE);
-	output->data_length -= BLOCK_SIZE;
-	*input_consumed -= BLOCK_SIZE;
-	op->prev_in_size += BLOCK_SIZE;
-	op->last_block.data_length = BLOCK_SIZE;
-	return KM_ERROR_OK;
-}
-
-static keymaster_error_t TA_restore_last_block(keymaster_blob_t *output,
-					size_t *input_consumed,
-					keymaster_operation_t *op,
-					uint32_t *pos)
-{
-	if (op->last_block.data_length != BLOCK_SIZE) {
-		EMSG("Stored block has a bad size");
-		return KM_ERROR_UNKNOWN_ERROR;
-	}
-	TEE_MemMove(output->data, op->last_block.data, BLOCK_SIZE);
-	*input_consumed += BLOCK_SIZE;
-	*pos += BLOCK_SIZE;
-	op->last_block.data_length = 0;
-	TEE_Free(op->last_block.data);
-	op->last_block.data = NULL;
-	output->data_length += BLOCK_SIZE;
-	return KM_ERROR_OK;
-}
-
 keymaster_error_t TA_aes_update(keymaster_operation_t *operation,
 				keymaster_blob_t *input,
 				keymaster_blob_t *output,
 				uint32_t *out_size,
 				const uint32_t input_provided,
 				size_t *input_consumed,
-				const keymaster_key_param_set_t *in_params,
-				bool *is_input_ext)
+				const keymaster_key_param_set_t *in_params)
 {
 	keymaster_error_t res = KM_ERROR_OK;
-	uint32_t pos = 0U;
-	uint32_t remainder = 0;
-	uint32_t in_size = BLOCK_SIZE;
 
-	/* KM_MODE_CBC, KM_MODE_ECB */
 	if (!TA_is_stream_cipher(operation->mode)) {
-		if (operation->last_block.data != NULL && operation->last_block.data_length != 0) {
-			DMSG("Restore last block");
-			res = TA_restore_last_block(output, input_consumed, operation, &pos);
-			if (res != KM_ERROR_OK) {
-				EMSG("Failed to restore last block");
-				goto out;
-			}
-		}
-		if (operation->padding == KM_PAD_PKCS7) {
-			if (operation->prev_in_size == input->data_length) {
-				DMSG("End of data reached");
-				operation->buffering = false;
-			} else {
-				DMSG("Buffering ON");
-				operation->buffering = true;
-			}
-			if (operation->prev_in_size == UNDEFINED
-					&& input->data_length == BLOCK_SIZE) {
-				operation->prev_in_size = input->data_length;
-				goto out;
-			}
-			operation->prev_in_size = input->data_length;
-			if (operation->buffering && ((input->data_length <=
-					BLOCK_SIZE && operation->purpose ==
-					KM_PURPOSE_DECRYPT) ||
-					(input->data_length < BLOCK_SIZE &&
-					operation->purpose ==
-					KM_PURPOSE_ENCRYPT))) {
-				DMSG("Input data is too small. Buffering");
-				/* Buffering if data
-				 * transferred by chunks
-				 */
-				goto out;
-			}
-			DMSG("Some blocks can be processed");
-		} else {/* KM_PAD_NONE */
-			if (input->data_length < BLOCK_SIZE)
-				goto out;
-		}
-	}
-
-	/* only KM_MODE_CBC and KM_MODE_ECB */
-	if (operation->padding == KM_PAD_PKCS7 && !operation->buffering &&
-			operation->purpose == KM_PURPOSE_ENCRYPT) {
-		DMSG("Adding padding before encryption");
-		res = TA_add_pkcs7_pad(input, !operation->padded, output,
-					out_size, is_input_ext);
+		/* KM_MODE_CBC, KM_MODE_ECB. Whole input is consumed,
+		 * incomplete block is carried to the next call
+		 */
+		res = TA_aes_feed_blocks(operation, input->data,
+				input->data_length,
+				TA_aes_keep_size(operation,
+					operation->carry_length +
+					input->data_length),
+				output, *out_size);
 		if (res != KM_ERROR_OK)
 			goto out;
-		operation->padded = true;
-	}
-	remainder = input->data_length - pos;
-	if (operation->mode == KM_MODE_GCM) {
+	} else if (operation->mode == KM_MODE_GCM) {
 		/* check presence of associated data for AES keys */
-		res = TA_aes_gcm_prepare(operation, in_params, input,
-								is_input_ext);
-		if (res != KM_ERROR_OK)
-			goto out;
-		/* Resize output if input length increased */
-		res = TA_check_out_size(input->data_length, output, out_size,
-						operation->mac_length / 8);
-		if (res != KM_ERROR_OK)
-			goto out;
-		res = TEE_AEUpdate(*operation->operation, input->data,
-				input->data_length, output->data, out_size);
+		res = TA_aes_gcm_prepare(operation, in_params, input);
 		if (res != KM_ERROR_OK)
 			goto out;
-		output->data_length += *out_size;
-		*input_consumed = input_provided;
-	} else {
-		if (operation->mode == KM_MODE_CTR)
-			/* CTR is a stream mode */
-			in_size = input->data_length;
-		while (operation->mode == KM_MODE_CTR
-			   || remainder / BLOCK_SIZE != 0) {
-			/* calculate memory left.
-			 * Add BLOCK_SIZE in case adding padding
-			 */
-			*out_size = BLOCK_SIZE + input->data_length -
-							output->data_length;
-			res = TEE_CipherUpdate(*operation->operation,
-					input->data + pos, in_size,
-					output->data + pos, out_size);
-			if (res != TEE_SUCCESS) {
-				EMSG("Error TEE_CipherUpdate, res=%x", res);
+		if (TA_is_gcm_decrypt(operation)) {
+			res = TA_aes_gcm_feed(operation, input, output,
+								*out_size);
+			if (res != KM_ERROR_OK)
 				goto out;
-			}
-			output->data_length += *out_size;
-			pos += in_size;
-			*input_consumed += in_size;
-			operation->prev_in_size -= in_size;
-			remainder -= in_size;
-			if (remainder < BLOCK_SIZE)
-				break;
-		}
-	}
-	if (*input_consumed > input_provided)
-		*input_consumed = input_provided;
-	if (res == KM_ERROR_OK && operation->padding == KM_PAD_PKCS7 &&
-			operation->purpose == KM_PURPOSE_DECRYPT
-			&& *input_consumed == input_provided) {
-		if (operation->buffering && TA_check_pkcs7_pad(output)
-						&& operation->first) {
-			DMSG("Store last block");
-			res = TA_store_last_block(output, input_consumed,
-								operation);
-			if (res != KM_ERROR_OK) {
-				EMSG("Failed to store last block");
+		} else {
+			res = TEE_AEUpdate(*operation->operation, input->data,
+					input->data_length, output->data,
+					out_size);
+			if (res != KM_ERROR_OK)
 				goto out;
-			}
+			output->data_length += *out_size;
 		}
-		if (!operation->buffering || TA_check_pkcs7_pad(output)) {
-			DMSG("Remove PKCS7 pad");
-			res = TA_remove_pkcs7_pad(output, out_size);
-			if (res == KM_ERROR_OK)
-				operation->padded = true;
+	} else {
+		/* CTR is a stream mode.
+		 * calculate memory left.
+		 */
+		*out_size = BLOCK_SIZE + input->data_length -
+						output->data_length;
+		res = TEE_CipherUpdate(*operation->operation,
+				input->data, input->data_length,
+				output->data, out_size);
+		if (res != TEE_SUCCESS) {
+			EMSG("Error TEE_CipherUpdate, res=%x", res);
+			goto out;
 		}
+		output->data_length += *out_size;
 	}
-	operation->first = false;
+	*input_consumed = input_provided;
 out:
 	return res;
 }
@@ -16,6 +16,7 @@
  */
 
 #include "crypto_ec.h"
+#include "heap.h"
 
 static keymaster_error_t TA_check_ec_data_size(uint8_t **data, uint32_t *data_l,
 				const uint32_t key_size, bool *clear_in_buf)
@@ -41,8 +42,13 @@ static keymaster_error_t TA_check_ec_data_size(uint8_t **data, uint32_t *data_l,
 			TA_short_be_rshift(*data, *data_l,
 				8 - (key_size & 0x7));
 		}
-	} else {
-		ptr = TEE_Malloc(key_size_bytes, TEE_MALLOC_FILL_ZERO);
+	} else if (key_size % 8 == 0) {
+		/*
+		 * Zero padding keeps the value only for whole byte key
+		 * sizes. For P-521 the leftmost 521 bits of the buffer
+		 * are used, so a shorter digest is passed as is.
+		 */
+		ptr = TA_malloc(key_size_bytes, KM_HEAP_CRYPTO);
 		if (!ptr) {
 			EMSG("Failed to allocate memory for extended data");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -51,7 +57,7 @@ static keymaster_error_t TA_check_ec_data_size(uint8_t **data, uint32_t *data_l,
 		TEE_MemMove(ptr + (key_size_bytes - *data_l), *data, *data_l);
 		*data_l = key_size_bytes;
 		if (*clear_in_buf)
-			TEE_Free(*data);
+			TA_free(*data);
 		*data = ptr;
 		*clear_in_buf = true;
 	}
@@ -94,12 +100,14 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 				keymaster_blob_t *signature,
 				uint32_t *out_size,
 				const uint32_t key_size,
-				TEE_TASessionHandle *sessionSTA,
 				bool *is_input_ext)
 {
 	keymaster_error_t res = KM_ERROR_OK;
 	uint32_t digest_out_size = KM_MAX_DIGEST_SIZE;
 	uint8_t digest_out[KM_MAX_DIGEST_SIZE];
+	uint8_t raw_sign[EC_MAX_RAW_SIGN_SIZE];
+	uint32_t raw_sign_l = sizeof(raw_sign);
+	uint32_t out_capacity = *out_size;
 	uint8_t *in_buf = NULL;
 	uint32_t in_buf_l = 0;
 	bool clear_in_buf = false;
@@ -142,8 +150,8 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 							in_buf_l, output->data,
 							out_size);
 			if (res == TEE_SUCCESS && *out_size > 0) {
-				res = TA_encode_ec_sign(*sessionSTA,
-						output->data, out_size);
+				res = TA_der_encode_ec_sign(output->data,
+						out_size, out_capacity);
 				if (res != KM_ERROR_OK) {
 					EMSG("Failed to encode EC sign, res=%x", res);
 					break;
@@ -151,8 +159,8 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 			}
 		} else {
 			*out_size = 0;
-			res = TA_decode_ec_sign(*sessionSTA, signature,
-								key_size);
+			res = TA_der_decode_ec_sign(signature, key_size,
+						raw_sign, &raw_sign_l);
 			if (res != KM_ERROR_OK) {
 				EMSG("Failed to decode EC sign, res=%x", res);
 				break;
@@ -160,8 +168,7 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 			res = TEE_AsymmetricVerifyDigest(*operation->operation,
 							NULL, 0, in_buf,
 							in_buf_l,
-							signature->data,
-							signature->data_length);
+							raw_sign, raw_sign_l);
 			/* Convert error code to Android style */
 			if (res == (int) TEE_ERROR_SIGNATURE_INVALID)
 				res = KM_ERROR_VERIFICATION_FAILED;
@@ -171,6 +178,6 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 		res = KM_ERROR_UNSUPPORTED_PURPOSE;
 	}
 	if (in_buf && clear_in_buf)
-		TEE_Free(in_buf);
+		TA_free(in_buf);
 	return res;
 }
@@ -47,12 +47,9 @@ static uint32_t TA_get_hash_size(const TEE_OperationHandle *digest_op)
 
 static keymaster_error_t TA_check_input_rsa(const keymaster_operation_t *operation,
 				const uint8_t *in_buf, const uint32_t in_buf_l,
-				const uint32_t key_size,
-				const TEE_ObjectHandle obj_h)
+				const uint32_t key_size)
 {
 	keymaster_error_t res = KM_ERROR_OK;
-	uint8_t *modulus = NULL;
-	uint32_t modulus_size = KM_RSA_ATTR_SIZE;
 	uint32_t modulus_len = (key_size + 7) / 8;
 	uint32_t hash_len = 0;
 	uint32_t salt_len = 0;
@@ -79,24 +76,13 @@ static keymaster_error_t TA_check_input_rsa(const keymaster_operation_t *operati
 		  operation->purpose == KM_PURPOSE_ENCRYPT) {
 		if (in_buf_l == key_size / 8) {
 			/* If the data is the same length as the key */
-			if (!modulus) {
-				modulus = TEE_Malloc(modulus_size,
-						TEE_MALLOC_FILL_ZERO);
-				if (!modulus) {
-					EMSG("Failed to allocate memory for RSA modulus");
-					res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
-					goto out;
-				}
-			}
-			res = TEE_GetObjectBufferAttribute(obj_h,
-						TEE_ATTR_RSA_MODULUS,
-						modulus,
-						&modulus_size);
-			if (res != KM_ERROR_OK) {
-				EMSG("Failed to read RSA key, res=%x", res);
+			if (operation->modulus.data_length != in_buf_l) {
+				EMSG("RSA modulus is not cached for operation");
+				res = KM_ERROR_UNKNOWN_ERROR;
 				goto out;
 			}
-			if (TEE_MemCompare(in_buf, modulus, in_buf_l) >= 0) {
+			if (TEE_MemCompare(in_buf, operation->modulus.data,
+							in_buf_l) >= 0) {
 				/* but numerically larger */
 				res = KM_ERROR_INVALID_ARGUMENT;
 				EMSG("For RSA Sign and Encrypt with KM_PAD_NONE input data value must be not bigger then key");
@@ -114,8 +100,6 @@ static keymaster_error_t TA_check_input_rsa(const keymaster_operation_t *operati
 		}
 	}
 out:
-	if (modulus)
-		TEE_Free(modulus);
 	return res;
 }
 
@@ -124,7 +108,6 @@ keymaster_error_t TA_rsa_finish(keymaster_operation_t *operation,
 				keymaster_blob_t *output, uint32_t *out_size,
 				const uint32_t key_size,
 				const keymaster_blob_t signature,
-				const TEE_ObjectHandle obj_h,
 				bool *is_input_ext)
 {
 	keymaster_error_t res = KM_ERROR_OK;
@@ -198,7 +181,7 @@ keymaster_error_t TA_rsa_finish(keymaster_operation_t *operation,
 			in_buf_l = signature.data_length;
 		}
 	}
-	res = TA_check_input_rsa(operation, in_buf, in_buf_l, key_size, obj_h);
+	res = TA_check_input_rsa(operation, in_buf, in_buf_l, key_size);
 	if (res != KM_ERROR_OK)
 		goto out;
 	switch (operation->purpose) {
@@ -350,7 +333,7 @@ keymaster_error_t TA_rsa_finish(keymaster_operation_t *operation,
 		 * and TEE_AsymmetricEncrypt for unpadded operation truncate all
 		 * zeroes but one if it is the last. Restore result array.
 		 */
-		res = TA_do_rsa_pad(&output->data, out_size, key_size);
+		res = TA_do_rsa_pad_in_place(output->data, out_size, key_size);
 	}
 	/* Convert error code to Android type */
 	if (res == (int) TEE_ERROR_BAD_PARAMETERS &&
@@ -366,8 +349,7 @@ keymaster_error_t TA_rsa_update(keymaster_operation_t *operation,
 				uint32_t *out_size,
 				const uint32_t key_size,
 				size_t *input_consumed,
-				const uint32_t input_provided,
-				const TEE_ObjectHandle obj_h)
+				const uint32_t input_provided)
 {
 	keymaster_error_t res = KM_ERROR_OK;
 	uint32_t key_bytes = (key_size + 7) / 8;
@@ -384,7 +366,7 @@ keymaster_error_t TA_rsa_update(keymaster_operation_t *operation,
 		if (operation->padding == KM_PAD_NONE) {
 			res = TA_check_input_rsa(operation, input->data,
 						input->data_length,
-						key_size, obj_h);
+						key_size);
 			if (res == KM_ERROR_INVALID_INPUT_LENGTH) {
 				res = TA_store_sf_data(input, operation);
 				*input_consumed = input_provided;
@@ -414,8 +396,8 @@ keymaster_error_t TA_rsa_update(keymaster_operation_t *operation,
 				 * operation truncate all zeroes but one
 				 * if it is the last. Restore result.
 				 */
-				res = TA_do_rsa_pad(&output->data, out_size,
-								key_size);
+				res = TA_do_rsa_pad_in_place(output->data,
+							out_size, key_size);
 			/* Convert error code to Android type */
 			if (res == (int) TEE_ERROR_BAD_PARAMETERS &&
 				      operation->padding != KM_PAD_NONE)
@@ -0,0 +1,608 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "der.h"
+#include "heap.h"
+
+#define DER_OID(arcs)	arcs, (sizeof(arcs) / sizeof(arcs[0]))
+
+static const uint64_t identifier_rsa[] = {1, 2, 840, 113549, 1, 1, 1};
+/* RSAPrivateKey ::= SEQUENCE {
+ *    version Version,
+ *    modulus INTEGER, -- n
+ *    publicExponent INTEGER, -- e
+ *    privateExponent INTEGER, -- d
+ *    prime1 INTEGER, -- p
+ *    prime2 INTEGER, -- q
+ *    exponent1 INTEGER, -- d mod (p-1)
+ *    exponent2 INTEGER, -- d mod (q-1)
+ *    coefficient INTEGER -- (inverse of q) mod p }
+ */
+
+static const uint64_t identifier_ec[] = {1, 2, 840, 10045, 2, 1};
+/* ECPrivateKey ::= SEQUNCE {
+ *    version Version,
+ *    secretValue OCTET_STRING,
+ *    parameters [0] ECParameters OPTIONAL,
+ *    publicValue CONSTRUCTED {
+ *        XYValue BIT_STRING } }
+ */
+
+static const uint64_t identifier_p224[] = {1, 3, 132, 0, 33};
+static const uint64_t identifier_p256[] = {1, 2, 840, 10045, 3, 1, 7};
+static const uint64_t identifier_p384[] = {1, 3, 132, 0, 34};
+static const uint64_t identifier_p521[] = {1, 3, 132, 0, 35};
+
+static const struct {
+	uint32_t key_size;
+	const uint64_t *arcs;
+	uint32_t arcs_count;
+} der_curves[] = {
+	{224, DER_OID(identifier_p224)},
+	{256, DER_OID(identifier_p256)},
+	{384, DER_OID(identifier_p384)},
+	{521, DER_OID(identifier_p521)},
+};
+
+bool TA_der_read(der_reader_t *reader, const uint8_t tag,
+		der_reader_t *content)
+{
+	const uint8_t *ptr = reader->ptr;
+	uint32_t length = 0;
+	uint32_t count = 0;
+
+	if (reader->end - ptr < 2 || ptr[0] != tag)
+		return false;
+	length = ptr[1];
+	ptr += 2;
+	if (length & 0x80) {
+		/* Long form, at most 4 length bytes */
+		count = length & 0x7f;
+		if (count == 0 || count > 4 ||
+				(uint32_t)(reader->end - ptr) < count ||
+				ptr[0] == 0)
+			return false;
+		length = 0;
+		while (count--)
+			length = (length << 8) | *ptr++;
+		if (length < 0x80)
+			return false;
+	}
+	if ((uint32_t)(reader->end - ptr) < length)
+		return false;
+	content->ptr = ptr;
+	content->end = ptr + length;
+	reader->ptr = ptr + length;
+	return true;
+}
+
+bool TA_der_read_uint(der_reader_t *reader, const uint8_t **value,
+		uint32_t *value_l)
+{
+	der_reader_t content;
+
+	if (!TA_der_read(reader, DER_TAG_INTEGER, &content) ||
+			content.ptr == content.end)
+		return false;
+	/* Negative value */
+	if (content.ptr[0] & 0x80)
+		return false;
+	if (content.ptr[0] == 0 && content.end - content.ptr > 1) {
+		/* Sign byte is allowed only before high bit set */
+		if (!(content.ptr[1] & 0x80))
+			return false;
+		content.ptr++;
+	}
+	*value = content.ptr;
+	*value_l = content.end - content.ptr;
+	return true;
+}
+
+uint32_t TA_der_header_size(const uint32_t length)
+{
+	if (length < 0x80)
+		return 2;
+	if (length <= 0xff)
+		return 3;
+	if (length <= 0xffff)
+		return 4;
+	if (length <= 0xffffff)
+		return 5;
+	return 6;
+}
+
+uint32_t TA_der_put_header(uint8_t *out, const uint8_t tag,
+		const uint32_t length)
+{
+	uint32_t size = TA_der_header_size(length);
+
+	out[0] = tag;
+	if (size == 2) {
+		out[1] = length;
+		return size;
+	}
+	out[1] = 0x80 | (size - 2);
+	for (uint32_t i = size - 1; i >= 2; i--)
+		out[i] = length >> (8 * (size - 1 - i));
+	return size;
+}
+
+static void TA_der_strip_zeroes(const uint8_t **value, uint32_t *value_l)
+{
+	while (*value_l > 1 && (*value)[0] == 0) {
+		(*value)++;
+		(*value_l)--;
+	}
+}
+
+uint32_t TA_der_uint_size(const uint8_t *value, uint32_t value_l)
+{
+	uint32_t length = 0;
+
+	TA_der_strip_zeroes(&value, &value_l);
+	length = value_l + ((value_l == 0 || value[0] & 0x80) ? 1 : 0);
+	return TA_der_header_size(length) + length;
+}
+
+uint32_t TA_der_put_uint(uint8_t *out, const uint8_t *value,
+		uint32_t value_l)
+{
+	uint8_t *start = out;
+	bool sign_byte = false;
+
+	TA_der_strip_zeroes(&value, &value_l);
+	sign_byte = value_l == 0 || value[0] & 0x80;
+	out += TA_der_put_header(out, DER_TAG_INTEGER,
+				value_l + (sign_byte ? 1 : 0));
+	if (sign_byte)
+		*out++ = 0;
+	TEE_MemMove(out, value, value_l);
+	out += value_l;
+	return out - start;
+}
+
+static uint32_t TA_der_arc_size(uint64_t arc)
+{
+	uint32_t size = 1;
+
+	while (arc >>= 7)
+		size++;
+	return size;
+}
+
+static uint64_t TA_der_arc(const uint64_t *arcs, const uint32_t i)
+{
+	/* First two arcs share one subidentifier */
+	return i == 1 ? arcs[0] * 40 + arcs[1] : arcs[i];
+}
+
+static uint32_t TA_der_oid_size(const uint64_t *arcs,
+				const uint32_t arcs_count)
+{
+	uint32_t length = 0;
+
+	for (uint32_t i = 1; i < arcs_count; i++)
+		length += TA_der_arc_size(TA_der_arc(arcs, i));
+	return TA_der_header_size(length) + length;
+}
+
+static uint32_t TA_der_put_oid(uint8_t *out, const uint64_t *arcs,
+				const uint32_t arcs_count)
+{
+	uint8_t *start = out;
+	uint32_t length = 0;
+	uint32_t size = 0;
+	uint64_t arc = 0;
+
+	for (uint32_t i = 1; i < arcs_count; i++)
+		length += TA_der_arc_size(TA_der_arc(arcs, i));
+	out += TA_der_put_header(out, DER_TAG_OID, length);
+	for (uint32_t i = 1; i < arcs_count; i++) {
+		arc = TA_der_arc(arcs, i);
+		size = TA_der_arc_size(arc);
+		for (uint32_t j = 0; j < size; j++)
+			out[j] = ((arc >> (7 * (size - 1 - j))) & 0x7f) |
+				(j + 1 < size ? 0x80 : 0);
+		out += size;
+	}
+	return out - start;
+}
+
+/* Skips the next element if it is exactly the given OID */
+static bool TA_der_read_oid(der_reader_t *reader, const uint64_t *arcs,
+				const uint32_t arcs_count)
+{
+	uint8_t oid[DER_MAX_OID_SIZE];
+	uint32_t oid_l = TA_der_put_oid(oid, arcs, arcs_count);
+
+	if ((uint32_t)(reader->end - reader->ptr) < oid_l ||
+			TEE_MemCompare(reader->ptr, oid, oid_l) != 0)
+		return false;
+	reader->ptr += oid_l;
+	return true;
+}
+
+static bool TA_der_read_curve(der_reader_t *reader, uint32_t *key_size)
+{
+	for (uint32_t i = 0; i < sizeof(der_curves) / sizeof(der_curves[0]);
+									i++) {
+		if (TA_der_read_oid(reader, der_curves[i].arcs,
+					der_curves[i].arcs_count)) {
+			*key_size = der_curves[i].key_size;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool TA_der_read_version(der_reader_t *reader, uint8_t *version)
+{
+	const uint8_t *value = NULL;
+	uint32_t value_l = 0;
+
+	if (!TA_der_read_uint(reader, &value, &value_l) || value_l != 1)
+		return false;
+	*version = value[0];
+	return true;
+}
+
+keymaster_error_t TA_der_encode_ec_sign(uint8_t *sign, uint32_t *sign_l,
+				const uint32_t capacity)
+{
+	uint8_t raw[EC_MAX_RAW_SIGN_SIZE];
+	uint32_t n = *sign_l / 2;
+	uint32_t length = 0;
+	uint8_t *out = sign;
+
+	if (*sign_l == 0 || *sign_l % 2 != 0 || *sign_l > sizeof(raw)) {
+		EMSG("Unexpected EC sign size %u", *sign_l);
+		return KM_ERROR_UNKNOWN_ERROR;
+	}
+	TEE_MemMove(raw, sign, *sign_l);
+	length = TA_der_uint_size(raw, n) + TA_der_uint_size(raw + n, n);
+	if (TA_der_header_size(length) + length > capacity) {
+		EMSG("No space for DER encoded EC sign");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	out += TA_der_put_header(out, DER_TAG_SEQUENCE, length);
+	out += TA_der_put_uint(out, raw, n);
+	out += TA_der_put_uint(out, raw + n, n);
+	*sign_l = out - sign;
+	return KM_ERROR_OK;
+}
+
+keymaster_error_t TA_der_decode_ec_sign(const keymaster_blob_t *signature,
+				const uint32_t key_size,
+				uint8_t *raw, uint32_t *raw_l)
+{
+	der_reader_t reader;
+	der_reader_t seq;
+	const uint8_t *r = NULL;
+	const uint8_t *s = NULL;
+	uint32_t r_l = 0;
+	uint32_t s_l = 0;
+	uint32_t n = (key_size + 7) / 8;
+
+	if (signature->data == NULL || signature->data_length == 0)
+		return KM_ERROR_VERIFICATION_FAILED;
+	if (2 * n > *raw_l) {
+		EMSG("Unexpected EC key size %u", key_size);
+		return KM_ERROR_UNSUPPORTED_KEY_SIZE;
+	}
+	reader.ptr = signature->data;
+	reader.end = signature->data + signature->data_length;
+	if (!TA_der_read(&reader, DER_TAG_SEQUENCE, &seq) ||
+			reader.ptr != reader.end ||
+			!TA_der_read_uint(&seq, &r, &r_l) ||
+			!TA_der_read_uint(&seq, &s, &s_l) ||
+			seq.ptr != seq.end || r_l > n || s_l > n) {
+		EMSG("Malformed DER EC sign");
+		return KM_ERROR_VERIFICATION_FAILED;
+	}
+	/* r and s are left padded to the key size */
+	TEE_MemFill(raw, 0, 2 * n);
+	TEE_MemMove(raw + n - r_l, r, r_l);
+	TEE_MemMove(raw + 2 * n - s_l, s, s_l);
+	*raw_l = 2 * n;
+	return KM_ERROR_OK;
+}
+
+static keymaster_error_t TA_der_decode_rsa_key(der_reader_t *key,
+				TEE_Attribute *attrs,
+				uint32_t *attrs_count,
+				uint32_t *key_size,
+				uint64_t *rsa_public_exponent)
+{
+	uint32_t *attrs_list = TA_get_attrs_list_short(KM_ALGORITHM_RSA, true);
+	der_reader_t seq;
+	const uint8_t *value = NULL;
+	uint32_t value_l = 0;
+	uint32_t modulus_size = 0;
+	uint64_t exponent = 0;
+	uint8_t version = 0;
+
+	if (!TA_der_read(key, DER_TAG_SEQUENCE, &seq) ||
+			key->ptr != key->end ||
+			!TA_der_read_version(&seq, &version) || version != 0)
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	for (uint32_t i = 0; i < KM_ATTR_COUNT_RSA; i++) {
+		if (!TA_der_read_uint(&seq, &value, &value_l) ||
+				value_l > KM_RSA_ATTR_SIZE)
+			return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+		TEE_InitRefAttribute(attrs + *attrs_count, attrs_list[i],
+						(void *)value, value_l);
+		(*attrs_count)++;
+	}
+	if (seq.ptr != seq.end)
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+
+	/* Key size is the bit length of modulus */
+	value = attrs[0].content.ref.buffer;
+	value_l = attrs[0].content.ref.length;
+	if (value[0] == 0)
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	modulus_size = value_l * 8;
+	for (uint8_t top = value[0]; !(top & 0x80); top <<= 1)
+		modulus_size--;
+	if (*key_size == UNDEFINED)
+		*key_size = modulus_size;
+	else if (*key_size != modulus_size)
+		return KM_ERROR_IMPORT_PARAMETER_MISMATCH;
+
+	value = attrs[1].content.ref.buffer;
+	value_l = attrs[1].content.ref.length;
+	if (value_l > sizeof(exponent))
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	for (uint32_t i = 0; i < value_l; i++)
+		exponent = (exponent << 8) | value[i];
+	if (*rsa_public_exponent == UNDEFINED)
+		*rsa_public_exponent = exponent;
+	else if (*rsa_public_exponent != exponent)
+		return KM_ERROR_IMPORT_PARAMETER_MISMATCH;
+	return KM_ERROR_OK;
+}
+
+static keymaster_error_t TA_der_decode_ec_key(der_reader_t *key,
+				const uint32_t curve_size,
+				TEE_Attribute *attrs,
+				uint32_t *attrs_count,
+				uint32_t *key_size)
+{
+	uint32_t *attrs_list = TA_get_attrs_list_short(KM_ALGORITHM_EC, true);
+	der_reader_t seq;
+	der_reader_t secret;
+	der_reader_t params;
+	der_reader_t public;
+	der_reader_t point;
+	uint32_t params_size = 0;
+	uint32_t n = (curve_size + 7) / 8;
+	uint8_t version = 0;
+
+	if (!TA_der_read(key, DER_TAG_SEQUENCE, &seq) ||
+			key->ptr != key->end ||
+			!TA_der_read_version(&seq, &version) || version != 1 ||
+			!TA_der_read(&seq, DER_TAG_OCTET_STRING, &secret) ||
+			(uint32_t)(secret.end - secret.ptr) > n)
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	if (TA_der_read(&seq, DER_TAG_CONTEXT_0, &params)) {
+		if (!TA_der_read_curve(&params, &params_size) ||
+				params.ptr != params.end)
+			return KM_ERROR_UNSUPPORTED_EC_CURVE;
+		if (params_size != curve_size)
+			return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	}
+	/* TEE needs the public point, it is not derived from the secret */
+	if (!TA_der_read(&seq, DER_TAG_CONTEXT_1, &public) ||
+			!TA_der_read(&public, DER_TAG_BIT_STRING, &point) ||
+			public.ptr != public.end || seq.ptr != seq.end) {
+		EMSG("EC key without public value is not supported");
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	}
+	/* No unused bits, uncompressed X || Y */
+	if ((uint32_t)(point.end - point.ptr) != 2 + 2 * n ||
+			point.ptr[0] != 0 || point.ptr[1] != 0x04)
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	if (*key_size == UNDEFINED)
+		*key_size = curve_size;
+	else if (*key_size != curve_size)
+		return KM_ERROR_IMPORT_PARAMETER_MISMATCH;
+
+	TEE_InitRefAttribute(attrs + (*attrs_count)++, attrs_list[0],
+			(void *)secret.ptr, secret.end - secret.ptr);
+	TEE_InitRefAttribute(attrs + (*attrs_count)++, attrs_list[1],
+			(void *)(point.ptr + 2), n);
+	TEE_InitRefAttribute(attrs + (*attrs_count)++, attrs_list[2],
+			(void *)(point.ptr + 2 + n), n);
+	return KM_ERROR_OK;
+}
+
+keymaster_error_t TA_der_decode_pkcs8(const keymaster_blob_t *key_data,
+				const keymaster_algorithm_t algorithm,
+				TEE_Attribute *attrs,
+				uint32_t *attrs_count,
+				uint32_t *key_size,
+				uint64_t *rsa_public_exponent)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+	der_reader_t reader;
+	der_reader_t info;
+	der_reader_t alg;
+	der_reader_t key;
+	der_reader_t null;
+	uint32_t curve_size = 0;
+	uint8_t version = 0;
+
+	reader.ptr = key_data->data;
+	reader.end = key_data->data + key_data->data_length;
+	if (key_data->data == NULL || !TA_der_read(&reader,
+				DER_TAG_SEQUENCE, &info) ||
+			reader.ptr != reader.end ||
+			!TA_der_read_version(&info, &version) || version > 1 ||
+			!TA_der_read(&info, DER_TAG_SEQUENCE, &alg) ||
+			!TA_der_read(&info, DER_TAG_OCTET_STRING, &key)) {
+		EMSG("Malformed PKCS#8 key");
+		return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+	}
+	if (algorithm == KM_ALGORITHM_RSA) {
+		if (!TA_der_read_oid(&alg, DER_OID(identifier_rsa))) {
+			EMSG("PKCS#8 key is not RSA");
+			return KM_ERROR_IMPORT_PARAMETER_MISMATCH;
+		}
+		/* NULL parameters */
+		if (alg.ptr != alg.end && (!TA_der_read(&alg, DER_TAG_NULL,
+					&null) || null.ptr != null.end ||
+				alg.ptr != alg.end)) {
+			EMSG("Malformed PKCS#8 RSA algorithm parameters");
+			return KM_ERROR_UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
+		}
+		res = TA_der_decode_rsa_key(&key, attrs, attrs_count,
+					key_size, rsa_public_exponent);
+	} else {
+		if (!TA_der_read_oid(&alg, DER_OID(identifier_ec))) {
+			EMSG("PKCS#8 key is not EC");
+			return KM_ERROR_IMPORT_PARAMETER_MISMATCH;
+		}
+		if (!TA_der_read_curve(&alg, &curve_size) ||
+				alg.ptr != alg.end) {
+			EMSG("Unsupported PKCS#8 EC curve");
+			return KM_ERROR_UNSUPPORTED_EC_CURVE;
+		}
+		res = TA_der_decode_ec_key(&key, curve_size, attrs,
+					attrs_count, key_size);
+	}
+	if (res != KM_ERROR_OK)
+		EMSG("Failed to decode PKCS#8 key, res = %x", res);
+	return res;
+}
+
+keymaster_error_t TA_der_encode_spki(const TEE_ObjectHandle obj_h,
+				const uint32_t type,
+				const uint32_t key_size,
+				keymaster_blob_t *export_data)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+	uint8_t *attrs = NULL;
+	uint8_t *attr1 = NULL;
+	uint8_t *attr2 = NULL;
+	uint32_t attr1_l = KM_RSA_ATTR_SIZE;
+	uint32_t attr2_l = KM_RSA_ATTR_SIZE;
+	uint32_t n = (key_size + 7) / 8;
+	uint32_t curve = 0;
+	uint32_t alg_l = 0;
+	uint32_t key_l = 0;
+	uint32_t bits_l = 0;
+	uint32_t spki_l = 0;
+	uint8_t *out = NULL;
+
+	attrs = TA_malloc(2 * KM_RSA_ATTR_SIZE, KM_HEAP_CRYPTO);
+	if (!attrs) {
+		EMSG("Failed to allocate memory for local buffers");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	attr1 = attrs;
+	attr2 = attrs + KM_RSA_ATTR_SIZE;
+	if (type == TEE_TYPE_RSA_KEYPAIR) {
+		res = TEE_GetObjectBufferAttribute(obj_h,
+					TEE_ATTR_RSA_MODULUS, attr1, &attr1_l);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to get modulus attribute, res = %x", res);
+			goto out;
+		}
+		res = TEE_GetObjectBufferAttribute(obj_h,
+				TEE_ATTR_RSA_PUBLIC_EXPONENT, attr2, &attr2_l);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to get public exponent attribute, res = %x",
+			     res);
+			goto out;
+		}
+		alg_l = TA_der_oid_size(DER_OID(identifier_rsa)) +
+					TA_der_header_size(0);
+		/* RSAPublicKey ::= SEQUENCE { modulus, publicExponent } */
+		key_l = TA_der_uint_size(attr1, attr1_l) +
+					TA_der_uint_size(attr2, attr2_l);
+		bits_l = 1 + TA_der_header_size(key_l) + key_l;
+	} else {
+		while (curve < sizeof(der_curves) / sizeof(der_curves[0]) &&
+				der_curves[curve].key_size != key_size)
+			curve++;
+		if (curve == sizeof(der_curves) / sizeof(der_curves[0])) {
+			EMSG("Unsupported EC key size %u", key_size);
+			res = KM_ERROR_UNSUPPORTED_EC_CURVE;
+			goto out;
+		}
+		res = TEE_GetObjectBufferAttribute(obj_h,
+				TEE_ATTR_ECC_PUBLIC_VALUE_X, attr1, &attr1_l);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to get public X attribute, res = %x", res);
+			goto out;
+		}
+		res = TEE_GetObjectBufferAttribute(obj_h,
+				TEE_ATTR_ECC_PUBLIC_VALUE_Y, attr2, &attr2_l);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to get public Y attribute, res = %x", res);
+			goto out;
+		}
+		if (attr1_l > n || attr2_l > n) {
+			EMSG("EC public value is longer than key size");
+			res = KM_ERROR_UNKNOWN_ERROR;
+			goto out;
+		}
+		alg_l = TA_der_oid_size(DER_OID(identifier_ec)) +
+				TA_der_oid_size(der_curves[curve].arcs,
+						der_curves[curve].arcs_count);
+		/* Uncompressed point 04 || X || Y */
+		key_l = 1 + 2 * n;
+		bits_l = 1 + key_l;
+	}
+	spki_l = TA_der_header_size(alg_l) + alg_l +
+			TA_der_header_size(bits_l) + bits_l;
+	export_data->data_length = TA_der_header_size(spki_l) + spki_l;
+	export_data->data = TA_malloc(export_data->data_length,
+							KM_HEAP_BLOB);
+	if (!export_data->data) {
+		EMSG("Failed to allocate memory for x.509 output");
+		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+		goto out;
+	}
+	out = export_data->data;
+	out += TA_der_put_header(out, DER_TAG_SEQUENCE, spki_l);
+	out += TA_der_put_header(out, DER_TAG_SEQUENCE, alg_l);
+	if (type == TEE_TYPE_RSA_KEYPAIR) {
+		out += TA_der_put_oid(out, DER_OID(identifier_rsa));
+		out += TA_der_put_header(out, DER_TAG_NULL, 0);
+	} else {
+		out += TA_der_put_oid(out, DER_OID(identifier_ec));
+		out += TA_der_put_oid(out, der_curves[curve].arcs,
+					der_curves[curve].arcs_count);
+	}
+	out += TA_der_put_header(out, DER_TAG_BIT_STRING, bits_l);
+	/* No unused bits */
+	*out++ = 0;
+	if (type == TEE_TYPE_RSA_KEYPAIR) {
+		out += TA_der_put_header(out, DER_TAG_SEQUENCE, key_l);
+		out += TA_der_put_uint(out, attr1, attr1_l);
+		out += TA_der_put_uint(out, attr2, attr2_l);
+	} else {
+		*out++ = 0x04;
+		/* Coordinates are left padded to the key size */
+		TEE_MemMove(out + n - attr1_l, attr1, attr1_l);
+		TEE_MemMove(out + 2 * n - attr2_l, attr2, attr2_l);
+	}
+out:
+	TA_free(attrs);
+	return res;
+}
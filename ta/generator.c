@@ -16,6 +16,7 @@
  */
 
 #include "generator.h"
+#include "heap.h"
 
 uint32_t attributes_aes_hmac[KM_ATTR_COUNT_AES_HMAC] = {TEE_ATTR_SECRET_VALUE};
 uint32_t attributes_rsa[KM_ATTR_COUNT_RSA] = {
@@ -92,9 +93,9 @@ void free_attrs(TEE_Attribute *attrs, uint32_t size)
 		return;
 	for (uint32_t i = 0; i < size; i++) {
 		if (!is_attr_value(attrs[i].attributeID))
-			(void)TEE_Free(attrs[i].content.ref.buffer);
+			(void)TA_free(attrs[i].content.ref.buffer);
 	}
-	(void)TEE_Free(attrs);
+	(void)TA_free(attrs);
 }
 
 uint32_t purpose_to_mode(const keymaster_purpose_t purpose)
@@ -115,6 +116,27 @@ uint32_t purpose_to_mode(const keymaster_purpose_t purpose)
 	}
 }
 
+bool TA_is_public_purpose(const keymaster_purpose_t purpose)
+{
+	return purpose == KM_PURPOSE_VERIFY || purpose == KM_PURPOSE_ENCRYPT;
+}
+
+static bool TA_is_private_attr(const uint32_t tag)
+{
+	switch (tag) {
+	case TEE_ATTR_RSA_PRIVATE_EXPONENT:
+	case TEE_ATTR_RSA_PRIME1:
+	case TEE_ATTR_RSA_PRIME2:
+	case TEE_ATTR_RSA_EXPONENT1:
+	case TEE_ATTR_RSA_EXPONENT2:
+	case TEE_ATTR_RSA_COEFFICIENT:
+	case TEE_ATTR_ECC_PRIVATE_VALUE:
+		return true;
+	default:
+		return false;
+	}
+}
+
 bool is_attr_value(const uint32_t tag)
 {
 	uint32_t mask = 1 << 29;
@@ -190,14 +212,14 @@ keymaster_error_t TA_check_hmac_key_size(keymaster_blob_t *key_data,
 	}
 
 	if (key_data->data_length <= min) {
-		buf = TEE_Malloc(min, TEE_MALLOC_FILL_ZERO);
+		buf = TA_malloc(min, KM_HEAP_CRYPTO);
 		if (!buf) {
 			EMSG("Failed to allocate memory for HMAC buffer");
 			return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		}
 		TEE_MemMove(buf, key_data->data, key_data->data_length);
 		key_data->data_length = min;
-		TEE_Free(key_data->data);
+		TA_free(key_data->data);
 		key_data->data = buf;
 	}
 	return KM_ERROR_OK;
@@ -360,16 +382,16 @@ keymaster_error_t TA_generate_key(const keymaster_algorithm_t algorithm,
 		attributes = attributes_rsa;
 		attr_count = KM_ATTR_COUNT_RSA;
 		type = TEE_TYPE_RSA_KEYPAIR;
-		attrs_in = TEE_Malloc(sizeof(TEE_Attribute),
-							TEE_MALLOC_FILL_ZERO);
+		attrs_in = TA_malloc(sizeof(TEE_Attribute),
+							KM_HEAP_CRYPTO);
 		if (!attrs_in) {
 			EMSG("Failed to allocate memory for attributes");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 			goto gk_out;
 		}
 		attrs_in_count = 1;
-		buf_pe = TEE_Malloc(sizeof(rsa_public_exponent),
-							TEE_MALLOC_FILL_ZERO);
+		buf_pe = TA_malloc(sizeof(rsa_public_exponent),
+							KM_HEAP_CRYPTO);
 		if (!buf_pe) {
 			EMSG("Failed to allocate memory for public exponent");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -386,8 +408,8 @@ keymaster_error_t TA_generate_key(const keymaster_algorithm_t algorithm,
 		attributes = attributes_ec;
 		attr_count = KM_ATTR_COUNT_EC;
 		type = TEE_TYPE_ECDSA_KEYPAIR;
-		attrs_in = TEE_Malloc(sizeof(TEE_Attribute),
-							TEE_MALLOC_FILL_ZERO);
+		attrs_in = TA_malloc(sizeof(TEE_Attribute),
+							KM_HEAP_CRYPTO);
 		if (!attrs_in) {
 			EMSG("Failed to allocate memory for attributes");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -407,18 +429,23 @@ keymaster_error_t TA_generate_key(const keymaster_algorithm_t algorithm,
 	default:
 		return KM_ERROR_UNSUPPORTED_ALGORITHM;
 	}
-	res = TEE_AllocateTransientObject(type, key_size, &obj_h);
-	if (res != TEE_SUCCESS) {
-		EMSG("Failed to allocate transient object, res=%x", res);
-		goto gk_out;
-	}
-	res = TEE_GenerateKey(obj_h, key_size, attrs_in, attrs_in_count);
-	if (res != TEE_SUCCESS) {
-		EMSG("Failed to generate key via TEE_GenerateKey, res = %x", res);
-		/* Convert error code to Android style */
-		if (res == TEE_ERROR_NOT_SUPPORTED)
-			res = KM_ERROR_UNSUPPORTED_KEY_SIZE;
-		goto gk_out;
+	if (algorithm == KM_ALGORITHM_RSA)
+		obj_h = TA_keypool_take(key_size, rsa_public_exponent);
+	if (obj_h == TEE_HANDLE_NULL) {
+		res = TEE_AllocateTransientObject(type, key_size, &obj_h);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to allocate transient object, res=%x", res);
+			goto gk_out;
+		}
+		res = TEE_GenerateKey(obj_h, key_size, attrs_in,
+							attrs_in_count);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to generate key via TEE_GenerateKey, res = %x", res);
+			/* Convert error code to Android style */
+			if (res == TEE_ERROR_NOT_SUPPORTED)
+				res = KM_ERROR_UNSUPPORTED_KEY_SIZE;
+			goto gk_out;
+		}
 	}
 
 	TEE_MemMove(key_material, &type, sizeof(type));
@@ -512,10 +539,13 @@ keymaster_error_t TA_restore_key(uint8_t *key_material,
 				const keymaster_key_blob_t *key_blob,
 				uint32_t *key_size, uint32_t *type,
 				TEE_ObjectHandle *obj_h,
+				const bool public_only,
 				keymaster_key_param_set_t *params_t)
 {
 	uint32_t padding = 0;
 	uint32_t attrs_count = 0;
+	uint32_t attrs_used = 0;
+	uint32_t obj_type = 0;
 	uint32_t tag;
 	uint32_t a;
 	uint32_t b;
@@ -540,6 +570,7 @@ keymaster_error_t TA_restore_key(uint8_t *key_material,
 	}
 	TEE_MemMove(type, key_material, sizeof(*type));
 	padding += sizeof(*type);
+	obj_type = *type;
 	switch (*type) {
 	case TEE_TYPE_AES:
 		attrs_count = KM_ATTR_COUNT_AES_HMAC;
@@ -548,24 +579,38 @@ keymaster_error_t TA_restore_key(uint8_t *key_material,
 	case TEE_TYPE_RSA_KEYPAIR:
 		attrs_count = KM_ATTR_COUNT_RSA;
 		algorithm = KM_ALGORITHM_RSA;
+		if (public_only)
+			obj_type = TEE_TYPE_RSA_PUBLIC_KEY;
 		break;
 	case TEE_TYPE_ECDSA_KEYPAIR:
 		attrs_count = KM_ATTR_COUNT_EC;
 		algorithm = KM_ALGORITHM_EC;
+		if (public_only)
+			obj_type = TEE_TYPE_ECDSA_PUBLIC_KEY;
 		break;
 	default: /* HMAC */
 		attrs_count = KM_ATTR_COUNT_AES_HMAC;
 		algorithm = KM_ALGORITHM_HMAC;
 	}
-	attrs = TEE_Malloc(attrs_count * sizeof(TEE_Attribute),
-						TEE_MALLOC_FILL_ZERO);
+	TEE_MemMove(key_size, key_material + padding, sizeof(*key_size));
+	padding += sizeof(*key_size);
+	if (algorithm == KM_ALGORITHM_HMAC) {
+		res = TA_check_hmac_key(*type, key_size);
+		if (res != KM_ERROR_OK) {
+			EMSG("HMAC key checking failed res = %x", res);
+			goto out_rk;
+		}
+	}
+	/* Only characteristics are needed */
+	if (!obj_h)
+		goto params_rk;
+	attrs = TA_malloc(attrs_count * sizeof(TEE_Attribute),
+						KM_HEAP_CRYPTO);
 	if (!attrs) {
 		EMSG("Failed to allocate memory for attributes array");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		goto out_rk;
 	}
-	TEE_MemMove(key_size, key_material + padding, sizeof(*key_size));
-	padding += sizeof(*key_size);
 	for (uint32_t i = 0; i < attrs_count; i++) {
 		TEE_MemMove(&tag, key_material + padding, sizeof(tag));
 		padding += sizeof(tag);
@@ -575,57 +620,52 @@ keymaster_error_t TA_restore_key(uint8_t *key_material,
 			padding += sizeof(a);
 			TEE_MemMove(&b, key_material + padding, sizeof(b));
 			padding += sizeof(b);
-			TEE_InitValueAttribute(attrs + i, tag, a, b);
-		} else {
-			/* buffer */
-			TEE_MemMove(&attr_size, key_material + padding,
-							sizeof(attr_size));
-			padding += sizeof(attr_size);
-			/* will be freed when parameters array is destroyed */
-			buf = TEE_Malloc(attr_size, TEE_MALLOC_FILL_ZERO);
-			if (!buf) {
-				res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
-				EMSG("Failed to allocate memory for attribute");
-				/*
-				 * If error occurs, attrs_count should be equal i,
-				 * because free_attrs will try to free memory for elements,
-				 * which didn't allocate.
-				 */
-				attrs_count = i;
-				goto out_rk;
-			}
-			TEE_MemMove(buf, key_material + padding, attr_size);
+			TEE_InitValueAttribute(attrs + attrs_used, tag, a, b);
+			attrs_used++;
+			continue;
+		}
+		/* buffer */
+		TEE_MemMove(&attr_size, key_material + padding,
+						sizeof(attr_size));
+		padding += sizeof(attr_size);
+		if (obj_type != *type && TA_is_private_attr(tag)) {
+			/* not a part of public key object */
 			padding += attr_size;
-			TEE_InitRefAttribute(attrs + i, tag, buf, attr_size);
+			continue;
 		}
-	}
-	if (algorithm == KM_ALGORITHM_HMAC) {
-		res = TA_check_hmac_key(*type, key_size);
-		if (res != KM_ERROR_OK) {
-			EMSG("HMAC key checking failed res = %x", res);
+		/* will be freed when parameters array is destroyed */
+		buf = TA_malloc(attr_size, KM_HEAP_CRYPTO);
+		if (!buf) {
+			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+			EMSG("Failed to allocate memory for attribute");
 			goto out_rk;
 		}
+		TEE_MemMove(buf, key_material + padding, attr_size);
+		padding += attr_size;
+		TEE_InitRefAttribute(attrs + attrs_used, tag, buf, attr_size);
+		attrs_used++;
 	}
-	res = TEE_AllocateTransientObject(*type, *key_size, obj_h);
+	res = TEE_AllocateTransientObject(obj_type, *key_size, obj_h);
 	if (res != TEE_SUCCESS) {
 		EMSG("Error TEE_AllocateTransientObject res = %x type = %x",
-								 res, *type);
+								 res, obj_type);
 		goto out_rk;
 	}
-	res = TEE_PopulateTransientObject(*obj_h, attrs, attrs_count);
+	res = TEE_PopulateTransientObject(*obj_h, attrs, attrs_used);
 	if (res != TEE_SUCCESS) {
 		EMSG("Error TEE_PopulateTransientObject res = %x", res);
 		goto out_rk;
 	}
+params_rk:
 	/* offset from array begin where parameters are stored */
 	padding = TA_get_key_size(algorithm);
-	TA_deserialize_param_set(key_material + padding, NULL,
-						params_t, false, &res);
+	TA_deserialize_param_set_v1(key_material + padding, NULL,
+						params_t, &res);
 	if (res != KM_ERROR_OK)
 		goto out_rk;
 	TA_add_origin(params_t, KM_ORIGIN_UNKNOWN, false);
 out_rk:
-	free_attrs(attrs, attrs_count);
+	free_attrs(attrs, attrs_used);
 
 	return res;
 }
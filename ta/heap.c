@@ -0,0 +1,222 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "heap.h"
+#include "command.h"
+#include "ring.h"
+#include "user_ta_header_defines.h"
+
+#define HEAP_MAGIC 0x4b4d4850
+
+/* Precedes each allocation, keeps the alignment of TEE_Malloc */
+typedef struct {
+	uint32_t size;
+	uint32_t category;
+	uint32_t magic;
+	uint32_t reserved;
+} heap_header_t;
+
+static km_heap_category_t categories[KM_HEAP_COUNT];
+static km_heap_command_t commands[KM_STATS_COMMANDS];
+static km_heap_failure_t last_failure;
+static uint64_t live_bytes;
+static uint64_t peak_bytes;
+
+/* Heap use of the command in progress */
+static struct {
+	uint64_t start;
+	uint64_t peak;
+	bool traced;
+} usage;
+
+/* Soak mode */
+static struct {
+	uint32_t command;
+	uint32_t calls;
+	km_ring_t events;
+} trace;
+
+static void TA_heap_record(const uint16_t type, const uint32_t category,
+				const uint32_t size)
+{
+	km_heap_event_t *event = NULL;
+
+	if (!usage.traced)
+		return;
+	event = TA_ring_push(&trace.events);
+	if (!event)
+		return;
+	event->call = trace.calls;
+	event->type = type;
+	event->category = category;
+	event->size = size;
+	event->live_bytes = live_bytes;
+}
+
+void *TA_malloc(const uint32_t size, const enum km_heap_category category)
+{
+	const km_command_t *current = TA_command_current();
+	heap_header_t *header = NULL;
+	km_heap_category_t *counters = &categories[category];
+
+	if (size <= UINT32_MAX - sizeof(*header))
+		header = TEE_Malloc(sizeof(*header) + size,
+						TEE_MALLOC_FILL_ZERO);
+	if (!header) {
+		DMSG("Failed to allocate %u bytes of category %d",
+							size, category);
+		counters->failures++;
+		if (current->active)
+			commands[current->slot].failures[category]++;
+		last_failure.command = current->active ? current->cmd : 0;
+		last_failure.category = category;
+		last_failure.size = size;
+		last_failure.live_bytes = live_bytes;
+		TA_heap_record(KM_HEAP_FAILED, category, size);
+		return NULL;
+	}
+	header->size = size;
+	header->category = category;
+	header->magic = HEAP_MAGIC;
+
+	counters->allocs++;
+	counters->live_count++;
+	counters->live_bytes += size;
+	if (counters->live_bytes > counters->peak_bytes)
+		counters->peak_bytes = counters->live_bytes;
+	live_bytes += size;
+	if (live_bytes > peak_bytes)
+		peak_bytes = live_bytes;
+	if (current->active && live_bytes > usage.peak)
+		usage.peak = live_bytes;
+	TA_heap_record(KM_HEAP_ALLOC, category, size);
+	return header + 1;
+}
+
+void TA_free(void *buffer)
+{
+	heap_header_t *header = NULL;
+	km_heap_category_t *counters = NULL;
+
+	if (!buffer)
+		return;
+	header = (heap_header_t *)buffer - 1;
+	if (header->magic != HEAP_MAGIC || header->category >= KM_HEAP_COUNT) {
+		/* Leaking is safer than freeing what TA_malloc did not return */
+		EMSG("Freeing memory not allocated with TA_malloc");
+		return;
+	}
+	counters = &categories[header->category];
+	counters->live_count--;
+	counters->live_bytes -= header->size;
+	live_bytes -= header->size;
+	TA_heap_record(KM_HEAP_FREE, header->category, header->size);
+	header->magic = 0;
+	TEE_Free(header);
+}
+
+void TA_heap_begin(void)
+{
+	const km_command_t *current = TA_command_current();
+
+	usage.start = live_bytes;
+	usage.peak = live_bytes;
+	usage.traced = trace.command && trace.command == current->cmd;
+	if (usage.traced)
+		trace.calls++;
+}
+
+void TA_heap_end(void)
+{
+	const km_command_t *current = TA_command_current();
+	km_heap_command_t *command = &commands[current->slot];
+
+	if (!current->active)
+		return;
+	if (usage.peak > usage.start &&
+			usage.peak - usage.start > command->peak_bytes)
+		command->peak_bytes = usage.peak - usage.start;
+	command->retained_bytes += (int64_t)live_bytes -
+					(int64_t)usage.start;
+	usage.traced = false;
+}
+
+static void TA_heap_reset(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < KM_HEAP_COUNT; i++) {
+		categories[i].allocs = 0;
+		categories[i].failures = 0;
+		categories[i].peak_bytes = categories[i].live_bytes;
+	}
+	peak_bytes = live_bytes;
+	/* The call in progress is measured against its own start */
+	usage.peak = live_bytes;
+	TEE_MemFill(commands, 0, sizeof(commands));
+	TEE_MemFill(&last_failure, 0, sizeof(last_failure));
+	trace.events.dropped = 0;
+}
+
+static keymaster_error_t TA_heap_trace(const uint32_t cmd)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+
+	if (!cmd) {
+		TA_ring_free(&trace.events);
+		trace.command = 0;
+		trace.calls = 0;
+		return KM_ERROR_OK;
+	}
+	res = TA_ring_alloc(&trace.events, sizeof(km_heap_event_t),
+							KM_HEAP_EVENTS);
+	if (res != KM_ERROR_OK)
+		return res;
+	TA_ring_clear(&trace.events);
+	trace.command = cmd;
+	trace.calls = 0;
+	return KM_ERROR_OK;
+}
+
+keymaster_error_t TA_heap_get(km_heap_t *heap, km_heap_event_t *events,
+				const uint32_t max_events,
+				const uint32_t flags, const uint32_t cmd)
+{
+	keymaster_error_t res = KM_ERROR_OK;
+
+	if (flags & KM_HEAP_TRACE) {
+		res = TA_heap_trace(cmd);
+		if (res != KM_ERROR_OK)
+			return res;
+	}
+	heap->version = KM_HEAP_VERSION;
+	heap->categories = KM_HEAP_COUNT;
+	heap->commands = KM_STATS_COMMANDS;
+	heap->overhead = sizeof(heap_header_t);
+	heap->data_size = TA_DATA_SIZE;
+	heap->trace_command = trace.command;
+	heap->live_bytes = live_bytes;
+	heap->peak_bytes = peak_bytes;
+	TEE_MemMove(heap->category, categories, sizeof(categories));
+	TEE_MemMove(heap->command, commands, sizeof(commands));
+	heap->last_failure = last_failure;
+	heap->events = TA_ring_pop(&trace.events, events, max_events);
+	heap->dropped = trace.events.dropped;
+	if (flags & KM_HEAP_RESET)
+		TA_heap_reset();
+	return KM_ERROR_OK;
+}
@@ -0,0 +1,50 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_HOST_TEE_H
+#define ANDROID_OPTEE_HOST_TEE_H
+
+#include <tee_internal_api.h>
+
+/*
+ * Controls of the host TEE shim for code that drives the TA on a
+ * workstation. They have no OP-TEE counterpart and must not be used by
+ * TA sources.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Identity returned for gpd.client.identity, TEE_LOGIN_PUBLIC by default
+ * as for a normal world client. Set TEE_LOGIN_TRUSTED_APP to act as
+ * another TA (gatekeeper).
+ */
+void host_tee_set_client_identity(const TEE_Identity *identity);
+
+/* Drops all persistent objects, as after a factory reset */
+void host_tee_storage_wipe(void);
+
+/* Number of TEE_Malloc and TEE_Realloc calls made so far */
+uint64_t host_tee_alloc_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANDROID_OPTEE_HOST_TEE_H */
@@ -0,0 +1,503 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host replacement of the OP-TEE TA dev kit header. Declares the part of
+ * the GlobalPlatform TEE Internal Core API used by the keymaster TA, with
+ * the same constant values, so TA sources build unchanged against the
+ * software shim in ta/host.
+ */
+
+#ifndef ANDROID_OPTEE_HOST_TEE_INTERNAL_API_H
+#define ANDROID_OPTEE_HOST_TEE_INTERNAL_API_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+/* Trace, same levels as OP-TEE: 1 error, 2 info, 3 debug, 4 flow */
+#ifndef CFG_TEE_TA_LOG_LEVEL
+#define CFG_TEE_TA_LOG_LEVEL 0
+#endif
+
+void host_tee_trace(const char *func, int line, int level,
+			const char *fmt, ...)
+			__attribute__((format(printf, 4, 5)));
+
+#if CFG_TEE_TA_LOG_LEVEL >= 1
+#define EMSG(...) host_tee_trace(__func__, __LINE__, 1, __VA_ARGS__)
+#else
+#define EMSG(...) (void)0
+#endif
+#if CFG_TEE_TA_LOG_LEVEL >= 2
+#define IMSG(...) host_tee_trace(__func__, __LINE__, 2, __VA_ARGS__)
+#else
+#define IMSG(...) (void)0
+#endif
+#if CFG_TEE_TA_LOG_LEVEL >= 3
+#define DMSG(...) host_tee_trace(__func__, __LINE__, 3, __VA_ARGS__)
+#else
+#define DMSG(...) (void)0
+#endif
+#if CFG_TEE_TA_LOG_LEVEL >= 4
+#define FMSG(...) host_tee_trace(__func__, __LINE__, 4, __VA_ARGS__)
+#else
+#define FMSG(...) (void)0
+#endif
+
+/* Types */
+typedef uint32_t TEE_Result;
+
+typedef struct {
+	uint32_t timeLow;
+	uint16_t timeMid;
+	uint16_t timeHiAndVersion;
+	uint8_t clockSeqAndNode[8];
+} TEE_UUID;
+
+typedef struct {
+	uint32_t login;
+	TEE_UUID uuid;
+} TEE_Identity;
+
+typedef union {
+	struct {
+		void *buffer;
+		uint32_t size;
+	} memref;
+	struct {
+		uint32_t a;
+		uint32_t b;
+	} value;
+} TEE_Param;
+
+typedef struct {
+	uint32_t attributeID;
+	union {
+		struct {
+			void *buffer;
+			uint32_t length;
+		} ref;
+		struct {
+			uint32_t a;
+			uint32_t b;
+		} value;
+	} content;
+} TEE_Attribute;
+
+typedef struct {
+	uint32_t objectType;
+	union {
+		uint32_t keySize;
+		uint32_t objectSize;
+	};
+	union {
+		uint32_t maxKeySize;
+		uint32_t maxObjectSize;
+	};
+	uint32_t objectUsage;
+	uint32_t dataSize;
+	uint32_t dataPosition;
+	uint32_t handleFlags;
+} TEE_ObjectInfo;
+
+typedef struct {
+	uint32_t algorithm;
+	uint32_t operationClass;
+	uint32_t mode;
+	uint32_t digestLength;
+	uint32_t maxKeySize;
+	uint32_t keySize;
+	uint32_t requiredKeyUsage;
+	uint32_t handleState;
+} TEE_OperationInfo;
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t millis;
+} TEE_Time;
+
+typedef struct __TEE_ObjectHandle *TEE_ObjectHandle;
+typedef struct __TEE_OperationHandle *TEE_OperationHandle;
+typedef struct __TEE_TASessionHandle *TEE_TASessionHandle;
+typedef struct __TEE_ObjectEnumHandle *TEE_ObjectEnumHandle;
+typedef struct __TEE_PropSetHandle *TEE_PropSetHandle;
+
+#define TEE_HANDLE_NULL 0
+
+/* Parameters */
+#define TEE_NUM_PARAMS 4
+
+#define TEE_PARAM_TYPE_NONE 0
+#define TEE_PARAM_TYPE_VALUE_INPUT 1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT 2
+#define TEE_PARAM_TYPE_VALUE_INOUT 3
+#define TEE_PARAM_TYPE_MEMREF_INPUT 5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT 6
+#define TEE_PARAM_TYPE_MEMREF_INOUT 7
+
+#define TEE_PARAM_TYPES(t0, t1, t2, t3) \
+	((t0) | ((t1) << 4) | ((t2) << 8) | ((t3) << 12))
+#define TEE_PARAM_TYPE_GET(t, i) (((t) >> ((i) * 4)) & 0xF)
+
+/* Return codes */
+#define TEE_SUCCESS 0x00000000
+#define TEE_ERROR_CORRUPT_OBJECT 0xF0100001
+#define TEE_ERROR_STORAGE_NOT_AVAILABLE 0xF0100003
+#define TEE_ERROR_GENERIC 0xFFFF0000
+#define TEE_ERROR_ACCESS_DENIED 0xFFFF0001
+#define TEE_ERROR_CANCEL 0xFFFF0002
+#define TEE_ERROR_ACCESS_CONFLICT 0xFFFF0003
+#define TEE_ERROR_EXCESS_DATA 0xFFFF0004
+#define TEE_ERROR_BAD_FORMAT 0xFFFF0005
+#define TEE_ERROR_BAD_PARAMETERS 0xFFFF0006
+#define TEE_ERROR_BAD_STATE 0xFFFF0007
+#define TEE_ERROR_ITEM_NOT_FOUND 0xFFFF0008
+#define TEE_ERROR_NOT_IMPLEMENTED 0xFFFF0009
+#define TEE_ERROR_NOT_SUPPORTED 0xFFFF000A
+#define TEE_ERROR_NO_DATA 0xFFFF000B
+#define TEE_ERROR_OUT_OF_MEMORY 0xFFFF000C
+#define TEE_ERROR_BUSY 0xFFFF000D
+#define TEE_ERROR_COMMUNICATION 0xFFFF000E
+#define TEE_ERROR_SECURITY 0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER 0xFFFF0010
+#define TEE_ERROR_OVERFLOW 0xFFFF300F
+#define TEE_ERROR_TARGET_DEAD 0xFFFF3024
+#define TEE_ERROR_STORAGE_NO_SPACE 0xFFFF3041
+#define TEE_ERROR_MAC_INVALID 0xFFFF3071
+#define TEE_ERROR_SIGNATURE_INVALID 0xFFFF3072
+#define TEE_ERROR_TIME_NOT_SET 0xFFFF5000
+#define TEE_ERROR_TIME_NEEDS_RESET 0xFFFF5001
+
+/* Return origins */
+#define TEE_ORIGIN_API 0x00000001
+#define TEE_ORIGIN_COMMS 0x00000002
+#define TEE_ORIGIN_TEE 0x00000003
+#define TEE_ORIGIN_TRUSTED_APP 0x00000004
+
+/* Login types */
+#define TEE_LOGIN_PUBLIC 0x00000000
+#define TEE_LOGIN_USER 0x00000001
+#define TEE_LOGIN_GROUP 0x00000002
+#define TEE_LOGIN_APPLICATION 0x00000004
+#define TEE_LOGIN_TRUSTED_APP 0xF0000000
+
+#define TEE_PROPSET_TEE_IMPLEMENTATION ((TEE_PropSetHandle)0xFFFFFFFD)
+#define TEE_PROPSET_CURRENT_CLIENT ((TEE_PropSetHandle)0xFFFFFFFE)
+#define TEE_PROPSET_CURRENT_TA ((TEE_PropSetHandle)0xFFFFFFFF)
+
+#define TEE_MALLOC_FILL_ZERO 0x00000000
+#define TEE_TIMEOUT_INFINITE 0xFFFFFFFF
+
+/* Storage */
+#define TEE_STORAGE_PRIVATE 0x00000001
+
+#define TEE_DATA_FLAG_ACCESS_READ 0x00000001
+#define TEE_DATA_FLAG_ACCESS_WRITE 0x00000002
+#define TEE_DATA_FLAG_ACCESS_WRITE_META 0x00000004
+#define TEE_DATA_FLAG_SHARE_READ 0x00000010
+#define TEE_DATA_FLAG_SHARE_WRITE 0x00000020
+#define TEE_DATA_FLAG_OVERWRITE 0x00000400
+
+#define TEE_OBJECT_ID_MAX_LEN 64
+#define TEE_DATA_MAX_POSITION 0xFFFFFFFF
+
+#define TEE_HANDLE_FLAG_PERSISTENT 0x00010000
+#define TEE_HANDLE_FLAG_INITIALIZED 0x00020000
+#define TEE_HANDLE_FLAG_KEY_SET 0x00040000
+#define TEE_HANDLE_FLAG_EXPECT_TWO_KEYS 0x00080000
+
+typedef enum {
+	TEE_DATA_SEEK_SET = 0,
+	TEE_DATA_SEEK_CUR = 1,
+	TEE_DATA_SEEK_END = 2
+} TEE_Whence;
+
+/* Operations */
+typedef enum {
+	TEE_MODE_ENCRYPT = 0,
+	TEE_MODE_DECRYPT = 1,
+	TEE_MODE_SIGN = 2,
+	TEE_MODE_VERIFY = 3,
+	TEE_MODE_MAC = 4,
+	TEE_MODE_DIGEST = 5,
+	TEE_MODE_DERIVE = 6
+} TEE_OperationMode;
+
+#define TEE_OPERATION_CIPHER 1
+#define TEE_OPERATION_MAC 3
+#define TEE_OPERATION_AE 4
+#define TEE_OPERATION_DIGEST 5
+#define TEE_OPERATION_ASYMMETRIC_CIPHER 6
+#define TEE_OPERATION_ASYMMETRIC_SIGNATURE 7
+#define TEE_OPERATION_KEY_DERIVATION 8
+
+/* Algorithms */
+#define TEE_ALG_AES_ECB_NOPAD 0x10000010
+#define TEE_ALG_AES_CBC_NOPAD 0x10000110
+#define TEE_ALG_AES_CTR 0x10000210
+#define TEE_ALG_AES_GCM 0x40000810
+#define TEE_ALG_RSASSA_PKCS1_V1_5_MD5 0x70001830
+#define TEE_ALG_RSASSA_PKCS1_V1_5_SHA1 0x70002830
+#define TEE_ALG_RSASSA_PKCS1_V1_5_SHA224 0x70003830
+#define TEE_ALG_RSASSA_PKCS1_V1_5_SHA256 0x70004830
+#define TEE_ALG_RSASSA_PKCS1_V1_5_SHA384 0x70005830
+#define TEE_ALG_RSASSA_PKCS1_V1_5_SHA512 0x70006830
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_MD5 0x70111930
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_SHA1 0x70212930
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_SHA224 0x70313930
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_SHA256 0x70414930
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_SHA384 0x70515930
+#define TEE_ALG_RSASSA_PKCS1_PSS_MGF1_SHA512 0x70616930
+#define TEE_ALG_RSAES_PKCS1_V1_5 0x60000130
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_MD5 0x60110230
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA1 0x60210230
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA224 0x60310230
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA256 0x60410230
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA384 0x60510230
+#define TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA512 0x60610230
+#define TEE_ALG_RSA_NOPAD 0x60000030
+#define TEE_ALG_ECDSA_P192 0x70001041
+#define TEE_ALG_ECDSA_P224 0x70002041
+#define TEE_ALG_ECDSA_P256 0x70003041
+#define TEE_ALG_ECDSA_P384 0x70004041
+#define TEE_ALG_ECDSA_P521 0x70005041
+#define TEE_ALG_MD5 0x50000001
+#define TEE_ALG_SHA1 0x50000002
+#define TEE_ALG_SHA224 0x50000003
+#define TEE_ALG_SHA256 0x50000004
+#define TEE_ALG_SHA384 0x50000005
+#define TEE_ALG_SHA512 0x50000006
+#define TEE_ALG_HMAC_MD5 0x30000001
+#define TEE_ALG_HMAC_SHA1 0x30000002
+#define TEE_ALG_HMAC_SHA224 0x30000003
+#define TEE_ALG_HMAC_SHA256 0x30000004
+#define TEE_ALG_HMAC_SHA384 0x30000005
+#define TEE_ALG_HMAC_SHA512 0x30000006
+
+/* Object types */
+#define TEE_TYPE_AES 0xA0000010
+#define TEE_TYPE_HMAC_MD5 0xA0000001
+#define TEE_TYPE_HMAC_SHA1 0xA0000002
+#define TEE_TYPE_HMAC_SHA224 0xA0000003
+#define TEE_TYPE_HMAC_SHA256 0xA0000004
+#define TEE_TYPE_HMAC_SHA384 0xA0000005
+#define TEE_TYPE_HMAC_SHA512 0xA0000006
+#define TEE_TYPE_RSA_PUBLIC_KEY 0xA0000030
+#define TEE_TYPE_RSA_KEYPAIR 0xA1000030
+#define TEE_TYPE_ECDSA_PUBLIC_KEY 0xA0000041
+#define TEE_TYPE_ECDSA_KEYPAIR 0xA1000041
+#define TEE_TYPE_GENERIC_SECRET 0xA0000000
+#define TEE_TYPE_DATA 0xA00000BF
+
+/* Object attributes, bit 29 marks value attributes */
+#define TEE_ATTR_SECRET_VALUE 0xC0000000
+#define TEE_ATTR_RSA_MODULUS 0xD0000130
+#define TEE_ATTR_RSA_PUBLIC_EXPONENT 0xD0000230
+#define TEE_ATTR_RSA_PRIVATE_EXPONENT 0xC0000330
+#define TEE_ATTR_RSA_PRIME1 0xC0000430
+#define TEE_ATTR_RSA_PRIME2 0xC0000530
+#define TEE_ATTR_RSA_EXPONENT1 0xC0000630
+#define TEE_ATTR_RSA_EXPONENT2 0xC0000730
+#define TEE_ATTR_RSA_COEFFICIENT 0xC0000830
+#define TEE_ATTR_RSA_PSS_SALT_LENGTH 0xF0000A30
+#define TEE_ATTR_ECC_PUBLIC_VALUE_X 0xD0000141
+#define TEE_ATTR_ECC_PUBLIC_VALUE_Y 0xD0000241
+#define TEE_ATTR_ECC_PRIVATE_VALUE 0xC0000341
+#define TEE_ATTR_ECC_CURVE 0xF0000441
+
+#define TEE_ATTR_BIT_VALUE (1 << 29)
+
+#define TEE_ECC_CURVE_NIST_P192 0x00000001
+#define TEE_ECC_CURVE_NIST_P224 0x00000002
+#define TEE_ECC_CURVE_NIST_P256 0x00000003
+#define TEE_ECC_CURVE_NIST_P384 0x00000004
+#define TEE_ECC_CURVE_NIST_P521 0x00000005
+
+/* TA entry points, implemented by the TA */
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t paramTypes,
+			TEE_Param params[TEE_NUM_PARAMS], void **sessionContext);
+void TA_CloseSessionEntryPoint(void *sessionContext);
+TEE_Result TA_InvokeCommandEntryPoint(void *sessionContext,
+			uint32_t commandID, uint32_t paramTypes,
+			TEE_Param params[TEE_NUM_PARAMS]);
+
+/* Properties */
+TEE_Result TEE_GetPropertyAsIdentity(TEE_PropSetHandle propsetOrEnumerator,
+			const char *name, TEE_Identity *value);
+
+/* Panic */
+void TEE_Panic(TEE_Result panicCode) __attribute__((noreturn));
+
+/* Internal client API */
+TEE_Result TEE_OpenTASession(const TEE_UUID *destination,
+			uint32_t cancellationRequestTimeout,
+			uint32_t paramTypes, TEE_Param params[TEE_NUM_PARAMS],
+			TEE_TASessionHandle *session, uint32_t *returnOrigin);
+void TEE_CloseTASession(TEE_TASessionHandle session);
+TEE_Result TEE_InvokeTACommand(TEE_TASessionHandle session,
+			uint32_t cancellationRequestTimeout,
+			uint32_t commandID, uint32_t paramTypes,
+			TEE_Param params[TEE_NUM_PARAMS],
+			uint32_t *returnOrigin);
+
+/* Memory */
+void *TEE_Malloc(uint32_t size, uint32_t hint);
+void *TEE_Realloc(void *buffer, uint32_t newSize);
+void TEE_Free(void *buffer);
+void *TEE_MemMove(void *dest, const void *src, uint32_t size);
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2,
+			uint32_t size);
+void *TEE_MemFill(void *buff, uint32_t x, uint32_t size);
+
+/* Transient and generic objects */
+void TEE_GetObjectInfo1(TEE_ObjectHandle object, TEE_ObjectInfo *objectInfo);
+TEE_Result TEE_GetObjectBufferAttribute(TEE_ObjectHandle object,
+			uint32_t attributeID, void *buffer, uint32_t *size);
+TEE_Result TEE_GetObjectValueAttribute(TEE_ObjectHandle object,
+			uint32_t attributeID, uint32_t *a, uint32_t *b);
+void TEE_CloseObject(TEE_ObjectHandle object);
+TEE_Result TEE_AllocateTransientObject(uint32_t objectType,
+			uint32_t maxObjectSize, TEE_ObjectHandle *object);
+void TEE_FreeTransientObject(TEE_ObjectHandle object);
+void TEE_ResetTransientObject(TEE_ObjectHandle object);
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+			const TEE_Attribute *attrs, uint32_t attrCount);
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			const void *buffer, uint32_t length);
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			uint32_t a, uint32_t b);
+TEE_Result TEE_CopyObjectAttributes1(TEE_ObjectHandle destObject,
+			TEE_ObjectHandle srcObject);
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+			const TEE_Attribute *params, uint32_t paramCount);
+
+/* Persistent objects */
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+			uint32_t objectIDLen, uint32_t flags,
+			TEE_ObjectHandle *object);
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID,
+			const void *objectID, uint32_t objectIDLen,
+			uint32_t flags, TEE_ObjectHandle attributes,
+			const void *initialData, uint32_t initialDataLen,
+			TEE_ObjectHandle *object);
+void TEE_CloseAndDeletePersistentObject(TEE_ObjectHandle object);
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object);
+TEE_Result TEE_AllocatePersistentObjectEnumerator(
+			TEE_ObjectEnumHandle *objectEnumerator);
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator);
+void TEE_ResetPersistentObjectEnumerator(
+			TEE_ObjectEnumHandle objectEnumerator);
+TEE_Result TEE_StartPersistentObjectEnumerator(
+			TEE_ObjectEnumHandle objectEnumerator,
+			uint32_t storageID);
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+			TEE_ObjectInfo *objectInfo, void *objectID,
+			uint32_t *objectIDLen);
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			uint32_t size, uint32_t *count);
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			uint32_t size);
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size);
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+			TEE_Whence whence);
+
+/* Operations */
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+			uint32_t algorithm, uint32_t mode,
+			uint32_t maxKeySize);
+void TEE_FreeOperation(TEE_OperationHandle operation);
+void TEE_GetOperationInfo(TEE_OperationHandle operation,
+			TEE_OperationInfo *operationInfo);
+void TEE_ResetOperation(TEE_OperationHandle operation);
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			TEE_ObjectHandle key);
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+			uint32_t chunkSize);
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation,
+			const void *chunk, uint32_t chunkLen,
+			void *hash, uint32_t *hashLen);
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+			uint32_t IVLen);
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen);
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen);
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV,
+			uint32_t IVLen);
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+			uint32_t chunkSize);
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			const void *message, uint32_t messageLen,
+			void *mac, uint32_t *macLen);
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			const void *message, uint32_t messageLen,
+			const void *mac, uint32_t macLen);
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+			uint32_t nonceLen, uint32_t tagLen, uint32_t AADLen,
+			uint32_t payloadLen);
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+			uint32_t AADdataLen);
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+			uint32_t srcLen, void *destData, uint32_t *destLen);
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen,
+			void *tag, uint32_t *tagLen);
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen,
+			void *tag, uint32_t tagLen);
+
+TEE_Result TEE_AsymmetricEncrypt(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen);
+TEE_Result TEE_AsymmetricDecrypt(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen);
+TEE_Result TEE_AsymmetricSignDigest(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *digest, uint32_t digestLen,
+			void *signature, uint32_t *signatureLen);
+TEE_Result TEE_AsymmetricVerifyDigest(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *digest, uint32_t digestLen,
+			const void *signature, uint32_t signatureLen);
+
+/* Time and random */
+void TEE_GetSystemTime(TEE_Time *time);
+TEE_Result TEE_Wait(uint32_t timeout);
+void TEE_GetREETime(TEE_Time *time);
+void TEE_GenerateRandom(void *randomBuffer, uint32_t randomBufferLen);
+
+#endif /* ANDROID_OPTEE_HOST_TEE_INTERNAL_API_H */
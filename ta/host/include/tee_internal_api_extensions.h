@@ -0,0 +1,24 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_HOST_TEE_INTERNAL_API_EXTENSIONS_H
+#define ANDROID_OPTEE_HOST_TEE_INTERNAL_API_EXTENSIONS_H
+
+/* The TA uses no OP-TEE extensions, the header only has to exist */
+#include <tee_internal_api.h>
+
+#endif /* ANDROID_OPTEE_HOST_TEE_INTERNAL_API_EXTENSIONS_H */
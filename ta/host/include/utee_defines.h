@@ -0,0 +1,40 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_HOST_UTEE_DEFINES_H
+#define ANDROID_OPTEE_HOST_UTEE_DEFINES_H
+
+#include <endian.h>
+
+#define TEE_MD5_HASH_SIZE 16
+#define TEE_SHA1_HASH_SIZE 20
+#define TEE_SHA224_HASH_SIZE 28
+#define TEE_SHA256_HASH_SIZE 32
+#define TEE_SHA384_HASH_SIZE 48
+#define TEE_SHA512_HASH_SIZE 64
+#define TEE_MAX_HASH_SIZE 64
+
+#define TEE_AES_BLOCK_SIZE 16UL
+
+#define TEE_U64_TO_BIG_ENDIAN(x) htobe64(x)
+#define TEE_U64_FROM_BIG_ENDIAN(x) be64toh(x)
+#define TEE_U32_TO_BIG_ENDIAN(x) htobe32(x)
+#define TEE_U32_FROM_BIG_ENDIAN(x) be32toh(x)
+#define TEE_U16_TO_BIG_ENDIAN(x) htobe16(x)
+#define TEE_U16_FROM_BIG_ENDIAN(x) be16toh(x)
+
+#endif /* ANDROID_OPTEE_HOST_UTEE_DEFINES_H */
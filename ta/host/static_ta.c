@@ -0,0 +1,310 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stubs of static TAs the keymaster TA talks to. ASN.1 TA only issues
+ * self-signed root certificates, RNG TA feeds entropy to OpenSSL.
+ */
+
+#include <stdlib.h>
+
+#include <openssl/ec.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/x509v3.h>
+
+#include "tee_shim.h"
+
+#define CMD_ASN1_GEN_ROOT_RSA_CERT 4
+#define CMD_ASN1_GEN_ROOT_EC_CERT 5
+#define CMD_ADD_RNG_ENTROPY 0
+
+#define RSA_RECORD_COUNT 8
+#define EC_RECORD_COUNT 4
+
+typedef TEE_Result (*static_ta_invoke_t)(uint32_t cmd, uint32_t param_types,
+					TEE_Param params[TEE_NUM_PARAMS]);
+
+struct __TEE_TASessionHandle {
+	static_ta_invoke_t invoke;
+};
+
+/* Splits size | buffer records of serialized key pair */
+static bool read_records(const TEE_Param *in, const uint8_t **bufs,
+			uint32_t *sizes, const uint32_t count)
+{
+	const uint8_t *p = in->memref.buffer;
+	uint32_t left = in->memref.size;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (left < sizeof(uint32_t))
+			return false;
+		memcpy(&sizes[i], p, sizeof(uint32_t));
+		p += sizeof(uint32_t);
+		left -= sizeof(uint32_t);
+		if (sizes[i] > left)
+			return false;
+		bufs[i] = p;
+		p += sizes[i];
+		left -= sizes[i];
+	}
+	return true;
+}
+
+static EVP_PKEY *rsa_record_key(const TEE_Param *in)
+{
+	const uint8_t *bufs[RSA_RECORD_COUNT];
+	uint32_t sizes[RSA_RECORD_COUNT];
+	BIGNUM *bn[RSA_RECORD_COUNT] = {NULL};
+	EVP_PKEY *pkey = NULL;
+	RSA *rsa = NULL;
+	uint32_t i = 0;
+
+	if (!read_records(in, bufs, sizes, RSA_RECORD_COUNT))
+		return NULL;
+	for (i = 0; i < RSA_RECORD_COUNT; i++) {
+		bn[i] = BN_bin2bn(bufs[i], sizes[i], NULL);
+		if (!bn[i])
+			goto out;
+	}
+	rsa = RSA_new();
+	if (!rsa || !RSA_set0_key(rsa, bn[0], bn[1], bn[2]))
+		goto out;
+	bn[0] = bn[1] = bn[2] = NULL;
+	if (!RSA_set0_factors(rsa, bn[3], bn[4]))
+		goto out;
+	bn[3] = bn[4] = NULL;
+	if (!RSA_set0_crt_params(rsa, bn[5], bn[6], bn[7]))
+		goto out;
+	bn[5] = bn[6] = bn[7] = NULL;
+	pkey = EVP_PKEY_new();
+	if (pkey && !EVP_PKEY_assign_RSA(pkey, rsa)) {
+		EVP_PKEY_free(pkey);
+		pkey = NULL;
+	}
+	if (pkey)
+		rsa = NULL;
+out:
+	for (i = 0; i < RSA_RECORD_COUNT; i++)
+		BN_clear_free(bn[i]);
+	RSA_free(rsa);
+	return pkey;
+}
+
+static EVP_PKEY *ec_record_key(const TEE_Param *in)
+{
+	const uint8_t *bufs[EC_RECORD_COUNT];
+	uint32_t sizes[EC_RECORD_COUNT];
+	EVP_PKEY *pkey = NULL;
+	EC_KEY *ec = NULL;
+	BIGNUM *x = NULL;
+	BIGNUM *y = NULL;
+	BIGNUM *d = NULL;
+	uint32_t curve = 0;
+	uint32_t bits = 0;
+	int nid = 0;
+
+	if (!read_records(in, bufs, sizes, EC_RECORD_COUNT) ||
+			sizes[0] != sizeof(uint32_t))
+		return NULL;
+	memcpy(&curve, bufs[0], sizeof(uint32_t));
+	nid = host_tee_curve_nid(curve, &bits);
+	if (nid == NID_undef)
+		return NULL;
+	ec = EC_KEY_new_by_curve_name(nid);
+	x = BN_bin2bn(bufs[1], sizes[1], NULL);
+	y = BN_bin2bn(bufs[2], sizes[2], NULL);
+	d = BN_bin2bn(bufs[3], sizes[3], NULL);
+	if (!ec || !x || !y || !d ||
+			!EC_KEY_set_public_key_affine_coordinates(ec, x, y) ||
+			!EC_KEY_set_private_key(ec, d))
+		goto out;
+	pkey = EVP_PKEY_new();
+	if (pkey && !EVP_PKEY_assign_EC_KEY(pkey, ec)) {
+		EVP_PKEY_free(pkey);
+		pkey = NULL;
+	}
+	if (pkey)
+		ec = NULL;
+out:
+	BN_free(x);
+	BN_free(y);
+	BN_clear_free(d);
+	EC_KEY_free(ec);
+	return pkey;
+}
+
+static bool add_extension(X509 *cert, const int nid, const char *value)
+{
+	X509V3_CTX ctx;
+	X509_EXTENSION *ext = NULL;
+	bool ok = false;
+
+	X509V3_set_ctx(&ctx, cert, cert, NULL, NULL, 0);
+	ext = X509V3_EXT_conf_nid(NULL, &ctx, nid, value);
+	if (ext)
+		ok = X509_add_ext(cert, ext, -1) == 1;
+	X509_EXTENSION_free(ext);
+	return ok;
+}
+
+static TEE_Result gen_root_cert(EVP_PKEY *pkey, const char *cn,
+				TEE_Param *out)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	X509 *cert = X509_new();
+	X509_NAME *name = NULL;
+	uint8_t *der = NULL;
+	int der_len = 0;
+
+	if (!cert || !X509_set_version(cert, 2) ||
+			!ASN1_INTEGER_set(X509_get_serialNumber(cert), 1) ||
+			!ASN1_TIME_set_string(X509_getm_notBefore(cert),
+							"700101000000Z") ||
+			!ASN1_TIME_set_string(X509_getm_notAfter(cert),
+						"99991231235959Z") ||
+			!X509_set_pubkey(cert, pkey))
+		goto out;
+	name = X509_get_subject_name(cert);
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+				(const unsigned char *)cn, -1, -1, 0) ||
+			!X509_set_issuer_name(cert, name) ||
+			!add_extension(cert, NID_basic_constraints,
+						"critical,CA:TRUE") ||
+			!add_extension(cert, NID_key_usage,
+						"critical,keyCertSign") ||
+			!X509_sign(cert, pkey, EVP_sha256()))
+		goto out;
+	der_len = i2d_X509(cert, &der);
+	if (der_len <= 0)
+		goto out;
+	if ((uint32_t)der_len > out->memref.size) {
+		out->memref.size = der_len;
+		res = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+	memcpy(out->memref.buffer, der, der_len);
+	out->memref.size = der_len;
+	res = TEE_SUCCESS;
+out:
+	OPENSSL_free(der);
+	X509_free(cert);
+	return res;
+}
+
+static TEE_Result asn1_invoke(uint32_t cmd, uint32_t param_types,
+			TEE_Param params[TEE_NUM_PARAMS])
+{
+	const uint32_t exp_param_types = TEE_PARAM_TYPES(
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	EVP_PKEY *pkey = NULL;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	switch (cmd) {
+	case CMD_ASN1_GEN_ROOT_RSA_CERT:
+		pkey = rsa_record_key(&params[0]);
+		break;
+	case CMD_ASN1_GEN_ROOT_EC_CERT:
+		pkey = ec_record_key(&params[0]);
+		break;
+	default:
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+	if (!pkey)
+		return TEE_ERROR_BAD_PARAMETERS;
+	res = gen_root_cert(pkey, cmd == CMD_ASN1_GEN_ROOT_RSA_CERT ?
+				"Keymaster Host Root RSA" :
+				"Keymaster Host Root EC", &params[1]);
+	EVP_PKEY_free(pkey);
+	return res;
+}
+
+static TEE_Result rng_invoke(uint32_t cmd, uint32_t param_types,
+			TEE_Param params[TEE_NUM_PARAMS])
+{
+	const uint32_t exp_param_types = TEE_PARAM_TYPES(
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (cmd != CMD_ADD_RNG_ENTROPY)
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	/* No entropy is credited, OpenSSL pool is seeded by the OS */
+	RAND_add(params[0].memref.buffer, params[0].memref.size, 0);
+	return TEE_SUCCESS;
+}
+
+static const struct {
+	TEE_UUID uuid;
+	static_ta_invoke_t invoke;
+} static_tas[] = {
+	{ { 0x273fcb14, 0xe831, 0x4cf2,
+		{ 0x93, 0xc4, 0x76, 0x15, 0xdb, 0xd3, 0x0e, 0x90 } },
+	  asn1_invoke },
+	{ { 0x57ff3310, 0x0919, 0x4935,
+		{ 0xb9, 0xc8, 0x32, 0xa4, 0x1d, 0x94, 0xb9, 0x5b } },
+	  rng_invoke },
+};
+
+TEE_Result TEE_OpenTASession(const TEE_UUID *destination,
+			uint32_t cancellationRequestTimeout __unused,
+			uint32_t paramTypes __unused,
+			TEE_Param params[TEE_NUM_PARAMS] __unused,
+			TEE_TASessionHandle *session, uint32_t *returnOrigin)
+{
+	*session = TEE_HANDLE_NULL;
+	if (returnOrigin)
+		*returnOrigin = TEE_ORIGIN_TEE;
+	for (size_t i = 0; i < sizeof(static_tas) / sizeof(static_tas[0]);
+									i++) {
+		if (memcmp(destination, &static_tas[i].uuid,
+						sizeof(TEE_UUID)) != 0)
+			continue;
+		*session = malloc(sizeof(**session));
+		if (!*session)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		(*session)->invoke = static_tas[i].invoke;
+		return TEE_SUCCESS;
+	}
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
+
+void TEE_CloseTASession(TEE_TASessionHandle session)
+{
+	free(session);
+}
+
+TEE_Result TEE_InvokeTACommand(TEE_TASessionHandle session,
+			uint32_t cancellationRequestTimeout __unused,
+			uint32_t commandID, uint32_t paramTypes,
+			TEE_Param params[TEE_NUM_PARAMS],
+			uint32_t *returnOrigin)
+{
+	if (returnOrigin)
+		*returnOrigin = TEE_ORIGIN_TRUSTED_APP;
+	if (session == TEE_HANDLE_NULL)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	return session->invoke(commandID, paramTypes, params);
+}
@@ -0,0 +1,144 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <openssl/rand.h>
+
+#include <host_tee.h>
+#include "tee_shim.h"
+
+static TEE_Identity client_identity = {
+	.login = TEE_LOGIN_PUBLIC,
+};
+
+void host_tee_trace(const char *func, int line, int level,
+			const char *fmt, ...)
+{
+	static const char prefix[] = "?EIDF";
+	va_list ap;
+
+	if (level < 1 || level > 4)
+		level = 0;
+	fprintf(stderr, "%c/TA: %s:%d ", prefix[level], func, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void host_tee_set_client_identity(const TEE_Identity *identity)
+{
+	client_identity = *identity;
+}
+
+void TEE_Panic(TEE_Result panicCode)
+{
+	fprintf(stderr, "TA panic %x\n", panicCode);
+	abort();
+}
+
+TEE_Result TEE_GetPropertyAsIdentity(TEE_PropSetHandle propsetOrEnumerator,
+			const char *name, TEE_Identity *value)
+{
+	if (propsetOrEnumerator != TEE_PROPSET_CURRENT_CLIENT ||
+			strcmp(name, "gpd.client.identity") != 0)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	*value = client_identity;
+	return TEE_SUCCESS;
+}
+
+static uint64_t alloc_count;
+
+uint64_t host_tee_alloc_count(void)
+{
+	return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+void *TEE_Malloc(uint32_t size, uint32_t hint __unused)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	/* TEE_MALLOC_FILL_ZERO is 0, memory is always cleared */
+	return calloc(1, size);
+}
+
+void *TEE_Realloc(void *buffer, uint32_t newSize)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	return realloc(buffer, newSize);
+}
+
+void TEE_Free(void *buffer)
+{
+	free(buffer);
+}
+
+/* NULL buffers of zero size are valid in TEE API, unlike in libc */
+void *TEE_MemMove(void *dest, const void *src, uint32_t size)
+{
+	return size ? memmove(dest, src, size) : dest;
+}
+
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2,
+			uint32_t size)
+{
+	return size ? memcmp(buffer1, buffer2, size) : 0;
+}
+
+void *TEE_MemFill(void *buff, uint32_t x, uint32_t size)
+{
+	return size ? memset(buff, x, size) : buff;
+}
+
+/* System time counts from boot as in OP-TEE */
+void TEE_GetSystemTime(TEE_Time *time)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	time->seconds = ts.tv_sec;
+	time->millis = ts.tv_nsec / 1000000;
+}
+
+void TEE_GetREETime(TEE_Time *time)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	time->seconds = ts.tv_sec;
+	time->millis = ts.tv_nsec / 1000000;
+}
+
+TEE_Result TEE_Wait(uint32_t timeout)
+{
+	struct timespec ts = {
+		.tv_sec = timeout / 1000,
+		.tv_nsec = (timeout % 1000) * 1000000L,
+	};
+
+	nanosleep(&ts, NULL);
+	return TEE_SUCCESS;
+}
+
+void TEE_GenerateRandom(void *randomBuffer, uint32_t randomBufferLen)
+{
+	if (RAND_bytes(randomBuffer, randomBufferLen) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
@@ -0,0 +1,724 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/rsa.h>
+
+#include "tee_shim.h"
+
+#define HOST_TEE_RSA_MIN_BITS 256
+#define HOST_TEE_RSA_MAX_BITS 4096
+
+/* Key size limits of HMAC objects, same as in OP-TEE */
+static const struct {
+	uint32_t type;
+	uint32_t min;
+	uint32_t max;
+} hmac_sizes[] = {
+	{TEE_TYPE_HMAC_MD5, 64, 512},
+	{TEE_TYPE_HMAC_SHA1, 80, 512},
+	{TEE_TYPE_HMAC_SHA224, 112, 512},
+	{TEE_TYPE_HMAC_SHA256, 192, 1024},
+	{TEE_TYPE_HMAC_SHA384, 256, 1024},
+	{TEE_TYPE_HMAC_SHA512, 256, 1024},
+	{TEE_TYPE_GENERIC_SECRET, 8, 4096},
+};
+
+static bool is_value_attr(const uint32_t id)
+{
+	return (id & TEE_ATTR_BIT_VALUE) != 0;
+}
+
+static bool is_secret_type(const uint32_t type)
+{
+	if (type == TEE_TYPE_AES)
+		return true;
+	for (size_t i = 0; i < sizeof(hmac_sizes) / sizeof(hmac_sizes[0]);
+									i++) {
+		if (hmac_sizes[i].type == type)
+			return true;
+	}
+	return false;
+}
+
+static TEE_Result check_secret_size(const uint32_t type,
+				const uint32_t key_size)
+{
+	if (type == TEE_TYPE_AES) {
+		if (key_size != 128 && key_size != 192 && key_size != 256)
+			return TEE_ERROR_NOT_SUPPORTED;
+		return TEE_SUCCESS;
+	}
+	for (size_t i = 0; i < sizeof(hmac_sizes) / sizeof(hmac_sizes[0]);
+									i++) {
+		if (hmac_sizes[i].type != type)
+			continue;
+		if (key_size % 8 != 0 || key_size < hmac_sizes[i].min ||
+					key_size > hmac_sizes[i].max)
+			return TEE_ERROR_NOT_SUPPORTED;
+		return TEE_SUCCESS;
+	}
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+
+int host_tee_curve_nid(const uint32_t curve, uint32_t *bits)
+{
+	switch (curve) {
+	case TEE_ECC_CURVE_NIST_P192:
+		*bits = 192;
+		return NID_X9_62_prime192v1;
+	case TEE_ECC_CURVE_NIST_P224:
+		*bits = 224;
+		return NID_secp224r1;
+	case TEE_ECC_CURVE_NIST_P256:
+		*bits = 256;
+		return NID_X9_62_prime256v1;
+	case TEE_ECC_CURVE_NIST_P384:
+		*bits = 384;
+		return NID_secp384r1;
+	case TEE_ECC_CURVE_NIST_P521:
+		*bits = 521;
+		return NID_secp521r1;
+	default:
+		*bits = 0;
+		return NID_undef;
+	}
+}
+
+static uint32_t curve_of_nid(const int nid)
+{
+	uint32_t bits = 0;
+
+	for (uint32_t curve = TEE_ECC_CURVE_NIST_P192;
+			curve <= TEE_ECC_CURVE_NIST_P521; curve++) {
+		if (host_tee_curve_nid(curve, &bits) == nid)
+			return curve;
+	}
+	return 0;
+}
+
+void host_tee_free_attrs(TEE_Attribute *attrs, const uint32_t count)
+{
+	if (!attrs)
+		return;
+	for (uint32_t i = 0; i < count; i++) {
+		if (is_value_attr(attrs[i].attributeID))
+			continue;
+		if (attrs[i].content.ref.buffer) {
+			OPENSSL_cleanse(attrs[i].content.ref.buffer,
+					attrs[i].content.ref.length);
+			free(attrs[i].content.ref.buffer);
+		}
+	}
+	free(attrs);
+}
+
+TEE_Result host_tee_copy_attrs(TEE_Attribute **dst, uint32_t *dst_count,
+				const TEE_Attribute *src,
+				const uint32_t src_count)
+{
+	TEE_Attribute *attrs = NULL;
+	uint32_t length = 0;
+
+	*dst = NULL;
+	*dst_count = 0;
+	if (src_count == 0)
+		return TEE_SUCCESS;
+	attrs = calloc(src_count, sizeof(*attrs));
+	if (!attrs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	for (uint32_t i = 0; i < src_count; i++) {
+		attrs[i] = src[i];
+		if (is_value_attr(src[i].attributeID))
+			continue;
+		length = src[i].content.ref.length;
+		attrs[i].content.ref.buffer = malloc(length ? length : 1);
+		if (!attrs[i].content.ref.buffer) {
+			host_tee_free_attrs(attrs, i);
+			return TEE_ERROR_OUT_OF_MEMORY;
+		}
+		memcpy(attrs[i].content.ref.buffer,
+				src[i].content.ref.buffer, length);
+	}
+	*dst = attrs;
+	*dst_count = src_count;
+	return TEE_SUCCESS;
+}
+
+const TEE_Attribute *host_tee_find_attr(const TEE_ObjectHandle object,
+				const uint32_t id)
+{
+	for (uint32_t i = 0; i < object->attr_count; i++) {
+		if (object->attrs[i].attributeID == id)
+			return object->attrs + i;
+	}
+	return NULL;
+}
+
+static BIGNUM *attr_bn(const TEE_ObjectHandle object, const uint32_t id)
+{
+	const TEE_Attribute *attr = host_tee_find_attr(object, id);
+
+	if (!attr)
+		return NULL;
+	return BN_bin2bn(attr->content.ref.buffer, attr->content.ref.length,
+									NULL);
+}
+
+static EVP_PKEY *build_rsa_pkey(const TEE_ObjectHandle object)
+{
+	EVP_PKEY *pkey = NULL;
+	RSA *rsa = NULL;
+	BIGNUM *n = attr_bn(object, TEE_ATTR_RSA_MODULUS);
+	BIGNUM *e = attr_bn(object, TEE_ATTR_RSA_PUBLIC_EXPONENT);
+	BIGNUM *d = attr_bn(object, TEE_ATTR_RSA_PRIVATE_EXPONENT);
+	BIGNUM *p = attr_bn(object, TEE_ATTR_RSA_PRIME1);
+	BIGNUM *q = attr_bn(object, TEE_ATTR_RSA_PRIME2);
+	BIGNUM *dp = attr_bn(object, TEE_ATTR_RSA_EXPONENT1);
+	BIGNUM *dq = attr_bn(object, TEE_ATTR_RSA_EXPONENT2);
+	BIGNUM *qp = attr_bn(object, TEE_ATTR_RSA_COEFFICIENT);
+
+	rsa = RSA_new();
+	if (!rsa || !n || !e || !RSA_set0_key(rsa, n, e, d))
+		goto out;
+	n = e = d = NULL;
+	if (p && q) {
+		if (!RSA_set0_factors(rsa, p, q))
+			goto out;
+		p = q = NULL;
+	}
+	if (dp && dq && qp) {
+		if (!RSA_set0_crt_params(rsa, dp, dq, qp))
+			goto out;
+		dp = dq = qp = NULL;
+	}
+	pkey = EVP_PKEY_new();
+	if (pkey && !EVP_PKEY_assign_RSA(pkey, rsa)) {
+		EVP_PKEY_free(pkey);
+		pkey = NULL;
+	}
+	if (pkey)
+		rsa = NULL;
+out:
+	RSA_free(rsa);
+	BN_free(n);
+	BN_free(e);
+	BN_clear_free(d);
+	BN_clear_free(p);
+	BN_clear_free(q);
+	BN_clear_free(dp);
+	BN_clear_free(dq);
+	BN_clear_free(qp);
+	return pkey;
+}
+
+static EVP_PKEY *build_ec_pkey(const TEE_ObjectHandle object)
+{
+	const TEE_Attribute *curve = host_tee_find_attr(object,
+						TEE_ATTR_ECC_CURVE);
+	EVP_PKEY *pkey = NULL;
+	EC_KEY *ec = NULL;
+	BIGNUM *x = attr_bn(object, TEE_ATTR_ECC_PUBLIC_VALUE_X);
+	BIGNUM *y = attr_bn(object, TEE_ATTR_ECC_PUBLIC_VALUE_Y);
+	BIGNUM *d = attr_bn(object, TEE_ATTR_ECC_PRIVATE_VALUE);
+	uint32_t bits = 0;
+	int nid = NID_undef;
+
+	if (curve)
+		nid = host_tee_curve_nid(curve->content.value.a, &bits);
+	if (nid == NID_undef || !x || !y)
+		goto out;
+	ec = EC_KEY_new_by_curve_name(nid);
+	if (!ec || !EC_KEY_set_public_key_affine_coordinates(ec, x, y))
+		goto out;
+	if (d && !EC_KEY_set_private_key(ec, d))
+		goto out;
+	pkey = EVP_PKEY_new();
+	if (pkey && !EVP_PKEY_assign_EC_KEY(pkey, ec)) {
+		EVP_PKEY_free(pkey);
+		pkey = NULL;
+	}
+	if (pkey)
+		ec = NULL;
+out:
+	EC_KEY_free(ec);
+	BN_free(x);
+	BN_free(y);
+	BN_clear_free(d);
+	return pkey;
+}
+
+EVP_PKEY *host_tee_object_pkey(TEE_ObjectHandle object)
+{
+	if (object->pkey)
+		return object->pkey;
+	if (!(object->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED))
+		return NULL;
+	switch (object->info.objectType) {
+	case TEE_TYPE_RSA_KEYPAIR:
+	case TEE_TYPE_RSA_PUBLIC_KEY:
+		object->pkey = build_rsa_pkey(object);
+		break;
+	case TEE_TYPE_ECDSA_KEYPAIR:
+	case TEE_TYPE_ECDSA_PUBLIC_KEY:
+		object->pkey = build_ec_pkey(object);
+		break;
+	default:
+		break;
+	}
+	return object->pkey;
+}
+
+static TEE_Result add_bn_attr(TEE_Attribute *attrs, uint32_t *count,
+				const uint32_t id, const BIGNUM *bn)
+{
+	uint32_t length = BN_num_bytes(bn);
+	uint8_t *buffer = malloc(length ? length : 1);
+
+	if (!buffer)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	BN_bn2bin(bn, buffer);
+	attrs[*count].attributeID = id;
+	attrs[*count].content.ref.buffer = buffer;
+	attrs[*count].content.ref.length = length;
+	(*count)++;
+	return TEE_SUCCESS;
+}
+
+TEE_Result host_tee_pkey_attrs(TEE_ObjectHandle object, EVP_PKEY *pkey)
+{
+	TEE_Result res = TEE_SUCCESS;
+	TEE_Attribute *attrs = NULL;
+	uint32_t count = 0;
+	const RSA *rsa = NULL;
+	const EC_KEY *ec = NULL;
+	const BIGNUM *bn[8];
+	BIGNUM *x = NULL;
+	BIGNUM *y = NULL;
+	static const uint32_t rsa_ids[] = {
+		TEE_ATTR_RSA_MODULUS,
+		TEE_ATTR_RSA_PUBLIC_EXPONENT,
+		TEE_ATTR_RSA_PRIVATE_EXPONENT,
+		TEE_ATTR_RSA_PRIME1,
+		TEE_ATTR_RSA_PRIME2,
+		TEE_ATTR_RSA_EXPONENT1,
+		TEE_ATTR_RSA_EXPONENT2,
+		TEE_ATTR_RSA_COEFFICIENT,
+	};
+
+	attrs = calloc(8, sizeof(*attrs));
+	if (!attrs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA) {
+		rsa = EVP_PKEY_get0_RSA(pkey);
+		RSA_get0_key(rsa, &bn[0], &bn[1], &bn[2]);
+		RSA_get0_factors(rsa, &bn[3], &bn[4]);
+		RSA_get0_crt_params(rsa, &bn[5], &bn[6], &bn[7]);
+		for (uint32_t i = 0; i < 8 && res == TEE_SUCCESS; i++)
+			res = add_bn_attr(attrs, &count, rsa_ids[i], bn[i]);
+	} else {
+		ec = EVP_PKEY_get0_EC_KEY(pkey);
+		x = BN_new();
+		y = BN_new();
+		if (!x || !y || !EC_POINT_get_affine_coordinates_GFp(
+					EC_KEY_get0_group(ec),
+					EC_KEY_get0_public_key(ec),
+					x, y, NULL)) {
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+		attrs[count].attributeID = TEE_ATTR_ECC_CURVE;
+		attrs[count].content.value.a = curve_of_nid(
+				EC_GROUP_get_curve_name(EC_KEY_get0_group(ec)));
+		attrs[count].content.value.b = 0;
+		count++;
+		res = add_bn_attr(attrs, &count,
+				TEE_ATTR_ECC_PUBLIC_VALUE_X, x);
+		if (res == TEE_SUCCESS)
+			res = add_bn_attr(attrs, &count,
+					TEE_ATTR_ECC_PUBLIC_VALUE_Y, y);
+		if (res == TEE_SUCCESS)
+			res = add_bn_attr(attrs, &count,
+					TEE_ATTR_ECC_PRIVATE_VALUE,
+					EC_KEY_get0_private_key(ec));
+	}
+out:
+	BN_free(x);
+	BN_free(y);
+	if (res != TEE_SUCCESS) {
+		host_tee_free_attrs(attrs, count);
+		return res;
+	}
+	object->attrs = attrs;
+	object->attr_count = count;
+	return TEE_SUCCESS;
+}
+
+void TEE_GetObjectInfo1(TEE_ObjectHandle object, TEE_ObjectInfo *objectInfo)
+{
+	*objectInfo = object->info;
+	if (object->pobj)
+		objectInfo->dataSize = object->pobj->data_size;
+}
+
+TEE_Result TEE_GetObjectBufferAttribute(TEE_ObjectHandle object,
+			uint32_t attributeID, void *buffer, uint32_t *size)
+{
+	const TEE_Attribute *attr = NULL;
+
+	if (is_value_attr(attributeID))
+		return TEE_ERROR_BAD_PARAMETERS;
+	attr = host_tee_find_attr(object, attributeID);
+	if (!attr)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (*size < attr->content.ref.length) {
+		*size = attr->content.ref.length;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	memcpy(buffer, attr->content.ref.buffer, attr->content.ref.length);
+	*size = attr->content.ref.length;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_GetObjectValueAttribute(TEE_ObjectHandle object,
+			uint32_t attributeID, uint32_t *a, uint32_t *b)
+{
+	const TEE_Attribute *attr = NULL;
+
+	if (!is_value_attr(attributeID))
+		return TEE_ERROR_BAD_PARAMETERS;
+	attr = host_tee_find_attr(object, attributeID);
+	if (!attr)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (a)
+		*a = attr->content.value.a;
+	if (b)
+		*b = attr->content.value.b;
+	return TEE_SUCCESS;
+}
+
+void TEE_CloseObject(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return;
+	if (object->pobj)
+		host_tee_storage_release(object->pobj);
+	host_tee_free_attrs(object->attrs, object->attr_count);
+	EVP_PKEY_free(object->pkey);
+	free(object);
+}
+
+TEE_Result TEE_AllocateTransientObject(uint32_t objectType,
+			uint32_t maxObjectSize, TEE_ObjectHandle *object)
+{
+	TEE_ObjectHandle obj = NULL;
+
+	switch (objectType) {
+	case TEE_TYPE_RSA_KEYPAIR:
+	case TEE_TYPE_RSA_PUBLIC_KEY:
+		if (maxObjectSize > HOST_TEE_RSA_MAX_BITS)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	case TEE_TYPE_ECDSA_KEYPAIR:
+	case TEE_TYPE_ECDSA_PUBLIC_KEY:
+		if (maxObjectSize > 521)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	default:
+		if (!is_secret_type(objectType))
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	}
+	obj = calloc(1, sizeof(*obj));
+	if (!obj)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	obj->info.objectType = objectType;
+	obj->info.maxObjectSize = maxObjectSize;
+	obj->info.objectUsage = 0xFFFFFFFF;
+	*object = obj;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeTransientObject(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return;
+	if (object->pobj)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	TEE_CloseObject(object);
+}
+
+void TEE_ResetTransientObject(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return;
+	host_tee_free_attrs(object->attrs, object->attr_count);
+	EVP_PKEY_free(object->pkey);
+	object->attrs = NULL;
+	object->attr_count = 0;
+	object->pkey = NULL;
+	object->info.objectSize = 0;
+	object->info.handleFlags &= ~TEE_HANDLE_FLAG_INITIALIZED;
+}
+
+/* Bit length of big endian number */
+static uint32_t bit_length(const uint8_t *buf, uint32_t len)
+{
+	while (len != 0 && buf[0] == 0) {
+		buf++;
+		len--;
+	}
+	if (len == 0)
+		return 0;
+	return (len - 1) * 8 + 32 - __builtin_clz(buf[0]);
+}
+
+static TEE_Result populated_size(const TEE_ObjectHandle object,
+				uint32_t *size)
+{
+	const TEE_Attribute *attr = NULL;
+	uint32_t type = object->info.objectType;
+
+	switch (type) {
+	case TEE_TYPE_RSA_KEYPAIR:
+	case TEE_TYPE_RSA_PUBLIC_KEY:
+		attr = host_tee_find_attr(object, TEE_ATTR_RSA_MODULUS);
+		if (!attr || !host_tee_find_attr(object,
+					TEE_ATTR_RSA_PUBLIC_EXPONENT))
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (type == TEE_TYPE_RSA_KEYPAIR && !host_tee_find_attr(
+				object, TEE_ATTR_RSA_PRIVATE_EXPONENT))
+			return TEE_ERROR_BAD_PARAMETERS;
+		*size = bit_length(attr->content.ref.buffer,
+					attr->content.ref.length);
+		return TEE_SUCCESS;
+	case TEE_TYPE_ECDSA_KEYPAIR:
+	case TEE_TYPE_ECDSA_PUBLIC_KEY:
+		attr = host_tee_find_attr(object, TEE_ATTR_ECC_CURVE);
+		if (!attr || host_tee_curve_nid(attr->content.value.a, size)
+							== NID_undef)
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (!host_tee_find_attr(object, TEE_ATTR_ECC_PUBLIC_VALUE_X) ||
+				!host_tee_find_attr(object,
+					TEE_ATTR_ECC_PUBLIC_VALUE_Y))
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (type == TEE_TYPE_ECDSA_KEYPAIR && !host_tee_find_attr(
+				object, TEE_ATTR_ECC_PRIVATE_VALUE))
+			return TEE_ERROR_BAD_PARAMETERS;
+		return TEE_SUCCESS;
+	default:
+		attr = host_tee_find_attr(object, TEE_ATTR_SECRET_VALUE);
+		if (!attr)
+			return TEE_ERROR_BAD_PARAMETERS;
+		*size = attr->content.ref.length * 8;
+		return TEE_SUCCESS;
+	}
+}
+
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+			const TEE_Attribute *attrs, uint32_t attrCount)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t size = 0;
+
+	if (object->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED)
+		return TEE_ERROR_BAD_STATE;
+	res = host_tee_copy_attrs(&object->attrs, &object->attr_count,
+							attrs, attrCount);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = populated_size(object, &size);
+	if (res == TEE_SUCCESS && size > object->info.maxObjectSize)
+		res = TEE_ERROR_BAD_PARAMETERS;
+	if (res != TEE_SUCCESS) {
+		TEE_ResetTransientObject(object);
+		return res;
+	}
+	object->info.objectSize = size;
+	object->info.handleFlags |= TEE_HANDLE_FLAG_INITIALIZED;
+	return TEE_SUCCESS;
+}
+
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			const void *buffer, uint32_t length)
+{
+	attr->attributeID = attributeID;
+	attr->content.ref.buffer = (void *)buffer;
+	attr->content.ref.length = length;
+}
+
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			uint32_t a, uint32_t b)
+{
+	attr->attributeID = attributeID;
+	attr->content.value.a = a;
+	attr->content.value.b = b;
+}
+
+TEE_Result TEE_CopyObjectAttributes1(TEE_ObjectHandle destObject,
+			TEE_ObjectHandle srcObject)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (destObject->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED)
+		return TEE_ERROR_BAD_STATE;
+	if (srcObject->info.objectSize > destObject->info.maxObjectSize)
+		return TEE_ERROR_BAD_PARAMETERS;
+	res = host_tee_copy_attrs(&destObject->attrs, &destObject->attr_count,
+				srcObject->attrs, srcObject->attr_count);
+	if (res != TEE_SUCCESS)
+		return res;
+	destObject->info.objectSize = srcObject->info.objectSize;
+	destObject->info.handleFlags |= TEE_HANDLE_FLAG_INITIALIZED;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result generate_rsa(TEE_ObjectHandle object,
+				const uint32_t key_size,
+				const TEE_Attribute *params,
+				const uint32_t count)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	EVP_PKEY *pkey = NULL;
+	RSA *rsa = NULL;
+	BIGNUM *e = BN_new();
+
+	if (key_size < HOST_TEE_RSA_MIN_BITS || key_size > HOST_TEE_RSA_MAX_BITS)
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (!e)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (!BN_set_word(e, RSA_F4))
+		goto out;
+	for (uint32_t i = 0; i < count; i++) {
+		if (params[i].attributeID != TEE_ATTR_RSA_PUBLIC_EXPONENT)
+			continue;
+		if (!BN_bin2bn(params[i].content.ref.buffer,
+				params[i].content.ref.length, e))
+			goto out;
+	}
+	rsa = RSA_new();
+	if (!rsa || !RSA_generate_key_ex(rsa, key_size, e, NULL)) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+	pkey = EVP_PKEY_new();
+	if (!pkey || !EVP_PKEY_assign_RSA(pkey, rsa))
+		goto out;
+	rsa = NULL;
+	object->info.objectSize = key_size;
+	res = host_tee_pkey_attrs(object, pkey);
+out:
+	if (res == TEE_SUCCESS)
+		object->pkey = pkey;
+	else
+		EVP_PKEY_free(pkey);
+	RSA_free(rsa);
+	BN_free(e);
+	return res;
+}
+
+static TEE_Result generate_ec(TEE_ObjectHandle object,
+				const uint32_t key_size,
+				const TEE_Attribute *params,
+				const uint32_t count)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	EVP_PKEY *pkey = NULL;
+	EC_KEY *ec = NULL;
+	uint32_t curve = 0;
+	uint32_t bits = 0;
+	int nid = NID_undef;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (params[i].attributeID == TEE_ATTR_ECC_CURVE)
+			curve = params[i].content.value.a;
+	}
+	nid = host_tee_curve_nid(curve, &bits);
+	if (nid == NID_undef || bits != key_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+	ec = EC_KEY_new_by_curve_name(nid);
+	if (!ec || !EC_KEY_generate_key(ec))
+		goto out;
+	pkey = EVP_PKEY_new();
+	if (!pkey || !EVP_PKEY_assign_EC_KEY(pkey, ec))
+		goto out;
+	ec = NULL;
+	object->info.objectSize = key_size;
+	res = host_tee_pkey_attrs(object, pkey);
+out:
+	if (res == TEE_SUCCESS)
+		object->pkey = pkey;
+	else
+		EVP_PKEY_free(pkey);
+	EC_KEY_free(ec);
+	return res;
+}
+
+static TEE_Result generate_secret(TEE_ObjectHandle object,
+				const uint32_t key_size)
+{
+	TEE_Result res = check_secret_size(object->info.objectType, key_size);
+	TEE_Attribute attr;
+
+	if (res != TEE_SUCCESS)
+		return res;
+	attr.attributeID = TEE_ATTR_SECRET_VALUE;
+	attr.content.ref.length = key_size / 8;
+	attr.content.ref.buffer = malloc(key_size / 8);
+	if (!attr.content.ref.buffer)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	TEE_GenerateRandom(attr.content.ref.buffer, key_size / 8);
+	res = host_tee_copy_attrs(&object->attrs, &object->attr_count,
+								&attr, 1);
+	OPENSSL_cleanse(attr.content.ref.buffer, key_size / 8);
+	free(attr.content.ref.buffer);
+	if (res == TEE_SUCCESS)
+		object->info.objectSize = key_size;
+	return res;
+}
+
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+			const TEE_Attribute *params, uint32_t paramCount)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (object->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED)
+		return TEE_ERROR_BAD_STATE;
+	if (keySize > object->info.maxObjectSize)
+		return TEE_ERROR_BAD_PARAMETERS;
+	switch (object->info.objectType) {
+	case TEE_TYPE_RSA_KEYPAIR:
+		res = generate_rsa(object, keySize, params, paramCount);
+		break;
+	case TEE_TYPE_ECDSA_KEYPAIR:
+		res = generate_ec(object, keySize, params, paramCount);
+		break;
+	case TEE_TYPE_RSA_PUBLIC_KEY:
+	case TEE_TYPE_ECDSA_PUBLIC_KEY:
+		res = TEE_ERROR_BAD_PARAMETERS;
+		break;
+	default:
+		res = generate_secret(object, keySize);
+		break;
+	}
+	if (res == TEE_SUCCESS)
+		object->info.handleFlags |= TEE_HANDLE_FLAG_INITIALIZED;
+	return res;
+}
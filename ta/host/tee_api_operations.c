@@ -0,0 +1,891 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <openssl/crypto.h>
+#include <openssl/ecdsa.h>
+#include <openssl/hmac.h>
+#include <openssl/rsa.h>
+
+#include <utee_defines.h>
+#include "tee_shim.h"
+
+/* Class of operation is the top nibble of algorithm identifier */
+#define ALG_CLASS(alg) ((alg) >> 28)
+/* Hash of digest, HMAC and RSASSA algorithms, MGF1 hash of RSAES OAEP */
+#define ALG_HASH(alg) ((alg) & 0xF)
+#define ALG_SIGN_HASH(alg) (((alg) >> 12) & 0xF)
+#define ALG_MGF1_HASH(alg) (((alg) >> 20) & 0xF)
+
+struct __TEE_OperationHandle {
+	TEE_OperationInfo info;
+	bool initialized;
+	/* AES or HMAC key */
+	uint8_t *secret;
+	uint32_t secret_len;
+	/* RSA or EC key */
+	EVP_PKEY *pkey;
+	const EVP_MD *md;
+	EVP_MD_CTX *md_ctx;
+	HMAC_CTX *hmac;
+	EVP_CIPHER_CTX *cipher;
+	/* Input of block modes not processed yet */
+	uint32_t buffered;
+	/* AE tag length in bytes */
+	uint32_t tag_len;
+};
+
+static const EVP_MD *hash_md(const uint32_t hash)
+{
+	switch (hash) {
+	case 1:
+		return EVP_md5();
+	case 2:
+		return EVP_sha1();
+	case 3:
+		return EVP_sha224();
+	case 4:
+		return EVP_sha256();
+	case 5:
+		return EVP_sha384();
+	case 6:
+		return EVP_sha512();
+	default:
+		return NULL;
+	}
+}
+
+static bool is_ecdsa(const uint32_t alg)
+{
+	return alg >= TEE_ALG_ECDSA_P192 && alg <= TEE_ALG_ECDSA_P521 &&
+					(alg & 0xFFF) == 0x041;
+}
+
+static bool is_rsassa(const uint32_t alg)
+{
+	return ALG_CLASS(alg) == 7 && (alg & 0xFF) == 0x30;
+}
+
+static bool is_pss(const uint32_t alg)
+{
+	return is_rsassa(alg) && ((alg >> 8) & 0xF) == 0x9;
+}
+
+static TEE_Result check_algorithm(TEE_OperationHandle op,
+				const uint32_t alg, const uint32_t mode)
+{
+	switch (alg) {
+	case TEE_ALG_AES_ECB_NOPAD:
+	case TEE_ALG_AES_CBC_NOPAD:
+	case TEE_ALG_AES_CTR:
+		op->info.operationClass = TEE_OPERATION_CIPHER;
+		break;
+	case TEE_ALG_AES_GCM:
+		op->info.operationClass = TEE_OPERATION_AE;
+		break;
+	case TEE_ALG_MD5:
+	case TEE_ALG_SHA1:
+	case TEE_ALG_SHA224:
+	case TEE_ALG_SHA256:
+	case TEE_ALG_SHA384:
+	case TEE_ALG_SHA512:
+		op->info.operationClass = TEE_OPERATION_DIGEST;
+		op->md = hash_md(ALG_HASH(alg));
+		break;
+	case TEE_ALG_HMAC_MD5:
+	case TEE_ALG_HMAC_SHA1:
+	case TEE_ALG_HMAC_SHA224:
+	case TEE_ALG_HMAC_SHA256:
+	case TEE_ALG_HMAC_SHA384:
+	case TEE_ALG_HMAC_SHA512:
+		op->info.operationClass = TEE_OPERATION_MAC;
+		op->md = hash_md(ALG_HASH(alg));
+		break;
+	case TEE_ALG_RSA_NOPAD:
+	case TEE_ALG_RSAES_PKCS1_V1_5:
+		op->info.operationClass = TEE_OPERATION_ASYMMETRIC_CIPHER;
+		break;
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_MD5:
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA1:
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA224:
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA256:
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA384:
+	case TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA512:
+		op->info.operationClass = TEE_OPERATION_ASYMMETRIC_CIPHER;
+		op->md = hash_md(ALG_MGF1_HASH(alg));
+		break;
+	default:
+		if (is_ecdsa(alg)) {
+			op->info.operationClass =
+					TEE_OPERATION_ASYMMETRIC_SIGNATURE;
+			break;
+		}
+		if (is_rsassa(alg) && hash_md(ALG_SIGN_HASH(alg))) {
+			op->info.operationClass =
+					TEE_OPERATION_ASYMMETRIC_SIGNATURE;
+			op->md = hash_md(ALG_SIGN_HASH(alg));
+			break;
+		}
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+	switch (op->info.operationClass) {
+	case TEE_OPERATION_CIPHER:
+	case TEE_OPERATION_AE:
+	case TEE_OPERATION_ASYMMETRIC_CIPHER:
+		if (mode != TEE_MODE_ENCRYPT && mode != TEE_MODE_DECRYPT)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	case TEE_OPERATION_ASYMMETRIC_SIGNATURE:
+		if (mode != TEE_MODE_SIGN && mode != TEE_MODE_VERIFY)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	case TEE_OPERATION_MAC:
+		if (mode != TEE_MODE_MAC)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	default:
+		if (mode != TEE_MODE_DIGEST)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	}
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+			uint32_t algorithm, uint32_t mode,
+			uint32_t maxKeySize)
+{
+	TEE_OperationHandle op = calloc(1, sizeof(*op));
+	TEE_Result res = TEE_SUCCESS;
+
+	*operation = TEE_HANDLE_NULL;
+	if (!op)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	op->info.algorithm = algorithm;
+	op->info.mode = mode;
+	op->info.maxKeySize = maxKeySize;
+	res = check_algorithm(op, algorithm, mode);
+	if (res != TEE_SUCCESS)
+		goto error;
+	res = TEE_ERROR_OUT_OF_MEMORY;
+	switch (op->info.operationClass) {
+	case TEE_OPERATION_DIGEST:
+		op->info.digestLength = EVP_MD_size(op->md);
+		op->md_ctx = EVP_MD_CTX_new();
+		if (!op->md_ctx || !EVP_DigestInit_ex(op->md_ctx, op->md,
+								NULL))
+			goto error;
+		op->initialized = true;
+		break;
+	case TEE_OPERATION_MAC:
+		op->info.digestLength = EVP_MD_size(op->md);
+		op->hmac = HMAC_CTX_new();
+		if (!op->hmac)
+			goto error;
+		break;
+	case TEE_OPERATION_CIPHER:
+	case TEE_OPERATION_AE:
+		op->cipher = EVP_CIPHER_CTX_new();
+		if (!op->cipher)
+			goto error;
+		break;
+	default:
+		break;
+	}
+	*operation = op;
+	return TEE_SUCCESS;
+error:
+	TEE_FreeOperation(op);
+	return res;
+}
+
+static void clear_key(TEE_OperationHandle op)
+{
+	if (op->secret) {
+		OPENSSL_cleanse(op->secret, op->secret_len);
+		free(op->secret);
+	}
+	op->secret = NULL;
+	op->secret_len = 0;
+	EVP_PKEY_free(op->pkey);
+	op->pkey = NULL;
+	op->info.keySize = 0;
+	op->info.handleState &= ~TEE_HANDLE_FLAG_KEY_SET;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL)
+		return;
+	clear_key(operation);
+	EVP_MD_CTX_free(operation->md_ctx);
+	HMAC_CTX_free(operation->hmac);
+	EVP_CIPHER_CTX_free(operation->cipher);
+	free(operation);
+}
+
+void TEE_GetOperationInfo(TEE_OperationHandle operation,
+			TEE_OperationInfo *operationInfo)
+{
+	*operationInfo = operation->info;
+}
+
+void TEE_ResetOperation(TEE_OperationHandle operation)
+{
+	if (operation->info.operationClass == TEE_OPERATION_DIGEST) {
+		EVP_DigestInit_ex(operation->md_ctx, operation->md, NULL);
+		return;
+	}
+	operation->initialized = false;
+	operation->info.handleState &= ~TEE_HANDLE_FLAG_INITIALIZED;
+}
+
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			TEE_ObjectHandle key)
+{
+	const TEE_Attribute *attr = NULL;
+	EVP_PKEY *pkey = NULL;
+
+	clear_key(operation);
+	operation->initialized = false;
+	if (key == TEE_HANDLE_NULL)
+		return TEE_SUCCESS;
+	if (!(key->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED) ||
+			key->info.objectSize > operation->info.maxKeySize)
+		return TEE_ERROR_BAD_PARAMETERS;
+	switch (operation->info.operationClass) {
+	case TEE_OPERATION_CIPHER:
+	case TEE_OPERATION_AE:
+	case TEE_OPERATION_MAC:
+		attr = host_tee_find_attr(key, TEE_ATTR_SECRET_VALUE);
+		if (!attr)
+			return TEE_ERROR_BAD_PARAMETERS;
+		operation->secret = malloc(attr->content.ref.length + 1);
+		if (!operation->secret)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		memcpy(operation->secret, attr->content.ref.buffer,
+						attr->content.ref.length);
+		operation->secret_len = attr->content.ref.length;
+		break;
+	case TEE_OPERATION_ASYMMETRIC_CIPHER:
+	case TEE_OPERATION_ASYMMETRIC_SIGNATURE:
+		pkey = host_tee_object_pkey(key);
+		if (!pkey || (is_ecdsa(operation->info.algorithm) !=
+				(EVP_PKEY_base_id(pkey) == EVP_PKEY_EC)))
+			return TEE_ERROR_BAD_PARAMETERS;
+		EVP_PKEY_up_ref(pkey);
+		operation->pkey = pkey;
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	operation->info.keySize = key->info.objectSize;
+	operation->info.handleState |= TEE_HANDLE_FLAG_KEY_SET;
+	return TEE_SUCCESS;
+}
+
+/* Digest */
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+			uint32_t chunkSize)
+{
+	if (chunkSize != 0 && !EVP_DigestUpdate(operation->md_ctx, chunk,
+								chunkSize))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation,
+			const void *chunk, uint32_t chunkLen,
+			void *hash, uint32_t *hashLen)
+{
+	unsigned int len = 0;
+
+	if (*hashLen < operation->info.digestLength) {
+		*hashLen = operation->info.digestLength;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	TEE_DigestUpdate(operation, chunk, chunkLen);
+	if (!EVP_DigestFinal_ex(operation->md_ctx, hash, &len))
+		return TEE_ERROR_GENERIC;
+	*hashLen = len;
+	/* Operation is ready for the next digest */
+	EVP_DigestInit_ex(operation->md_ctx, operation->md, NULL);
+	return TEE_SUCCESS;
+}
+
+/* Symmetric ciphers */
+
+static const EVP_CIPHER *aes_cipher(const uint32_t alg, const uint32_t len)
+{
+	switch (alg) {
+	case TEE_ALG_AES_ECB_NOPAD:
+		return len == 16 ? EVP_aes_128_ecb() :
+			len == 24 ? EVP_aes_192_ecb() : EVP_aes_256_ecb();
+	case TEE_ALG_AES_CBC_NOPAD:
+		return len == 16 ? EVP_aes_128_cbc() :
+			len == 24 ? EVP_aes_192_cbc() : EVP_aes_256_cbc();
+	case TEE_ALG_AES_CTR:
+		return len == 16 ? EVP_aes_128_ctr() :
+			len == 24 ? EVP_aes_192_ctr() : EVP_aes_256_ctr();
+	default:
+		return len == 16 ? EVP_aes_128_gcm() :
+			len == 24 ? EVP_aes_192_gcm() : EVP_aes_256_gcm();
+	}
+}
+
+static bool is_block_mode(const TEE_OperationHandle op)
+{
+	return op->info.algorithm == TEE_ALG_AES_ECB_NOPAD ||
+			op->info.algorithm == TEE_ALG_AES_CBC_NOPAD;
+}
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+			uint32_t IVLen)
+{
+	const EVP_CIPHER *cipher = aes_cipher(operation->info.algorithm,
+						operation->secret_len);
+
+	if (!operation->secret)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+	if (operation->info.algorithm != TEE_ALG_AES_ECB_NOPAD &&
+			IVLen != (uint32_t)EVP_CIPHER_iv_length(cipher))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (!EVP_CipherInit_ex(operation->cipher, cipher, NULL,
+				operation->secret, IV,
+				operation->info.mode == TEE_MODE_ENCRYPT))
+		TEE_Panic(TEE_ERROR_GENERIC);
+	EVP_CIPHER_CTX_set_padding(operation->cipher, 0);
+	operation->buffered = 0;
+	operation->initialized = true;
+}
+
+static TEE_Result cipher_update(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	int len = 0;
+
+	if (srcLen == 0) {
+		*destLen = 0;
+		return TEE_SUCCESS;
+	}
+	if (!EVP_CipherUpdate(operation->cipher, destData, &len, srcData,
+								srcLen))
+		return TEE_ERROR_BAD_STATE;
+	*destLen = len;
+	return TEE_SUCCESS;
+}
+
+static uint32_t cipher_out_size(const TEE_OperationHandle operation,
+				const uint32_t srcLen, const bool final)
+{
+	uint32_t total = operation->buffered + srcLen;
+
+	if (!is_block_mode(operation))
+		return srcLen;
+	if (final)
+		return total;
+	return total - total % TEE_AES_BLOCK_SIZE;
+}
+
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	uint32_t need = cipher_out_size(operation, srcLen, false);
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!operation->initialized)
+		return TEE_ERROR_BAD_STATE;
+	if (*destLen < need) {
+		*destLen = need;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	res = cipher_update(operation, srcData, srcLen, destData, destLen);
+	if (res == TEE_SUCCESS && is_block_mode(operation))
+		operation->buffered = (operation->buffered + srcLen) %
+							TEE_AES_BLOCK_SIZE;
+	return res;
+}
+
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	uint32_t need = cipher_out_size(operation, srcLen, true);
+	uint32_t len = 0;
+	int tail = 0;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!operation->initialized)
+		return TEE_ERROR_BAD_STATE;
+	if (is_block_mode(operation) && need % TEE_AES_BLOCK_SIZE != 0)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (*destLen < need) {
+		*destLen = need;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	res = cipher_update(operation, srcData, srcLen, destData, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (!EVP_CipherFinal_ex(operation->cipher,
+				(uint8_t *)destData + len, &tail))
+		return TEE_ERROR_BAD_PARAMETERS;
+	*destLen = len + tail;
+	operation->buffered = 0;
+	operation->initialized = false;
+	return TEE_SUCCESS;
+}
+
+/* MAC */
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV __unused,
+			uint32_t IVLen __unused)
+{
+	if (!operation->secret)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+	if (!HMAC_Init_ex(operation->hmac, operation->secret,
+			operation->secret_len, operation->md, NULL))
+		TEE_Panic(TEE_ERROR_GENERIC);
+	operation->initialized = true;
+}
+
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+			uint32_t chunkSize)
+{
+	if (!operation->initialized)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+	if (chunkSize != 0 && !HMAC_Update(operation->hmac, chunk, chunkSize))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			const void *message, uint32_t messageLen,
+			void *mac, uint32_t *macLen)
+{
+	unsigned int len = 0;
+
+	if (*macLen < operation->info.digestLength) {
+		*macLen = operation->info.digestLength;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	TEE_MACUpdate(operation, message, messageLen);
+	if (!HMAC_Final(operation->hmac, mac, &len))
+		return TEE_ERROR_GENERIC;
+	*macLen = len;
+	operation->initialized = false;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			const void *message, uint32_t messageLen,
+			const void *mac, uint32_t macLen)
+{
+	uint8_t computed[EVP_MAX_MD_SIZE];
+	uint32_t len = sizeof(computed);
+	TEE_Result res = TEE_MACComputeFinal(operation, message, messageLen,
+							computed, &len);
+
+	if (res != TEE_SUCCESS)
+		return res;
+	if (macLen != len || CRYPTO_memcmp(computed, mac, len) != 0)
+		return TEE_ERROR_MAC_INVALID;
+	return TEE_SUCCESS;
+}
+
+/* Authenticated encryption */
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+			uint32_t nonceLen, uint32_t tagLen,
+			uint32_t AADLen __unused,
+			uint32_t payloadLen __unused)
+{
+	const bool enc = operation->info.mode == TEE_MODE_ENCRYPT;
+
+	if (!operation->secret)
+		return TEE_ERROR_BAD_STATE;
+	if (tagLen % 8 != 0 || tagLen < 96 || tagLen > 128)
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (!EVP_CipherInit_ex(operation->cipher,
+			aes_cipher(operation->info.algorithm,
+				operation->secret_len), NULL, NULL, NULL, enc) ||
+			!EVP_CIPHER_CTX_ctrl(operation->cipher,
+				EVP_CTRL_GCM_SET_IVLEN, nonceLen, NULL) ||
+			!EVP_CipherInit_ex(operation->cipher, NULL, NULL,
+				operation->secret, nonce, enc))
+		return TEE_ERROR_BAD_PARAMETERS;
+	operation->tag_len = tagLen / 8;
+	operation->initialized = true;
+	return TEE_SUCCESS;
+}
+
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+			uint32_t AADdataLen)
+{
+	int len = 0;
+
+	if (!operation->initialized)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+	if (AADdataLen != 0 && !EVP_CipherUpdate(operation->cipher, NULL,
+						&len, AADdata, AADdataLen))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+			uint32_t srcLen, void *destData, uint32_t *destLen)
+{
+	if (!operation->initialized)
+		return TEE_ERROR_BAD_STATE;
+	if (*destLen < srcLen) {
+		*destLen = srcLen;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	return cipher_update(operation, srcData, srcLen, destData, destLen);
+}
+
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen,
+			void *tag, uint32_t *tagLen)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t len = 0;
+	int tail = 0;
+
+	if (!operation->initialized)
+		return TEE_ERROR_BAD_STATE;
+	if (*destLen < srcLen || *tagLen < operation->tag_len) {
+		*destLen = srcLen;
+		*tagLen = operation->tag_len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	res = cipher_update(operation, srcData, srcLen, destData, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (!EVP_CipherFinal_ex(operation->cipher,
+				(uint8_t *)destData + len, &tail) ||
+			!EVP_CIPHER_CTX_ctrl(operation->cipher,
+				EVP_CTRL_GCM_GET_TAG, operation->tag_len, tag))
+		return TEE_ERROR_GENERIC;
+	*destLen = len + tail;
+	*tagLen = operation->tag_len;
+	operation->initialized = false;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen,
+			void *tag, uint32_t tagLen)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t len = 0;
+	int tail = 0;
+
+	if (!operation->initialized)
+		return TEE_ERROR_BAD_STATE;
+	if (*destLen < srcLen) {
+		*destLen = srcLen;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	if (tagLen != operation->tag_len)
+		return TEE_ERROR_MAC_INVALID;
+	res = cipher_update(operation, srcData, srcLen, destData, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+	operation->initialized = false;
+	if (!EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_SET_TAG,
+							tagLen, tag) ||
+			EVP_CipherFinal_ex(operation->cipher,
+				(uint8_t *)destData + len, &tail) <= 0)
+		return TEE_ERROR_MAC_INVALID;
+	*destLen = len + tail;
+	return TEE_SUCCESS;
+}
+
+/* Asymmetric operations */
+
+static EVP_PKEY_CTX *rsa_ctx(const TEE_OperationHandle op, const bool cipher,
+			const TEE_Attribute *params, const uint32_t count)
+{
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(op->pkey, NULL);
+	uint32_t alg = op->info.algorithm;
+	int salt = 0;
+	int ok = 0;
+
+	if (!ctx)
+		return NULL;
+	switch (op->info.mode) {
+	case TEE_MODE_ENCRYPT:
+		ok = EVP_PKEY_encrypt_init(ctx);
+		break;
+	case TEE_MODE_DECRYPT:
+		ok = EVP_PKEY_decrypt_init(ctx);
+		break;
+	case TEE_MODE_SIGN:
+		ok = EVP_PKEY_sign_init(ctx);
+		break;
+	default:
+		ok = EVP_PKEY_verify_init(ctx);
+		break;
+	}
+	if (ok <= 0)
+		goto error;
+	if (cipher) {
+		if (alg == TEE_ALG_RSA_NOPAD)
+			ok = EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_NO_PADDING);
+		else if (alg == TEE_ALG_RSAES_PKCS1_V1_5)
+			ok = EVP_PKEY_CTX_set_rsa_padding(ctx,
+							RSA_PKCS1_PADDING);
+		else
+			ok = EVP_PKEY_CTX_set_rsa_padding(ctx,
+						RSA_PKCS1_OAEP_PADDING) > 0 &&
+				EVP_PKEY_CTX_set_rsa_oaep_md(ctx, op->md) > 0 &&
+				EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, op->md);
+	} else if (is_pss(alg)) {
+		/* Salt is as long as the hash unless set explicitly */
+		salt = EVP_MD_size(op->md);
+		for (uint32_t i = 0; i < count; i++) {
+			if (params[i].attributeID ==
+					TEE_ATTR_RSA_PSS_SALT_LENGTH)
+				salt = params[i].content.value.a;
+		}
+		ok = EVP_PKEY_CTX_set_rsa_padding(ctx,
+					RSA_PKCS1_PSS_PADDING) > 0 &&
+			EVP_PKEY_CTX_set_signature_md(ctx, op->md) > 0 &&
+			EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, op->md) > 0 &&
+			EVP_PKEY_CTX_set_rsa_pss_saltlen(ctx, salt);
+	} else {
+		ok = EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+			EVP_PKEY_CTX_set_signature_md(ctx, op->md);
+	}
+	if (ok > 0)
+		return ctx;
+error:
+	EVP_PKEY_CTX_free(ctx);
+	return NULL;
+}
+
+static TEE_Result rsa_cipher(TEE_OperationHandle operation,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	TEE_Result res = TEE_ERROR_BAD_PARAMETERS;
+	EVP_PKEY_CTX *ctx = NULL;
+	const uint8_t *in = srcData;
+	uint8_t *padded = NULL;
+	uint8_t *out = NULL;
+	uint8_t *start = NULL;
+	size_t k = EVP_PKEY_size(operation->pkey);
+	size_t out_len = k;
+	int ok = 0;
+
+	if (!operation->pkey)
+		return TEE_ERROR_BAD_STATE;
+	if (operation->info.algorithm == TEE_ALG_RSA_NOPAD) {
+		/* Input is a number, it is extended to modulus length */
+		if (srcLen > k)
+			return TEE_ERROR_BAD_PARAMETERS;
+		padded = calloc(1, k);
+		if (!padded)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		memcpy(padded + k - srcLen, srcData, srcLen);
+		in = padded;
+		srcLen = k;
+	}
+	out = malloc(k);
+	ctx = rsa_ctx(operation, true, NULL, 0);
+	if (!out || !ctx) {
+		res = out ? TEE_ERROR_BAD_PARAMETERS : TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	if (operation->info.mode == TEE_MODE_ENCRYPT)
+		ok = EVP_PKEY_encrypt(ctx, out, &out_len, in, srcLen);
+	else
+		ok = EVP_PKEY_decrypt(ctx, out, &out_len, in, srcLen);
+	if (ok <= 0)
+		goto out;
+	start = out;
+	if (operation->info.algorithm == TEE_ALG_RSA_NOPAD) {
+		/* Result is a number too, leading zeroes are dropped */
+		while (out_len > 1 && *start == 0) {
+			start++;
+			out_len--;
+		}
+	}
+	if (*destLen < out_len) {
+		*destLen = out_len;
+		res = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+	memcpy(destData, start, out_len);
+	*destLen = out_len;
+	res = TEE_SUCCESS;
+out:
+	EVP_PKEY_CTX_free(ctx);
+	if (out) {
+		OPENSSL_cleanse(out, k);
+		free(out);
+	}
+	free(padded);
+	return res;
+}
+
+TEE_Result TEE_AsymmetricEncrypt(TEE_OperationHandle operation,
+			const TEE_Attribute *params __unused,
+			uint32_t paramCount __unused,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	if (operation->info.mode != TEE_MODE_ENCRYPT)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return rsa_cipher(operation, srcData, srcLen, destData, destLen);
+}
+
+TEE_Result TEE_AsymmetricDecrypt(TEE_OperationHandle operation,
+			const TEE_Attribute *params __unused,
+			uint32_t paramCount __unused,
+			const void *srcData, uint32_t srcLen,
+			void *destData, uint32_t *destLen)
+{
+	if (operation->info.mode != TEE_MODE_DECRYPT)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return rsa_cipher(operation, srcData, srcLen, destData, destLen);
+}
+
+/* ECDSA signature is r | s, both padded to the key size */
+static TEE_Result ecdsa_sign(TEE_OperationHandle operation,
+			const void *digest, uint32_t digestLen,
+			void *signature, uint32_t *signatureLen)
+{
+	uint32_t n = (operation->info.keySize + 7) / 8;
+	ECDSA_SIG *sig = NULL;
+	const BIGNUM *r = NULL;
+	const BIGNUM *s = NULL;
+	uint8_t *out = signature;
+
+	if (*signatureLen < 2 * n) {
+		*signatureLen = 2 * n;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	sig = ECDSA_do_sign(digest, digestLen,
+			(EC_KEY *)EVP_PKEY_get0_EC_KEY(operation->pkey));
+	if (!sig)
+		return TEE_ERROR_BAD_PARAMETERS;
+	ECDSA_SIG_get0(sig, &r, &s);
+	memset(out, 0, 2 * n);
+	BN_bn2bin(r, out + n - BN_num_bytes(r));
+	BN_bn2bin(s, out + 2 * n - BN_num_bytes(s));
+	*signatureLen = 2 * n;
+	ECDSA_SIG_free(sig);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ecdsa_verify(TEE_OperationHandle operation,
+			const void *digest, uint32_t digestLen,
+			const void *signature, uint32_t signatureLen)
+{
+	uint32_t n = (operation->info.keySize + 7) / 8;
+	const uint8_t *in = signature;
+	ECDSA_SIG *sig = NULL;
+	BIGNUM *r = NULL;
+	BIGNUM *s = NULL;
+	int ok = 0;
+
+	if (signatureLen != 2 * n)
+		return TEE_ERROR_SIGNATURE_INVALID;
+	sig = ECDSA_SIG_new();
+	r = BN_bin2bn(in, n, NULL);
+	s = BN_bin2bn(in + n, n, NULL);
+	if (sig && r && s && ECDSA_SIG_set0(sig, r, s)) {
+		r = s = NULL;
+		ok = ECDSA_do_verify(digest, digestLen, sig,
+			(EC_KEY *)EVP_PKEY_get0_EC_KEY(operation->pkey));
+	}
+	BN_free(r);
+	BN_free(s);
+	ECDSA_SIG_free(sig);
+	return ok == 1 ? TEE_SUCCESS : TEE_ERROR_SIGNATURE_INVALID;
+}
+
+TEE_Result TEE_AsymmetricSignDigest(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *digest, uint32_t digestLen,
+			void *signature, uint32_t *signatureLen)
+{
+	TEE_Result res = TEE_SUCCESS;
+	EVP_PKEY_CTX *ctx = NULL;
+	size_t k = 0;
+	size_t len = 0;
+
+	if (operation->info.mode != TEE_MODE_SIGN)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (!operation->pkey)
+		return TEE_ERROR_BAD_STATE;
+	if (is_ecdsa(operation->info.algorithm))
+		return ecdsa_sign(operation, digest, digestLen, signature,
+								signatureLen);
+	k = EVP_PKEY_size(operation->pkey);
+	if (*signatureLen < k) {
+		*signatureLen = k;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	if (digestLen != (uint32_t)EVP_MD_size(operation->md))
+		return TEE_ERROR_BAD_PARAMETERS;
+	ctx = rsa_ctx(operation, false, params, paramCount);
+	if (!ctx)
+		return TEE_ERROR_BAD_PARAMETERS;
+	len = *signatureLen;
+	if (EVP_PKEY_sign(ctx, signature, &len, digest, digestLen) > 0) {
+		*signatureLen = len;
+	} else if (is_pss(operation->info.algorithm)) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+	} else {
+		/* Encoded digest does not fit the modulus, as in OP-TEE */
+		res = TEE_ERROR_SHORT_BUFFER;
+	}
+	EVP_PKEY_CTX_free(ctx);
+	return res;
+}
+
+TEE_Result TEE_AsymmetricVerifyDigest(TEE_OperationHandle operation,
+			const TEE_Attribute *params, uint32_t paramCount,
+			const void *digest, uint32_t digestLen,
+			const void *signature, uint32_t signatureLen)
+{
+	TEE_Result res = TEE_ERROR_SIGNATURE_INVALID;
+	EVP_PKEY_CTX *ctx = NULL;
+
+	if (operation->info.mode != TEE_MODE_VERIFY)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (!operation->pkey)
+		return TEE_ERROR_BAD_STATE;
+	if (is_ecdsa(operation->info.algorithm))
+		return ecdsa_verify(operation, digest, digestLen, signature,
+								signatureLen);
+	if (digestLen != (uint32_t)EVP_MD_size(operation->md))
+		return TEE_ERROR_BAD_PARAMETERS;
+	ctx = rsa_ctx(operation, false, params, paramCount);
+	if (!ctx)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (EVP_PKEY_verify(ctx, signature, signatureLen, digest,
+							digestLen) == 1)
+		res = TEE_SUCCESS;
+	EVP_PKEY_CTX_free(ctx);
+	return res;
+}
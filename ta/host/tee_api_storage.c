@@ -0,0 +1,368 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <host_tee.h>
+#include "tee_shim.h"
+
+/*
+ * TEE_STORAGE_PRIVATE kept in process memory. As on a device objects
+ * survive TA_DestroyEntryPoint and TA_CreateEntryPoint, they are gone
+ * only when deleted, wiped by host_tee_storage_wipe() or at process exit.
+ */
+static struct host_tee_pobj *storage;
+
+struct __TEE_ObjectEnumHandle {
+	bool started;
+	uint32_t position;
+};
+
+static struct host_tee_pobj *find_pobj(const void *id, const uint32_t id_len)
+{
+	struct host_tee_pobj *pobj = storage;
+
+	for (; pobj; pobj = pobj->next) {
+		if (pobj->id_len == id_len && !memcmp(pobj->id, id, id_len))
+			return pobj;
+	}
+	return NULL;
+}
+
+static void free_pobj(struct host_tee_pobj *pobj)
+{
+	host_tee_free_attrs(pobj->attrs, pobj->attr_count);
+	if (pobj->data) {
+		OPENSSL_cleanse(pobj->data, pobj->data_capacity);
+		free(pobj->data);
+	}
+	free(pobj);
+}
+
+/* Removes object from storage, open handles keep it until closed */
+static void unlink_pobj(struct host_tee_pobj *pobj)
+{
+	struct host_tee_pobj **link = &storage;
+
+	while (*link && *link != pobj)
+		link = &(*link)->next;
+	if (*link)
+		*link = pobj->next;
+	pobj->next = NULL;
+	pobj->unlinked = true;
+	if (pobj->refs == 0)
+		free_pobj(pobj);
+}
+
+void host_tee_storage_release(struct host_tee_pobj *pobj)
+{
+	pobj->refs--;
+	if (pobj->unlinked && pobj->refs == 0)
+		free_pobj(pobj);
+}
+
+void host_tee_storage_wipe(void)
+{
+	while (storage)
+		unlink_pobj(storage);
+}
+
+static TEE_Result check_id(const uint32_t storageID,
+				const uint32_t objectIDLen)
+{
+	if (storageID != TEE_STORAGE_PRIVATE)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (objectIDLen > TEE_OBJECT_ID_MAX_LEN)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result open_handle(struct host_tee_pobj *pobj, const uint32_t flags,
+				TEE_ObjectHandle *object)
+{
+	TEE_Result res = TEE_SUCCESS;
+	TEE_ObjectHandle obj = calloc(1, sizeof(*obj));
+
+	if (!obj)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	res = host_tee_copy_attrs(&obj->attrs, &obj->attr_count,
+					pobj->attrs, pobj->attr_count);
+	if (res != TEE_SUCCESS) {
+		free(obj);
+		return res;
+	}
+	obj->info.objectType = pobj->type;
+	obj->info.objectSize = pobj->key_size;
+	obj->info.maxObjectSize = pobj->max_key_size;
+	obj->info.objectUsage = 0xFFFFFFFF;
+	obj->info.handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+				TEE_HANDLE_FLAG_INITIALIZED | flags;
+	obj->pobj = pobj;
+	pobj->refs++;
+	*object = obj;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+			uint32_t objectIDLen, uint32_t flags,
+			TEE_ObjectHandle *object)
+{
+	TEE_Result res = check_id(storageID, objectIDLen);
+	struct host_tee_pobj *pobj = NULL;
+
+	*object = TEE_HANDLE_NULL;
+	if (res != TEE_SUCCESS)
+		return res;
+	pobj = find_pobj(objectID, objectIDLen);
+	if (!pobj)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	return open_handle(pobj, flags, object);
+}
+
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID,
+			const void *objectID, uint32_t objectIDLen,
+			uint32_t flags, TEE_ObjectHandle attributes,
+			const void *initialData, uint32_t initialDataLen,
+			TEE_ObjectHandle *object)
+{
+	TEE_Result res = check_id(storageID, objectIDLen);
+	struct host_tee_pobj *pobj = NULL;
+	struct host_tee_pobj *old = NULL;
+	TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+
+	if (object)
+		*object = TEE_HANDLE_NULL;
+	if (res != TEE_SUCCESS)
+		return res;
+	old = find_pobj(objectID, objectIDLen);
+	if (old && !(flags & TEE_DATA_FLAG_OVERWRITE))
+		return TEE_ERROR_ACCESS_CONFLICT;
+	pobj = calloc(1, sizeof(*pobj));
+	if (!pobj)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memcpy(pobj->id, objectID, objectIDLen);
+	pobj->id_len = objectIDLen;
+	pobj->type = TEE_TYPE_DATA;
+	if (attributes != TEE_HANDLE_NULL) {
+		pobj->type = attributes->info.objectType;
+		pobj->key_size = attributes->info.objectSize;
+		pobj->max_key_size = attributes->info.maxObjectSize;
+		res = host_tee_copy_attrs(&pobj->attrs, &pobj->attr_count,
+				attributes->attrs, attributes->attr_count);
+		if (res != TEE_SUCCESS)
+			goto error;
+	}
+	if (initialDataLen != 0) {
+		pobj->data = malloc(initialDataLen);
+		if (!pobj->data) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto error;
+		}
+		memcpy(pobj->data, initialData, initialDataLen);
+		pobj->data_size = initialDataLen;
+		pobj->data_capacity = initialDataLen;
+	}
+	if (object) {
+		res = open_handle(pobj, flags, &obj);
+		if (res != TEE_SUCCESS)
+			goto error;
+	}
+	if (old)
+		unlink_pobj(old);
+	pobj->next = storage;
+	storage = pobj;
+	if (object)
+		*object = obj;
+	return TEE_SUCCESS;
+error:
+	free_pobj(pobj);
+	return res;
+}
+
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return TEE_SUCCESS;
+	if (!object->pobj)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (!object->pobj->unlinked)
+		unlink_pobj(object->pobj);
+	TEE_CloseObject(object);
+	return TEE_SUCCESS;
+}
+
+void TEE_CloseAndDeletePersistentObject(TEE_ObjectHandle object)
+{
+	TEE_CloseAndDeletePersistentObject1(object);
+}
+
+TEE_Result TEE_AllocatePersistentObjectEnumerator(
+			TEE_ObjectEnumHandle *objectEnumerator)
+{
+	*objectEnumerator = calloc(1, sizeof(**objectEnumerator));
+	if (!*objectEnumerator)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator)
+{
+	free(objectEnumerator);
+}
+
+void TEE_ResetPersistentObjectEnumerator(
+			TEE_ObjectEnumHandle objectEnumerator)
+{
+	objectEnumerator->started = false;
+	objectEnumerator->position = 0;
+}
+
+TEE_Result TEE_StartPersistentObjectEnumerator(
+			TEE_ObjectEnumHandle objectEnumerator,
+			uint32_t storageID)
+{
+	if (storageID != TEE_STORAGE_PRIVATE)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	objectEnumerator->started = true;
+	objectEnumerator->position = 0;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+			TEE_ObjectInfo *objectInfo, void *objectID,
+			uint32_t *objectIDLen)
+{
+	struct host_tee_pobj *pobj = storage;
+
+	if (!objectEnumerator->started)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	for (uint32_t i = 0; pobj && i < objectEnumerator->position; i++)
+		pobj = pobj->next;
+	if (!pobj)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	objectEnumerator->position++;
+	if (objectInfo) {
+		memset(objectInfo, 0, sizeof(*objectInfo));
+		objectInfo->objectType = pobj->type;
+		objectInfo->objectSize = pobj->key_size;
+		objectInfo->maxObjectSize = pobj->max_key_size;
+		objectInfo->objectUsage = 0xFFFFFFFF;
+		objectInfo->dataSize = pobj->data_size;
+		objectInfo->handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+					TEE_HANDLE_FLAG_INITIALIZED;
+	}
+	memcpy(objectID, pobj->id, pobj->id_len);
+	*objectIDLen = pobj->id_len;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			uint32_t size, uint32_t *count)
+{
+	struct host_tee_pobj *pobj = object->pobj;
+	uint32_t pos = object->info.dataPosition;
+
+	if (!pobj)
+		return TEE_ERROR_BAD_PARAMETERS;
+	*count = 0;
+	if (pos < pobj->data_size) {
+		*count = pobj->data_size - pos;
+		if (*count > size)
+			*count = size;
+		memcpy(buffer, pobj->data + pos, *count);
+	}
+	object->info.dataPosition += *count;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result resize_data(struct host_tee_pobj *pobj, const uint32_t size)
+{
+	uint32_t capacity = pobj->data_capacity;
+	uint8_t *data = NULL;
+
+	if (size > capacity) {
+		capacity = capacity ? capacity : 64;
+		while (capacity < size)
+			capacity *= 2;
+		data = realloc(pobj->data, capacity);
+		if (!data)
+			return TEE_ERROR_STORAGE_NO_SPACE;
+		pobj->data = data;
+		pobj->data_capacity = capacity;
+	}
+	if (size > pobj->data_size)
+		memset(pobj->data + pobj->data_size, 0,
+					size - pobj->data_size);
+	pobj->data_size = size;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			uint32_t size)
+{
+	struct host_tee_pobj *pobj = object->pobj;
+	uint32_t pos = object->info.dataPosition;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!pobj)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (size > TEE_DATA_MAX_POSITION - pos)
+		return TEE_ERROR_OVERFLOW;
+	if (pos + size > pobj->data_size) {
+		res = resize_data(pobj, pos + size);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+	memcpy(pobj->data + pos, buffer, size);
+	object->info.dataPosition += size;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size)
+{
+	if (!object->pobj)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return resize_data(object->pobj, size);
+}
+
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+			TEE_Whence whence)
+{
+	int64_t pos = 0;
+
+	if (!object->pobj)
+		return TEE_ERROR_BAD_PARAMETERS;
+	switch (whence) {
+	case TEE_DATA_SEEK_SET:
+		pos = offset;
+		break;
+	case TEE_DATA_SEEK_CUR:
+		pos = (int64_t)object->info.dataPosition + offset;
+		break;
+	case TEE_DATA_SEEK_END:
+		pos = (int64_t)object->pobj->data_size + offset;
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	if (pos < 0)
+		pos = 0;
+	if (pos > TEE_DATA_MAX_POSITION)
+		return TEE_ERROR_OVERFLOW;
+	object->info.dataPosition = pos;
+	return TEE_SUCCESS;
+}
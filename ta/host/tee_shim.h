@@ -0,0 +1,71 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_HOST_TEE_SHIM_H
+#define ANDROID_OPTEE_HOST_TEE_SHIM_H
+
+#include <openssl/evp.h>
+
+#include <tee_internal_api.h>
+
+/* Persistent object as kept in memory storage */
+struct host_tee_pobj {
+	struct host_tee_pobj *next;
+	uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+	uint32_t id_len;
+	uint32_t type;
+	uint32_t key_size;
+	uint32_t max_key_size;
+	TEE_Attribute *attrs;
+	uint32_t attr_count;
+	uint8_t *data;
+	uint32_t data_size;
+	uint32_t data_capacity;
+	/* Open handles, unlinked object is freed with the last one */
+	uint32_t refs;
+	bool unlinked;
+};
+
+struct __TEE_ObjectHandle {
+	TEE_ObjectInfo info;
+	TEE_Attribute *attrs;
+	uint32_t attr_count;
+	/* RSA or EC key built from attrs on first use */
+	EVP_PKEY *pkey;
+	/* NULL for transient objects */
+	struct host_tee_pobj *pobj;
+};
+
+/* Attribute arrays own their buffers */
+TEE_Result host_tee_copy_attrs(TEE_Attribute **dst, uint32_t *dst_count,
+				const TEE_Attribute *src,
+				const uint32_t src_count);
+void host_tee_free_attrs(TEE_Attribute *attrs, const uint32_t count);
+const TEE_Attribute *host_tee_find_attr(const TEE_ObjectHandle object,
+				const uint32_t id);
+
+/* Key of RSA or EC object, reference stays with the object */
+EVP_PKEY *host_tee_object_pkey(TEE_ObjectHandle object);
+/* Attributes of RSA or EC object from OpenSSL key */
+TEE_Result host_tee_pkey_attrs(TEE_ObjectHandle object, EVP_PKEY *pkey);
+/* OpenSSL curve NID and size in bits of TEE_ECC_CURVE_* */
+int host_tee_curve_nid(const uint32_t curve, uint32_t *bits);
+
+/* Releases persistent object of handle being closed */
+void host_tee_storage_release(struct host_tee_pobj *pobj);
+
+#endif /* ANDROID_OPTEE_HOST_TEE_SHIM_H */
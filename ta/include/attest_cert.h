@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_ATTEST_CERT_H
+#define ANDROID_OPTEE_ATTEST_CERT_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+#include <utee_defines.h>
+
+#include "ta_ca_defs.h"
+
+#define ATTEST_CERT_SERIAL_SIZE 8U
+
+/* Version of the key description, keymaster 3 uses version 2 */
+#define ATTEST_CERT_ATTESTATION_VERSION 2U
+#define ATTEST_CERT_KEYMASTER_VERSION 3U
+#define ATTEST_CERT_SECURITY_LEVEL 1U /* TrustedEnvironment */
+
+/*
+ * Constant beginning of attestation TBSCertificate for one attestation
+ * key type: version, serial, signature algorithm, issuer (subject of the
+ * root certificate), validity and subject. Serial is a patch point.
+ */
+typedef struct {
+	uint32_t type;
+	uint8_t *head;
+	uint32_t head_l;
+	uint32_t serial_offset;
+} attest_cert_template_t;
+
+/* Builds template for RSA or EC attestation key from its root certificate */
+TEE_Result TA_attest_cert_init_template(attest_cert_template_t *tmpl,
+				const uint32_t type,
+				const keymaster_blob_t *root_cert);
+
+void TA_attest_cert_free_template(attest_cert_template_t *tmpl);
+
+/*
+ * Fills template with serial, public key of the attested key and key
+ * description (challenge, unique ID, authorization lists), then signs it
+ * with attestation key. cert gets allocated DER certificate.
+ */
+TEE_Result TA_attest_cert_build(const attest_cert_template_t *tmpl,
+				const TEE_ObjectHandle sign_key,
+				const TEE_ObjectHandle attested_key,
+				const uint32_t attested_key_size,
+				const keymaster_key_param_set_t *attest_params,
+				const keymaster_key_characteristics_t *key_chr,
+				const keymaster_blob_t *unique_id,
+				const uint8_t verified_boot,
+				keymaster_blob_t *cert);
+
+#endif /* ANDROID_OPTEE_ATTEST_CERT_H */
@@ -68,14 +68,22 @@ TEE_Result TA_create_root_ec_attest_cert(TEE_TASessionHandle sessionSTA);
 
 TEE_Result TA_read_root_attest_cert(uint32_t type,
 		keymaster_cert_chain_t *cert_chain);
-TEE_Result TA_gen_key_attest_cert(TEE_TASessionHandle sessionSTA,
-		uint32_t type, TEE_ObjectHandle attestedKey,
+/* Fills attestation certificate template and signs it with attestation key */
+TEE_Result TA_gen_key_attest_cert(uint32_t type,
+		TEE_ObjectHandle attestedKey, uint32_t key_size,
 		keymaster_key_param_set_t *attest_params,
 		keymaster_key_characteristics_t *key_chr,
 		keymaster_cert_chain_t *cert_chain,
 		uint8_t verified_boot);
 
+/*
+ * Creates missing attestation keys and root certificates and loads them
+ * into TA memory, does nothing once they are loaded
+ */
 TEE_Result TA_create_attest_objs(TEE_TASessionHandle sessionSTA);
+/* Loads already created attestation objects, never creates them */
+TEE_Result TA_load_attest_objs(void);
+void TA_free_attest_cache(void);
 void TA_close_attest_obj(TEE_ObjectHandle attObj);
 
 TEE_Result TA_write_attest_obj_attr(TEE_ObjectHandle attObj,
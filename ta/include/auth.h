@@ -19,6 +19,8 @@
 #define ANDROID_OPTEE_AUTH_H
 
 #define MAX_SUID 10
+/* Validated auth tokens remembered to skip HMAC on every update */
+#define AUTH_TOKEN_CACHE_SIZE 4
 
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
@@ -39,6 +41,9 @@ keymaster_error_t TA_check_auth_token(const uint64_t *suid,
 keymaster_error_t TA_do_auth(const keymaster_key_param_set_t in_params,
 				const keymaster_key_param_set_t key_params);
 
+/* Drops auth_token key object and validated tokens */
+void TA_FreeAuthTokenCache(void);
+
 #define HMAC_SHA256_KEY_SIZE_BYTE 32
 #define HMAC_SHA256_KEY_SIZE_BIT (8*HMAC_SHA256_KEY_SIZE_BYTE)
 #define HW_AUTH_TOKEN_VERSION 0
@@ -0,0 +1,45 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_COMMAND_H
+#define ANDROID_OPTEE_COMMAND_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "common.h"
+#include "ta_ca_defs.h"
+
+/* Command in progress, the TA serves one command at a time */
+typedef struct {
+	uint32_t cmd;
+	/* Index in per-command counters, unknown ids share slot 0 */
+	uint32_t slot;
+	bool active;
+} km_command_t;
+
+/*
+ * Bracket a command handler. Stats and heap accounting of the command
+ * begin after TA_command_begin and end before TA_command_end.
+ */
+void TA_command_begin(const uint32_t cmd);
+
+void TA_command_end(void);
+
+const km_command_t *TA_command_current(void);
+
+#endif /* ANDROID_OPTEE_COMMAND_H */
@@ -18,6 +18,9 @@
 #ifndef KEYMASTER_COMMON_H
 #define KEYMASTER_COMMON_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define SIZE_LENGTH sizeof(uint64_t) //TODO: find all of those macros and refactor them
 #define SIZE_OF_ITEM(item) (item ? sizeof(item[0]) : 0)
 #define PARAM_SET_SIZE(parameters) \
@@ -47,6 +50,12 @@ enum keystore_command {
 	KM_FINISH				= 13,
 	KM_ABORT				= 14,
 	KM_DESTROY_ATT_IDS			= 15,
+	KM_GET_VERSION				= 16,
+	KM_REFILL_KEY_POOL			= 17,
+	KM_PROVISION				= 18,
+	KM_GET_STATS				= 19,
+	KM_GET_HEAP_STATS			= 20,
+	KM_GET_TRACE				= 21,
 /*
  * Please keep this constant consistent with KM_GET_AUTHTOKEN_KEY define that
  * is defined in Gatekeeper
@@ -59,4 +68,311 @@ typedef enum{
 	KM_POPULATED				= 1,
 } presence;
 
+/*
+ * HAL <-> TA wire format versions, negotiated with KM_GET_VERSION right
+ * after the session is opened. KM_GET_VERSION itself always uses two
+ * fixed uint32_t words (version, capabilities) in both directions.
+ *
+ * Version 1: sizes are 64-bit words, presence is a 32-bit enum and
+ *            parameters are raw keymaster_key_param_t images.
+ * Version 2: sizes, tags, enums and integers are LEB128 varints,
+ *            presence is one byte, parameters are encoded as the tag
+ *            followed by the value of its type only. Operation handles
+ *            remain fixed 64-bit words.
+ */
+#define KM_WIRE_VERSION_1			1
+#define KM_WIRE_VERSION_2			2
+#define KM_WIRE_VERSION				KM_WIRE_VERSION_2
+
+/* Optional features advertised by the TA in KM_GET_VERSION reply */
+#define KM_CAP_WIRE_V2				(1 << 0)
+/*
+ * KM_REFILL_KEY_POOL generates one pregenerated RSA key pair and returns
+ * a fixed uint32_t with the number of key pairs still missing in the pool
+ */
+#define KM_CAP_KEY_POOL				(1 << 1)
+/*
+ * KM_PROVISION creates missing attestation keys and root certificates and
+ * returns a fixed uint32_t KM_PROVISION_* state. KM_ATTEST_KEY does not
+ * create them, it fails with KM_ERROR_KEYMASTER_NOT_CONFIGURED until
+ * provisioning is done.
+ */
+#define KM_CAP_PROVISION			(1 << 2)
+/*
+ * KM_GET_STATS takes optional uint32_t KM_STATS_* flags and returns a
+ * fixed km_stats_t image
+ */
+#define KM_CAP_STATS				(1 << 3)
+/*
+ * KM_GET_HEAP_STATS takes optional uint32_t KM_HEAP_* flags and a command
+ * id, returns a fixed km_heap_t image followed by km_heap_event_t entries
+ */
+#define KM_CAP_HEAP				(1 << 4)
+/*
+ * Commands take an optional TEE value input as third parameter, a is an
+ * id of the HAL call and b numbers TA calls within it. Phases of tagged
+ * commands are recorded, KM_GET_TRACE takes optional uint32_t KM_TRACE_*
+ * flags and returns km_trace_t followed by km_trace_span_t entries.
+ */
+#define KM_CAP_TRACE				(1 << 5)
+#define KM_CAPABILITIES				(KM_CAP_WIRE_V2 | KM_CAP_KEY_POOL | \
+						 KM_CAP_PROVISION | KM_CAP_STATS | \
+						 KM_CAP_HEAP | KM_CAP_TRACE)
+
+#define KM_PROVISION_NOT_READY			0
+#define KM_PROVISION_READY			1
+
+/* Counters start over after they are returned */
+#define KM_STATS_RESET				(1 << 0)
+#define KM_STATS_VERSION			3
+/* Commands are counted by id, slot 0 counts ids out of range */
+#define KM_STATS_COMMANDS			22
+
+/* Parts of TA command handlers timed separately */
+enum km_stats_phase {
+	KM_PHASE_DESERIALIZE			= 0,
+	/* Unwrapping and sealing of key blobs */
+	KM_PHASE_KEY_BLOB			= 1,
+	/* Parameter, permission and authorization checks */
+	KM_PHASE_CHECK				= 2,
+	/* The work of the command: key generation, cipher, signature */
+	KM_PHASE_CRYPTO				= 3,
+	KM_PHASE_SERIALIZE			= 4,
+	/* Anything not attributed to the phases above, cleanup included */
+	KM_PHASE_OTHER				= 5,
+	KM_PHASE_COUNT				= 6,
+};
+
+typedef struct {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t phase_ns[KM_PHASE_COUNT];
+} km_stats_command_t;
+
+typedef struct {
+	uint32_t capacity;
+	uint32_t used;
+	/* Most entries used at once since the last reset */
+	uint32_t peak;
+	uint32_t reserved;
+	uint64_t inserts;
+	/* Inserts refused because the table was full */
+	uint64_t full;
+	/* Entries dropped before their owner was done with them */
+	uint64_t evictions;
+} km_stats_table_t;
+
+/* Layout is the same for 32 and 64-bit builds of the HAL and the TA */
+typedef struct {
+	uint32_t version;
+	uint32_t commands;
+	uint32_t phases;
+	/* Resolution of the TA clock used for timing */
+	uint32_t clock_ns;
+	km_stats_command_t command[KM_STATS_COMMANDS];
+	km_stats_table_t operations;
+	km_stats_table_t use_counters;
+	km_stats_table_t use_timers;
+} km_stats_t;
+
+/* Counters and peaks start over after they are returned */
+#define KM_HEAP_RESET				(1 << 0)
+/*
+ * Soak mode: allocations made by the command given with the flags are
+ * recorded until KM_HEAP_TRACE is passed with command 0. Recorded events
+ * are returned, as many as fit, and dropped from the TA.
+ */
+#define KM_HEAP_TRACE				(1 << 1)
+#define KM_HEAP_VERSION				2
+/* Events kept by the TA between two reads, older ones are dropped */
+#define KM_HEAP_EVENTS				256
+
+/* What the TA heap is used for */
+enum km_heap_category {
+	/* Key parameters and characteristics */
+	KM_HEAP_PARAMS				= 0,
+	/* Key material, input and output data */
+	KM_HEAP_BLOB				= 1,
+	/* State of operations kept between commands */
+	KM_HEAP_OPERATION			= 2,
+	/* Temporary buffers and attributes of crypto work */
+	KM_HEAP_CRYPTO				= 3,
+	/* Attestation keys and certificates */
+	KM_HEAP_ATTESTATION			= 4,
+	/* Sessions, key use tables and anything else */
+	KM_HEAP_OTHER				= 5,
+	KM_HEAP_COUNT				= 6,
+};
+
+enum km_heap_event_type {
+	KM_HEAP_ALLOC				= 0,
+	KM_HEAP_FREE				= 1,
+	KM_HEAP_FAILED				= 2,
+};
+
+typedef struct {
+	uint64_t allocs;
+	uint64_t failures;
+	uint64_t live_bytes;
+	/* Most bytes allocated at once since the last reset */
+	uint64_t peak_bytes;
+	uint32_t live_count;
+	uint32_t reserved;
+} km_heap_category_t;
+
+typedef struct {
+	/* Most bytes a call had allocated on top of what was live before it */
+	uint64_t peak_bytes;
+	/*
+	 * Bytes calls left allocated, less bytes they freed of earlier
+	 * calls. Operations keep state from begin to finish, anything else
+	 * growing here is a leak.
+	 */
+	int64_t retained_bytes;
+	uint32_t failures[KM_HEAP_COUNT];
+} km_heap_command_t;
+
+typedef struct {
+	uint32_t command;
+	uint32_t category;
+	uint32_t size;
+	uint32_t reserved;
+	/* Bytes allocated by the TA when the allocation failed */
+	uint64_t live_bytes;
+} km_heap_failure_t;
+
+/* Layout is the same for 32 and 64-bit builds of the HAL and the TA */
+typedef struct {
+	uint32_t version;
+	uint32_t categories;
+	uint32_t commands;
+	/* Bookkeeping added to each allocation, not counted in the bytes */
+	uint32_t overhead;
+	/* TA_DATA_SIZE, the heap limit */
+	uint32_t data_size;
+	/* Command recorded in soak mode, 0 if none */
+	uint32_t trace_command;
+	/* Number of km_heap_event_t following this header */
+	uint32_t events;
+	/* Events overwritten before they were read */
+	uint32_t dropped;
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+	km_heap_category_t category[KM_HEAP_COUNT];
+	km_heap_command_t command[KM_STATS_COMMANDS];
+	/* Most recent failed allocation, command 0 and size 0 if none */
+	km_heap_failure_t last_failure;
+} km_heap_t;
+
+typedef struct {
+	/* Call of the traced command, counted from 1 since soak mode is on */
+	uint32_t call;
+	uint16_t type;
+	uint16_t category;
+	uint32_t size;
+	/* Bytes allocated by the TA after the event */
+	uint32_t live_bytes;
+} km_heap_event_t;
+
+/* Recording stops and the span buffer is released after the read */
+#define KM_TRACE_STOP				(1 << 0)
+#define KM_TRACE_VERSION			1
+/* Spans kept by the TA between two reads, older ones are dropped */
+#define KM_TRACE_SPANS				256
+/* Phase of the span covering the whole command */
+#define KM_TRACE_COMMAND			KM_PHASE_COUNT
+
+typedef struct {
+	uint32_t id;
+	uint32_t seq;
+	uint32_t cmd;
+	/* KM_PHASE_* or KM_TRACE_COMMAND */
+	uint32_t phase;
+	/* Result of the command, for KM_TRACE_COMMAND spans */
+	uint32_t res;
+	uint32_t reserved;
+	/* From the start of the command, TA clocks and HAL clocks differ */
+	uint64_t start_ns;
+	uint64_t duration_ns;
+} km_trace_span_t;
+
+typedef struct {
+	uint32_t version;
+	/* Number of km_trace_span_t following this header */
+	uint32_t spans;
+	/* Spans overwritten before they were read */
+	uint32_t dropped;
+	uint32_t clock_ns;
+} km_trace_t;
+
+#define VARINT_MAX_LENGTH			10
+
+/*
+ * Largest input processed by one KM_UPDATE. The HAL splits bigger
+ * inputs, the TA reports the rest of a bigger input as not consumed.
+ * Keeps the call within shared memory and TA heap limits.
+ */
+#define KM_MAX_UPDATE_CHUNK			(64 * 1024)
+
+static inline size_t km_varint_size(uint64_t value)
+{
+	size_t size = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
+
+static inline size_t km_put_varint(uint8_t *out, uint64_t value)
+{
+	size_t size = 0;
+
+	while (value >= 0x80) {
+		out[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (uint8_t)value;
+	return size;
+}
+
+/*
+ * Writes value using exactly width bytes (width >= km_varint_size(value)),
+ * so a size field can be reserved before the value is known.
+ */
+static inline size_t km_put_varint_padded(uint8_t *out, uint64_t value,
+					  size_t width)
+{
+	size_t size = 0;
+
+	while (size + 1 < width) {
+		out[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (uint8_t)value;
+	return size;
+}
+
+/* Returns number of consumed bytes or 0 on malformed/truncated input */
+static inline size_t km_get_varint(const uint8_t *in, const uint8_t *end,
+				   uint64_t *value)
+{
+	size_t size = 0;
+	uint32_t shift = 0;
+
+	*value = 0;
+	while (size < VARINT_MAX_LENGTH) {
+		if (end && in + size >= end)
+			return 0;
+		*value |= (uint64_t)(in[size] & 0x7f) << shift;
+		if (!(in[size++] & 0x80))
+			return size;
+		shift += 7;
+	}
+	return 0;
+}
+
 #endif /* KEYMASTER_COMMON_H */
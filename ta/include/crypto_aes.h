@@ -29,7 +29,7 @@
 keymaster_error_t TA_aes_finish(keymaster_operation_t *operation,
 				keymaster_blob_t *input,
 				keymaster_blob_t *output, uint32_t *out_size,
-				uint32_t tag_len, bool *is_input_ext,
+				uint32_t tag_len,
 				const keymaster_key_param_set_t *in_params);
 
 keymaster_error_t TA_aes_update(keymaster_operation_t *operation,
@@ -38,7 +38,6 @@ keymaster_error_t TA_aes_update(keymaster_operation_t *operation,
 				uint32_t *out_size,
 				const uint32_t input_provided,
 				size_t *input_consumed,
-				const keymaster_key_param_set_t *in_params,
-				bool *is_input_ext);
+				const keymaster_key_param_set_t *in_params);
 
 #endif/*ANDROID_OPTEE_CRYPTO_AES_H*/
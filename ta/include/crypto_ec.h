@@ -27,6 +27,7 @@
 #include "operations.h"
 #include "crypto_rsa.h"
 #include "asn1.h"
+#include "der.h"
 
 keymaster_error_t TA_ec_update(keymaster_operation_t *operation,
 				const keymaster_blob_t *input,
@@ -40,7 +41,6 @@ keymaster_error_t TA_ec_finish(const keymaster_operation_t *operation,
 				keymaster_blob_t *signature,
 				uint32_t *out_size,
 				const uint32_t key_size,
-				TEE_TASessionHandle *sessionSTA,
 				bool *is_input_ext);
 
 #endif/* ANDROID_OPTEE_CRYPTO_EC_H */
@@ -33,7 +33,6 @@ keymaster_error_t TA_rsa_finish(keymaster_operation_t *operation,
 				keymaster_blob_t *output, uint32_t *out_size,
 				const uint32_t key_size,
 				const keymaster_blob_t signature,
-				const TEE_ObjectHandle obj_h,
 				bool *is_input_ext);
 
 keymaster_error_t TA_rsa_update(keymaster_operation_t *operation,
@@ -42,7 +41,6 @@ keymaster_error_t TA_rsa_update(keymaster_operation_t *operation,
 				uint32_t *out_size,
 				const uint32_t key_size,
 				size_t *input_consumed,
-				const uint32_t input_provided,
-				const TEE_ObjectHandle obj_h);
+				const uint32_t input_provided);
 
 #endif/*ANDROID_OPTEE_CRYPTO_RSA_H*/
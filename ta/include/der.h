@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_DER_H
+#define ANDROID_OPTEE_DER_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+#include <utee_defines.h>
+
+#include "ta_ca_defs.h"
+#include "generator.h"
+
+#define DER_TAG_BOOLEAN		0x01
+#define DER_TAG_INTEGER		0x02
+#define DER_TAG_BIT_STRING	0x03
+#define DER_TAG_OCTET_STRING	0x04
+#define DER_TAG_NULL		0x05
+#define DER_TAG_OID		0x06
+#define DER_TAG_ENUMERATED	0x0a
+#define DER_TAG_UTF8_STRING	0x0c
+#define DER_TAG_UTC_TIME	0x17
+#define DER_TAG_GENERALIZED_TIME	0x18
+#define DER_TAG_SEQUENCE	0x30
+#define DER_TAG_SET		0x31
+#define DER_TAG_CONTEXT_0	0xa0
+#define DER_TAG_CONTEXT_1	0xa1
+#define DER_TAG_CONTEXT_3	0xa3
+
+/* Encoded OBJECT IDENTIFIER of supported OIDs fits into this size */
+#define DER_MAX_OID_SIZE	16
+
+/* Largest EC key supported by keymaster is P-521 */
+#define EC_MAX_KEY_BYTES	66
+#define EC_MAX_RAW_SIGN_SIZE	(2 * EC_MAX_KEY_BYTES)
+
+/* Unread part of a DER buffer */
+typedef struct {
+	const uint8_t *ptr;
+	const uint8_t *end;
+} der_reader_t;
+
+/*
+ * Reads the next element if it has the expected tag, content gets its
+ * value. Returns false on other tag, malformed or not minimal length.
+ */
+bool TA_der_read(der_reader_t *reader, const uint8_t tag,
+		der_reader_t *content);
+
+/* Reads a non-negative INTEGER and drops its sign byte */
+bool TA_der_read_uint(der_reader_t *reader, const uint8_t **value,
+		uint32_t *value_l);
+
+uint32_t TA_der_header_size(const uint32_t length);
+
+/* Writes tag and length, returns number of written bytes */
+uint32_t TA_der_put_header(uint8_t *out, const uint8_t tag,
+		const uint32_t length);
+
+/* Size of an unsigned big-endian number encoded as INTEGER */
+uint32_t TA_der_uint_size(const uint8_t *value, uint32_t value_l);
+
+/* Writes an unsigned big-endian number as INTEGER */
+uint32_t TA_der_put_uint(uint8_t *out, const uint8_t *value,
+		uint32_t value_l);
+
+/*
+ * ECDSA-Sig-Value ::= SEQUENCE { r INTEGER, s INTEGER }
+ * Converts raw r || s in sign to DER in place.
+ */
+keymaster_error_t TA_der_encode_ec_sign(uint8_t *sign, uint32_t *sign_l,
+				const uint32_t capacity);
+
+/* Converts DER signature to raw r || s sized for the key */
+keymaster_error_t TA_der_decode_ec_sign(const keymaster_blob_t *signature,
+				const uint32_t key_size,
+				uint8_t *raw, uint32_t *raw_l);
+
+/*
+ * PrivateKeyInfo ::= SEQUENCE {
+ *    version Version,
+ *    privateKeyAlgorithm AlgorithmIdentifier,
+ *    privateKey OCTET STRING -- RSAPrivateKey or ECPrivateKey
+ *    attributes [0] IMPLICIT Attributes OPTIONAL }
+ *
+ * Fills attrs in order of TA_get_attrs_list_short(). Attributes refer to
+ * key_data, so it must outlive them and attrs must not be freed with
+ * free_attrs(). EC curve attribute is not added.
+ */
+keymaster_error_t TA_der_decode_pkcs8(const keymaster_blob_t *key_data,
+				const keymaster_algorithm_t algorithm,
+				TEE_Attribute *attrs,
+				uint32_t *attrs_count,
+				uint32_t *key_size,
+				uint64_t *rsa_public_exponent);
+
+/*
+ * SubjectPublicKeyInfo ::= SEQUENCE {
+ *    algorithm AlgorithmIdentifier,
+ *    subjectPublicKey BIT STRING }
+ *
+ * Encodes public part of RSA or EC key pair into allocated export_data.
+ */
+keymaster_error_t TA_der_encode_spki(const TEE_ObjectHandle obj_h,
+				const uint32_t type,
+				const uint32_t key_size,
+				keymaster_blob_t *export_data);
+
+#endif/* ANDROID_OPTEE_DER_H */
@@ -47,6 +47,7 @@
 #include "master_crypto.h"
 #include "parsel.h"
 #include "parameters.h"
+#include "keypool.h"
 
 /* Operations with keys */
 keymaster_error_t TA_import_key(const keymaster_algorithm_t algorithm,
@@ -62,10 +63,16 @@ keymaster_error_t TA_generate_key(const keymaster_algorithm_t algorithm,
 				const keymaster_digest_t digest,
 				const uint64_t rsa_public_exponent);
 
+/*
+ * Decrypts key blob into params_t, type keeps the stored (key pair) type.
+ * No object is created if obj_h is NULL. With public_only RSA and EC
+ * keys are restored as public key objects.
+ */
 keymaster_error_t TA_restore_key(uint8_t *key_material,
 				const keymaster_key_blob_t *key_blob,
 				uint32_t *key_size, uint32_t *type,
 				TEE_ObjectHandle *obj_h,
+				const bool public_only,
 				keymaster_key_param_set_t *params_t);
 
 /* Operations handling */
@@ -93,6 +100,8 @@ bool is_attr_value(const uint32_t tag);
 
 uint32_t purpose_to_mode(const keymaster_purpose_t purpose);
 
+bool TA_is_public_purpose(const keymaster_purpose_t purpose);
+
 void free_attrs(TEE_Attribute *attrs, uint32_t size);
 
 uint32_t TA_get_key_size(const keymaster_algorithm_t algorithm);
@@ -0,0 +1,50 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_HEAP_H
+#define ANDROID_OPTEE_HEAP_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "common.h"
+#include "ta_ca_defs.h"
+
+/*
+ * Accounted TEE_Malloc and TEE_Free, all TA allocations go through them.
+ * Memory from TA_malloc must be released with TA_free and never with
+ * TEE_Free. Memory is always zero filled. Allocations are counted per
+ * category and per command, for the command in progress between
+ * TA_heap_begin and TA_heap_end, see command.h.
+ */
+void *TA_malloc(const uint32_t size, const enum km_heap_category category);
+
+void TA_free(void *buffer);
+
+void TA_heap_begin(void);
+
+void TA_heap_end(void);
+
+/*
+ * Applies KM_HEAP_* flags, fills heap counters and moves up to max_events
+ * recorded events to events.
+ */
+keymaster_error_t TA_heap_get(km_heap_t *heap, km_heap_event_t *events,
+				const uint32_t max_events,
+				const uint32_t flags, const uint32_t cmd);
+
+#endif /* ANDROID_OPTEE_HEAP_H */
@@ -0,0 +1,46 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_KEYPOOL_H
+#define ANDROID_OPTEE_KEYPOOL_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "ta_ca_defs.h"
+
+/* Only keys with default public exponent are pregenerated */
+#define KM_KEYPOOL_EXPONENT 65537
+#define KM_KEYPOOL_MAX_DEPTH 2
+
+/*
+ * Takes a pregenerated RSA key pair out of the pool, TEE_HANDLE_NULL is
+ * returned if there is no ready key of such size and exponent.
+ * The caller owns the returned transient object.
+ */
+TEE_ObjectHandle TA_keypool_take(const uint32_t key_size,
+				const uint64_t rsa_public_exponent);
+
+/*
+ * Generates one missing key pair, smaller key sizes first.
+ * missing is set to the number of key pairs still to be generated.
+ */
+keymaster_error_t TA_keypool_refill(uint32_t *missing);
+
+void TA_keypool_free(void);
+
+#endif /* ANDROID_OPTEE_KEYPOOL_H */
@@ -49,6 +49,12 @@
 
 #define CMD_ADD_RNG_ENTROPY 0
 
+/* Per-session state, set up by KM_GET_VERSION */
+typedef struct {
+	uint32_t wire_version;
+	uint32_t capabilities;
+} keymaster_session_t;
+
 /* Empty definitions */
 #define EMPTY_CERT_CHAIN {.entries = NULL, .entry_count = 0}
 #define EMPTY_BLOB {.data = NULL, .data_length = 0}
@@ -60,6 +66,7 @@
 #define EMPTY_OPERATION {					\
 			.key = NULL,				\
 			.nonce = EMPTY_BLOB,			\
+			.modulus = EMPTY_BLOB,			\
 			.op_handle = UNDEFINED,			\
 			.purpose = UNDEFINED,			\
 			.padding = UNDEFINED,			\
@@ -68,38 +75,13 @@
 			.last_access = NULL,			\
 			.operation = TEE_HANDLE_NULL,		\
 			.digest_op = TEE_HANDLE_NULL,		\
-			.prev_in_size = UNDEFINED,		\
 			.min_sec = UNDEFINED,			\
 			.mac_length = UNDEFINED,		\
-			.a_data_length = 0,			\
-			.a_data = NULL,				\
 			.do_auth = false,			\
 			.got_input = false,			\
-			.buffering = false,			\
-			.padded = false,			\
-			.first = true,				\
-			.last_block = EMPTY_BLOB}
-
-uint64_t identifier_rsa[] = {1, 2, 840, 113549, 1, 1, 1};
-/* RSAPrivateKey ::= SEQUENCE {
- *    version Version,
- *    modulus INTEGER, -- n
- *    publicExponent INTEGER, -- e
- *    privateExponent INTEGER, -- d
- *    prime1 INTEGER, -- p
- *    prime2 INTEGER, -- q
- *    exponent1 INTEGER, -- d mod (p-1)
- *    exponent2 INTEGER, -- d mod (q-1)
- *    coefficient INTEGER -- (inverse of q) mod p }
- */
-
-uint64_t identifier_ec[] = {1, 2, 840, 10045, 2, 1};
-/* ECPrivateKey ::= SEQUNCE {
- *    version Version,
- *    secretValue OCTET_STRING,
- *    publicValue CONSTRUCTED {
- *        XYValue BIT_STRING } }
- */
+			.carry_length = 0,			\
+			.tag_start = 0,				\
+			.tag_length = 0}
 
 static uint32_t TA_possibe_size(const uint32_t type,
 				const uint32_t key_size,
@@ -107,6 +89,9 @@ static uint32_t TA_possibe_size(const uint32_t type,
 				const uint32_t tag_len);
 
 
+static keymaster_error_t TA_getVersion(TEE_Param params[TEE_NUM_PARAMS],
+					keymaster_session_t *session);
+
 static keymaster_error_t TA_addRngEntropy(TEE_Param params[TEE_NUM_PARAMS]);
 
 static keymaster_error_t TA_generateKey(TEE_Param params[TEE_NUM_PARAMS]);
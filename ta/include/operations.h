@@ -24,8 +24,10 @@
 #include <tee_internal_api_extensions.h>
 #include <utee_defines.h>
 
+#include "common.h"
 #include "ta_ca_defs.h"
 #include "tables.h"
+#include "paddings.h"
 
 typedef struct keymaster_blob_list_item_t {
 	keymaster_blob_t data;
@@ -35,7 +37,7 @@ typedef struct keymaster_blob_list_item_t {
 typedef struct {
 	keymaster_key_blob_t *key;
 	keymaster_blob_t nonce;
-	keymaster_blob_t last_block;
+	keymaster_blob_t modulus;/*RSA unpadded sign/encrypt input check*/
 	keymaster_operation_handle_t op_handle;
 	keymaster_purpose_t purpose;
 	keymaster_padding_t padding;
@@ -44,17 +46,23 @@ typedef struct {
 	TEE_Time *last_access;
 	TEE_OperationHandle *operation;
 	TEE_OperationHandle *digest_op;
-	size_t prev_in_size;
 	uint32_t min_sec;
 	uint32_t mac_length;
 	uint32_t digestLength;
-	uint32_t a_data_length;
-	uint8_t *a_data;
 	bool do_auth;
 	bool got_input;
-	bool buffering;
-	bool padded;
-	bool first;
+	/* AES CBC/ECB bytes not processed yet: incomplete block or,
+	 * for PKCS7 decryption, the last block holding the pad
+	 */
+	uint32_t carry_length;
+	uint8_t carry[BLOCK_SIZE];
+	/* AES GCM decryption: the last tag size bytes of input seen so
+	 * far, tag_length of them starting at tag_start (GCM tag is at
+	 * most one block)
+	 */
+	uint32_t tag_start;
+	uint32_t tag_length;
+	uint8_t tag_ring[BLOCK_SIZE];
 } keymaster_operation_t;
 
 void TA_free_blob_list(keymaster_blob_list_item_t *item);
@@ -71,7 +79,8 @@ keymaster_error_t TA_try_start_operation(
 				const keymaster_block_mode_t mode,
 				const uint32_t mac_length,
 				const keymaster_digest_t digest,
-				const keymaster_blob_t nonce);
+				const keymaster_blob_t nonce,
+				const keymaster_blob_t modulus);
 
 keymaster_error_t TA_start_operation(
 				const keymaster_operation_handle_t op_handle,
@@ -85,7 +94,8 @@ keymaster_error_t TA_start_operation(
 				const keymaster_block_mode_t mode,
 				const uint32_t mac_length,
 				const keymaster_digest_t digest,
-				const keymaster_blob_t nonce);
+				const keymaster_blob_t nonce,
+				const keymaster_blob_t modulus);
 
 keymaster_error_t TA_get_operation(const keymaster_operation_handle_t op_handle,
 				keymaster_operation_t *operation);
@@ -111,4 +121,6 @@ void TA_decriment_nonce(keymaster_operation_t *operation);
 
 void TA_reset_operations_table(void);
 
+void TA_get_operations_stats(km_stats_table_t *stats, const bool reset);
+
 #endif  /* ANDROID_OPTEE_OPERATIONS_H */
@@ -26,15 +26,6 @@
 
 #include "ta_ca_defs.h"
 
-keymaster_error_t TA_check_out_size(const uint32_t input_l,
-					keymaster_blob_t *output,
-					uint32_t *out_size,
-					uint32_t tag_len);
-
-keymaster_error_t TA_add_pkcs7_pad(keymaster_blob_t *input,
-				const bool force, keymaster_blob_t *output,
-				uint32_t *out_size, bool *is_input_ext);
-
 keymaster_error_t TA_remove_pkcs7_pad(keymaster_blob_t *output,
 					uint32_t *out_size);
 
@@ -43,6 +34,10 @@ bool TA_check_pkcs7_pad(keymaster_blob_t *output);
 keymaster_error_t TA_do_rsa_pad(uint8_t **input, uint32_t *input_l,
 				const uint32_t key_size);
 
+/* Same as TA_do_rsa_pad for a buffer of key size, without reallocation */
+keymaster_error_t TA_do_rsa_pad_in_place(uint8_t *data, uint32_t *data_l,
+					const uint32_t key_size);
+
 keymaster_error_t TA_do_rsa_pkcs_v1_5_rawpad(uint8_t **input, uint32_t *input_l,
 					     const uint32_t key_size);
 
@@ -37,12 +37,60 @@
 #define IS_OUT_OF_BOUNDS(ptr, end, required) \
 			(end ? (ptr + required > end) : false)
 
+/*
+ * Output of a crypto routine placed straight into the response buffer.
+ * The size field is reserved for max_size bytes and written once the
+ * real length is known. data is NULL when a scratch buffer is used
+ * instead because the response has no room for max_size bytes.
+ */
+typedef struct {
+	uint8_t *size_field;
+	uint32_t max_size;
+	uint8_t *data;
+} keymaster_out_sink_t;
+
+#define EMPTY_OUT_SINK {NULL, 0, NULL}
+
+/* Wire format used by (de)serializers for HAL buffers */
+void TA_set_wire_version(const uint32_t version);
+
+uint32_t TA_get_wire_version(void);
+
 /* Serializers */
 int TA_serialize_blob(uint8_t *out, const keymaster_blob_t *export_data);
 
+int TA_serialize_size(uint8_t *out, const uint64_t size);
+
+/* Bytes TA_serialize_size_padded takes for sizes up to max_size */
+uint32_t TA_size_width(const uint64_t max_size);
+
+/* Writes size using as many bytes as max_size would take */
+int TA_serialize_size_padded(uint8_t *out, const uint64_t size,
+			const uint64_t max_size);
+
+/* Points output->data to the response at out or to a scratch buffer */
+keymaster_error_t TA_sink_open(keymaster_out_sink_t *sink, uint8_t *out,
+			const uint8_t *out_end, const uint32_t max_size,
+			keymaster_blob_t *output);
+
+/* Serializes output as a blob ending before out_end, moves out past it */
+keymaster_error_t TA_sink_commit(const keymaster_out_sink_t *sink,
+			uint8_t **out, const uint8_t *out_end,
+			const keymaster_blob_t *output);
+
+void TA_sink_close(const keymaster_out_sink_t *sink, keymaster_blob_t *output,
+			const keymaster_error_t res);
+
 int TA_serialize_characteristics(uint8_t *out,
 			const keymaster_key_characteristics_t *characteristics);
 
+/*
+ * Key blobs and requests to the ASN.1 static TA always keep the version 1
+ * layout, whatever wire format is negotiated with the HAL.
+ */
+int TA_serialize_characteristics_v1(uint8_t *out,
+			const keymaster_key_characteristics_t *characteristics);
+
 int TA_serialize_key_blob(uint8_t *out, const keymaster_key_blob_t *key_blob);
 
 int TA_serialize_cert_chain(uint8_t *out,
@@ -52,6 +100,9 @@ int TA_serialize_cert_chain(uint8_t *out,
 int TA_serialize_param_set(uint8_t *out,
 			const keymaster_key_param_set_t *params);
 
+int TA_serialize_param_set_v1(uint8_t *out,
+			const keymaster_key_param_set_t *params);
+
 TEE_Result TA_serialize_rsa_keypair(uint8_t *out,
 				    uint32_t *out_size,
 				    const TEE_ObjectHandle key_obj);
@@ -70,6 +121,10 @@ int TA_deserialize_param_set(uint8_t *in, const uint8_t *end,
 			keymaster_key_param_set_t *params_t,
 			const bool check_presence, keymaster_error_t *res);
 
+int TA_deserialize_param_set_v1(uint8_t *in, const uint8_t *end,
+			keymaster_key_param_set_t *params_t,
+			keymaster_error_t *res);
+
 int TA_deserialize_key_blob(const uint8_t *in, const uint8_t *end,
 			keymaster_key_blob_t *key_blob,
 			keymaster_error_t *res);
@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_RING_H
+#define ANDROID_OPTEE_RING_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "common.h"
+#include "ta_ca_defs.h"
+
+/*
+ * Ring of fixed size records kept until the normal world reads them. A
+ * full ring drops its oldest record. The buffer comes from TEE_Malloc, so
+ * it is not accounted as heap of commands.
+ */
+typedef struct {
+	uint8_t *records;
+	uint32_t record_size;
+	uint32_t capacity;
+	uint32_t head;
+	uint32_t count;
+	uint32_t dropped;
+} km_ring_t;
+
+/* Allocates the buffer unless allocated already */
+keymaster_error_t TA_ring_alloc(km_ring_t *ring, const uint32_t record_size,
+				const uint32_t capacity);
+
+void TA_ring_free(km_ring_t *ring);
+
+/* Drops all records and the count of dropped ones */
+void TA_ring_clear(km_ring_t *ring);
+
+/* Returns the record to fill in, NULL if the ring is not allocated */
+void *TA_ring_push(km_ring_t *ring);
+
+/* Moves up to max oldest records to out, returns how many were moved */
+uint32_t TA_ring_pop(km_ring_t *ring, void *out, const uint32_t max);
+
+#endif /* ANDROID_OPTEE_RING_H */
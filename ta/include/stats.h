@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPTEE_STATS_H
+#define ANDROID_OPTEE_STATS_H
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "common.h"
+#include "ta_ca_defs.h"
+
+/*
+ * Timing of command handlers. TA_stats_begin and TA_stats_end bracket the
+ * command in progress, see command.h. TA_stats_mark adds the time since
+ * the previous mark (or the begin) to a phase. Time after the last mark
+ * counts as KM_PHASE_OTHER.
+ *
+ * Timestamps come from TEE_GetSystemTime, its millisecond steps average
+ * out over many calls. Build with CFG_KM_STATS_CNTVCT=y to read the ARM
+ * generic timer directly on platforms that let TAs access it.
+ */
+void TA_stats_begin(void);
+
+/*
+ * Records phases of the command begun last as spans, tagged with ids the
+ * HAL passed along. The span buffer is allocated by the first call.
+ */
+void TA_stats_trace(const uint32_t id, const uint32_t seq);
+
+void TA_stats_mark(const enum km_stats_phase phase);
+
+void TA_stats_end(const keymaster_error_t res);
+
+/* Fills command timing and table occupancy, optionally starts over */
+void TA_stats_get(km_stats_t *stats, const bool reset);
+
+/* Moves up to max_spans recorded spans to spans, applies KM_TRACE_* flags */
+void TA_stats_get_trace(km_trace_t *trace, km_trace_span_t *spans,
+			const uint32_t max_spans, const uint32_t flags);
+
+#endif /* ANDROID_OPTEE_STATS_H */
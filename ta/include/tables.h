@@ -26,6 +26,7 @@
 #include <tee_internal_api_extensions.h>
 #include <utee_defines.h>
 
+#include "common.h"
 #include "ta_ca_defs.h"
 #include "master_crypto.h"
 
@@ -52,4 +53,7 @@ keymaster_error_t TA_trigger_timer(const keymaster_key_blob_t *key,
 keymaster_error_t TA_check_key_use_timer(const keymaster_key_blob_t *key,
 				const uint32_t min_sec);
 
+void TA_get_use_tables_stats(km_stats_table_t *counters,
+				km_stats_table_t *timers, const bool reset);
+
 #endif/* ANDROID_OPTEE_TABLES_H */
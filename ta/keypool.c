@@ -0,0 +1,113 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keypool.h"
+
+/*
+ * RSA key pairs are generated in advance when the HAL is idle and kept
+ * as transient objects only, they are never stored outside of the TA.
+ */
+static struct {
+	const uint32_t key_size;
+	const uint32_t depth;
+	uint32_t count;
+	TEE_ObjectHandle keys[KM_KEYPOOL_MAX_DEPTH];
+} keypool[] = {
+	{.key_size = 2048, .depth = 2},
+	{.key_size = 3072, .depth = 1},
+	{.key_size = 4096, .depth = 1},
+};
+
+#define KEYPOOL_SLOTS (sizeof(keypool) / sizeof(keypool[0]))
+
+TEE_ObjectHandle TA_keypool_take(const uint32_t key_size,
+				const uint64_t rsa_public_exponent)
+{
+	if (rsa_public_exponent != KM_KEYPOOL_EXPONENT)
+		return TEE_HANDLE_NULL;
+	for (uint32_t i = 0; i < KEYPOOL_SLOTS; i++) {
+		if (keypool[i].key_size != key_size || keypool[i].count == 0)
+			continue;
+		keypool[i].count--;
+		DMSG("RSA-%u key pair taken from pool, %u left", key_size,
+						keypool[i].count);
+		return keypool[i].keys[keypool[i].count];
+	}
+	return TEE_HANDLE_NULL;
+}
+
+static uint32_t TA_keypool_missing(void)
+{
+	uint32_t missing = 0;
+
+	for (uint32_t i = 0; i < KEYPOOL_SLOTS; i++)
+		missing += keypool[i].depth - keypool[i].count;
+	return missing;
+}
+
+keymaster_error_t TA_keypool_refill(uint32_t *missing)
+{
+	static const uint8_t exponent[] = {0x01, 0x00, 0x01};
+	TEE_ObjectHandle obj_h = TEE_HANDLE_NULL;
+	TEE_Attribute attr;
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t i = 0;
+
+	for (i = 0; i < KEYPOOL_SLOTS; i++) {
+		if (keypool[i].count < keypool[i].depth)
+			break;
+	}
+	if (i == KEYPOOL_SLOTS)
+		goto out;
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_RSA_PUBLIC_EXPONENT,
+				(void *)exponent, sizeof(exponent));
+	res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR,
+				keypool[i].key_size, &obj_h);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate transient object, res=%x", res);
+		goto out;
+	}
+	res = TEE_GenerateKey(obj_h, keypool[i].key_size, &attr, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to generate pool key, res = %x", res);
+		TEE_FreeTransientObject(obj_h);
+		goto out;
+	}
+	keypool[i].keys[keypool[i].count++] = obj_h;
+out:
+	*missing = TA_keypool_missing();
+	/* Convert error code to Android style */
+	if (res == TEE_SUCCESS)
+		return KM_ERROR_OK;
+	if (res == TEE_ERROR_OUT_OF_MEMORY)
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	if (res == TEE_ERROR_NOT_SUPPORTED)
+		return KM_ERROR_UNSUPPORTED_KEY_SIZE;
+	return KM_ERROR_UNKNOWN_ERROR;
+}
+
+void TA_keypool_free(void)
+{
+	for (uint32_t i = 0; i < KEYPOOL_SLOTS; i++) {
+		while (keypool[i].count > 0) {
+			keypool[i].count--;
+			TEE_FreeTransientObject(
+				keypool[i].keys[keypool[i].count]);
+		}
+	}
+}
@@ -23,6 +23,9 @@
 #include "ta_ca_defs.h"
 #include "keystore_ta.h"
 #include "attestation.h"
+#include "command.h"
+#include "stats.h"
+#include "heap.h"
 
 static TEE_TASessionHandle sessionSTA = TEE_HANDLE_NULL;
 static TEE_TASessionHandle session_rngSTA = TEE_HANDLE_NULL;
@@ -73,6 +76,9 @@ exit:
 
 void TA_DestroyEntryPoint(void)
 {
+	TA_keypool_free();
+	TA_free_attest_cache();
+	TA_FreeAuthTokenCache();
 	TEE_CloseTASession(sessionSTA);
 	TEE_CloseTASession(session_rngSTA);
 	sessionSTA = TEE_HANDLE_NULL;
@@ -80,8 +86,9 @@ void TA_DestroyEntryPoint(void)
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
-		TEE_Param params[TEE_NUM_PARAMS] __unused, void **sess_ctx __unused)
+		TEE_Param params[TEE_NUM_PARAMS] __unused, void **sess_ctx)
 {
+	keymaster_session_t *session = NULL;
 	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
 						   TEE_PARAM_TYPE_NONE,
 						   TEE_PARAM_TYPE_NONE,
@@ -89,11 +96,21 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
+	session = TA_malloc(sizeof(*session), KM_HEAP_OTHER);
+	if (!session) {
+		EMSG("Failed to allocate memory for session context");
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	/* Clients that skip KM_GET_VERSION talk the original format */
+	session->wire_version = KM_WIRE_VERSION_1;
+	*sess_ctx = session;
+
 	return TEE_SUCCESS;
 }
 
-void TA_CloseSessionEntryPoint(void *sess_ctx __unused)
+void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
+	TA_free(sess_ctx);
 }
 
 static uint32_t TA_possibe_size(const uint32_t type, const uint32_t key_size,
@@ -104,11 +121,12 @@ static uint32_t TA_possibe_size(const uint32_t type, const uint32_t key_size,
 	case TEE_TYPE_AES:
 		/*
 		 * Input can be extended to block size and one block
-		 * can be added as a padding.
+		 * can be added as a padding, GCM decryption can prepend
+		 * up to a tag of buffered data.
 		 * Additionaly GCM tag can be added
 		 */
-		return ((input.data_length + BLOCK_SIZE - 1)
-				/ BLOCK_SIZE + 1) * BLOCK_SIZE + tag_len;
+		return ((input.data_length + tag_len + BLOCK_SIZE - 1)
+				/ BLOCK_SIZE + 2) * BLOCK_SIZE + tag_len;
 	case TEE_TYPE_RSA_KEYPAIR:
 		return (key_size + 7) / 8;
 	case TEE_TYPE_ECDSA_KEYPAIR:
@@ -122,14 +140,203 @@ static uint32_t TA_possibe_size(const uint32_t type, const uint32_t key_size,
 	}
 }
 
+/*
+ * Largest AES input processed by one update: its output has to fit in
+ * the response of out_capacity bytes next to the other fields (consumed
+ * size, blob size and empty param set) or in TA heap.
+ */
+static uint32_t TA_aes_max_input(const uint32_t out_capacity,
+				const uint32_t tag_len)
+{
+	uint32_t reserve = 3 * SIZE_LENGTH + 3 * BLOCK_SIZE + 2 * tag_len;
+
+	if (out_capacity > reserve &&
+			out_capacity - reserve < KM_MAX_UPDATE_CHUNK)
+		return out_capacity - reserve;
+	return KM_MAX_UPDATE_CHUNK;
+}
+
+//Negotiates HAL <-> TA wire format and reports optional TA features
+static keymaster_error_t TA_getVersion(TEE_Param params[TEE_NUM_PARAMS],
+					keymaster_session_t *session)
+{
+	uint8_t *in = NULL;
+	uint8_t *out = NULL;
+	uint32_t version = KM_WIRE_VERSION_1;	/* IN/OUT */
+	uint32_t capabilities = 0;		/* IN/OUT */
+
+	in = (uint8_t *) params[0].memref.buffer;
+	out = (uint8_t *) params[1].memref.buffer;
+
+	if (params[0].memref.size < sizeof(version) + sizeof(capabilities) ||
+			params[1].memref.size <
+			sizeof(version) + sizeof(capabilities)) {
+		EMSG("Wrong buffers size for version exchange");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	TEE_MemMove(&version, in, sizeof(version));
+	TEE_MemMove(&capabilities, in + sizeof(version), sizeof(capabilities));
+	if (version > KM_WIRE_VERSION)
+		version = KM_WIRE_VERSION;
+	if (version < KM_WIRE_VERSION_1)
+		version = KM_WIRE_VERSION_1;
+	session->wire_version = version;
+	session->capabilities = capabilities & KM_CAPABILITIES;
+	TA_set_wire_version(version);
+
+	capabilities = KM_CAPABILITIES;
+	TEE_MemMove(out, &version, sizeof(version));
+	TEE_MemMove(out + sizeof(version), &capabilities, sizeof(capabilities));
+	DMSG("Wire format version %u, capabilities %x", version,
+						session->capabilities);
+	return KM_ERROR_OK;
+}
+
+//Generates one key pair of RSA key pool, reports how many are missing
+static keymaster_error_t TA_refillKeyPool(TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t missing = 0;	/* OUT */
+	keymaster_error_t res = KM_ERROR_OK;
+
+	if (params[1].memref.size < sizeof(missing)) {
+		EMSG("Wrong buffer size for key pool refill");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	res = TA_keypool_refill(&missing);
+	TA_stats_mark(KM_PHASE_CRYPTO);
+	TEE_MemMove(params[1].memref.buffer, &missing, sizeof(missing));
+	return res;
+}
+
+//Creates attestation keys and root certificates ahead of first attestKey
+static keymaster_error_t TA_provision(TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t state = KM_PROVISION_NOT_READY;	/* OUT */
+	TEE_Result res = TEE_SUCCESS;
+
+	if (params[1].memref.size < sizeof(state)) {
+		EMSG("Wrong buffer size for provisioning state");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+#ifdef ENUM_PERS_OBJS
+	TA_enum_attest_objs();
+#endif
+#ifdef WIPE_PERS_OBJS
+	TA_wipe_attest_objs();
+#endif
+	//This call creates keys/certs only once during first TA run
+	res = TA_create_attest_objs(sessionSTA);
+	TA_stats_mark(KM_PHASE_CRYPTO);
+	if (res == TEE_SUCCESS)
+		state = KM_PROVISION_READY;
+	else
+		EMSG("Failed to create attestation objects, res=%x", res);
+	TEE_MemMove(params[1].memref.buffer, &state, sizeof(state));
+	return res == TEE_SUCCESS ? KM_ERROR_OK : KM_ERROR_UNKNOWN_ERROR;
+}
+
+//Reports timing of commands and occupancy of operation and key use tables
+static keymaster_error_t TA_getStats(TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t flags = 0;		/* IN */
+	km_stats_t *stats = NULL;	/* OUT */
+
+	if (params[1].memref.size < sizeof(*stats)) {
+		EMSG("Wrong buffer size for statistics");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	if (params[0].memref.size >= sizeof(flags))
+		TEE_MemMove(&flags, params[0].memref.buffer, sizeof(flags));
+	/* Too big for TA stack */
+	stats = TA_malloc(sizeof(*stats), KM_HEAP_OTHER);
+	if (!stats) {
+		EMSG("Failed to allocate memory for statistics");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	TA_stats_get(stats, flags & KM_STATS_RESET);
+	TEE_MemMove(params[1].memref.buffer, stats, sizeof(*stats));
+	TA_free(stats);
+	return KM_ERROR_OK;
+}
+
+//Reports use of the TA heap, records allocations of a command in soak mode
+static keymaster_error_t TA_getHeapStats(TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t flags = 0;		/* IN */
+	uint32_t cmd = 0;		/* IN */
+	km_heap_t *heap = NULL;		/* OUT */
+	uint32_t max_events = 0;
+	uint32_t size = 0;
+	keymaster_error_t res = KM_ERROR_OK;
+
+	if (params[1].memref.size < sizeof(*heap)) {
+		EMSG("Wrong buffer size for heap statistics");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	if (params[0].memref.size >= sizeof(flags))
+		TEE_MemMove(&flags, params[0].memref.buffer, sizeof(flags));
+	if (params[0].memref.size >= sizeof(flags) + sizeof(cmd))
+		TEE_MemMove(&cmd, (uint8_t *)params[0].memref.buffer +
+						sizeof(flags), sizeof(cmd));
+	max_events = (params[1].memref.size - sizeof(*heap)) /
+						sizeof(km_heap_event_t);
+	if (max_events > KM_HEAP_EVENTS)
+		max_events = KM_HEAP_EVENTS;
+	size = sizeof(*heap) + max_events * sizeof(km_heap_event_t);
+	/* Too big for TA stack */
+	heap = TA_malloc(size, KM_HEAP_OTHER);
+	if (!heap) {
+		EMSG("Failed to allocate memory for heap statistics");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	res = TA_heap_get(heap, (km_heap_event_t *)(heap + 1), max_events,
+								flags, cmd);
+	if (res == KM_ERROR_OK)
+		TEE_MemMove(params[1].memref.buffer, heap, sizeof(*heap) +
+				heap->events * sizeof(km_heap_event_t));
+	TA_free(heap);
+	return res;
+}
+
+//Returns phase spans of commands tagged by the HAL
+static keymaster_error_t TA_getTrace(TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t flags = 0;		/* IN */
+	km_trace_t *trace = NULL;	/* OUT */
+	uint32_t max_spans = 0;
+	uint32_t size = 0;
+
+	if (params[1].memref.size < sizeof(*trace)) {
+		EMSG("Wrong buffer size for trace");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	if (params[0].memref.size >= sizeof(flags))
+		TEE_MemMove(&flags, params[0].memref.buffer, sizeof(flags));
+	max_spans = (params[1].memref.size - sizeof(*trace)) /
+						sizeof(km_trace_span_t);
+	if (max_spans > KM_TRACE_SPANS)
+		max_spans = KM_TRACE_SPANS;
+	size = sizeof(*trace) + max_spans * sizeof(km_trace_span_t);
+	trace = TA_malloc(size, KM_HEAP_OTHER);
+	if (!trace) {
+		EMSG("Failed to allocate memory for trace");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	TA_stats_get_trace(trace, (km_trace_span_t *)(trace + 1), max_spans,
+									flags);
+	TEE_MemMove(params[1].memref.buffer, trace, sizeof(*trace) +
+				trace->spans * sizeof(km_trace_span_t));
+	TA_free(trace);
+	return KM_ERROR_OK;
+}
+
 //Adds caller-provided entropy to the pool
 static keymaster_error_t TA_addRngEntropy(TEE_Param params[TEE_NUM_PARAMS])
 {
 	uint8_t *in = NULL;
 	uint8_t *in_end = NULL;
 	size_t  in_size = 0;
-	uint8_t *data = NULL;		/* IN */
-	size_t data_length = 0;		/* IN */
+	keymaster_blob_t data = EMPTY_BLOB;	/* IN */
 	uint32_t sta_param_types = TEE_PARAM_TYPES(
 						TEE_PARAM_TYPE_MEMREF_INPUT,
 						TEE_PARAM_TYPE_NONE,
@@ -144,38 +351,28 @@ static keymaster_error_t TA_addRngEntropy(TEE_Param params[TEE_NUM_PARAMS])
 
 	if (in_size == 0)
 		return KM_ERROR_OK;
-	if (IS_OUT_OF_BOUNDS(in, in_end, sizeof(data_length))) {
-		EMSG("Out of input array bounds on deserialization");
-		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-	}
-	TEE_MemMove(&data_length, in, sizeof(data_length));
-	in += sizeof(data_length);
-	if (IS_OUT_OF_BOUNDS(in, in_end, data_length)) {
-		EMSG("Out of input array bounds on deserialization");
-		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-	}
-	data = TEE_Malloc(data_length, TEE_MALLOC_FILL_ZERO);
-	if (!data) {
-		EMSG("Failed to allocate memory for data");
-		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-	}
-	TEE_MemMove(data, in, data_length);
+	/* Copied out of shared memory before it is passed to static TA */
+	in += TA_deserialize_blob(in, in_end, &data, false, &res, false);
+	if (res != KM_ERROR_OK)
+		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 	if (session_rngSTA == TEE_HANDLE_NULL) {
 		EMSG("Session with RNG static TA is not opened");
 		res = KM_ERROR_SECURE_HW_COMMUNICATION_FAILED;
 		goto out;
 	}
-	params_tee[0].memref.buffer = data;
-	params_tee[0].memref.size = data_length;
+	params_tee[0].memref.buffer = data.data;
+	params_tee[0].memref.size = data.data_length;
 	res = TEE_InvokeTACommand(session_rngSTA, TEE_TIMEOUT_INFINITE,
 				CMD_ADD_RNG_ENTROPY, sta_param_types, params_tee, NULL);
 	if (res != TEE_SUCCESS) {
 		EMSG("Invoke command for RNG static TA failed, res=%x", res);
 		goto out;
 	}
+	TA_stats_mark(KM_PHASE_CRYPTO);
 out:
-	if (data)
-		TEE_Free(data);
+	if (data.data)
+		TA_free(data.data);
 	return res;
 }
 
@@ -210,6 +407,7 @@ static keymaster_error_t TA_generateKey(TEE_Param params[TEE_NUM_PARAMS])
 	in += 4;
 	memcpy(&os_patchlevel, in, sizeof(os_patchlevel));
 	in += 4;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 	/*Add additional parameters*/
 	TA_add_origin(&params_t, KM_ORIGIN_GENERATED, true);
 	TA_add_creation_datetime(&params_t, true);
@@ -242,14 +440,15 @@ static keymaster_error_t TA_generateKey(TEE_Param params[TEE_NUM_PARAMS])
 							&characts_size);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_CHECK);
 
 	key_buffer_size = TA_get_key_size(key_algorithm);
 
 	key_blob.key_material_size = characts_size + key_buffer_size +
 		IV_LENGTH + TAG_LENGTH;
 
-	key_material = TEE_Malloc(key_blob.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_blob.key_material_size,
+						KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Failed to allocate memory for key_material");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -261,8 +460,9 @@ static keymaster_error_t TA_generateKey(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("Failed to generate key, res=%x", res);
 		goto exit;
 	}
+	TA_stats_mark(KM_PHASE_CRYPTO);
 
-	TA_serialize_param_set(key_material + key_buffer_size, &params_t);
+	TA_serialize_param_set_v1(key_material + key_buffer_size, &params_t);
 
 	res = TA_encrypt(key_material, key_blob.key_material_size);
 	if (res != KM_ERROR_OK) {
@@ -270,12 +470,14 @@ static keymaster_error_t TA_generateKey(TEE_Param params[TEE_NUM_PARAMS])
 		goto exit;
 	}
 	key_blob.key_material = key_material;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 
 	out += TA_serialize_key_blob(out, &key_blob);
 	out += TA_serialize_characteristics(out, &characts);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 exit:
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	TA_free_params(&characts.sw_enforced);
 	TA_free_params(&characts.hw_enforced);
 	TA_free_params(&params_t);
@@ -297,7 +499,6 @@ static keymaster_error_t TA_getKeyCharacteristics(
 	keymaster_key_characteristics_t chr = EMPTY_CHARACTS;	/* OUT */
 	keymaster_key_param_set_t params_t = EMPTY_PARAM_SET;
 	keymaster_error_t res = KM_ERROR_OK;
-	TEE_ObjectHandle obj_h = TEE_HANDLE_NULL;
 	uint32_t characts_size = 0;
 	uint32_t key_size = 0;
 	uint32_t type = 0;
@@ -316,22 +517,24 @@ static keymaster_error_t TA_getKeyCharacteristics(
 	in += TA_deserialize_blob(in, in_end, &app_data, true, &res, false);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 	if (key_blob.key_material_size == 0) {
 		EMSG("Bad key blob");
 		res = KM_ERROR_UNSUPPORTED_KEY_FORMAT;
 		goto exit;
 	}
-	key_material = TEE_Malloc(key_blob.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_blob.key_material_size,
+						KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Failed to allocate memory for key material");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		goto exit;
 	}
 	res = TA_restore_key(key_material, &key_blob, &key_size, &type,
-						 &obj_h, &params_t);
+						 NULL, false, &params_t);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 
 	res = TA_check_permission(&params_t, client_id, app_data, &exportable);
 	if (res != KM_ERROR_OK)
@@ -340,18 +543,18 @@ static keymaster_error_t TA_getKeyCharacteristics(
 	res = TA_fill_characteristics(&chr, &params_t, &characts_size);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_CHECK);
 	out += TA_serialize_characteristics(out, &chr);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 exit:
-	if (obj_h != TEE_HANDLE_NULL)
-		TEE_FreeTransientObject(obj_h);
 	if (key_blob.key_material)
-		TEE_Free(key_blob.key_material);
+		TA_free(key_blob.key_material);
 	if (client_id.data)
-		TEE_Free(client_id.data);
+		TA_free(client_id.data);
 	if (app_data.data)
-		TEE_Free(app_data.data);
+		TA_free(app_data.data);
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	TA_free_params(&chr.sw_enforced);
 	TA_free_params(&chr.hw_enforced);
 	TA_free_params(&params_t);
@@ -390,13 +593,13 @@ static keymaster_error_t TA_importKey(TEE_Param params[TEE_NUM_PARAMS])
 	if (res != KM_ERROR_OK)
 		goto out;
 	TA_add_origin(&params_t, KM_ORIGIN_IMPORTED, true);
-	TEE_MemMove(&key_format, in, sizeof(key_format));
 	in += TA_deserialize_key_format(in, in_end, &key_format, &res);
 	if (res != KM_ERROR_OK)
 		goto out;
 	in += TA_deserialize_blob(in, in_end, &key_data, false, &res, false);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	//Parse mandatory and optional parameters
 	res = TA_parse_params(params_t, &key_algorithm, &key_size,
@@ -418,8 +621,8 @@ static keymaster_error_t TA_importKey(TEE_Param params[TEE_NUM_PARAMS])
 				goto out;
 			}
 		}
-		attrs_in = TEE_Malloc(sizeof(TEE_Attribute),
-							TEE_MALLOC_FILL_ZERO);
+		attrs_in = TA_malloc(sizeof(TEE_Attribute),
+							KM_HEAP_CRYPTO);
 		if (!attrs_in) {
 			EMSG("Failed to allocate memory for attributes");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -448,9 +651,19 @@ static keymaster_error_t TA_importKey(TEE_Param params[TEE_NUM_PARAMS])
 				key_algorithm != KM_ALGORITHM_EC) {
 			EMSG("Only TA_serialize_characteristicsRSA and EC keys can imported in PKCS8 fromat");
 			res = KM_ERROR_UNSUPPORTED_KEY_FORMAT;
+			goto out;
+		}
+		attrs_in = TA_malloc(sizeof(TEE_Attribute) *
+				(key_algorithm == KM_ALGORITHM_RSA ?
+				KM_ATTR_COUNT_RSA : KM_ATTR_COUNT_EC),
+				KM_HEAP_CRYPTO);
+		if (!attrs_in) {
+			EMSG("Failed to allocate memory for attributes");
+			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+			goto out;
 		}
-		res = TA_decode_pkcs8(sessionSTA, key_data, &attrs_in,
-				&attrs_in_count, key_algorithm, &key_size,
+		res = TA_der_decode_pkcs8(&key_data, key_algorithm, attrs_in,
+				&attrs_in_count, &key_size,
 				&key_rsa_public_exponent);
 		if (res != KM_ERROR_OK)
 			goto out;
@@ -487,11 +700,12 @@ static keymaster_error_t TA_importKey(TEE_Param params[TEE_NUM_PARAMS])
 					&params_t, &characts_size);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_CHECK);
 	key_buffer_size = TA_get_key_size(key_algorithm);
 	key_blob.key_material_size = characts_size + key_buffer_size +
 		IV_LENGTH + TAG_LENGTH;
-	key_material = TEE_Malloc(key_blob.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_blob.key_material_size,
+						KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Failed to allocate memory for key_material");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -504,28 +718,35 @@ static keymaster_error_t TA_importKey(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("Failed to import key");
 		goto out;
 	}
-	TA_serialize_param_set(key_material + key_buffer_size, &params_t);
+	TA_stats_mark(KM_PHASE_CRYPTO);
+	TA_serialize_param_set_v1(key_material + key_buffer_size, &params_t);
 	res = TA_encrypt(key_material, key_blob.key_material_size);
 	if (res != KM_ERROR_OK) {
 		EMSG("Failed to encrypt blob");
 		goto out;
 	}
 	key_blob.key_material = key_material;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 
 	out += TA_serialize_key_blob(out, &key_blob);
 	out += TA_serialize_characteristics(out, &characts);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
 	if ((key_data.data && key_format != KM_KEY_FORMAT_RAW) ||
 		(key_data.data && key_format == KM_KEY_FORMAT_RAW && res != KM_ERROR_OK)) {
-		TEE_Free(key_data.data);
+		TA_free(key_data.data);
 	}
 free_attrs:
-	free_attrs(attrs_in, attrs_in_count);
+	if (key_format == KM_KEY_FORMAT_PKCS8)
+		/* Decoded attributes refer to key_data */
+		TA_free(attrs_in);
+	else
+		free_attrs(attrs_in, attrs_in_count);
 	TA_free_params(&params_t);
 	TA_free_params(&characts.sw_enforced);
 	TA_free_params(&characts.hw_enforced);
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 
 	return res;
 }
@@ -565,6 +786,7 @@ static keymaster_error_t TA_exportKey(TEE_Param params[TEE_NUM_PARAMS])
 	in += TA_deserialize_blob(in, in_end, &app_data, true, &res, false);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	//Keymaster supports export of public keys only in X.509 format
 	if (export_format != KM_KEY_FORMAT_X509) {
@@ -572,17 +794,18 @@ static keymaster_error_t TA_exportKey(TEE_Param params[TEE_NUM_PARAMS])
 		res = KM_ERROR_UNSUPPORTED_KEY_FORMAT;
 		goto out;
 	}
-	key_material = TEE_Malloc(key_to_export.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_to_export.key_material_size,
+						KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Failed to allocate memory for key material");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		goto out;
 	}
 	res = TA_restore_key(key_material, &key_to_export, &key_size, &type,
-						 &obj_h, &params_t);
+						 &obj_h, true, &params_t);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 	res = TA_check_permission(&params_t, client_id, app_data, &exportable);
 	if (res != KM_ERROR_OK)
 		goto out;
@@ -592,23 +815,26 @@ static keymaster_error_t TA_exportKey(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("This key type is not exportable");
 		goto out;
 	}
-	res = TA_encode_key(sessionSTA, &export_data, type, &obj_h, key_size);
+	TA_stats_mark(KM_PHASE_CHECK);
+	res = TA_der_encode_spki(obj_h, type, key_size, &export_data);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_CRYPTO);
 	out += TA_serialize_blob(out, &export_data);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
 	if (obj_h != TEE_HANDLE_NULL)
 		TEE_FreeTransientObject(obj_h);
 	if (client_id.data)
-		TEE_Free(client_id.data);
+		TA_free(client_id.data);
 	if (app_data.data)
-		TEE_Free(app_data.data);
+		TA_free(app_data.data);
 	if (key_to_export.key_material)
-		TEE_Free(key_to_export.key_material);
+		TA_free(key_to_export.key_material);
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	if (export_data.data)
-		TEE_Free(export_data.data);
+		TA_free(export_data.data);
 	TA_free_params(&params_t);
 
 	return res;
@@ -642,20 +868,14 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 	uint32_t key_chr_size = 0;
 	uint8_t verified_boot_state = 0xff;
 
-#ifdef ENUM_PERS_OBJS
-	TA_enum_attest_objs();
-#endif
-#ifdef WIPE_PERS_OBJS
-	TA_wipe_attest_objs();
-#endif
-
-	//This call creates keys/certs only once during first TA run
-	res = TA_create_attest_objs(sessionSTA);
+	//Keys/certs are created by KM_PROVISION, here they are only loaded
+	res = TA_load_attest_objs();
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to create attestation objects, res=%x", res);
-		res = KM_ERROR_UNKNOWN_ERROR;
+		EMSG("Attestation objects are not provisioned, res=%x", res);
+		res = KM_ERROR_KEYMASTER_NOT_CONFIGURED;
 		goto exit;
 	}
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 
 	in = (uint8_t *) params[0].memref.buffer;
 	in_end = in + params[0].memref.size;
@@ -674,8 +894,8 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 			goto exit;
 	}
 
-	key_material = TEE_Malloc(key_to_attest.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_to_attest.key_material_size,
+						KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Failed to allocate memory for key material");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -687,6 +907,7 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 	if (res != KM_ERROR_OK)
 		goto exit;
 	verified_boot_state = *in;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	for (size_t i = 0; i < attest_params.length; i++) {
 		switch (attest_params.params[i].tag) {
@@ -731,12 +952,14 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 		goto exit;
 	}
 
+	TA_stats_mark(KM_PHASE_CHECK);
 	//Restore key
 	res = TA_restore_key(key_material, &key_to_attest,
 						&key_size, &key_type,
-						&attestedKey, &params_t);
+						&attestedKey, false, &params_t);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 
 	if (app_id != NULL && app_data != NULL) {//TODO
 		res = TA_check_permission(&params_t, *app_id, *app_data, &exportable);
@@ -755,6 +978,7 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 	res = TA_fill_characteristics(&key_chr, &params_t, &key_chr_size);
 	if (res != KM_ERROR_OK)
 		goto exit;
+	TA_stats_mark(KM_PHASE_CHECK);
 
 	if (includeUniqueID == true) {//TODO
 		//TA_generate_UniqueID(...);
@@ -762,9 +986,9 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 
 	//Allocate memory for chain of certificates
 	//NOTE: current impl support only 2 certificates in chain
-	cert_chain.entries = TEE_Malloc(
+	cert_chain.entries = TA_malloc(
 			sizeof(keymaster_blob_t)*ATT_CERT_CHAIN_LEN,
-			TEE_MALLOC_FILL_ZERO);
+			KM_HEAP_ATTESTATION);
 	if (!cert_chain.entries) {
 		EMSG("Failed to allocate memory for chain of certificates");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -772,8 +996,8 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 	}
 	cert_chain.entry_count = ATT_CERT_CHAIN_LEN;
 
-	//Generate key attestation certificate (using STA ASN.1)
-	res = TA_gen_key_attest_cert(sessionSTA, key_type, attestedKey,
+	//Generate key attestation certificate from template
+	res = TA_gen_key_attest_cert(key_type, attestedKey, key_size,
 				     &attest_params, &key_chr, &cert_chain,
 				     verified_boot_state);
 	if (res != TEE_SUCCESS) {
@@ -786,6 +1010,7 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("Failed to read root att cert, res=%x", res);
 		goto exit;
 	}
+	TA_stats_mark(KM_PHASE_CRYPTO);
 	//Check output buffer length
 	if (TA_cert_chain_size(&cert_chain) > out_size) {
 		EMSG("Short output buffer for chain of certificates");
@@ -798,16 +1023,17 @@ static keymaster_error_t TA_attestKey(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("Failed to serialize output chain of certificates, res=%x", res);
 		goto exit;
 	}
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 
 exit:
 	if (key_to_attest.key_material)
-		TEE_Free(key_to_attest.key_material);
+		TA_free(key_to_attest.key_material);
 
 	if (attestedKey != TEE_HANDLE_NULL)
 		TEE_FreeTransientObject(attestedKey);
 
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 
 	TA_free_params(&attest_params);
 	TA_free_params(&key_chr.sw_enforced);
@@ -839,14 +1065,16 @@ static keymaster_error_t TA_upgradeKey(TEE_Param params[TEE_NUM_PARAMS])
 	if (res != KM_ERROR_OK)
 		goto out;
 	TA_add_origin(&upgr_params, KM_ORIGIN_UNKNOWN, false);
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	/* TODO Upgrade Key */
 
 	out += TA_serialize_key_blob(out, &upgraded_key);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
 	TA_free_params(&upgr_params);
 	if (key_to_upgrade.key_material)
-		TEE_Free(key_to_upgrade.key_material);
+		TA_free(key_to_upgrade.key_material);
 	return res;
 }
 
@@ -898,6 +1126,8 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 	keymaster_error_t res = KM_ERROR_OK;
 	keymaster_algorithm_t algorithm = UNDEFINED;
 	keymaster_blob_t nonce = EMPTY_BLOB;
+	keymaster_blob_t modulus = EMPTY_BLOB;
+	uint32_t modulus_size = 0;
 	keymaster_digest_t digest = UNDEFINED;
 	keymaster_block_mode_t mode = UNDEFINED;
 	keymaster_padding_t padding = UNDEFINED;
@@ -910,16 +1140,16 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 	out = (uint8_t *) params[1].memref.buffer;
 
 	/* Freed when operation is aborted (TA_abort_operation) */
-	operation = TEE_Malloc(sizeof(TEE_OperationHandle),
-					TEE_MALLOC_FILL_ZERO);
+	operation = TA_malloc(sizeof(TEE_OperationHandle),
+					KM_HEAP_OPERATION);
 	if (!operation) {
 		EMSG("Failed to allocate memory for operation");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		goto out;
 	}
 	/* Freed when operation is aborted (TA_abort_operation) */
-	digest_op = TEE_Malloc(sizeof(TEE_OperationHandle),
-					TEE_MALLOC_FILL_ZERO);
+	digest_op = TA_malloc(sizeof(TEE_OperationHandle),
+					KM_HEAP_OPERATION);
 	if (!digest_op) {
 		EMSG("Failed to allocate memory for digest operation");
 		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -937,11 +1167,13 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 	in += TA_deserialize_param_set(in, in_end, &in_params, true, &res);
 	if (res != KM_ERROR_OK)
 		goto out;
-	key_material = TEE_Malloc(key.key_material_size, TEE_MALLOC_FILL_ZERO);
-	res = TA_restore_key(key_material, &key, &key_size,
-						 &type, &obj_h, &params_t);
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
+	key_material = TA_malloc(key.key_material_size, KM_HEAP_BLOB);
+	res = TA_restore_key(key_material, &key, &key_size, &type, &obj_h,
+				TA_is_public_purpose(purpose), &params_t);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 	switch (type) {
 	case TEE_TYPE_AES:
 		algorithm = KM_ALGORITHM_AES;
@@ -961,6 +1193,7 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 				&min_sec, &do_auth);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_CHECK);
 	if (algorithm == KM_ALGORITHM_AES && mode !=
 		    KM_MODE_ECB && nonce.data_length == 0) {
 		if (mode == KM_MODE_CBC || mode == KM_MODE_CTR) {
@@ -969,13 +1202,13 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 			IVsize = 12;
 		}
 		out_params.length = 1;
-		secretIV = TEE_Malloc(IVsize, TEE_MALLOC_FILL_ZERO);
+		secretIV = TA_malloc(IVsize, KM_HEAP_PARAMS);
 		if (!secretIV) {
 			EMSG("Failed to allocate memory for secretIV");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
 			goto out;
 		}
-		nonce_param = TEE_Malloc(sizeof(keymaster_key_param_t), TEE_MALLOC_FILL_ZERO);
+		nonce_param = TA_malloc(sizeof(keymaster_key_param_t), KM_HEAP_PARAMS);
 		if (!nonce_param) {
 			EMSG("Failed to allocate memory for parameters");
 			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -995,6 +1228,25 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 				digest, mode, padding, mac_length);
 	if (res != KM_ERROR_OK)
 		goto out;
+	if (algorithm == KM_ALGORITHM_RSA && padding == KM_PAD_NONE &&
+			(purpose == KM_PURPOSE_SIGN ||
+			purpose == KM_PURPOSE_ENCRYPT)) {
+		/* Unpadded input is checked against modulus on each call */
+		modulus_size = (key_size + 7) / 8;
+		modulus.data = TA_malloc(modulus_size, KM_HEAP_CRYPTO);
+		if (!modulus.data) {
+			EMSG("Failed to allocate memory for RSA modulus");
+			res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+			goto out;
+		}
+		res = TEE_GetObjectBufferAttribute(obj_h, TEE_ATTR_RSA_MODULUS,
+						modulus.data, &modulus_size);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to read RSA modulus, res=%x", res);
+			goto out;
+		}
+		modulus.data_length = modulus_size;
+	}
 
 	TEE_GenerateRandom(&operation_handle, sizeof(operation_handle));
 	if (purpose == KM_PURPOSE_SIGN || purpose == KM_PURPOSE_VERIFY ||
@@ -1006,26 +1258,31 @@ static keymaster_error_t TA_begin(TEE_Param params[TEE_NUM_PARAMS])
 	}
 	res = TA_start_operation(operation_handle, key, min_sec,
 					operation, purpose, digest_op, do_auth,
-					padding, mode, mac_length, digest, nonce);
+					padding, mode, mac_length, digest, nonce,
+					modulus);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_CRYPTO);
 	out += TA_serialize_param_set(out, &out_params);
 	TEE_MemMove(out, &operation_handle, sizeof(operation_handle));
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
 	if (obj_h != TEE_HANDLE_NULL)
 		TEE_FreeTransientObject(obj_h);
 	if (key.key_material)
-		TEE_Free(key.key_material);
+		TA_free(key.key_material);
 	if (res != KM_ERROR_OK) {
 		if (*digest_op != TEE_HANDLE_NULL)
 			TEE_FreeOperation(*digest_op);
 		if (*operation != TEE_HANDLE_NULL)
 			TEE_FreeOperation(*operation);
-		TEE_Free(operation);
-		TEE_Free(digest_op);
+		TA_free(operation);
+		TA_free(digest_op);
+		if (modulus.data)
+			TA_free(modulus.data);
 	}
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	TA_free_params(&in_params);
 	TA_free_params(&params_t);
 	TA_free_params(&out_params);
@@ -1038,6 +1295,8 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 	uint8_t *in = NULL;
 	uint8_t *in_end = NULL;
 	uint8_t *out = NULL;
+	uint8_t *out_end = NULL;
+	uint8_t *consumed_field = NULL;
 	keymaster_operation_handle_t operation_handle = 0;		/* IN */
 	keymaster_key_param_set_t in_params = EMPTY_PARAM_SET;	/* IN */
 	keymaster_blob_t input = EMPTY_BLOB;	/* IN */
@@ -1048,16 +1307,18 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 	uint32_t key_size = 0;
 	uint32_t type = 0;
 	uint32_t out_size = 0;
+	uint32_t tag_len = 0;
+	uint32_t max_input = 0;
 	uint32_t input_provided = 0;
 	keymaster_error_t res = KM_ERROR_OK;
 	keymaster_key_param_set_t params_t = EMPTY_PARAM_SET;
 	keymaster_operation_t operation = EMPTY_OPERATION;
-	TEE_ObjectHandle obj_h = TEE_HANDLE_NULL;
-	bool is_input_ext = false;
+	keymaster_out_sink_t sink = EMPTY_OUT_SINK;
 
 	in = (uint8_t *) params[0].memref.buffer;
 	in_end = in + params[0].memref.size;
 	out = (uint8_t *) params[1].memref.buffer;
+	out_end = out + params[1].memref.size;
 
 	in += TA_deserialize_op_handle(in, in_end, &operation_handle, &res);
 	if (res != KM_ERROR_OK)
@@ -1068,6 +1329,7 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 	in += TA_deserialize_blob(in, in_end, &input, false, &res, true);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	input_provided = input.data_length;
 	res = TA_get_operation(operation_handle, &operation);
@@ -1078,12 +1340,13 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 		goto out;
 	}
 
-	key_material = TEE_Malloc(operation.key->key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(operation.key->key_material_size,
+						KM_HEAP_BLOB);
 	res = TA_restore_key(key_material, operation.key, &key_size,
-						 &type, &obj_h, &params_t);
+						 &type, NULL, false, &params_t);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 	if (operation.do_auth) {
 		res = TA_do_auth(in_params, params_t);
 		if (res != KM_ERROR_OK) {
@@ -1091,26 +1354,43 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 			goto out;
 		}
 	}
+	TA_stats_mark(KM_PHASE_CHECK);
 
 	if (input.data_length != 0 && type == TEE_TYPE_RSA_KEYPAIR)
 		operation.got_input = true;
-	out_size = TA_possibe_size(type, key_size, input, 0);
-	output.data = TEE_Malloc(out_size, TEE_MALLOC_FILL_ZERO);
-	if (!output.data) {
-		EMSG("Failed to allocate memory for output");
-		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	if (type == TEE_TYPE_AES && operation.mode == KM_MODE_GCM)
+		tag_len = operation.mac_length / 8;/* from bits to bytes */
+	if (type == TEE_TYPE_AES)
+		max_input = TA_aes_max_input(params[1].memref.size, tag_len);
+	if (type == TEE_TYPE_AES && input.data_length > max_input) {
+		/* The rest is reported as not consumed */
+		input.data_length = max_input;
+		input_provided = input.data_length;
+		DMSG("Input is limited to %u bytes", input_provided);
+	}
+	out_size = TA_possibe_size(type, key_size, input, tag_len);
+
+	/* input_consumed is known after processing, reserve its field */
+	if (IS_OUT_OF_BOUNDS(out, out_end, TA_size_width(input_provided))) {
+		EMSG("Out of output array bounds on serialization");
+		res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
 		goto out;
 	}
+	consumed_field = out;
+	out += TA_serialize_size_padded(out, 0, input_provided);
+	res = TA_sink_open(&sink, out, out_end, out_size, &output);
+	if (res != KM_ERROR_OK)
+		goto out;
 	switch (type) {
 	case TEE_TYPE_AES:
 		res = TA_aes_update(&operation, &input, &output, &out_size,
 					input_provided, &input_consumed,
-					&in_params, &is_input_ext);
+					&in_params);
 		break;
 	case TEE_TYPE_RSA_KEYPAIR:
 		res = TA_rsa_update(&operation, &input, &output, &out_size,
 					key_size, &input_consumed,
-					input_provided, obj_h);
+					input_provided);
 		break;
 	case TEE_TYPE_ECDSA_KEYPAIR:
 		res = TA_ec_update(&operation, &input, &output,
@@ -1125,21 +1405,20 @@ static keymaster_error_t TA_update(TEE_Param params[TEE_NUM_PARAMS])
 		EMSG("Update operation failed with error code %x", res);
 		goto out;
 	}
+	TA_stats_mark(KM_PHASE_CRYPTO);
 
-	TEE_MemMove(out, &input_consumed, sizeof(input_consumed));
-	out += SIZE_LENGTH;
-	out += TA_serialize_blob(out, &output);
+	TA_serialize_size_padded(consumed_field, input_consumed,
+							input_provided);
+	res = TA_sink_commit(&sink, &out, out_end, &output);
+	if (res != KM_ERROR_OK)
+		goto out;
 	out += TA_serialize_param_set(out, &out_params);
 	TA_update_operation(operation_handle, &operation);
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
-	if (input.data && is_input_ext)
-		TEE_Free(input.data);
-	if (output.data)
-		TEE_Free(output.data);
-	if (obj_h != TEE_HANDLE_NULL)
-		TEE_FreeTransientObject(obj_h);
+	TA_sink_close(&sink, &output, res);
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	if (res != KM_ERROR_OK)
 		TA_abort_operation(operation_handle);
 	TA_free_params(&params_t);
@@ -1155,6 +1434,7 @@ static keymaster_error_t TA_finish(TEE_Param params[TEE_NUM_PARAMS])
 	uint8_t *in = NULL;
 	uint8_t *in_end = NULL;
 	uint8_t *out = NULL;
+	uint8_t *out_end = NULL;
 	keymaster_operation_handle_t operation_handle = 0;		/* IN */
 	keymaster_key_param_set_t in_params = EMPTY_PARAM_SET;	/* IN */
 	keymaster_blob_t input = EMPTY_BLOB;		/* IN */
@@ -1169,12 +1449,13 @@ static keymaster_error_t TA_finish(TEE_Param params[TEE_NUM_PARAMS])
 	keymaster_error_t res = KM_ERROR_OK;
 	keymaster_key_param_set_t params_t = EMPTY_PARAM_SET;
 	keymaster_operation_t operation = EMPTY_OPERATION;
-	TEE_ObjectHandle obj_h = TEE_HANDLE_NULL;
+	keymaster_out_sink_t sink = EMPTY_OUT_SINK;
 	bool is_input_ext = false;
 
 	in = (uint8_t *) params[0].memref.buffer;
 	in_end = in + params[0].memref.size;
 	out = (uint8_t *) params[1].memref.buffer;
+	out_end = out + params[1].memref.size;
 
 	in += TA_deserialize_op_handle(in, in_end, &operation_handle, &res);
 	if (res != KM_ERROR_OK)
@@ -1188,16 +1469,18 @@ static keymaster_error_t TA_finish(TEE_Param params[TEE_NUM_PARAMS])
 	in += TA_deserialize_blob(in, in_end, &signature, true, &res, false);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 
 	res = TA_get_operation(operation_handle, &operation);
 	if (res != KM_ERROR_OK)
 		goto out;
-	key_material = TEE_Malloc(operation.key->key_material_size,
-					TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(operation.key->key_material_size,
+					KM_HEAP_BLOB);
 	res = TA_restore_key(key_material, operation.key, &key_size, &type,
-						 &obj_h, &params_t);
+						 NULL, false, &params_t);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_KEY_BLOB);
 	if (operation.do_auth) {
 		res = TA_do_auth(in_params, params_t);
 		if (res != KM_ERROR_OK) {
@@ -1205,29 +1488,29 @@ static keymaster_error_t TA_finish(TEE_Param params[TEE_NUM_PARAMS])
 			goto out;
 		}
 	}
+	TA_stats_mark(KM_PHASE_CHECK);
 	if (type == TEE_TYPE_AES && operation.mode == KM_MODE_GCM)
 		tag_len = operation.mac_length / 8;/* from bits to bytes */
 
 	out_size = TA_possibe_size(type, key_size, input, tag_len);
-	output.data = TEE_Malloc(out_size, TEE_MALLOC_FILL_ZERO);
-	if (!output.data) {
-		EMSG("Failed to allocate memory for output");
-		res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
+
+	/* out_params go first, so output can be written to its place */
+	out += TA_serialize_param_set(out, &out_params);
+	res = TA_sink_open(&sink, out, out_end, out_size, &output);
+	if (res != KM_ERROR_OK)
 		goto out;
-	}
 	switch (type) {
 	case TEE_TYPE_AES:
 		res = TA_aes_finish(&operation, &input, &output, &out_size,
-					tag_len, &is_input_ext, &in_params);
+					tag_len, &in_params);
 		break;
 	case TEE_TYPE_RSA_KEYPAIR:
 		res = TA_rsa_finish(&operation, &input, &output, &out_size,
-				key_size, signature, obj_h, &is_input_ext);
+				key_size, signature, &is_input_ext);
 		break;
 	case TEE_TYPE_ECDSA_KEYPAIR:
 		res = TA_ec_finish(&operation, &input, &output, &signature,
-					&out_size, key_size,
-					&sessionSTA, &is_input_ext);
+					&out_size, key_size, &is_input_ext);
 		break;
 	default: /* HMAC */
 		if (operation.purpose == KM_PURPOSE_SIGN) {
@@ -1255,26 +1538,26 @@ static keymaster_error_t TA_finish(TEE_Param params[TEE_NUM_PARAMS])
 				res = KM_ERROR_VERIFICATION_FAILED;
 		}
 	}
+	TA_stats_mark(KM_PHASE_CRYPTO);
 	if (res != TEE_SUCCESS) {
 		EMSG("Finish operation failed with error code %x", res);
 		goto out;
 	}
 	output.data_length = out_size;
 
-	out += TA_serialize_param_set(out, &out_params);
-	out += TA_serialize_blob(out, &output);
+	res = TA_sink_commit(&sink, &out, out_end, &output);
+	if (res != KM_ERROR_OK)
+		goto out;
+	TA_stats_mark(KM_PHASE_SERIALIZE);
 out:
 	TA_abort_operation(operation_handle);
 	if (input.data && is_input_ext)
-		TEE_Free(input.data);
-	if (output.data)
-		TEE_Free(output.data);
+		TA_free(input.data);
+	TA_sink_close(&sink, &output, res);
 	if (signature.data)
-		TEE_Free(signature.data);
-	if (obj_h != TEE_HANDLE_NULL)
-		TEE_FreeTransientObject(obj_h);
+		TA_free(signature.data);
 	if (key_material)
-		TEE_Free(key_material);
+		TA_free(key_material);
 	TA_free_params(&params_t);
 	TA_free_params(&in_params);
 	TA_free_params(&out_params);
@@ -1295,27 +1578,20 @@ static keymaster_error_t TA_abort(TEE_Param params[TEE_NUM_PARAMS])
 	in += TA_deserialize_op_handle(in, in_end, &operation_handle, &res);
 	if (res != KM_ERROR_OK)
 		goto out;
+	TA_stats_mark(KM_PHASE_DESERIALIZE);
 	res = TA_abort_operation(operation_handle);
 out:
 	return res;
 }
 
-TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx __unused,
-			uint32_t cmd_id, uint32_t param_types,
-			TEE_Param params[TEE_NUM_PARAMS])
+static TEE_Result TA_dispatch(uint32_t cmd_id,
+			TEE_Param params[TEE_NUM_PARAMS],
+			keymaster_session_t *session)
 {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(
-			TEE_PARAM_TYPE_MEMREF_INPUT,
-			TEE_PARAM_TYPE_MEMREF_OUTPUT,
-			TEE_PARAM_TYPE_NONE,
-			TEE_PARAM_TYPE_NONE);
-	if (param_types != exp_param_types) {
-		EMSG("Keystore TA wrong parameters");
-		return KM_ERROR_SECURE_HW_COMMUNICATION_FAILED;
-	}
-
 	switch(cmd_id) {
 	//Keymaster commands:
+	case KM_GET_VERSION:
+		return TA_getVersion(params, session);
 	case KM_ADD_RNG_ENTROPY:
 		return TA_addRngEntropy(params);
 	case KM_GENERATE_KEY:
@@ -1344,6 +1620,16 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx __unused,
 		return TA_finish(params);
 	case KM_ABORT:
 		return TA_abort(params);
+	case KM_REFILL_KEY_POOL:
+		return TA_refillKeyPool(params);
+	case KM_PROVISION:
+		return TA_provision(params);
+	case KM_GET_STATS:
+		return TA_getStats(params);
+	case KM_GET_HEAP_STATS:
+		return TA_getHeapStats(params);
+	case KM_GET_TRACE:
+		return TA_getTrace(params);
 
 	//Gatekeeper commands:
 	case KM_GET_AUTHTOKEN_KEY:
@@ -1353,3 +1639,39 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx __unused,
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 }
+
+TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx,
+			uint32_t cmd_id, uint32_t param_types,
+			TEE_Param params[TEE_NUM_PARAMS])
+{
+	keymaster_session_t *session = (keymaster_session_t *)sess_ctx;
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t exp_param_types = TEE_PARAM_TYPES(
+			TEE_PARAM_TYPE_MEMREF_INPUT,
+			TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			TEE_PARAM_TYPE_NONE,
+			TEE_PARAM_TYPE_NONE);
+	/* Tagged by the HAL for tracing, see KM_CAP_TRACE */
+	uint32_t traced_param_types = TEE_PARAM_TYPES(
+			TEE_PARAM_TYPE_MEMREF_INPUT,
+			TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			TEE_PARAM_TYPE_VALUE_INPUT,
+			TEE_PARAM_TYPE_NONE);
+	if (param_types != exp_param_types &&
+			param_types != traced_param_types) {
+		EMSG("Keystore TA wrong parameters");
+		return KM_ERROR_SECURE_HW_COMMUNICATION_FAILED;
+	}
+	TA_set_wire_version(session->wire_version);
+
+	TA_command_begin(cmd_id);
+	TA_stats_begin();
+	if (param_types == traced_param_types)
+		TA_stats_trace(params[2].value.a, params[2].value.b);
+	TA_heap_begin();
+	res = TA_dispatch(cmd_id, params, session);
+	TA_heap_end();
+	TA_stats_end(res);
+	TA_command_end();
+	return res;
+}
@@ -16,6 +16,7 @@
  */
 
 #include "master_crypto.h"
+#include "heap.h"
 
 //Master key for encryption/decryption of all CA's keys,
 //and also used as HBK during attestation
@@ -98,7 +99,7 @@ TEE_Result TA_execute(uint8_t *data, const size_t size, const uint32_t mode)
 		return res;
 	}
 
-	outbuf = TEE_Malloc(size, TEE_MALLOC_FILL_ZERO);
+	outbuf = TA_malloc(size, KM_HEAP_BLOB);
 	outptr = outbuf;
 	if (!outbuf) {
 		EMSG("failed to allocate memory for out buffer");
@@ -166,7 +167,7 @@ exit:
 	if (op != TEE_HANDLE_NULL)
 		TEE_FreeOperation(op);
 	if (outbuf)
-		TEE_Free(outbuf);
+		TA_free(outbuf);
 	return res;
 }
 
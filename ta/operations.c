@@ -17,8 +17,21 @@
 
 #include "operations.h"
 #include "parameters.h"
+#include "heap.h"
 
 static keymaster_operation_t operations[KM_MAX_OPERATION];
+static km_stats_table_t operations_stats = {.capacity = KM_MAX_OPERATION};
+
+static uint32_t TA_count_operations(void)
+{
+	uint32_t used = 0;
+
+	for (uint32_t i = 0; i < KM_MAX_OPERATION; i++) {
+		if (operations[i].op_handle != UNDEFINED)
+			used++;
+	}
+	return used;
+}
 
 void TA_free_blob_list(keymaster_blob_list_item_t *item)
 {
@@ -26,10 +39,10 @@ void TA_free_blob_list(keymaster_blob_list_item_t *item)
 
 	while (item != NULL) {
 		if (item->data.data)
-			TEE_Free(item->data.data);
+			TA_free(item->data.data);
 		prev = item;
 		item = item->next;
-		TEE_Free(prev);
+		TA_free(prev);
 	}
 }
 
@@ -48,22 +61,22 @@ keymaster_error_t TA_abort_operation(
 			operations[i].op_handle = UNDEFINED;
 			if (operations[i].key != NULL) {
 				if (operations[i].key->key_material)
-					TEE_Free(operations[i].key->
+					TA_free(operations[i].key->
 							key_material);
-				TEE_Free(operations[i].key);
+				TA_free(operations[i].key);
 			}
 			operations[i].key = NULL;
 			operations[i].last_access = NULL;
 			operations[i].min_sec = UNDEFINED;
 			if (*operations[i].operation != TEE_HANDLE_NULL)
 				TEE_FreeOperation(*operations[i].operation);
-			TEE_Free(operations[i].operation);
+			TA_free(operations[i].operation);
 			operations[i].operation = TEE_HANDLE_NULL;
 			operations[i].purpose = UNDEFINED;
 			operations[i].do_auth = false;
 			if (*operations[i].digest_op != TEE_HANDLE_NULL)
 				TEE_FreeOperation(*operations[i].digest_op);
-			TEE_Free(operations[i].digest_op);
+			TA_free(operations[i].digest_op);
 			operations[i].padding = UNDEFINED;
 			operations[i].mode = UNDEFINED;
 			operations[i].got_input = false;
@@ -72,22 +85,19 @@ keymaster_error_t TA_abort_operation(
 			operations[i].sf_item = NULL;
 			operations[i].mac_length = UNDEFINED;
 			operations[i].digestLength = UNDEFINED;
-			if (operations[i].a_data)
-				TEE_Free(operations[i].a_data);
-			operations[i].a_data = NULL;
-			operations[i].a_data_length = 0;
-			operations[i].buffering = false;
-			operations[i].prev_in_size = UNDEFINED;
 			if (operations[i].nonce.data)
-				TEE_Free(operations[i].nonce.data);
+				TA_free(operations[i].nonce.data);
 			operations[i].nonce.data = NULL;
 			operations[i].nonce.data_length = 0;
-			operations[i].padded = false;
-			operations[i].first = true;
-			if (operations[i].last_block.data)
-				TEE_Free(operations[i].last_block.data);
-			operations[i].last_block.data = NULL;
-			operations[i].last_block.data_length = 0;
+			if (operations[i].modulus.data)
+				TA_free(operations[i].modulus.data);
+			operations[i].modulus.data = NULL;
+			operations[i].modulus.data_length = 0;
+			TEE_MemFill(operations[i].carry, 0, BLOCK_SIZE);
+			operations[i].carry_length = 0;
+			TEE_MemFill(operations[i].tag_ring, 0, BLOCK_SIZE);
+			operations[i].tag_start = 0;
+			operations[i].tag_length = 0;
 			break;
 		}
 	}
@@ -111,22 +121,32 @@ void TA_reset_operations_table(void)
 		operations[i].sf_item = NULL;
 		operations[i].mac_length = UNDEFINED;
 		operations[i].digestLength = UNDEFINED;
-		operations[i].a_data = NULL;
-		operations[i].a_data_length = 0;
-		operations[i].buffering = false;
-		operations[i].prev_in_size = UNDEFINED;
 		operations[i].nonce.data = NULL;
 		operations[i].nonce.data_length = 0;
-		operations[i].last_block.data = NULL;
-		operations[i].last_block.data_length = 0;
-		operations[i].first = true;
-		operations[i].padded = false;
+		operations[i].modulus.data = NULL;
+		operations[i].modulus.data_length = 0;
+		operations[i].carry_length = 0;
+		operations[i].tag_start = 0;
+		operations[i].tag_length = 0;
 	}
 }
 
+void TA_get_operations_stats(km_stats_table_t *stats, const bool reset)
+{
+	operations_stats.used = TA_count_operations();
+	*stats = operations_stats;
+	if (!reset)
+		return;
+	operations_stats.peak = operations_stats.used;
+	operations_stats.inserts = 0;
+	operations_stats.full = 0;
+	operations_stats.evictions = 0;
+}
+
 keymaster_error_t TA_kill_old_operation(void)
 {
 	keymaster_operation_t oldest;
+	keymaster_error_t res = KM_ERROR_OK;
 
 	oldest = operations[0];
 	for (uint32_t i = 1; i < KM_MAX_OPERATION; i++) {
@@ -139,7 +159,10 @@ keymaster_error_t TA_kill_old_operation(void)
 			oldest = operations[i];
 		}
 	}
-	return TA_abort_operation(oldest.op_handle);
+	res = TA_abort_operation(oldest.op_handle);
+	if (res == KM_ERROR_OK)
+		operations_stats.evictions++;
+	return res;
 }
 
 keymaster_error_t TA_try_start_operation(
@@ -154,18 +177,20 @@ keymaster_error_t TA_try_start_operation(
 				const keymaster_block_mode_t mode,
 				const uint32_t mac_length,
 				const keymaster_digest_t digest,
-				const keymaster_blob_t nonce)
+				const keymaster_blob_t nonce,
+				const keymaster_blob_t modulus)
 {
 	TEE_Time cur_t;
+	uint32_t used = 0;
 
 	for (uint32_t i = 0; i < KM_MAX_OPERATION; i++) {
 		if (operations[i].op_handle == UNDEFINED) {
 			TEE_GetSystemTime(&cur_t);
 			operations[i].op_handle = op_handle;
 			/* freed when operation aborted (TA_abort_operation) */
-			operations[i].key = TEE_Malloc(
+			operations[i].key = TA_malloc(
 					sizeof(keymaster_key_blob_t),
-					TEE_MALLOC_FILL_ZERO);
+					KM_HEAP_OPERATION);
 			if (!operations[i].key) {
 				EMSG("Failed to allocate memory for operation key struct");
 				return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -173,9 +198,9 @@ keymaster_error_t TA_try_start_operation(
 			operations[i].key->key_material_size =
 							key.key_material_size;
 			/* freed when operation aborted (TA_abort_operation) */
-			operations[i].key->key_material = TEE_Malloc(
+			operations[i].key->key_material = TA_malloc(
 						key.key_material_size,
-						TEE_MALLOC_FILL_ZERO);
+						KM_HEAP_OPERATION);
 			if (!operations[i].key->key_material) {
 				EMSG("Failed to allocate memory for operation key data");
 				return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -193,9 +218,9 @@ keymaster_error_t TA_try_start_operation(
 			operations[i].padding = padding;
 			operations[i].mode = mode;
 			operations[i].digestLength = get_digest_size(&digest) / 8; /*in bytes*/
-			operations[i].nonce.data = TEE_Malloc(
+			operations[i].nonce.data = TA_malloc(
 						nonce.data_length,
-						TEE_MALLOC_FILL_ZERO);
+						KM_HEAP_OPERATION);
 			if (!operations[i].nonce.data) {
 				EMSG("Failed to allocate memory for nonce");
 				return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -203,9 +228,16 @@ keymaster_error_t TA_try_start_operation(
 			TEE_MemMove(operations[i].nonce.data,
 					nonce.data, nonce.data_length);
 			operations[i].nonce.data_length = nonce.data_length;
+			/* freed when operation aborted (TA_abort_operation) */
+			operations[i].modulus = modulus;
+			operations_stats.inserts++;
+			used = TA_count_operations();
+			if (used > operations_stats.peak)
+				operations_stats.peak = used;
 			return KM_ERROR_OK;
 		}
 	}
+	operations_stats.full++;
 	return KM_ERROR_TOO_MANY_OPERATIONS;
 }
 
@@ -220,13 +252,15 @@ keymaster_error_t TA_start_operation(
 				const keymaster_block_mode_t mode,
 				const uint32_t mac_length,
 				const keymaster_digest_t digest,
-				const keymaster_blob_t nonce)
+				const keymaster_blob_t nonce,
+				const keymaster_blob_t modulus)
 {
 	keymaster_error_t res = TA_try_start_operation(op_handle, key, min_sec,
 							operation, purpose,
 							digest_op, do_auth,
 							padding, mode,
-							mac_length, digest, nonce);
+							mac_length, digest, nonce,
+							modulus);
 	if (res != KM_ERROR_OK) {
 		res = TA_kill_old_operation();
 		if (res == KM_ERROR_OK) {
@@ -234,7 +268,8 @@ keymaster_error_t TA_start_operation(
 							operation, purpose,
 							digest_op, do_auth,
 							padding, mode,
-							mac_length, digest, nonce);
+							mac_length, digest, nonce,
+							modulus);
 		}
 	}
 	return res;
@@ -278,8 +313,8 @@ keymaster_error_t TA_store_sf_data(const keymaster_blob_t *input,
 	keymaster_blob_list_item_t *new;
 	keymaster_blob_list_item_t *current = operation->sf_item;
 	/* freed when operation is aborted (TA_abort_operation) */
-	new = TEE_Malloc(sizeof(keymaster_blob_list_item_t),
-					TEE_MALLOC_FILL_ZERO);
+	new = TA_malloc(sizeof(keymaster_blob_list_item_t),
+					KM_HEAP_OPERATION);
 	if (!new) {
 		EMSG("Failed to allocate memory for buffered sign/veify data struct");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -287,8 +322,8 @@ keymaster_error_t TA_store_sf_data(const keymaster_blob_t *input,
 	new->next = NULL;
 	new->data.data_length = input->data_length;
 	/* freed when operation is aborted (TA_abort_operation) */
-	new->data.data = TEE_Malloc(new->data.data_length,
-						TEE_MALLOC_FILL_ZERO);
+	new->data.data = TA_malloc(new->data.data_length,
+						KM_HEAP_OPERATION);
 	if (!new->data.data) {
 		EMSG("Failed to allocate memory for buffered sign/veify data");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -323,7 +358,7 @@ keymaster_error_t TA_append_sf_data(keymaster_blob_t *input,
 			 * In this case input is stack variable and we need to
 			 * allocate memory for next operations.
 			 */
-			ptr = TEE_Malloc(input->data_length, TEE_MALLOC_FILL_ZERO);
+			ptr = TA_malloc(input->data_length, KM_HEAP_OPERATION);
 			if (!ptr) {
 				EMSG("Failed to allocate memory for input data buffer");
 				return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -340,7 +375,7 @@ keymaster_error_t TA_append_sf_data(keymaster_blob_t *input,
 		current = current->next;
 	}
 	/* Freed before input blob is destroyed */
-	ptr = TEE_Malloc(size + input->data_length, TEE_MALLOC_FILL_ZERO);
+	ptr = TA_malloc(size + input->data_length, KM_HEAP_OPERATION);
 	if (!ptr) {
 		EMSG("Failed to allocate memory on saved blocks append");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -355,7 +390,7 @@ keymaster_error_t TA_append_sf_data(keymaster_blob_t *input,
 	}
 	TEE_MemMove(ptr + padding, input->data, input->data_length);
 	if (*is_input_ext)
-		TEE_Free(input->data);
+		TA_free(input->data);
 	input->data = ptr;
 	input->data_length = size + input->data_length;
 	*is_input_ext = true;
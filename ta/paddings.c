@@ -16,6 +16,7 @@
  */
 
 #include "paddings.h"
+#include "heap.h"
 
 bool TA_check_pkcs7_pad(keymaster_blob_t *output)
 {
@@ -37,69 +38,10 @@ bool TA_check_pkcs7_pad(keymaster_blob_t *output)
 	return true;
 }
 
-keymaster_error_t TA_check_out_size(const uint32_t input_l,
-					keymaster_blob_t *output,
-					uint32_t *out_size,
-					uint32_t tag_len)
-{
-	uint8_t *ptr = NULL;
-
-	/* Recalculate output size */
-	if (*out_size != (((input_l + BLOCK_SIZE - 1) / BLOCK_SIZE + 1)
-						* BLOCK_SIZE + tag_len)) {
-		*out_size = ((input_l + BLOCK_SIZE - 1) / BLOCK_SIZE + 1)
-							* BLOCK_SIZE + tag_len;
-		ptr = TEE_Realloc(output->data, *out_size);
-		if (!ptr) {
-			EMSG("Failed reallocate memory for output");
-			return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-		}
-		output->data = ptr;
-	}
-	return KM_ERROR_OK;
-}
-
-keymaster_error_t TA_add_pkcs7_pad(keymaster_blob_t *input,
-				const bool force, keymaster_blob_t *output,
-				uint32_t *out_size, bool *is_input_ext)
-{
-	uint32_t pad = 0;
-	uint8_t *data = NULL;
-
-	if (input == NULL) {
-		EMSG("Input is NULL");
-		return KM_ERROR_UNEXPECTED_NULL_POINTER;
-	}
-	if (input->data_length == 0 && !force)
-		return KM_ERROR_OK;
-	pad = BLOCK_SIZE - (input->data_length % BLOCK_SIZE);
-	DMSG("PKCS7 ADD pad = %x", pad);
-	/* if input data size is a multiple of block size add
-	 * one extra block as padding
-	 */
-	if (pad == 0)
-		pad = BLOCK_SIZE;
-	/* Freed before input blob is destroyed by caller */
-	data = TEE_Malloc(pad + input->data_length, TEE_MALLOC_FILL_ZERO);
-	if (!data) {
-		EMSG("Failed to allocate memory for buffer on padding adding");
-		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
-	}
-	TEE_MemMove(data, input->data, input->data_length);
-	TEE_MemFill(data + input->data_length, pad, pad);
-	if (*is_input_ext)
-		TEE_Free(input->data);
-	input->data = data;
-	input->data_length = input->data_length + pad;
-	*is_input_ext = true;
-	return TA_check_out_size(input->data_length, output, out_size, 0);
-}
-
 keymaster_error_t TA_remove_pkcs7_pad(keymaster_blob_t *output,
 					uint32_t *out_size)
 {
 	uint32_t pad = 0;
-	uint8_t *data;
 
 	if (output == NULL) {
 		EMSG("Output is NULL");
@@ -107,19 +49,17 @@ keymaster_error_t TA_remove_pkcs7_pad(keymaster_blob_t *output,
 	}
 	if (output->data_length == 0)
 		return KM_ERROR_OK;
-	pad = output->data[output->data_length - 1];
-	DMSG("PKCS7 REMOVE pad = %x", pad);
 	if (!TA_check_pkcs7_pad(output)) {
 		EMSG("Failed to read PKCS7 padding");
 		return KM_ERROR_INVALID_ARGUMENT;
 	}
-	/* Freed before output blob is destroyed by caller */
-	data = TEE_Realloc(output->data, output->data_length - pad);
-	if (!data) {
-		EMSG("Failed to reallocate memory for unpudded out");
-		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	pad = output->data[output->data_length - 1];
+	DMSG("PKCS7 REMOVE pad = %x", pad);
+	/* Output can be in shared memory, validate the byte really used */
+	if (pad > BLOCK_SIZE || pad > output->data_length) {
+		EMSG("Failed to read PKCS7 padding");
+		return KM_ERROR_INVALID_ARGUMENT;
 	}
-	output->data = data;
 	output->data_length = output->data_length - pad;
 	*out_size = output->data_length;
 	return KM_ERROR_OK;
@@ -132,18 +72,34 @@ keymaster_error_t TA_do_rsa_pad(uint8_t **input, uint32_t *input_l,
 	uint32_t key_size_bytes = key_size / 8;
 
 	/* Freed before input blob is destroyed by caller */
-	buf = TEE_Malloc(key_size_bytes, TEE_MALLOC_FILL_ZERO);
+	buf = TA_malloc(key_size_bytes, KM_HEAP_CRYPTO);
 	if (!buf) {
 		EMSG("Failed to allocate memory for padded RSA input");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 	}
 	TEE_MemMove(buf + key_size_bytes - *input_l, *input, *input_l);
-	TEE_Free(*input);
+	TA_free(*input);
 	*input = buf;
 	*input_l = key_size_bytes;
 	return KM_ERROR_OK;
 }
 
+keymaster_error_t TA_do_rsa_pad_in_place(uint8_t *data, uint32_t *data_l,
+					const uint32_t key_size)
+{
+	uint32_t key_size_bytes = key_size / 8;
+
+	if (*data_l > key_size_bytes) {
+		EMSG("RSA result exceeds key size");
+		return KM_ERROR_UNKNOWN_ERROR;
+	}
+	/* data buffer is expected to hold key_size_bytes */
+	TEE_MemMove(data + key_size_bytes - *data_l, data, *data_l);
+	TEE_MemFill(data, 0, key_size_bytes - *data_l);
+	*data_l = key_size_bytes;
+	return KM_ERROR_OK;
+}
+
 /* Padding according PKCS#1 v1_5 (https://tools.ietf.org/html/rfc2437#section-9.2.1),
  * with modification from https://source.android.com/security/keystore/implementer-ref#begin
  * (when Digest::NONE and PaddingMode::RSA_PKCS1_1_5_SIGN) */
@@ -154,7 +110,7 @@ keymaster_error_t TA_do_rsa_pkcs_v1_5_rawpad(uint8_t **input, uint32_t *input_l,
 	uint32_t key_size_bytes = key_size / 8;
 
 	/* Freed before input blob is destroyed by caller */
-	buf = TEE_Malloc(key_size_bytes, TEE_MALLOC_FILL_ZERO);
+	buf = TA_malloc(key_size_bytes, KM_HEAP_CRYPTO);
 	if (!buf) {
 		EMSG("Failed to allocate memory for padded RSA input");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -166,7 +122,7 @@ keymaster_error_t TA_do_rsa_pkcs_v1_5_rawpad(uint8_t **input, uint32_t *input_l,
 	TEE_MemFill(buf + 2, 0xFF, key_size_bytes - 3 - *input_l);
 	buf[key_size_bytes - *input_l - 1] = 0;
 	TEE_MemMove(buf + key_size_bytes - *input_l, *input, *input_l);
-	TEE_Free(*input);
+	TA_free(*input);
 	*input = buf;
 	*input_l = key_size_bytes;
 	return KM_ERROR_OK;
@@ -16,6 +16,7 @@
  */
 
 #include "parameters.h"
+#include "heap.h"
 
 const size_t kMinGcmTagLength = 12 * 8;
 const size_t kMaxGcmTagLength = 16 * 8;
@@ -28,10 +29,10 @@ void TA_free_params(keymaster_key_param_set_t *params)
 		if (keymaster_tag_get_type(params->params[i].tag) == KM_BIGNUM
 				|| keymaster_tag_get_type(params->
 				params[i].tag) == KM_BYTES) {
-			TEE_Free(params->params[i].key_param.blob.data);
+			TA_free(params->params[i].key_param.blob.data);
 		}
 	}
-	TEE_Free(params->params);
+	TA_free(params->params);
 }
 
 void TA_free_cert_chain(keymaster_cert_chain_t *cert_chain)
@@ -42,9 +43,9 @@ void TA_free_cert_chain(keymaster_cert_chain_t *cert_chain)
 
 	for (size_t i = 0; i < cert_chain->entry_count; i++) {
 		if (cert_chain->entries[i].data)
-			TEE_Free(cert_chain->entries[i].data);
+			TA_free(cert_chain->entries[i].data);
 	}
-	TEE_Free(cert_chain->entries);
+	TA_free(cert_chain->entries);
 }
 
 void TA_add_to_params(keymaster_key_param_set_t *params,
@@ -270,20 +271,20 @@ keymaster_error_t TA_fill_characteristics(
 			uint32_t *size)
 {
 	/* Freed before characteristics is destoyed by caller */
-	characteristics->hw_enforced.params = TEE_Malloc(
+	characteristics->hw_enforced.params = TA_malloc(
 					MAX_ENFORCED_PARAMS_COUNT *
 					sizeof(keymaster_key_param_t),
-					TEE_MALLOC_FILL_ZERO);
+					KM_HEAP_PARAMS);
 	if (!characteristics->hw_enforced.params) {
 		EMSG("Failed to allocate memory for hw_enforced.params");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 	}
 	characteristics->hw_enforced.length = 0;
 	/* Freed before characteristics is destoyed by caller */
-	characteristics->sw_enforced.params = TEE_Malloc(
+	characteristics->sw_enforced.params = TA_malloc(
 					MAX_ENFORCED_PARAMS_COUNT *
 					sizeof(keymaster_key_param_t),
-					TEE_MALLOC_FILL_ZERO);
+					KM_HEAP_PARAMS);
 	if (!characteristics->sw_enforced.params) {
 		EMSG("Failed to allocate memory for sw_enforced.params");
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -18,37 +18,124 @@
 #include "parsel.h"
 #include "attestation.h"
 #include "generator.h"
+#include "heap.h"
+
+/* Wire format negotiated by the session of the current command */
+static uint32_t wire_version = KM_WIRE_VERSION_1;
+
+void TA_set_wire_version(const uint32_t version)
+{
+	wire_version = version;
+}
+
+uint32_t TA_get_wire_version(void)
+{
+	return wire_version;
+}
+
+static int TA_get_varint(const uint8_t *in, const uint8_t *end,
+			uint64_t *value, keymaster_error_t *res)
+{
+	size_t len = km_get_varint(in, end, value);
+
+	if (!len) {
+		EMSG("Out of input array bounds on deserialization");
+		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	return len;
+}
+
+static int TA_get_size(const uint8_t *in, const uint8_t *end,
+			uint64_t *size, const uint32_t version,
+			keymaster_error_t *res)
+{
+	if (version != KM_WIRE_VERSION_1)
+		return TA_get_varint(in, end, size, res);
+	if (IS_OUT_OF_BOUNDS(in, end, SIZE_LENGTH)) {
+		EMSG("Out of input array bounds on deserialization");
+		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		return 0;
+	}
+	TEE_MemMove(size, in, SIZE_LENGTH);
+	return SIZE_LENGTH;
+}
+
+static int TA_put_size(uint8_t *out, const uint64_t size,
+			const uint32_t version)
+{
+	if (version != KM_WIRE_VERSION_1)
+		return km_put_varint(out, size);
+	TEE_MemMove(out, &size, SIZE_LENGTH);
+	return SIZE_LENGTH;
+}
+
+static int TA_get_presence(const uint8_t *in, const uint8_t *end,
+			presence *p, const uint32_t version,
+			keymaster_error_t *res)
+{
+	if (version != KM_WIRE_VERSION_1) {
+		if (IS_OUT_OF_BOUNDS(in, end, sizeof(uint8_t))) {
+			EMSG("Out of input array bounds on deserialization");
+			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+			return 0;
+		}
+		*p = in[0] ? KM_POPULATED : KM_NULL;
+		return sizeof(uint8_t);
+	}
+	if (IS_OUT_OF_BOUNDS(in, end, sizeof(*p))) {
+		EMSG("Out of input array bounds on deserialization");
+		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		return 0;
+	}
+	TEE_MemMove(p, in, sizeof(*p));
+	return sizeof(*p);
+}
+
+/* Reads 32-bit enum: raw word in version 1, varint in version 2 */
+static int TA_get_enum(const uint8_t *in, const uint8_t *end,
+			uint32_t *value, keymaster_error_t *res)
+{
+	uint64_t v = 0;
+	int len;
+
+	if (wire_version == KM_WIRE_VERSION_1) {
+		if (IS_OUT_OF_BOUNDS(in, end, sizeof(*value))) {
+			EMSG("Out of input array bounds on deserialization");
+			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+			return 0;
+		}
+		TEE_MemMove(value, in, sizeof(*value));
+		return sizeof(*value);
+	}
+	len = TA_get_varint(in, end, &v, res);
+	*value = (uint32_t)v;
+	return len;
+}
 
 /* Deserializers */
-int TA_deserialize_blob(uint8_t *in, const uint8_t *end,
+static int TA_deserialize_blob_ver(uint8_t *in, const uint8_t *end,
 			keymaster_blob_t *blob,
 			const bool check_presence,
 			keymaster_error_t *res,
-			bool is_input)
+			bool is_input, const uint32_t version)
 {
 	uint8_t *data;
 	const uint8_t *start = in;
 	presence p = KM_POPULATED;
+	uint64_t size = 0;
 
 	TEE_MemFill(blob, 0, sizeof(*blob));
 	if (check_presence) {
-		if (IS_OUT_OF_BOUNDS(in, end, sizeof(p))) {
-			EMSG("Out of input array bounds on deserialization");
-			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		in += TA_get_presence(in, end, &p, version, res);
+		if (*res != KM_ERROR_OK)
 			return in - start;
-		}
-		TEE_MemMove(&p, in, sizeof(p));
-		in += sizeof(p);
 	}
 	if (p == KM_NULL)
-		return sizeof(p);
-	if (IS_OUT_OF_BOUNDS(in, end, SIZE_LENGTH)) {
-		EMSG("Out of input array bounds on deserialization");
-		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
 		return in - start;
-	}
-	TEE_MemMove(&blob->data_length, in, sizeof(blob->data_length));
-	in += SIZE_LENGTH;
+	in += TA_get_size(in, end, &size, version, res);
+	if (*res != KM_ERROR_OK)
+		return in - start;
+	blob->data_length = size;
 	if (IS_OUT_OF_BOUNDS(in, end, blob->data_length)) {
 		EMSG("Out of input array bounds on deserialization %lu", blob->data_length);
 		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
@@ -56,7 +143,7 @@ int TA_deserialize_blob(uint8_t *in, const uint8_t *end,
 	}
 	if (!is_input) {
 		/* Freed when deserialized blob is destroyed by caller */
-		data = TEE_Malloc(blob->data_length, TEE_MALLOC_FILL_ZERO);
+		data = TA_malloc(blob->data_length, KM_HEAP_BLOB);
 		if (!data) {
 			EMSG("Failed to allocate memory for blob");
 			*res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
@@ -73,39 +160,104 @@ int TA_deserialize_blob(uint8_t *in, const uint8_t *end,
 	return in - start;
 }
 
-int TA_deserialize_param_set(uint8_t *in, const uint8_t *end,
+int TA_deserialize_blob(uint8_t *in, const uint8_t *end,
+			keymaster_blob_t *blob,
+			const bool check_presence,
+			keymaster_error_t *res,
+			bool is_input)
+{
+	return TA_deserialize_blob_ver(in, end, blob, check_presence, res,
+					is_input, wire_version);
+}
+
+static int TA_deserialize_param_v1(uint8_t *in, const uint8_t *end,
+			keymaster_key_param_t *param, keymaster_error_t *res)
+{
+	const uint8_t *start = in;
+
+	if (IS_OUT_OF_BOUNDS(in, end, sizeof(*param))) {
+		EMSG("Out of input array bounds on deserialization");
+		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		return 0;
+	}
+	TEE_MemMove(param, in, sizeof(*param));
+	in += sizeof(*param);
+	if (keymaster_tag_get_type(param->tag) == KM_BIGNUM ||
+			keymaster_tag_get_type(param->tag) == KM_BYTES) {
+		in += TA_deserialize_blob_ver(in, end, &param->key_param.blob,
+				false, res, false, KM_WIRE_VERSION_1);
+	}
+	return in - start;
+}
+
+static int TA_deserialize_param_v2(uint8_t *in, const uint8_t *end,
+			keymaster_key_param_t *param, keymaster_error_t *res)
+{
+	const uint8_t *start = in;
+	uint64_t value = 0;
+
+	in += TA_get_varint(in, end, &value, res);
+	if (*res != KM_ERROR_OK)
+		return in - start;
+	param->tag = (keymaster_tag_t)value;
+	switch (keymaster_tag_get_type(param->tag)) {
+	case KM_INVALID:
+		break;
+	case KM_BOOL:
+		if (IS_OUT_OF_BOUNDS(in, end, sizeof(uint8_t))) {
+			EMSG("Out of input array bounds on deserialization");
+			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+			break;
+		}
+		param->key_param.boolean = *in != 0;
+		in += sizeof(uint8_t);
+		break;
+	case KM_BIGNUM:
+	case KM_BYTES:
+		in += TA_deserialize_blob_ver(in, end, &param->key_param.blob,
+				false, res, false, KM_WIRE_VERSION_2);
+		break;
+	case KM_ULONG:
+	case KM_ULONG_REP:
+	case KM_DATE:
+		in += TA_get_varint(in, end, &param->key_param.long_integer,
+									res);
+		break;
+	default: /* KM_ENUM, KM_ENUM_REP, KM_UINT, KM_UINT_REP */
+		in += TA_get_varint(in, end, &value, res);
+		param->key_param.integer = (uint32_t)value;
+	}
+	return in - start;
+}
+
+static int TA_deserialize_param_set_ver(uint8_t *in, const uint8_t *end,
 			keymaster_key_param_set_t *params,
-			const bool check_presence, keymaster_error_t *res)
+			const bool check_presence, keymaster_error_t *res,
+			const uint32_t version)
 {
 	const uint8_t *start = in;
 	presence p = KM_POPULATED;
+	uint64_t length = 0;
 
 	TEE_MemFill(params, 0, sizeof(*params));
 	if (check_presence) {
-		if (IS_OUT_OF_BOUNDS(in, end, sizeof(p))) {
-			EMSG("Out of input array bounds on deserialization");
-			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		in += TA_get_presence(in, end, &p, version, res);
+		if (*res != KM_ERROR_OK)
 			return in - start;
-		}
-		TEE_MemMove(&p, in, sizeof(p));
-		in += sizeof(p);
 	}
 	if (p == KM_NULL)
 		return in - start;
-	if (IS_OUT_OF_BOUNDS(in, end, SIZE_LENGTH)) {
-		EMSG("Out of input array bounds on deserialization");
-		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	in += TA_get_size(in, end, &length, version, res);
+	if (*res != KM_ERROR_OK)
 		return in - start;
-	}
-	TEE_MemMove(&params->length, in, sizeof(params->length));
-	in += SIZE_LENGTH;
+	params->length = length;
 	/* Do +3 to params count to have memory for
 	 * adding KM_TAG_ORIGIN params and key size with RSA
 	 * public exponent on import
 	 */
-	params->params = TEE_Malloc(sizeof(keymaster_key_param_t)
+	params->params = TA_malloc(sizeof(keymaster_key_param_t)
 			* (params->length + ADDITIONAL_TAGS),
-			TEE_MALLOC_FILL_ZERO);
+			KM_HEAP_PARAMS);
 	/* Freed when deserialized params set is destroyed by caller */
 	if (!params->params) {
 		EMSG("Failed to allocate memory for params");
@@ -113,63 +265,70 @@ int TA_deserialize_param_set(uint8_t *in, const uint8_t *end,
 		return in - start;
 	}
 	for (size_t i = 0; i < params->length; i++) {
-		if (IS_OUT_OF_BOUNDS(in, end, SIZE_OF_ITEM(params->params))) {
-			EMSG("Out of input array bounds on deserialization");
-			*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+		if (version == KM_WIRE_VERSION_1)
+			in += TA_deserialize_param_v1(in, end,
+					params->params + i, res);
+		else
+			in += TA_deserialize_param_v2(in, end,
+					params->params + i, res);
+		if (*res != KM_ERROR_OK)
 			return in - start;
-		}
-		TEE_MemMove(params->params + i, in,
-			SIZE_OF_ITEM(params->params));
-		in += SIZE_OF_ITEM(params->params);
-		if (keymaster_tag_get_type(params->params[i].tag)
-				== KM_BIGNUM || keymaster_tag_get_type(
-				params->params[i].tag) == KM_BYTES) {
-			in += TA_deserialize_blob(in, end,
-				&(params->params[i].key_param.blob),
-				false, res, false);
-			if (*res != KM_ERROR_OK)
-				return in - start;
-	}
 	}
 	return in - start;
 }
 
+int TA_deserialize_param_set(uint8_t *in, const uint8_t *end,
+			keymaster_key_param_set_t *params,
+			const bool check_presence, keymaster_error_t *res)
+{
+	return TA_deserialize_param_set_ver(in, end, params, check_presence,
+					res, wire_version);
+}
+
+int TA_deserialize_param_set_v1(uint8_t *in, const uint8_t *end,
+			keymaster_key_param_set_t *params,
+			keymaster_error_t *res)
+{
+	return TA_deserialize_param_set_ver(in, end, params, false,
+					res, KM_WIRE_VERSION_1);
+}
+
 int TA_deserialize_key_blob(const uint8_t *in, const uint8_t *end,
 			keymaster_key_blob_t *key_blob,
 			keymaster_error_t *res)
 {
 	uint8_t *key_material;
+	const uint8_t *start = in;
+	uint64_t size = 0;
 
-	if (IS_OUT_OF_BOUNDS(in, end, SIZE_LENGTH)) {
-		EMSG("Out of input array bounds on deserialization");
-		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-		return 0;
-	}
-	TEE_MemMove(&key_blob->key_material_size, in,
-				sizeof(key_blob->key_material_size));
-	in += SIZE_LENGTH;
+	in += TA_get_size(in, end, &size, wire_version, res);
+	if (*res != KM_ERROR_OK)
+		return in - start;
+	key_blob->key_material_size = size;
 	if (IS_OUT_OF_BOUNDS(in, end, key_blob->key_material_size)) {
 		EMSG("Out of input array bounds on deserialization");
 		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-		return SIZE_LENGTH;
+		return in - start;
 	}
 	/* Freed when deserialized key blob is destoyrd by caller */
-	key_material = TEE_Malloc(key_blob->key_material_size,
-							TEE_MALLOC_FILL_ZERO);
+	key_material = TA_malloc(key_blob->key_material_size,
+							KM_HEAP_BLOB);
 	if (!key_material) {
 		EMSG("Fialed to allocate memory for key_material");
 		*res = KM_ERROR_MEMORY_ALLOCATION_FAILED;
-		return 0;
+		return in - start;
 	}
 	TEE_MemMove(key_material, in, key_blob->key_material_size);
+	in += key_blob->key_material_size;
 	key_blob->key_material = key_material;
-	return KEY_BLOB_SIZE(key_blob);
+	return in - start;
 }
 
 int TA_deserialize_op_handle(const uint8_t *in, const uint8_t *in_end,
 			keymaster_operation_handle_t *op_handle,
 			keymaster_error_t *res)
 {
+	/* Handles are random 64-bit values, keep them fixed size */
 	if (IS_OUT_OF_BOUNDS(in, in_end, sizeof(*op_handle))) {
 		EMSG("Out of input array bounds on deserialization");
 		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
@@ -183,83 +342,218 @@ int TA_deserialize_op_handle(const uint8_t *in, const uint8_t *in_end,
 int TA_deserialize_purpose(const uint8_t *in, const uint8_t *in_end,
 			keymaster_purpose_t *purpose, keymaster_error_t *res)
 {
-	if (IS_OUT_OF_BOUNDS(in, in_end, sizeof(*purpose))) {
-		EMSG("Out of input array bounds on deserialization");
-		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-		return 0;
-	}
-	TEE_MemMove(purpose, in, sizeof(*purpose));
-	return sizeof(*purpose);
+	uint32_t value = 0;
+	int len = TA_get_enum(in, in_end, &value, res);
+
+	*purpose = (keymaster_purpose_t)value;
+	return len;
 }
 
 int TA_deserialize_key_format(const uint8_t *in, const uint8_t *in_end,
 			keymaster_key_format_t *key_format,
 			keymaster_error_t *res)
 {
-	if (IS_OUT_OF_BOUNDS(in, in_end, sizeof(*key_format))) {
-		EMSG("Out of input array bounds on deserialization");
-		*res = KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
-		return 0;
-	}
-	TEE_MemMove(key_format, in, sizeof(*key_format));
-	return sizeof(*key_format);
+	uint32_t value = 0;
+	int len = TA_get_enum(in, in_end, &value, res);
+
+	*key_format = (keymaster_key_format_t)value;
+	return len;
 }
 
 /* Serializers */
-int TA_serialize_blob(uint8_t *out, const keymaster_blob_t *blob)
+static int TA_serialize_blob_ver(uint8_t *out, const keymaster_blob_t *blob,
+			const uint32_t version)
 {
-	TEE_MemMove(out, &blob->data_length, sizeof(blob->data_length));
-	out += SIZE_LENGTH;
+	uint8_t *start = out;
+
+	out += TA_put_size(out, blob->data_length, version);
 	TEE_MemMove(out, blob->data, blob->data_length);
-	return BLOB_SIZE(blob);
+	out += blob->data_length;
+	return out - start;
 }
 
-int TA_serialize_characteristics(uint8_t *out,
-			const keymaster_key_characteristics_t *characteristics)
+int TA_serialize_blob(uint8_t *out, const keymaster_blob_t *blob)
+{
+	return TA_serialize_blob_ver(out, blob, wire_version);
+}
+
+int TA_serialize_size(uint8_t *out, const uint64_t size)
+{
+	return TA_put_size(out, size, wire_version);
+}
+
+uint32_t TA_size_width(const uint64_t max_size)
+{
+	if (wire_version == KM_WIRE_VERSION_1)
+		return SIZE_LENGTH;
+	return km_varint_size(max_size);
+}
+
+int TA_serialize_size_padded(uint8_t *out, const uint64_t size,
+			const uint64_t max_size)
+{
+	if (wire_version == KM_WIRE_VERSION_1)
+		return TA_put_size(out, size, wire_version);
+	return km_put_varint_padded(out, size, TA_size_width(max_size));
+}
+
+/* Output sink */
+keymaster_error_t TA_sink_open(keymaster_out_sink_t *sink, uint8_t *out,
+			const uint8_t *out_end, const uint32_t max_size,
+			keymaster_blob_t *output)
+{
+	sink->size_field = out;
+	sink->max_size = max_size;
+	sink->data = NULL;
+	output->data_length = 0;
+	out += TA_size_width(max_size);
+	if (!IS_OUT_OF_BOUNDS(out, out_end, max_size)) {
+		sink->data = out;
+		output->data = out;
+		return KM_ERROR_OK;
+	}
+	/* Scratch buffer, copied to the response by TA_sink_commit */
+	output->data = TA_malloc(max_size, KM_HEAP_BLOB);
+	if (!output->data) {
+		EMSG("Failed to allocate memory for output");
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	return KM_ERROR_OK;
+}
+
+keymaster_error_t TA_sink_commit(const keymaster_out_sink_t *sink,
+			uint8_t **out, const uint8_t *out_end,
+			const keymaster_blob_t *output)
+{
+	uint8_t *start = sink->size_field;
+
+	if (IS_OUT_OF_BOUNDS(start, out_end,
+			TA_size_width(sink->max_size) + output->data_length)) {
+		EMSG("Out of output array bounds on serialization");
+		return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+	}
+	start += TA_serialize_size_padded(start, output->data_length,
+							sink->max_size);
+	if (output->data != start)
+		TEE_MemMove(start, output->data, output->data_length);
+	*out = start + output->data_length;
+	return KM_ERROR_OK;
+}
+
+void TA_sink_close(const keymaster_out_sink_t *sink, keymaster_blob_t *output,
+			const keymaster_error_t res)
+{
+	if (output->data != sink->data) {
+		TA_free(output->data);
+	} else if (sink->data && res != KM_ERROR_OK) {
+		/* Do not leave output of a failed operation (e.g. GCM
+		 * plaintext that failed tag verification) to the client
+		 */
+		TEE_MemFill(sink->data, 0, sink->max_size);
+	}
+	output->data = NULL;
+}
+
+static int TA_serialize_param_v1(uint8_t *out,
+			const keymaster_key_param_t *param)
 {
 	uint8_t *start = out;
 
-	TEE_MemMove(out, &characteristics->hw_enforced.length,
-				sizeof(characteristics->hw_enforced.length));
-	out += SIZE_LENGTH;
-	for (size_t i = 0; i < characteristics->hw_enforced.length; i++) {
-		TEE_MemMove(out, characteristics->hw_enforced.params + i,
-			SIZE_OF_ITEM(characteristics->hw_enforced.params));
-		out += SIZE_OF_ITEM(characteristics->hw_enforced.params);
-		if (keymaster_tag_get_type(characteristics->
-				hw_enforced.params[i].tag) == KM_BIGNUM ||
-				keymaster_tag_get_type(characteristics->
-				hw_enforced.params[i].tag) == KM_BYTES) {
-			out += TA_serialize_blob(out, &(characteristics->
-				hw_enforced.params[i].key_param.blob));
-		}
+	TEE_MemMove(out, param, sizeof(*param));
+	out += sizeof(*param);
+	if (keymaster_tag_get_type(param->tag) == KM_BIGNUM ||
+			keymaster_tag_get_type(param->tag) == KM_BYTES)
+		out += TA_serialize_blob_ver(out, &param->key_param.blob,
+						KM_WIRE_VERSION_1);
+	return out - start;
+}
+
+static int TA_serialize_param_v2(uint8_t *out,
+			const keymaster_key_param_t *param)
+{
+	uint8_t *start = out;
+
+	out += km_put_varint(out, param->tag);
+	switch (keymaster_tag_get_type(param->tag)) {
+	case KM_INVALID:
+		break;
+	case KM_BOOL:
+		*out++ = param->key_param.boolean ? 1 : 0;
+		break;
+	case KM_BIGNUM:
+	case KM_BYTES:
+		out += TA_serialize_blob_ver(out, &param->key_param.blob,
+						KM_WIRE_VERSION_2);
+		break;
+	case KM_ULONG:
+	case KM_ULONG_REP:
+	case KM_DATE:
+		out += km_put_varint(out, param->key_param.long_integer);
+		break;
+	default: /* KM_ENUM, KM_ENUM_REP, KM_UINT, KM_UINT_REP */
+		out += km_put_varint(out, param->key_param.integer);
 	}
+	return out - start;
+}
 
-	TEE_MemMove(out, &characteristics->sw_enforced.length,
-				sizeof(characteristics->sw_enforced.length));
-	out += SIZE_LENGTH;
-	for (size_t i = 0; i < characteristics->sw_enforced.length; i++) {
-		TEE_MemMove(out, characteristics->sw_enforced.params + i,
-			SIZE_OF_ITEM(characteristics->sw_enforced.params));
-		out += SIZE_OF_ITEM(characteristics->sw_enforced.params);
-		if (keymaster_tag_get_type(characteristics->
-				sw_enforced.params[i].tag) == KM_BIGNUM ||
-				keymaster_tag_get_type(characteristics->
-				sw_enforced.params[i].tag) == KM_BYTES) {
-			out += TA_serialize_blob(out, &((characteristics->
-				sw_enforced.params + i)->key_param.blob));
-		}
+static int TA_serialize_param_set_ver(uint8_t *out,
+			const keymaster_key_param_set_t *params,
+			const uint32_t version)
+{
+	uint8_t *start = out;
+
+	out += TA_put_size(out, params->length, version);
+	for (size_t i = 0; i < params->length; i++) {
+		if (version == KM_WIRE_VERSION_1)
+			out += TA_serialize_param_v1(out, params->params + i);
+		else
+			out += TA_serialize_param_v2(out, params->params + i);
 	}
 	return out - start;
 }
 
+int TA_serialize_param_set(uint8_t *out,
+			const keymaster_key_param_set_t *params)
+{
+	return TA_serialize_param_set_ver(out, params, wire_version);
+}
+
+int TA_serialize_param_set_v1(uint8_t *out,
+			const keymaster_key_param_set_t *params)
+{
+	return TA_serialize_param_set_ver(out, params, KM_WIRE_VERSION_1);
+}
+
+int TA_serialize_characteristics(uint8_t *out,
+			const keymaster_key_characteristics_t *characteristics)
+{
+	uint8_t *start = out;
+
+	out += TA_serialize_param_set_ver(out, &characteristics->hw_enforced,
+					wire_version);
+	out += TA_serialize_param_set_ver(out, &characteristics->sw_enforced,
+					wire_version);
+	return out - start;
+}
+
+int TA_serialize_characteristics_v1(uint8_t *out,
+			const keymaster_key_characteristics_t *characteristics)
+{
+	uint8_t *start = out;
+
+	out += TA_serialize_param_set_v1(out, &characteristics->hw_enforced);
+	out += TA_serialize_param_set_v1(out, &characteristics->sw_enforced);
+	return out - start;
+}
+
 int TA_serialize_key_blob(uint8_t *out, const keymaster_key_blob_t *key_blob)
 {
-	TEE_MemMove(out, &key_blob->key_material_size,
-				sizeof(key_blob->key_material_size));
-	out += SIZE_LENGTH;
+	uint8_t *start = out;
+
+	out += TA_put_size(out, key_blob->key_material_size, wire_version);
 	TEE_MemMove(out, key_blob->key_material, key_blob->key_material_size);
-	return KEY_BLOB_SIZE(key_blob);
+	out += key_blob->key_material_size;
+	return out - start;
 }
 
 int TA_serialize_cert_chain(uint8_t *out,
@@ -274,45 +568,13 @@ int TA_serialize_cert_chain(uint8_t *out,
 		return 0;
 	}
 
-	TEE_MemMove(out, &cert_chain->entry_count,
-				sizeof(cert_chain->entry_count));
-	out += SIZE_LENGTH;
-
-	for (size_t i = 0; i < cert_chain->entry_count; i++) {
-		TEE_MemMove(out, &cert_chain->entries[i].data_length,
-				sizeof(cert_chain->entries[i].data_length));
-		out += SIZE_LENGTH;
-
-		TEE_MemMove(out, cert_chain->entries[i].data,
-				cert_chain->entries[i].data_length);
-		out += cert_chain->entries[i].data_length;
-	}
+	out += TA_put_size(out, cert_chain->entry_count, wire_version);
+	for (size_t i = 0; i < cert_chain->entry_count; i++)
+		out += TA_serialize_blob(out, cert_chain->entries + i);
 	*res = KM_ERROR_OK;
 	return out - start;
 }
 
-int TA_serialize_param_set(uint8_t *out,
-			const keymaster_key_param_set_t *params)
-{
-	uint8_t *start = out;
-	TEE_MemMove(out, &params->length, sizeof(params->length));
-	out += SIZE_LENGTH;
-
-	for (size_t i = 0; i < params->length; i++) {
-		TEE_MemMove(out, params->params + i,
-				SIZE_OF_ITEM(params->params));
-		out += SIZE_OF_ITEM(params->params);
-
-		if (keymaster_tag_get_type(params->params[i].tag) == KM_BIGNUM
-				|| keymaster_tag_get_type(params->
-				params[i].tag) == KM_BYTES) {
-			out += TA_serialize_blob(out,
-				&(params->params[i].key_param.blob));
-		}
-	}
-	return out - start;
-}
-
 //Serialize root RSA key-pair (public and private parts)
 TEE_Result TA_serialize_rsa_keypair(uint8_t *out,
 			uint32_t *out_size,
@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ring.h"
+
+keymaster_error_t TA_ring_alloc(km_ring_t *ring, const uint32_t record_size,
+				const uint32_t capacity)
+{
+	if (ring->records)
+		return KM_ERROR_OK;
+	ring->records = TEE_Malloc(capacity * record_size,
+					TEE_MALLOC_FILL_ZERO);
+	if (!ring->records) {
+		EMSG("Failed to allocate memory for ring of %u records",
+								capacity);
+		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
+	}
+	ring->record_size = record_size;
+	ring->capacity = capacity;
+	TA_ring_clear(ring);
+	return KM_ERROR_OK;
+}
+
+void TA_ring_free(km_ring_t *ring)
+{
+	TEE_Free(ring->records);
+	TEE_MemFill(ring, 0, sizeof(*ring));
+}
+
+void TA_ring_clear(km_ring_t *ring)
+{
+	ring->head = 0;
+	ring->count = 0;
+	ring->dropped = 0;
+}
+
+void *TA_ring_push(km_ring_t *ring)
+{
+	uint32_t tail = 0;
+
+	if (!ring->records)
+		return NULL;
+	if (ring->count == ring->capacity) {
+		ring->head = (ring->head + 1) % ring->capacity;
+		ring->count--;
+		ring->dropped++;
+	}
+	tail = (ring->head + ring->count) % ring->capacity;
+	ring->count++;
+	return ring->records + tail * ring->record_size;
+}
+
+uint32_t TA_ring_pop(km_ring_t *ring, void *out, const uint32_t max)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < max && ring->count; i++) {
+		TEE_MemMove((uint8_t *)out + i * ring->record_size,
+			ring->records + ring->head * ring->record_size,
+			ring->record_size);
+		ring->head = (ring->head + 1) % ring->capacity;
+		ring->count--;
+	}
+	return i;
+}
@@ -0,0 +1,188 @@
+/*
+ *
+ * Copyright (C) 2017 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats.h"
+#include "command.h"
+#include "operations.h"
+#include "ring.h"
+#include "tables.h"
+
+static km_stats_command_t commands[KM_STATS_COMMANDS];
+
+/* Timing of the command in progress */
+static struct {
+	uint64_t start;
+	uint64_t last;
+	/* Tags of the HAL call, set when phases are recorded as spans */
+	uint32_t id;
+	uint32_t seq;
+	bool traced;
+} timing;
+
+/* Spans not read yet */
+static km_ring_t recorded;
+
+#ifdef KM_STATS_CNTVCT
+static uint64_t TA_stats_counter(uint64_t *freq)
+{
+	uint64_t count = 0;
+#ifdef __aarch64__
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (count));
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r" (*freq));
+#else
+	uint32_t frq = 0;
+
+	__asm__ volatile("isb; mrrc p15, 1, %Q0, %R0, c14" : "=r" (count));
+	__asm__ volatile("mrc p15, 0, %0, c14, c0, 0" : "=r" (frq));
+	*freq = frq;
+#endif
+	return count;
+}
+
+static uint64_t TA_stats_now(void)
+{
+	uint64_t freq = 0;
+	uint64_t count = TA_stats_counter(&freq);
+
+	if (!freq)
+		return 0;
+	return count / freq * 1000000000ULL +
+		count % freq * 1000000000ULL / freq;
+}
+
+static uint32_t TA_stats_clock_ns(void)
+{
+	uint64_t freq = 0;
+
+	TA_stats_counter(&freq);
+	return freq ? (1000000000ULL + freq - 1) / freq : 0;
+}
+#else
+static uint64_t TA_stats_now(void)
+{
+	TEE_Time time;
+
+	TEE_GetSystemTime(&time);
+	return time.seconds * 1000000000ULL + time.millis * 1000000ULL;
+}
+
+static uint32_t TA_stats_clock_ns(void)
+{
+	return 1000000;
+}
+#endif
+
+static void TA_stats_span(const uint32_t phase, const uint64_t start,
+				const uint64_t end, const keymaster_error_t res)
+{
+	km_trace_span_t *span = TA_ring_push(&recorded);
+
+	if (!span)
+		return;
+	span->id = timing.id;
+	span->seq = timing.seq;
+	span->cmd = TA_command_current()->cmd;
+	span->phase = phase;
+	span->res = res;
+	span->start_ns = start - timing.start;
+	span->duration_ns = end - start;
+}
+
+void TA_stats_begin(void)
+{
+	timing.start = TA_stats_now();
+	timing.last = timing.start;
+	timing.traced = false;
+}
+
+void TA_stats_trace(const uint32_t id, const uint32_t seq)
+{
+	if (!TA_command_current()->active)
+		return;
+	if (TA_ring_alloc(&recorded, sizeof(km_trace_span_t),
+					KM_TRACE_SPANS) != KM_ERROR_OK)
+		return;
+	timing.id = id;
+	timing.seq = seq;
+	timing.traced = true;
+}
+
+void TA_stats_mark(const enum km_stats_phase phase)
+{
+	const km_command_t *current = TA_command_current();
+	uint64_t now = 0;
+
+	if (!current->active)
+		return;
+	now = TA_stats_now();
+	commands[current->slot].phase_ns[phase] += now - timing.last;
+	if (timing.traced)
+		TA_stats_span(phase, timing.last, now, KM_ERROR_OK);
+	timing.last = now;
+}
+
+void TA_stats_end(const keymaster_error_t res)
+{
+	const km_command_t *current = TA_command_current();
+	km_stats_command_t *command = NULL;
+	uint64_t total = 0;
+
+	if (!current->active)
+		return;
+	TA_stats_mark(KM_PHASE_OTHER);
+	command = &commands[current->slot];
+	total = timing.last - timing.start;
+	command->calls++;
+	if (res != KM_ERROR_OK)
+		command->errors++;
+	command->total_ns += total;
+	if (total > command->max_ns)
+		command->max_ns = total;
+	if (timing.traced)
+		TA_stats_span(KM_TRACE_COMMAND, timing.start, timing.last,
+									res);
+	timing.traced = false;
+}
+
+void TA_stats_get(km_stats_t *stats, const bool reset)
+{
+	stats->version = KM_STATS_VERSION;
+	stats->commands = KM_STATS_COMMANDS;
+	stats->phases = KM_PHASE_COUNT;
+	stats->clock_ns = TA_stats_clock_ns();
+	TEE_MemMove(stats->command, commands, sizeof(commands));
+	TA_get_operations_stats(&stats->operations, reset);
+	TA_get_use_tables_stats(&stats->use_counters, &stats->use_timers,
+				reset);
+	if (reset)
+		TEE_MemFill(commands, 0, sizeof(commands));
+}
+
+void TA_stats_get_trace(km_trace_t *trace, km_trace_span_t *spans,
+			const uint32_t max_spans, const uint32_t flags)
+{
+	trace->version = KM_TRACE_VERSION;
+	trace->spans = TA_ring_pop(&recorded, spans, max_spans);
+	trace->dropped = recorded.dropped;
+	trace->clock_ns = TA_stats_clock_ns();
+	recorded.dropped = 0;
+	if (flags & KM_TRACE_STOP) {
+		TA_ring_free(&recorded);
+		/* KM_GET_TRACE itself may be tagged */
+		timing.traced = false;
+	}
+}
@@ -8,9 +8,17 @@ srcs-y += paddings.c
 srcs-y += parameters.c
 srcs-y += auth.c
 srcs-y += generator.c
+srcs-y += keypool.c
 srcs-y += asn1.c
+srcs-y += der.c
 srcs-y += crypto_aes.c
 srcs-y += crypto_rsa.c
 srcs-y += shift.c
 srcs-y += crypto_ec.c
 srcs-y += attestation.c
+srcs-y += attest_cert.c
+srcs-y += command.c
+srcs-y += ring.c
+srcs-y += stats.c
+srcs-y += heap.c
+cppflags-$(CFG_KM_STATS_CNTVCT) += -DKM_STATS_CNTVCT
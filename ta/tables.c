@@ -16,10 +16,25 @@
  */
 
 #include "tables.h"
+#include "heap.h"
 
 static keymaster_use_timer_t use_timers[KM_MAX_USE_TIMERS];
 static keymaster_use_counter_t use_counters[KM_MAX_USE_COUNTERS];
 static uint32_t in_use_c;
+static km_stats_table_t use_counters_stats = {
+	.capacity = KM_MAX_USE_COUNTERS};
+static km_stats_table_t use_timers_stats = {.capacity = KM_MAX_USE_TIMERS};
+
+static uint32_t TA_count_timers(void)
+{
+	uint32_t used = 0;
+
+	for (uint32_t i = 0; i < KM_MAX_USE_TIMERS; i++) {
+		if (use_timers[i].key_tag)
+			used++;
+	}
+	return used;
+}
 
 keymaster_error_t TA_count_key_uses(const keymaster_key_blob_t *key,
 				const uint32_t max_uses)
@@ -29,6 +44,7 @@ keymaster_error_t TA_count_key_uses(const keymaster_key_blob_t *key,
 				(key->key_material_size - TAG_LENGTH);
 
 	if (in_use_c == KM_MAX_USE_COUNTERS) {
+		use_counters_stats.full++;
 		return KM_ERROR_TOO_MANY_OPERATIONS;
 	}
 
@@ -45,13 +61,16 @@ keymaster_error_t TA_count_key_uses(const keymaster_key_blob_t *key,
 	}
 
 	if (i == in_use_c) {
-		use_counters[i].key_tag = TEE_Malloc(TAG_LENGTH,
-			TEE_MALLOC_FILL_ZERO);
+		use_counters[i].key_tag = TA_malloc(TAG_LENGTH,
+			KM_HEAP_OTHER);
 		if (use_counters[i].key_tag) {
 			TEE_MemMove(use_counters[in_use_c].key_tag, tag_pointer,
 				TAG_LENGTH);
 			use_counters[in_use_c].count = 1;
 			in_use_c++;
+			use_counters_stats.inserts++;
+			if (in_use_c > use_counters_stats.peak)
+				use_counters_stats.peak = in_use_c;
 		} else {
 			return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 		}
@@ -70,12 +89,13 @@ void TA_clean_timers(void)
 				use_timers[i].last_access.seconds +
 				use_timers[i].min_sec > cur_t.seconds) {
 			if (use_timers[i].key_tag) {
-				TEE_Free(use_timers[i].key_tag);
+				TA_free(use_timers[i].key_tag);
 			}
 			use_timers[i].key_tag = NULL;
 			use_timers[i].min_sec = 0;
 			use_timers[i].last_access.seconds = 0;
 			use_timers[i].last_access.millis = 0;
+			use_timers_stats.evictions++;
 		}
 	}
 }
@@ -107,6 +127,7 @@ keymaster_error_t TA_trigger_timer(const keymaster_key_blob_t *key,
 {
 	TEE_Time cur_t;
 	uint32_t free_n = KM_MAX_USE_TIMERS;
+	uint32_t used = 0;
 	uint8_t *tag_pointer = key->key_material +
 				(key->key_material_size - TAG_LENGTH);
 
@@ -123,19 +144,43 @@ keymaster_error_t TA_trigger_timer(const keymaster_key_blob_t *key,
 		}
 	}
 	if (free_n == KM_MAX_USE_TIMERS) {
+		use_timers_stats.full++;
 		EMSG("Table of last access key time is full");
 		return KM_ERROR_TOO_MANY_OPERATIONS;
 	}
-	use_timers[free_n].key_tag = TEE_Malloc(TAG_LENGTH,
-		TEE_MALLOC_FILL_ZERO);
+	use_timers[free_n].key_tag = TA_malloc(TAG_LENGTH,
+		KM_HEAP_OTHER);
 	if (use_timers[free_n].key_tag) {
 		TEE_MemMove(use_timers[free_n].key_tag, tag_pointer,
 			TAG_LENGTH);
 		use_timers[free_n].last_access = cur_t;
 		use_timers[free_n].min_sec = min_sec;
+		use_timers_stats.inserts++;
+		used = TA_count_timers();
+		if (used > use_timers_stats.peak)
+			use_timers_stats.peak = used;
 	} else {
 		return KM_ERROR_MEMORY_ALLOCATION_FAILED;
 	}
 
 	return KM_ERROR_OK;
 }
+
+void TA_get_use_tables_stats(km_stats_table_t *counters,
+				km_stats_table_t *timers, const bool reset)
+{
+	use_counters_stats.used = in_use_c;
+	use_timers_stats.used = TA_count_timers();
+	*counters = use_counters_stats;
+	*timers = use_timers_stats;
+	if (!reset)
+		return;
+	use_counters_stats.peak = use_counters_stats.used;
+	use_counters_stats.inserts = 0;
+	use_counters_stats.full = 0;
+	use_counters_stats.evictions = 0;
+	use_timers_stats.peak = use_timers_stats.used;
+	use_timers_stats.inserts = 0;
+	use_timers_stats.full = 0;
+	use_timers_stats.evictions = 0;
+}